@@ -0,0 +1,232 @@
+#include "BookCacheKey.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+#include <Serialization.h>
+
+#include <functional>
+#include <vector>
+
+namespace {
+constexpr uint8_t ALIAS_MAP_VERSION = 2;
+constexpr char aliasMapFile[] = "/cache_keys.bin";
+// Most recently opened first, paths that fall off the end are simply hashed again next time
+constexpr size_t MAX_ALIASES = 32;
+// Bytes at the end of the identity range hashed to check an alias still points at the same book
+constexpr uint64_t FINGERPRINT_LENGTH = 64 * 1024;
+// Identity ranges are capped, anything past this is assumed not to add to uniqueness
+constexpr uint64_t MAX_IDENTITY_LENGTH = 1024 * 1024;
+
+struct Alias {
+  std::string path;
+  uint64_t fileSize;
+  uint32_t fingerprint;
+  uint64_t key;
+};
+
+// FNV-1a
+uint32_t hash32(uint32_t hash, const uint8_t* data, const size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+uint64_t hash64(uint64_t hash, const uint8_t* data, const size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool readFingerprint(FsFile& file, const uint64_t offset, uint64_t length, uint32_t* fingerprint) {
+  uint8_t buffer[512];
+  uint32_t hash = 2166136261u;
+
+  if (length > FINGERPRINT_LENGTH) {
+    if (!file.seek(offset + length - FINGERPRINT_LENGTH)) {
+      return false;
+    }
+    length = FINGERPRINT_LENGTH;
+  } else if (!file.seek(offset)) {
+    return false;
+  }
+  while (length > 0) {
+    const size_t toRead = length < sizeof(buffer) ? length : sizeof(buffer);
+    if (file.read(buffer, toRead) != static_cast<int>(toRead)) {
+      return false;
+    }
+    hash = hash32(hash, buffer, toRead);
+    length -= toRead;
+  }
+
+  *fingerprint = hash;
+  return true;
+}
+
+bool computeKey(FsFile& file, const uint64_t fileSize, const uint64_t offset, uint64_t length, uint64_t* key) {
+  uint8_t buffer[512];
+  for (int i = 0; i < 8; i++) {
+    buffer[i] = static_cast<uint8_t>(fileSize >> (8 * i));
+  }
+  uint64_t hash = hash64(14695981039346656037ull, buffer, 8);
+
+  if (!file.seek(offset)) {
+    return false;
+  }
+  while (length > 0) {
+    const size_t toRead = length < sizeof(buffer) ? length : sizeof(buffer);
+    if (file.read(buffer, toRead) != static_cast<int>(toRead)) {
+      return false;
+    }
+    hash = hash64(hash, buffer, toRead);
+    length -= toRead;
+  }
+
+  *key = hash;
+  return true;
+}
+
+std::vector<Alias> loadAliases(const std::string& mapPath) {
+  std::vector<Alias> aliases;
+  if (!SdMan.exists(mapPath.c_str())) {
+    return aliases;
+  }
+
+  FsFile file;
+  if (!SdMan.openFileForRead("BCK", mapPath, file)) {
+    return aliases;
+  }
+
+  uint8_t version;
+  uint16_t count;
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  if (version != ALIAS_MAP_VERSION || count > MAX_ALIASES) {
+    Serial.printf("[%lu] [BCK] Ignoring unknown alias map (version %d, %d entries)\n", millis(), version, count);
+    file.close();
+    return aliases;
+  }
+
+  aliases.resize(count);
+  for (auto& alias : aliases) {
+    serialization::readString(file, alias.path);
+    serialization::readPod(file, alias.fileSize);
+    serialization::readPod(file, alias.fingerprint);
+    serialization::readPod(file, alias.key);
+  }
+
+  if (file.position() != file.size()) {
+    Serial.printf("[%lu] [BCK] Alias map is truncated or corrupt, ignoring it\n", millis());
+    aliases.clear();
+  }
+  file.close();
+  return aliases;
+}
+
+void saveAliases(const std::string& mapPath, const std::vector<Alias>& aliases) {
+  FsFile file;
+  if (!SdMan.openFileForWrite("BCK", mapPath, file)) {
+    return;
+  }
+
+  serialization::writePod(file, ALIAS_MAP_VERSION);
+  serialization::writePod(file, static_cast<uint16_t>(aliases.size()));
+  for (const auto& alias : aliases) {
+    serialization::writeString(file, alias.path);
+    serialization::writePod(file, alias.fileSize);
+    serialization::writePod(file, alias.fingerprint);
+    serialization::writePod(file, alias.key);
+  }
+  file.close();
+}
+}  // namespace
+
+std::string BookCacheKey::resolve(const std::string& filepath, const std::string& cacheDir, const std::string& prefix,
+                                  const IdentityRangeFn identityRange, const LegacyCacheCheckFn legacyCacheCheck) {
+  // Caches used to be named after a hash of the path, which is still the fallback if the file can't be read
+  const std::string legacyCachePath = cacheDir + "/" + prefix + std::to_string(std::hash<std::string>{}(filepath));
+
+  FsFile file;
+  if (!SdMan.openFileForRead("BCK", filepath, file)) {
+    return legacyCachePath;
+  }
+  const uint64_t fileSize = file.size();
+
+  uint64_t offset = 0;
+  uint64_t length = fileSize;
+  if (!identityRange(filepath, fileSize, &offset, &length) || offset > fileSize || length > fileSize - offset) {
+    Serial.printf("[%lu] [BCK] No identity range for %s, using the start of the file\n", millis(), filepath.c_str());
+    offset = 0;
+    length = fileSize;
+  }
+  if (length > MAX_IDENTITY_LENGTH) {
+    length = MAX_IDENTITY_LENGTH;
+  }
+
+  uint32_t fingerprint;
+  if (!readFingerprint(file, offset, length, &fingerprint)) {
+    Serial.printf("[%lu] [BCK] Could not read %s, keying cache on path\n", millis(), filepath.c_str());
+    file.close();
+    return legacyCachePath;
+  }
+
+  const std::string mapPath = cacheDir + aliasMapFile;
+  auto aliases = loadAliases(mapPath);
+
+  size_t aliasIndex = 0;
+  while (aliasIndex < aliases.size() && aliases[aliasIndex].path != filepath) {
+    aliasIndex++;
+  }
+
+  const bool aliasHit = aliasIndex < aliases.size() && aliases[aliasIndex].fileSize == fileSize &&
+                        aliases[aliasIndex].fingerprint == fingerprint;
+  uint64_t key;
+  if (aliasHit) {
+    key = aliases[aliasIndex].key;
+  } else {
+    // Unknown path, or the file changed since it was last seen
+    const unsigned long start = millis();
+    if (!computeKey(file, fileSize, offset, length, &key)) {
+      Serial.printf("[%lu] [BCK] Could not read %s, keying cache on path\n", millis(), filepath.c_str());
+      file.close();
+      return legacyCachePath;
+    }
+    Serial.printf("[%lu] [BCK] Hashed %llu bytes of %s in %lums\n", millis(), static_cast<unsigned long long>(length),
+                  filepath.c_str(), millis() - start);
+  }
+  file.close();
+
+  // Keep the map most recently used first, it is only rewritten when that order or an alias changes
+  if (!aliasHit || aliasIndex != 0) {
+    if (aliasIndex < aliases.size()) {
+      aliases.erase(aliases.begin() + aliasIndex);
+    }
+    aliases.insert(aliases.begin(), {filepath, fileSize, fingerprint, key});
+    if (aliases.size() > MAX_ALIASES) {
+      aliases.resize(MAX_ALIASES);
+    }
+    saveAliases(mapPath, aliases);
+  }
+
+  const std::string cachePath = cacheDir + "/" + prefix + std::to_string(key);
+
+  // Carry over a cache (and reading progress) from before caches were keyed on content. The path may now hold a
+  // different book than the one the cache was built from, so it is only kept if it can be shown to be this one.
+  if (!SdMan.exists(cachePath.c_str()) && SdMan.exists(legacyCachePath.c_str())) {
+    if (legacyCacheCheck && legacyCacheCheck(filepath, legacyCachePath)) {
+      FsFile legacyDir = SdMan.open(legacyCachePath.c_str());
+      if (legacyDir && legacyDir.rename(cachePath.c_str())) {
+        Serial.printf("[%lu] [BCK] Moved cache %s to %s\n", millis(), legacyCachePath.c_str(), cachePath.c_str());
+      }
+      legacyDir.close();
+    } else {
+      Serial.printf("[%lu] [BCK] Cache %s is not from this book, removing it\n", millis(), legacyCachePath.c_str());
+      SdMan.removeDir(legacyCachePath.c_str());
+    }
+  }
+
+  return cachePath;
+}
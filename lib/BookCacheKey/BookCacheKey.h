@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Names a book's cache directory after the file's content rather than its path, so renaming or moving a book keeps
+// its cache and replacing a book with a different one under the same name doesn't serve the old cache.
+//
+// The key is a hash of the file size and an identity range chosen by the format (central directory for EPUB, header
+// and page table for XTC), capped at 1MB. A small alias map in the cache dir remembers path -> key along with the size
+// and a fingerprint of the last 64KB of the identity range, so only that much is hashed again for a known path. That
+// covers the whole central directory of almost every EPUB, whose entry CRCs change with any change to the book.
+class BookCacheKey {
+ public:
+  // Returns the range of the file that identifies its content, false if it can't be determined
+  using IdentityRangeFn = bool (*)(const std::string& filepath, uint64_t fileSize, uint64_t* offset, uint64_t* length);
+  // Returns true if a cache from before caches were keyed on content was built from this file. Caches that can't be
+  // shown to belong to it are removed rather than carried over.
+  using LegacyCacheCheckFn = bool (*)(const std::string& filepath, const std::string& legacyCachePath);
+
+  // Returns cacheDir + "/" + prefix + key
+  static std::string resolve(const std::string& filepath, const std::string& cacheDir, const std::string& prefix,
+                             IdentityRangeFn identityRange, LegacyCacheCheckFn legacyCacheCheck = nullptr);
+};
@@ -0,0 +1,250 @@
+#include "BookCacheManager.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+#include <Serialization.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr uint8_t MANIFEST_VERSION = 1;
+constexpr char manifestFile[] = "/cache_manifest.bin";
+// Kept when a book's cache is evicted, everything else in it is rebuilt from the book the next time it is opened
+constexpr char progressFile[] = "progress.bin";
+// Longest directory or file name within the cache dir, e.g. epub_<20 digit key>
+constexpr uint32_t MAX_NAME_LENGTH = 63;
+// Smallest manifest entry on disk: an empty name's length, its size and its last read
+constexpr uint32_t MIN_ENTRY_SIZE = sizeof(uint32_t) * 3;
+
+struct CacheEntry {
+  // Directory name within the cache dir, e.g. epub_<key>
+  std::string name;
+  uint32_t size;
+  // Value of the manifest's read counter when the book was last opened, the lowest is the least recently read
+  uint32_t lastRead;
+};
+
+struct Manifest {
+  uint32_t readCounter = 0;
+  std::vector<CacheEntry> entries;
+};
+
+bool isBookCache(const char* name) { return strncmp(name, "epub_", 5) == 0 || strncmp(name, "xtc_", 4) == 0; }
+
+uint64_t measureDir(FsFile& dir) {
+  uint64_t total = 0;
+  for (auto file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    total += file.isDirectory() ? measureDir(file) : file.size();
+    file.close();
+  }
+  return total;
+}
+
+uint32_t measure(const std::string& path) {
+  auto dir = SdMan.open(path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    dir.close();
+    return 0;
+  }
+  const uint64_t size = measureDir(dir);
+  dir.close();
+  return size > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(size);
+}
+
+bool loadManifest(const std::string& manifestPath, Manifest& manifest) {
+  if (!SdMan.exists(manifestPath.c_str())) {
+    return false;
+  }
+
+  FsFile file;
+  if (!SdMan.openFileForRead("BCM", manifestPath, file)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint16_t count;
+  serialization::readPod(file, version);
+  if (version != MANIFEST_VERSION) {
+    Serial.printf("[%lu] [BCM] Ignoring unknown cache manifest version %d\n", millis(), version);
+    file.close();
+    return false;
+  }
+  serialization::readPod(file, manifest.readCounter);
+  serialization::readPod(file, count);
+
+  // A damaged count or name length isn't allowed to size an allocation past what the file could hold
+  bool valid = static_cast<uint64_t>(count) * MIN_ENTRY_SIZE <= file.size() - file.position();
+  if (valid) {
+    manifest.entries.resize(count);
+  }
+  for (size_t i = 0; valid && i < manifest.entries.size(); i++) {
+    auto& entry = manifest.entries[i];
+    uint32_t nameLength = 0;
+    serialization::readPod(file, nameLength);
+    if (nameLength > MAX_NAME_LENGTH) {
+      valid = false;
+      break;
+    }
+    char name[MAX_NAME_LENGTH + 1];
+    valid = file.read(name, nameLength) == static_cast<int>(nameLength);
+    entry.name.assign(name, valid ? nameLength : 0);
+    serialization::readPod(file, entry.size);
+    serialization::readPod(file, entry.lastRead);
+  }
+
+  if (!valid || file.position() != file.size()) {
+    Serial.printf("[%lu] [BCM] Cache manifest is truncated or corrupt, ignoring it\n", millis());
+    manifest = Manifest{};
+    file.close();
+    return false;
+  }
+  file.close();
+  return true;
+}
+
+void saveManifest(const std::string& manifestPath, const Manifest& manifest) {
+  FsFile file;
+  if (!SdMan.openFileForWrite("BCM", manifestPath, file)) {
+    return;
+  }
+
+  serialization::writePod(file, MANIFEST_VERSION);
+  serialization::writePod(file, manifest.readCounter);
+  serialization::writePod(file, static_cast<uint16_t>(manifest.entries.size()));
+  for (const auto& entry : manifest.entries) {
+    serialization::writeString(file, entry.name);
+    serialization::writePod(file, entry.size);
+    serialization::writePod(file, entry.lastRead);
+  }
+  file.close();
+}
+
+// Removes everything in a book's cache except its reading progress, the directory itself is kept for that
+bool evict(const std::string& path) {
+  auto dir = SdMan.open(path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    dir.close();
+    return false;
+  }
+
+  // Names are gathered first so the directory isn't changed while it is being listed
+  std::vector<std::string> names;
+  char name[MAX_NAME_LENGTH + 1];
+  for (auto file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    if (strcmp(name, progressFile) != 0) {
+      names.emplace_back(name);
+    }
+    file.close();
+  }
+  dir.close();
+
+  bool removed = true;
+  for (const auto& childName : names) {
+    const std::string childPath = path + "/" + childName;
+    auto child = SdMan.open(childPath.c_str());
+    const bool isDirectory = child && child.isDirectory();
+    child.close();
+    if (!(isDirectory ? SdMan.removeDir(childPath.c_str()) : SdMan.remove(childPath.c_str()))) {
+      removed = false;
+    }
+  }
+  return removed;
+}
+
+// One-off scan for caches created before the manifest existed, they all count as read before any tracked book
+void seedManifest(const std::string& cacheDir, Manifest& manifest) {
+  auto dir = SdMan.open(cacheDir.c_str());
+  if (!dir || !dir.isDirectory()) {
+    dir.close();
+    return;
+  }
+
+  const unsigned long start = millis();
+  char name[MAX_NAME_LENGTH + 1];
+  for (auto file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    if (file.isDirectory() && isBookCache(name) && manifest.entries.size() < UINT16_MAX) {
+      const uint64_t size = measureDir(file);
+      manifest.entries.push_back({name, size > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(size), 0});
+    }
+    file.close();
+  }
+  dir.close();
+  Serial.printf("[%lu] [BCM] Seeded cache manifest with %u books in %lums\n", millis(),
+                static_cast<unsigned>(manifest.entries.size()), millis() - start);
+}
+}  // namespace
+
+void BookCacheManager::onBookOpened(const std::string& cachePath, const uint64_t budget) {
+  update(cachePath, budget, true);
+}
+
+void BookCacheManager::onBookClosed(const std::string& cachePath, const uint64_t budget) {
+  update(cachePath, budget, false);
+}
+
+void BookCacheManager::update(const std::string& cachePath, const uint64_t budget, const bool markRead) {
+  const auto lastSlash = cachePath.find_last_of('/');
+  if (lastSlash == std::string::npos) {
+    return;
+  }
+  const std::string cacheDir = cachePath.substr(0, lastSlash);
+  const std::string name = cachePath.substr(lastSlash + 1);
+  const std::string manifestPath = cacheDir + manifestFile;
+
+  Manifest manifest;
+  if (!loadManifest(manifestPath, manifest)) {
+    seedManifest(cacheDir, manifest);
+  }
+
+  size_t index = 0;
+  while (index < manifest.entries.size() && manifest.entries[index].name != name) {
+    index++;
+  }
+  if (index == manifest.entries.size()) {
+    if (index >= UINT16_MAX) {
+      return;
+    }
+    manifest.entries.push_back({name, 0, 0});
+  }
+
+  manifest.entries[index].size = measure(cachePath);
+  if (markRead) {
+    manifest.entries[index].lastRead = ++manifest.readCounter;
+  }
+
+  uint64_t total = 0;
+  for (const auto& entry : manifest.entries) {
+    total += entry.size;
+  }
+
+  // The book being read is never a candidate, if it alone is over budget everything else goes
+  while (total > budget) {
+    size_t victim = manifest.entries.size();
+    for (size_t i = 0; i < manifest.entries.size(); i++) {
+      if (manifest.entries[i].name != name &&
+          (victim == manifest.entries.size() || manifest.entries[i].lastRead < manifest.entries[victim].lastRead)) {
+        victim = i;
+      }
+    }
+    if (victim == manifest.entries.size()) {
+      break;
+    }
+
+    // Evicted books leave the manifest, they are measured again if they are ever reopened
+    const std::string victimPath = cacheDir + "/" + manifest.entries[victim].name;
+    if (SdMan.exists(victimPath.c_str()) && !evict(victimPath)) {
+      Serial.printf("[%lu] [BCM] Could not evict %s, forgetting it until it is read again\n", millis(),
+                    victimPath.c_str());
+    } else {
+      Serial.printf("[%lu] [BCM] Evicted %s (%u bytes)\n", millis(), victimPath.c_str(),
+                    static_cast<unsigned>(manifest.entries[victim].size));
+    }
+    total -= manifest.entries[victim].size;
+    manifest.entries.erase(manifest.entries.begin() + victim);
+  }
+
+  saveManifest(manifestPath, manifest);
+}
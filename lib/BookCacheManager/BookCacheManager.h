@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Keeps the book caches under a cache dir within a byte budget by evicting the least recently read books. Eviction
+// only removes what can be rebuilt from the book, its reading progress is kept.
+//
+// A small manifest in the cache dir records each book cache's size and when it was last read, so deciding what to
+// evict never walks the cache tree. Sizes are re-measured one book at a time, by walking only that book's directory
+// when it is opened or closed. The only full scan happens once, to seed the manifest when it doesn't exist yet.
+class BookCacheManager {
+ public:
+  // No limit, caches are still tracked so a budget can be applied later
+  static constexpr uint64_t UNLIMITED = UINT64_MAX;
+
+  // Marks the book as the most recently read, then evicts other books until the cache dir fits in budget bytes
+  static void onBookOpened(const std::string& cachePath, uint64_t budget);
+  // Re-measures the book now that reading may have added sections to it, then evicts other books to fit budget bytes
+  static void onBookClosed(const std::string& cachePath, uint64_t budget);
+
+ private:
+  static void update(const std::string& cachePath, uint64_t budget, bool markRead);
+};
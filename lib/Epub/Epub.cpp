@@ -1,15 +1,106 @@
 #include "Epub.h"
 
+#include <BookCacheKey.h>
 #include <FsHelpers.h>
 #include <HardwareSerial.h>
 #include <JpegToBmpConverter.h>
 #include <SDCardManager.h>
+#include <Serialization.h>
 #include <ZipFile.h>
 
+#include "Epub/BookStyles.h"
 #include "Epub/parsers/ContainerParser.h"
 #include "Epub/parsers/ContentOpfParser.h"
+#include "Epub/parsers/CssParser.h"
 #include "Epub/parsers/TocNcxParser.h"
 
+namespace {
+// A zip is identified by its central directory and EOCD, which run from the start of the central directory to the end
+bool zipIdentityRange(const std::string& filepath, const uint64_t fileSize, uint64_t* offset, uint64_t* length) {
+  ZipFile zip(filepath);
+  uint64_t centralDirOffset;
+  if (!zip.getCentralDirOffset(&centralDirOffset) || centralDirOffset > fileSize) {
+    return false;
+  }
+  *offset = centralDirOffset;
+  *length = fileSize - centralDirOffset;
+  return true;
+}
+
+// A path-keyed cache is this book's if every spine item listed in its book.bin still has the size it was recorded
+// with. Versions 3 and 4 of book.bin share the header, spine lookup table and spine entry layout read here.
+bool legacyCacheMatches(const std::string& filepath, const std::string& legacyCachePath) {
+  FsFile bookFile;
+  const std::string bookBinPath = legacyCachePath + "/book.bin";
+  if (!SdMan.exists(bookBinPath.c_str()) || !SdMan.openFileForRead("EBP", bookBinPath, bookFile)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint32_t lutOffset;
+  uint16_t spineCount;
+  serialization::readPod(bookFile, version);
+  serialization::readPod(bookFile, lutOffset);
+  serialization::readPod(bookFile, spineCount);
+  if ((version != 3 && version != 4) || spineCount == 0 ||
+      lutOffset + sizeof(uint32_t) * static_cast<uint64_t>(spineCount) > bookFile.size()) {
+    bookFile.close();
+    return false;
+  }
+
+  // The index is built in the legacy cache, so it moves along with the cache if it turns out to be this book's
+  ZipFile zip(filepath, legacyCachePath + "/zip.idx");
+  if (!zip.open()) {
+    bookFile.close();
+    return false;
+  }
+
+  uint32_t cumulativeSize = 0;
+  uint16_t itemsFound = 0;
+  bool matches = true;
+  for (uint16_t i = 0; i < spineCount && matches; i++) {
+    uint32_t entryOffset;
+    bookFile.seek(lutOffset + sizeof(uint32_t) * i);
+    serialization::readPod(bookFile, entryOffset);
+
+    uint32_t hrefLength;
+    bookFile.seek(entryOffset);
+    serialization::readPod(bookFile, hrefLength);
+    if (hrefLength >= 256) {
+      matches = false;
+      break;
+    }
+    char href[256];
+    uint32_t recordedSize;
+    if (bookFile.read(href, hrefLength) != static_cast<int>(hrefLength)) {
+      matches = false;
+      break;
+    }
+    href[hrefLength] = '\0';
+    serialization::readPod(bookFile, recordedSize);
+
+    // Items missing from the zip were skipped over when the cache was built
+    size_t itemSize;
+    if (zip.getInflatedFileSize(FsHelpers::normalisePath(href).c_str(), &itemSize)) {
+      cumulativeSize += itemSize;
+      matches = recordedSize == cumulativeSize;
+      itemsFound++;
+    }
+  }
+  zip.close();
+  bookFile.close();
+  return matches && itemsFound > 0;
+}
+}  // namespace
+
+Epub::Epub(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)) {
+  // create a cache key based on the file's content, so moving or renaming the book keeps its cache
+  cachePath = BookCacheKey::resolve(this->filepath, cacheDir, "epub_", zipIdentityRange, legacyCacheMatches);
+  zip.reset(new ZipFile(this->filepath, getZipIndexPath(), getInflateCheckpointDir()));
+}
+
+Epub::~Epub() = default;
+
 bool Epub::findContentOpfFile(std::string* contentOpfFile) const {
   const auto containerPath = "META-INF/container.xml";
   size_t containerSize;
@@ -42,7 +133,8 @@ bool Epub::findContentOpfFile(std::string* contentOpfFile) const {
   return true;
 }
 
-bool Epub::parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata) {
+bool Epub::parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata,
+                           std::vector<std::string>& stylesheetHrefs) {
   std::string contentOpfFilePath;
   if (!findContentOpfFile(&contentOpfFilePath)) {
     Serial.printf("[%lu] [EBP] Could not find content.opf in zip\n", millis());
@@ -75,10 +167,9 @@ bool Epub::parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata) {
   bookMetadata.author = opfParser.author;
   bookMetadata.coverItemHref = opfParser.coverItemHref;
   bookMetadata.textReferenceHref = opfParser.textReferenceHref;
-
-  if (!opfParser.tocNcxPath.empty()) {
-    tocNcxItem = opfParser.tocNcxPath;
-  }
+  bookMetadata.contentBasePath = contentBasePath;
+  bookMetadata.tocNcxPath = opfParser.tocNcxPath;
+  stylesheetHrefs = std::move(opfParser.stylesheetHrefs);
 
   Serial.printf("[%lu] [EBP] Successfully parsed content.opf\n", millis());
   return true;
@@ -86,6 +177,7 @@ bool Epub::parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata) {
 
 bool Epub::parseTocNcxFile() const {
   // the ncx file should have been specified in the content.opf file
+  const auto& tocNcxItem = bookMetadataCache->coreMetadata.tocNcxPath;
   if (tocNcxItem.empty()) {
     Serial.printf("[%lu] [EBP] No ncx file specified\n", millis());
     return false;
@@ -93,52 +185,40 @@ bool Epub::parseTocNcxFile() const {
 
   Serial.printf("[%lu] [EBP] Parsing toc ncx file: %s\n", millis(), tocNcxItem.c_str());
 
-  const auto tmpNcxPath = getCachePath() + "/toc.ncx";
-  FsFile tempNcxFile;
-  if (!SdMan.openFileForWrite("EBP", tmpNcxPath, tempNcxFile)) {
+  size_t ncxSize;
+  if (!getItemSize(tocNcxItem, &ncxSize)) {
+    Serial.printf("[%lu] [EBP] Could not get size of toc ncx\n", millis());
     return false;
   }
-  readItemContentsToStream(tocNcxItem, tempNcxFile, 1024);
-  tempNcxFile.close();
-  if (!SdMan.openFileForRead("EBP", tmpNcxPath, tempNcxFile)) {
-    return false;
-  }
-  const auto ncxSize = tempNcxFile.size();
-
-  TocNcxParser ncxParser(contentBasePath, ncxSize, bookMetadataCache.get());
 
+  TocNcxParser ncxParser(bookMetadataCache->coreMetadata.contentBasePath, ncxSize, bookMetadataCache.get());
   if (!ncxParser.setup()) {
     Serial.printf("[%lu] [EBP] Could not setup toc ncx parser\n", millis());
-    tempNcxFile.close();
     return false;
   }
 
-  const auto ncxBuffer = static_cast<uint8_t*>(malloc(1024));
-  if (!ncxBuffer) {
-    Serial.printf("[%lu] [EBP] Could not allocate memory for toc ncx parser\n", millis());
-    tempNcxFile.close();
+  // Inflated straight into the parser, like container.xml and content.opf
+  if (!readItemContentsToStream(tocNcxItem, ncxParser, 1024)) {
+    Serial.printf("[%lu] [EBP] Could not process all toc ncx data\n", millis());
     return false;
   }
 
-  while (tempNcxFile.available()) {
-    const auto readSize = tempNcxFile.read(ncxBuffer, 1024);
-    if (readSize == 0) break;
-    const auto processedSize = ncxParser.write(ncxBuffer, readSize);
+  Serial.printf("[%lu] [EBP] Parsed TOC items\n", millis());
+  return true;
+}
 
-    if (processedSize != readSize) {
-      Serial.printf("[%lu] [EBP] Could not process all toc ncx data\n", millis());
-      free(ncxBuffer);
-      tempNcxFile.close();
-      return false;
+bool Epub::buildStyles(const std::vector<std::string>& stylesheetHrefs) const {
+  // Written even for a book without stylesheets, so a cache with no table is known to be from before they were used
+  BookStyles::Builder rules;
+  for (const auto& href : stylesheetHrefs) {
+    CssParser cssParser(rules);
+    if (!readItemContentsToStream(href, cssParser, 1024)) {
+      Serial.printf("[%lu] [EBP] Could not read stylesheet %s - ignoring\n", millis(), href.c_str());
     }
   }
-
-  free(ncxBuffer);
-  tempNcxFile.close();
-  SdMan.remove(tmpNcxPath.c_str());
-
-  Serial.printf("[%lu] [EBP] Parsed TOC items\n", millis());
-  return true;
+  Serial.printf("[%lu] [EBP] Parsed %u stylesheets, %u style rules\n", millis(),
+                static_cast<unsigned>(stylesheetHrefs.size()), static_cast<unsigned>(rules.size()));
+  return rules.write(getStylesPath());
 }
 
 // load in the meta data for the epub file
@@ -148,10 +228,15 @@ bool Epub::load(const bool buildIfMissing) {
   // Initialize spine/TOC cache
   bookMetadataCache.reset(new BookMetadataCache(cachePath));
 
-  // Try to load existing cache first
+  // Try to load existing cache first. One without a style table is from before stylesheets were compiled, it is built
+  // again if allowed to, otherwise it still has everything but the styles.
   if (bookMetadataCache->load()) {
-    Serial.printf("[%lu] [EBP] Loaded ePub: %s\n", millis(), filepath.c_str());
-    return true;
+    if (!buildIfMissing || BookStyles::isCurrent(getStylesPath())) {
+      Serial.printf("[%lu] [EBP] Loaded ePub: %s\n", millis(), filepath.c_str());
+      return true;
+    }
+    Serial.printf("[%lu] [EBP] No style table in cache\n", millis());
+    bookMetadataCache.reset(new BookMetadataCache(cachePath));
   }
 
   // If we didn't load from cache above and we aren't allowed to build, fail now
@@ -171,11 +256,12 @@ bool Epub::load(const bool buildIfMissing) {
 
   // OPF Pass
   BookMetadataCache::BookMetadata bookMetadata;
+  std::vector<std::string> stylesheetHrefs;
   if (!bookMetadataCache->beginContentOpfPass()) {
     Serial.printf("[%lu] [EBP] Could not begin writing content.opf pass\n", millis());
     return false;
   }
-  if (!parseContentOpf(bookMetadata)) {
+  if (!parseContentOpf(bookMetadata, stylesheetHrefs)) {
     Serial.printf("[%lu] [EBP] Could not parse content.opf\n", millis());
     return false;
   }
@@ -184,19 +270,7 @@ bool Epub::load(const bool buildIfMissing) {
     return false;
   }
 
-  // TOC Pass
-  if (!bookMetadataCache->beginTocPass()) {
-    Serial.printf("[%lu] [EBP] Could not begin writing toc pass\n", millis());
-    return false;
-  }
-  if (!parseTocNcxFile()) {
-    Serial.printf("[%lu] [EBP] Could not parse toc\n", millis());
-    return false;
-  }
-  if (!bookMetadataCache->endTocPass()) {
-    Serial.printf("[%lu] [EBP] Could not end writing toc pass\n", millis());
-    return false;
-  }
+  // The TOC pass is deferred to loadToc, the reader only needs the spine to show the first page
 
   // Close the cache files
   if (!bookMetadataCache->endWrite()) {
@@ -205,7 +279,7 @@ bool Epub::load(const bool buildIfMissing) {
   }
 
   // Build final book.bin
-  if (!bookMetadataCache->buildBookBin(filepath, bookMetadata)) {
+  if (!bookMetadataCache->buildBookBin(openZip(), bookMetadata)) {
     Serial.printf("[%lu] [EBP] Could not update mappings and sizes\n", millis());
     return false;
   }
@@ -214,6 +288,11 @@ bool Epub::load(const bool buildIfMissing) {
     Serial.printf("[%lu] [EBP] Could not cleanup tmp files - ignoring\n", millis());
   }
 
+  // Chapters are parsed without styles if this fails, and the next load tries again
+  if (!buildStyles(stylesheetHrefs)) {
+    Serial.printf("[%lu] [EBP] Could not build style table - ignoring\n", millis());
+  }
+
   // Reload the cache from disk so it's in the correct state
   bookMetadataCache.reset(new BookMetadataCache(cachePath));
   if (!bookMetadataCache->load()) {
@@ -225,12 +304,57 @@ bool Epub::load(const bool buildIfMissing) {
   return true;
 }
 
+// Build the TOC on first use and persist it next to book.bin, later opens load it with the rest of the cache
+bool Epub::loadToc() {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    Serial.printf("[%lu] [EBP] loadToc called but cache not loaded\n", millis());
+    return false;
+  }
+
+  if (bookMetadataCache->isTocLoaded()) {
+    return true;
+  }
+
+  // Don't retry a failed build for every caller during this session
+  if (tocBuildFailed) {
+    return false;
+  }
+
+  Serial.printf("[%lu] [EBP] Building TOC cache\n", millis());
+  if (!bookMetadataCache->beginTocPass()) {
+    Serial.printf("[%lu] [EBP] Could not begin writing toc pass\n", millis());
+    tocBuildFailed = true;
+    return false;
+  }
+  // A missing or broken NCX still leaves an (empty or partial) TOC, so it isn't parsed again on every open
+  if (!parseTocNcxFile()) {
+    Serial.printf("[%lu] [EBP] Could not parse toc\n", millis());
+  }
+  if (!bookMetadataCache->endTocPass()) {
+    Serial.printf("[%lu] [EBP] Could not end writing toc pass\n", millis());
+    tocBuildFailed = true;
+    return false;
+  }
+
+  if (!bookMetadataCache->cleanupTmpFiles()) {
+    Serial.printf("[%lu] [EBP] Could not cleanup tmp files - ignoring\n", millis());
+  }
+
+  Serial.printf("[%lu] [EBP] Built TOC cache with %d entries\n", millis(), bookMetadataCache->getTocCount());
+  return true;
+}
+
+bool Epub::isTocLoaded() const { return bookMetadataCache && bookMetadataCache->isTocLoaded(); }
+
 bool Epub::clearCache() const {
   if (!SdMan.exists(cachePath.c_str())) {
     Serial.printf("[%lu] [EPB] Cache does not exist, no action needed\n", millis());
     return true;
   }
 
+  // The zip index lives in the cache directory, release it before removing the directory
+  zip->close();
+
   if (!SdMan.removeDir(cachePath.c_str())) {
     Serial.printf("[%lu] [EPB] Failed to clear cache\n", millis());
     return false;
@@ -270,8 +394,22 @@ const std::string& Epub::getAuthor() const {
   return bookMetadataCache->coreMetadata.author;
 }
 
+std::string Epub::getZipIndexPath() const { return cachePath + "/zip.idx"; }
+
+std::string Epub::getInflateCheckpointDir() const { return cachePath + "/inflate"; }
+
+ZipFile& Epub::openZip() const {
+  // If opening fails here, each read will retry opening the zip by itself and fail gracefully
+  if (!zip->isOpen() && !zip->open()) {
+    Serial.printf("[%lu] [EBP] Could not open zip session for %s\n", millis(), filepath.c_str());
+  }
+  return *zip;
+}
+
 std::string Epub::getCoverBmpPath() const { return cachePath + "/cover.bmp"; }
 
+std::string Epub::getStylesPath() const { return cachePath + "/css.bin"; }
+
 bool Epub::generateCoverBmp() const {
   // Already generated, return true
   if (SdMan.exists(getCoverBmpPath().c_str())) {
@@ -336,7 +474,7 @@ uint8_t* Epub::readItemContentsToBytes(const std::string& itemHref, size_t* size
 
   const std::string path = FsHelpers::normalisePath(itemHref);
 
-  const auto content = ZipFile(filepath).readFileToMemory(path.c_str(), size, trailingNullByte);
+  const auto content = openZip().readFileToMemory(path.c_str(), size, trailingNullByte);
   if (!content) {
     Serial.printf("[%lu] [EBP] Failed to read item %s\n", millis(), path.c_str());
     return nullptr;
@@ -352,12 +490,26 @@ bool Epub::readItemContentsToStream(const std::string& itemHref, Print& out, con
   }
 
   const std::string path = FsHelpers::normalisePath(itemHref);
-  return ZipFile(filepath).readFileToStream(path.c_str(), out, chunkSize);
+  return openZip().readFileToStream(path.c_str(), out, chunkSize);
+}
+
+bool Epub::openItem(const std::string& itemHref, ZipFile::EntryReader& reader, const size_t chunkSize) const {
+  if (itemHref.empty()) {
+    Serial.printf("[%lu] [EBP] Failed to open item, empty href\n", millis());
+    return false;
+  }
+
+  const std::string path = FsHelpers::normalisePath(itemHref);
+  if (!openZip().openEntry(path.c_str(), reader, chunkSize)) {
+    Serial.printf("[%lu] [EBP] Failed to open item %s\n", millis(), path.c_str());
+    return false;
+  }
+  return true;
 }
 
 bool Epub::getItemSize(const std::string& itemHref, size_t* size) const {
   const std::string path = FsHelpers::normalisePath(itemHref);
-  return ZipFile(filepath).getInflatedFileSize(path.c_str(), size);
+  return openZip().getInflatedFileSize(path.c_str(), size);
 }
 
 int Epub::getSpineItemsCount() const {
@@ -367,7 +519,16 @@ int Epub::getSpineItemsCount() const {
   return bookMetadataCache->getSpineCount();
 }
 
-size_t Epub::getCumulativeSpineItemSize(const int spineIndex) const { return getSpineItem(spineIndex).cumulativeSize; }
+size_t Epub::getCumulativeSpineItemSize(const int spineIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    return 0;
+  }
+  // Out of range indexes fall back to the first spine item, matching getSpineItem
+  if (spineIndex < 0 || spineIndex >= bookMetadataCache->getSpineCount()) {
+    return bookMetadataCache->getCumulativeSpineSize(0);
+  }
+  return bookMetadataCache->getCumulativeSpineSize(spineIndex);
+}
 
 BookMetadataCache::SpineEntry Epub::getSpineItem(const int spineIndex) const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
@@ -417,7 +578,7 @@ int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
     return 0;
   }
 
-  const int spineIndex = bookMetadataCache->getTocEntry(tocIndex).spineIndex;
+  const int spineIndex = bookMetadataCache->getSpineIndexForToc(tocIndex);
   if (spineIndex < 0) {
     Serial.printf("[%lu] [EBP] Section not found for TOC index %d\n", millis(), tocIndex);
     return 0;
@@ -426,7 +587,16 @@ int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
   return spineIndex;
 }
 
-int Epub::getTocIndexForSpineIndex(const int spineIndex) const { return getSpineItem(spineIndex).tocIndex; }
+int Epub::getTocIndexForSpineIndex(const int spineIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    return -1;
+  }
+  // Out of range indexes fall back to the first spine item, matching getSpineItem
+  if (spineIndex < 0 || spineIndex >= bookMetadataCache->getSpineCount()) {
+    return bookMetadataCache->getTocIndexForSpine(0);
+  }
+  return bookMetadataCache->getTocIndexForSpine(spineIndex);
+}
 
 size_t Epub::getBookSize() const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded() || bookMetadataCache->getSpineCount() == 0) {
@@ -451,13 +621,11 @@ int Epub::getSpineIndexForTextReference() const {
     return 0;
   }
 
-  // loop through spine items to get the correct index matching the text href
-  for (size_t i = 0; i < getSpineItemsCount(); i++) {
-    if (getSpineItem(i).href == bookMetadataCache->coreMetadata.textReferenceHref) {
-      Serial.printf("[%lu] [ERS] Text reference %s found at index %d\n", millis(),
-                    bookMetadataCache->coreMetadata.textReferenceHref.c_str(), i);
-      return i;
-    }
+  const int spineIndex = bookMetadataCache->getSpineIndexForHref(bookMetadataCache->coreMetadata.textReferenceHref);
+  if (spineIndex >= 0) {
+    Serial.printf("[%lu] [ERS] Text reference %s found at index %d\n", millis(),
+                  bookMetadataCache->coreMetadata.textReferenceHref.c_str(), spineIndex);
+    return spineIndex;
   }
   // This should not happen, as we checked for empty textReferenceHref earlier
   Serial.printf("[%lu] [EBP] Section not found for text reference\n", millis());
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Print.h>
+#include <ZipFile.h>
 
 #include <memory>
 #include <string>
@@ -9,11 +10,7 @@
 
 #include "Epub/BookMetadataCache.h"
 
-class ZipFile;
-
 class Epub {
-  // the ncx file
-  std::string tocNcxItem;
   // where is the EPUBfile?
   std::string filepath;
   // the base path for items in the EPUB file
@@ -22,19 +19,25 @@ class Epub {
   std::string cachePath;
   // Spine and TOC cache
   std::unique_ptr<BookMetadataCache> bookMetadataCache;
+  // Zip session kept open for the life of the book so EOCD, index and resolved entries are only loaded once
+  std::unique_ptr<ZipFile> zip;
+  bool tocBuildFailed = false;
 
   bool findContentOpfFile(std::string* contentOpfFile) const;
-  bool parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata);
+  bool parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata, std::vector<std::string>& stylesheetHrefs);
+  bool buildStyles(const std::vector<std::string>& stylesheetHrefs) const;
   bool parseTocNcxFile() const;
+  std::string getZipIndexPath() const;
+  std::string getInflateCheckpointDir() const;
+  ZipFile& openZip() const;
 
  public:
-  explicit Epub(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)) {
-    // create a cache key based on the filepath
-    cachePath = cacheDir + "/epub_" + std::to_string(std::hash<std::string>{}(this->filepath));
-  }
-  ~Epub() = default;
+  explicit Epub(std::string filepath, const std::string& cacheDir);
+  ~Epub();
   std::string& getBasePath() { return contentBasePath; }
   bool load(bool buildIfMissing = true);
+  bool loadToc();
+  bool isTocLoaded() const;
   bool clearCache() const;
   void setupCacheDir() const;
   const std::string& getCachePath() const;
@@ -42,10 +45,14 @@ class Epub {
   const std::string& getTitle() const;
   const std::string& getAuthor() const;
   std::string getCoverBmpPath() const;
+  // The book's stylesheets as a table of selectors to styles, compiled when the book is first loaded
+  std::string getStylesPath() const;
   bool generateCoverBmp() const;
   uint8_t* readItemContentsToBytes(const std::string& itemHref, size_t* size = nullptr,
                                    bool trailingNullByte = false) const;
   bool readItemContentsToStream(const std::string& itemHref, Print& out, size_t chunkSize) const;
+  // Opens an item for pulling its contents chunk by chunk, the reader must not outlive the Epub
+  bool openItem(const std::string& itemHref, ZipFile::EntryReader& reader, size_t chunkSize) const;
   bool getItemSize(const std::string& itemHref, size_t* size) const;
   BookMetadataCache::SpineEntry getSpineItem(int spineIndex) const;
   BookMetadataCache::TocEntry getTocItem(int tocIndex) const;
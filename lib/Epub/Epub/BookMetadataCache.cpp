@@ -4,15 +4,28 @@
 #include <Serialization.h>
 #include <ZipFile.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "FsHelpers.h"
 
 namespace {
-constexpr uint8_t BOOK_CACHE_VERSION = 3;
+constexpr uint8_t BOOK_CACHE_VERSION = 4;
+constexpr uint8_t TOC_CACHE_VERSION = 1;
 constexpr char bookBinFile[] = "/book.bin";
+constexpr char tocBinFile[] = "/toc.bin";
 constexpr char tmpSpineBinFile[] = "/spine.bin.tmp";
 constexpr char tmpTocBinFile[] = "/toc.bin.tmp";
+
+// FNV-1a, only used to spread hrefs across the spine lookup table
+uint32_t hashHref(const std::string& href) {
+  uint32_t hash = 2166136261u;
+  for (const char c : href) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
 }  // namespace
 
 /* ============= WRITING / BUILDING FUNCTIONS ================ */
@@ -20,7 +33,6 @@ constexpr char tmpTocBinFile[] = "/toc.bin.tmp";
 bool BookMetadataCache::beginWrite() {
   buildMode = true;
   spineCount = 0;
-  tocCount = 0;
   Serial.printf("[%lu] [BMC] Entering write mode\n", millis());
   return true;
 }
@@ -37,24 +49,60 @@ bool BookMetadataCache::endContentOpfPass() {
   return true;
 }
 
+// The TOC pass runs against a loaded book.bin, spine hrefs are resolved through the resident spine table
 bool BookMetadataCache::beginTocPass() {
-  Serial.printf("[%lu] [BMC] Beginning toc pass\n", millis());
-
-  // Open spine file for reading
-  if (!SdMan.openFileForRead("BMC", cachePath + tmpSpineBinFile, spineFile)) {
+  if (!loaded) {
+    Serial.printf("[%lu] [BMC] beginTocPass called but cache not loaded\n", millis());
     return false;
   }
+
+  Serial.printf("[%lu] [BMC] Beginning toc pass\n", millis());
+
+  tocCacheFile.close();
+  tocLoaded = false;
+  tocCount = 0;
   if (!SdMan.openFileForWrite("BMC", cachePath + tmpTocBinFile, tocFile)) {
-    spineFile.close();
     return false;
   }
+  buildSpineHrefIndex();
   return true;
 }
 
 bool BookMetadataCache::endTocPass() {
   tocFile.close();
-  spineFile.close();
-  return true;
+  spineHrefHashes = {};
+
+  if (!buildTocBin()) {
+    Serial.printf("[%lu] [BMC] Could not build toc.bin\n", millis());
+    return false;
+  }
+  return loadToc();
+}
+
+void BookMetadataCache::buildSpineHrefIndex() {
+  spineHrefHashes.resize(spineCount);
+  for (uint16_t i = 0; i < spineCount; i++) {
+    spineHrefHashes[i] = {spineInfos[i].hrefHash, i};
+  }
+
+  // Ties keep spine order, so the first spine entry with a given href is found first
+  std::sort(spineHrefHashes.begin(), spineHrefHashes.end(), [](const SpineHrefHash& a, const SpineHrefHash& b) {
+    return a.hrefHash != b.hrefHash ? a.hrefHash < b.hrefHash : a.spineIndex < b.spineIndex;
+  });
+}
+
+int BookMetadataCache::findSpineIndex(const std::string& href) {
+  const uint32_t hash = hashHref(href);
+  auto it = std::lower_bound(spineHrefHashes.begin(), spineHrefHashes.end(), hash,
+                             [](const SpineHrefHash& entry, const uint32_t value) { return entry.hrefHash < value; });
+
+  // Check the href of each spine entry with a matching hash, only a collision moves on to the next one
+  for (; it != spineHrefHashes.end() && it->hrefHash == hash; ++it) {
+    if (getSpineEntry(it->spineIndex).href == href) {
+      return it->spineIndex;
+    }
+  }
+  return -1;
 }
 
 bool BookMetadataCache::endWrite() {
@@ -64,12 +112,12 @@ bool BookMetadataCache::endWrite() {
   }
 
   buildMode = false;
-  Serial.printf("[%lu] [BMC] Wrote %d spine, %d TOC entries\n", millis(), spineCount, tocCount);
+  Serial.printf("[%lu] [BMC] Wrote %d spine entries\n", millis(), spineCount);
   return true;
 }
 
-bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMetadata& metadata) {
-  // Open all three files, writing to meta, reading from spine and toc
+bool BookMetadataCache::buildBookBin(ZipFile& zip, const BookMetadata& metadata) {
+  // Open both files, writing to meta, reading from spine
   if (!SdMan.openFileForWrite("BMC", cachePath + bookBinFile, bookFile)) {
     return false;
   }
@@ -79,29 +127,24 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     return false;
   }
 
-  if (!SdMan.openFileForRead("BMC", cachePath + tmpTocBinFile, tocFile)) {
-    bookFile.close();
-    spineFile.close();
-    return false;
-  }
-
-  constexpr uint32_t headerASize =
-      sizeof(BOOK_CACHE_VERSION) + /* LUT Offset */ sizeof(uint32_t) + sizeof(spineCount) + sizeof(tocCount);
+  constexpr uint32_t headerASize = sizeof(BOOK_CACHE_VERSION) + /* LUT Offset */ sizeof(uint32_t) + sizeof(spineCount);
   const uint32_t metadataSize = metadata.title.size() + metadata.author.size() + metadata.coverItemHref.size() +
-                                metadata.textReferenceHref.size() + sizeof(uint32_t) * 4;
-  const uint32_t lutSize = sizeof(uint32_t) * spineCount + sizeof(uint32_t) * tocCount;
+                                metadata.textReferenceHref.size() + metadata.contentBasePath.size() +
+                                metadata.tocNcxPath.size() + sizeof(uint32_t) * 6;
+  const uint32_t lutSize = sizeof(uint32_t) * spineCount;
   const uint32_t lutOffset = headerASize + metadataSize;
 
   // Header A
   serialization::writePod(bookFile, BOOK_CACHE_VERSION);
   serialization::writePod(bookFile, lutOffset);
   serialization::writePod(bookFile, spineCount);
-  serialization::writePod(bookFile, tocCount);
   // Metadata
   serialization::writeString(bookFile, metadata.title);
   serialization::writeString(bookFile, metadata.author);
   serialization::writeString(bookFile, metadata.coverItemHref);
   serialization::writeString(bookFile, metadata.textReferenceHref);
+  serialization::writeString(bookFile, metadata.contentBasePath);
+  serialization::writeString(bookFile, metadata.tocNcxPath);
 
   // Loop through spine entries, writing LUT positions
   spineFile.seek(0);
@@ -111,90 +154,97 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     serialization::writePod(bookFile, pos + lutOffset + lutSize);
   }
 
-  // Loop through toc entries, writing LUT positions
-  tocFile.seek(0);
-  for (int i = 0; i < tocCount; i++) {
-    uint32_t pos = tocFile.position();
-    auto tocEntry = readTocEntry(tocFile);
-    serialization::writePod(bookFile, pos + lutOffset + lutSize + static_cast<uint32_t>(spineFile.position()));
-  }
-
-  // LUTs complete
-  // Loop through spines from spine file matching up TOC indexes, calculating cumulative size and writing to book.bin
+  // LUT complete
+  // Loop through spines from spine file calculating cumulative size and writing to book.bin
 
-  ZipFile zip(epubPath);
-  // Pre-open zip file to speed up size calculations
-  if (!zip.open()) {
+  // Zip is normally already open as part of the book's session, lookups go through its on-disk index
+  if (!zip.isOpen() && !zip.open()) {
     Serial.printf("[%lu] [BMC] Could not open EPUB zip for size calculations\n", millis());
     bookFile.close();
     spineFile.close();
-    tocFile.close();
-    return false;
-  }
-  // TODO: For large ZIPs loading the all localHeaderOffsets will crash.
-  //       However not having them loaded is extremely slow. Need a better solution here.
-  //       Perhaps only a cache of spine items or a better way to speedup lookups?
-  if (!zip.loadAllFileStatSlims()) {
-    Serial.printf("[%lu] [BMC] Could not load zip local header offsets for size calculations\n", millis());
-    bookFile.close();
-    spineFile.close();
-    tocFile.close();
-    zip.close();
     return false;
   }
   uint32_t cumSize = 0;
   spineFile.seek(0);
-  int lastSpineTocIndex = -1;
   for (int i = 0; i < spineCount; i++) {
     auto spineEntry = readSpineEntry(spineFile);
 
-    tocFile.seek(0);
-    for (int j = 0; j < tocCount; j++) {
-      auto tocEntry = readTocEntry(tocFile);
-      if (tocEntry.spineIndex == i) {
-        spineEntry.tocIndex = j;
-        break;
-      }
-    }
-
-    // Not a huge deal if we don't fine a TOC entry for the spine entry, this is expected behaviour for EPUBs
-    // Logging here is for debugging
-    if (spineEntry.tocIndex == -1) {
-      Serial.printf(
-          "[%lu] [BMC] Warning: Could not find TOC entry for spine item %d: %s, using title from last section\n",
-          millis(), i, spineEntry.href.c_str());
-      spineEntry.tocIndex = lastSpineTocIndex;
-    }
-    lastSpineTocIndex = spineEntry.tocIndex;
-
     // Calculate size for cumulative size
     size_t itemSize = 0;
     const std::string path = FsHelpers::normalisePath(spineEntry.href);
     if (zip.getInflatedFileSize(path.c_str(), &itemSize)) {
       cumSize += itemSize;
-      spineEntry.cumulativeSize = cumSize;
     } else {
       Serial.printf("[%lu] [BMC] Warning: Could not get size for spine item: %s\n", millis(), path.c_str());
     }
+    // A missing item takes up no room, it keeps the running size rather than dropping progress back to 0
+    spineEntry.cumulativeSize = cumSize;
 
     // Write out spine data to book.bin
     writeSpineEntry(bookFile, spineEntry);
   }
-  // Close opened zip file
-  zip.close();
 
-  // Loop through toc entries from toc file writing to book.bin
+  bookFile.close();
+  spineFile.close();
+
+  Serial.printf("[%lu] [BMC] Successfully built book.bin\n", millis());
+  return true;
+}
+
+bool BookMetadataCache::buildTocBin() {
+  if (!SdMan.openFileForWrite("BMC", cachePath + tocBinFile, tocCacheFile)) {
+    return false;
+  }
+
+  if (!SdMan.openFileForRead("BMC", cachePath + tmpTocBinFile, tocFile)) {
+    tocCacheFile.close();
+    return false;
+  }
+
+  constexpr uint32_t headerSize = sizeof(TOC_CACHE_VERSION) + sizeof(spineCount) + sizeof(tocCount);
+  const uint32_t entriesOffset = headerSize + sizeof(uint32_t) * tocCount + sizeof(int16_t) * spineCount;
+
+  serialization::writePod(tocCacheFile, TOC_CACHE_VERSION);
+  serialization::writePod(tocCacheFile, spineCount);
+  serialization::writePod(tocCacheFile, tocCount);
+
+  // Loop through toc entries, writing LUT positions and noting the first TOC entry pointing at each spine entry
+  std::vector<int16_t> spineTocIndexes(spineCount, -1);
   tocFile.seek(0);
   for (int i = 0; i < tocCount; i++) {
+    uint32_t pos = tocFile.position();
     auto tocEntry = readTocEntry(tocFile);
-    writeTocEntry(bookFile, tocEntry);
+    serialization::writePod(tocCacheFile, pos + entriesOffset);
+    if (tocEntry.spineIndex >= 0 && tocEntry.spineIndex < spineCount && spineTocIndexes[tocEntry.spineIndex] == -1) {
+      spineTocIndexes[tocEntry.spineIndex] = i;
+    }
   }
 
-  bookFile.close();
-  spineFile.close();
+  // Spine to TOC mapping, spine items without a TOC entry use the one from the last section
+  int16_t lastSpineTocIndex = -1;
+  for (int i = 0; i < spineCount; i++) {
+    // Not a huge deal if we don't fine a TOC entry for the spine entry, this is expected behaviour for EPUBs
+    // Logging here is for debugging
+    if (spineTocIndexes[i] == -1) {
+      Serial.printf("[%lu] [BMC] Warning: Could not find TOC entry for spine item %d, using title from last section\n",
+                    millis(), i);
+      spineTocIndexes[i] = lastSpineTocIndex;
+    }
+    lastSpineTocIndex = spineTocIndexes[i];
+    serialization::writePod(tocCacheFile, spineTocIndexes[i]);
+  }
+
+  // Loop through toc entries from toc file writing to toc.bin
+  tocFile.seek(0);
+  for (int i = 0; i < tocCount; i++) {
+    auto tocEntry = readTocEntry(tocFile);
+    writeTocEntry(tocCacheFile, tocEntry);
+  }
+
+  tocCacheFile.close();
   tocFile.close();
 
-  Serial.printf("[%lu] [BMC] Successfully built book.bin\n", millis());
+  Serial.printf("[%lu] [BMC] Successfully built toc.bin with %d entries\n", millis(), tocCount);
   return true;
 }
 
@@ -211,8 +261,8 @@ bool BookMetadataCache::cleanupTmpFiles() const {
 uint32_t BookMetadataCache::writeSpineEntry(FsFile& file, const SpineEntry& entry) const {
   const uint32_t pos = file.position();
   serialization::writeString(file, entry.href);
-  serialization::writePod(file, entry.cumulativeSize);
-  serialization::writePod(file, entry.tocIndex);
+  // 32 bits as on the device, so book.bin doesn't depend on the width of size_t
+  serialization::writePod(file, static_cast<uint32_t>(entry.cumulativeSize));
   return pos;
 }
 
@@ -241,24 +291,12 @@ void BookMetadataCache::createSpineEntry(const std::string& href) {
 
 void BookMetadataCache::createTocEntry(const std::string& title, const std::string& href, const std::string& anchor,
                                        const uint8_t level) {
-  if (!buildMode || !tocFile || !spineFile) {
-    Serial.printf("[%lu] [BMC] createTocEntry called but not in build mode\n", millis());
+  if (!tocFile) {
+    Serial.printf("[%lu] [BMC] createTocEntry called outside of the toc pass\n", millis());
     return;
   }
 
-  int spineIndex = -1;
-  // find spine index
-  // TODO: This lookup is slow as need to scan through all items each time. We can't hold it all in memory due to size.
-  //       But perhaps we can load just the hrefs in a vector/list to do an index lookup?
-  spineFile.seek(0);
-  for (int i = 0; i < spineCount; i++) {
-    auto spineEntry = readSpineEntry(spineFile);
-    if (spineEntry.href == href) {
-      spineIndex = i;
-      break;
-    }
-  }
-
+  const int spineIndex = findSpineIndex(href);
   if (spineIndex == -1) {
     Serial.printf("[%lu] [BMC] addTocEntry: Could not find spine item for TOC href %s\n", millis(), href.c_str());
   }
@@ -285,18 +323,143 @@ bool BookMetadataCache::load() {
 
   serialization::readPod(bookFile, lutOffset);
   serialization::readPod(bookFile, spineCount);
-  serialization::readPod(bookFile, tocCount);
 
   serialization::readString(bookFile, coreMetadata.title);
   serialization::readString(bookFile, coreMetadata.author);
   serialization::readString(bookFile, coreMetadata.coverItemHref);
   serialization::readString(bookFile, coreMetadata.textReferenceHref);
+  serialization::readString(bookFile, coreMetadata.contentBasePath);
+  serialization::readString(bookFile, coreMetadata.tocNcxPath);
+
+  if (!loadSpineTable()) {
+    Serial.printf("[%lu] [BMC] Failed to read spine table\n", millis());
+    bookFile.close();
+    return false;
+  }
 
   loaded = true;
+  // The TOC is built separately on first use, the book is readable without it
+  if (!loadToc()) {
+    Serial.printf("[%lu] [BMC] No TOC cache yet\n", millis());
+  }
   Serial.printf("[%lu] [BMC] Loaded cache data: %d spine, %d TOC entries\n", millis(), spineCount, tocCount);
   return true;
 }
 
+// Single sequential pass over the spine entries (stored back to back after the LUT)
+bool BookMetadataCache::loadSpineTable() {
+  if (!bookFile.seek(lutOffset + sizeof(uint32_t) * spineCount)) {
+    return false;
+  }
+
+  spineInfos.clear();
+  spineInfos.reserve(spineCount);
+  std::string href;
+  for (uint16_t i = 0; i < spineCount; i++) {
+    uint32_t cumulativeSize;
+    serialization::readString(bookFile, href);
+    serialization::readPod(bookFile, cumulativeSize);
+    spineInfos.push_back({cumulativeSize, hashHref(href), -1});
+  }
+
+  return bookFile.position() == bookFile.size();
+}
+
+bool BookMetadataCache::loadToc() {
+  tocCacheFile.close();
+  tocLoaded = false;
+  tocCount = 0;
+  tocSpineIndexes.clear();
+  for (auto& info : spineInfos) {
+    info.tocIndex = -1;
+  }
+
+  if (!SdMan.exists((cachePath + tocBinFile).c_str()) ||
+      !SdMan.openFileForRead("BMC", cachePath + tocBinFile, tocCacheFile)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint16_t tocSpineCount;
+  uint16_t count;
+  serialization::readPod(tocCacheFile, version);
+  serialization::readPod(tocCacheFile, tocSpineCount);
+  serialization::readPod(tocCacheFile, count);
+  if (version != TOC_CACHE_VERSION || tocSpineCount != spineCount) {
+    Serial.printf("[%lu] [BMC] TOC cache mismatch: version %d, %d spine entries\n", millis(), version, tocSpineCount);
+    tocCacheFile.close();
+    return false;
+  }
+
+  // Skip the TOC LUT, then read the spine to TOC mapping
+  std::vector<int16_t> spineTocIndexes(spineCount);
+  tocCacheFile.seekCur(sizeof(uint32_t) * count);
+  for (auto& tocIndex : spineTocIndexes) {
+    serialization::readPod(tocCacheFile, tocIndex);
+  }
+
+  std::vector<int16_t> spineIndexes;
+  spineIndexes.reserve(count);
+  for (uint16_t i = 0; i < count; i++) {
+    // Skip title, href and anchor, then level
+    for (int field = 0; field < 3; field++) {
+      uint32_t len;
+      serialization::readPod(tocCacheFile, len);
+      tocCacheFile.seekCur(len);
+    }
+    uint8_t level;
+    int16_t spineIndex;
+    serialization::readPod(tocCacheFile, level);
+    serialization::readPod(tocCacheFile, spineIndex);
+    spineIndexes.push_back(spineIndex);
+  }
+
+  if (tocCacheFile.position() != tocCacheFile.size()) {
+    Serial.printf("[%lu] [BMC] TOC cache is truncated or corrupt\n", millis());
+    tocCacheFile.close();
+    return false;
+  }
+
+  for (uint16_t i = 0; i < spineCount; i++) {
+    spineInfos[i].tocIndex = spineTocIndexes[i];
+  }
+  tocSpineIndexes = std::move(spineIndexes);
+  tocCount = count;
+  tocLoaded = true;
+  return true;
+}
+
+size_t BookMetadataCache::getCumulativeSpineSize(const int index) const {
+  if (index < 0 || index >= static_cast<int>(spineInfos.size())) {
+    return 0;
+  }
+  return spineInfos[index].cumulativeSize;
+}
+
+int16_t BookMetadataCache::getTocIndexForSpine(const int index) const {
+  if (index < 0 || index >= static_cast<int>(spineInfos.size())) {
+    return -1;
+  }
+  return spineInfos[index].tocIndex;
+}
+
+int16_t BookMetadataCache::getSpineIndexForToc(const int index) const {
+  if (index < 0 || index >= static_cast<int>(tocSpineIndexes.size())) {
+    return -1;
+  }
+  return tocSpineIndexes[index];
+}
+
+int BookMetadataCache::getSpineIndexForHref(const std::string& href) {
+  const uint32_t hash = hashHref(href);
+  for (size_t i = 0; i < spineInfos.size(); i++) {
+    if (spineInfos[i].hrefHash == hash && getSpineEntry(static_cast<int>(i)).href == href) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
 BookMetadataCache::SpineEntry BookMetadataCache::getSpineEntry(const int index) {
   if (!loaded) {
     Serial.printf("[%lu] [BMC] getSpineEntry called but cache not loaded\n", millis());
@@ -313,12 +476,14 @@ BookMetadataCache::SpineEntry BookMetadataCache::getSpineEntry(const int index)
   uint32_t spineEntryPos;
   serialization::readPod(bookFile, spineEntryPos);
   bookFile.seek(spineEntryPos);
-  return readSpineEntry(bookFile);
+  auto entry = readSpineEntry(bookFile);
+  entry.tocIndex = spineInfos[index].tocIndex;
+  return entry;
 }
 
 BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
-  if (!loaded) {
-    Serial.printf("[%lu] [BMC] getTocEntry called but cache not loaded\n", millis());
+  if (!tocLoaded) {
+    Serial.printf("[%lu] [BMC] getTocEntry called but TOC not loaded\n", millis());
     return {};
   }
 
@@ -327,19 +492,20 @@ BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
     return {};
   }
 
-  // Seek to TOC LUT item, read from LUT and get out data
-  bookFile.seek(lutOffset + sizeof(uint32_t) * spineCount + sizeof(uint32_t) * index);
+  // Seek to TOC LUT item (after the toc.bin header), read from LUT and get out data
+  tocCacheFile.seek(sizeof(TOC_CACHE_VERSION) + sizeof(spineCount) + sizeof(tocCount) + sizeof(uint32_t) * index);
   uint32_t tocEntryPos;
-  serialization::readPod(bookFile, tocEntryPos);
-  bookFile.seek(tocEntryPos);
-  return readTocEntry(bookFile);
+  serialization::readPod(tocCacheFile, tocEntryPos);
+  tocCacheFile.seek(tocEntryPos);
+  return readTocEntry(tocCacheFile);
 }
 
 BookMetadataCache::SpineEntry BookMetadataCache::readSpineEntry(FsFile& file) const {
   SpineEntry entry;
+  uint32_t cumulativeSize;
   serialization::readString(file, entry.href);
-  serialization::readPod(file, entry.cumulativeSize);
-  serialization::readPod(file, entry.tocIndex);
+  serialization::readPod(file, cumulativeSize);
+  entry.cumulativeSize = cumulativeSize;
   return entry;
 }
 
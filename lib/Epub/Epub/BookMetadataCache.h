@@ -3,6 +3,9 @@
 #include <SDCardManager.h>
 
 #include <string>
+#include <vector>
+
+class ZipFile;
 
 class BookMetadataCache {
  public:
@@ -11,6 +14,9 @@ class BookMetadataCache {
     std::string author;
     std::string coverItemHref;
     std::string textReferenceHref;
+    // Needed to build the TOC after the spine cache
+    std::string contentBasePath;
+    std::string tocNcxPath;
   };
 
   struct SpineEntry {
@@ -41,16 +47,39 @@ class BookMetadataCache {
 
  private:
   std::string cachePath;
-  size_t lutOffset;
+  uint32_t lutOffset;
   uint16_t spineCount;
   uint16_t tocCount;
   bool loaded;
+  bool tocLoaded;
   bool buildMode;
 
   FsFile bookFile;
+  FsFile tocCacheFile;
   // Temp file handles during build
   FsFile spineFile;
   FsFile tocFile;
+  // Hash of each spine href sorted by hash, built at the start of the TOC pass to resolve TOC hrefs to spine indexes
+  struct SpineHrefHash {
+    uint32_t hrefHash;
+    uint16_t spineIndex;
+  };
+  std::vector<SpineHrefHash> spineHrefHashes;
+  // Fixed-width spine fields kept in RAM while the book is open so progress math never touches the SD card,
+  // hrefs stay on disk and are only read on demand
+  struct SpineInfo {
+    uint32_t cumulativeSize;
+    uint32_t hrefHash;
+    int16_t tocIndex;
+  };
+  std::vector<SpineInfo> spineInfos;
+  std::vector<int16_t> tocSpineIndexes;
+
+  bool loadSpineTable();
+  bool buildTocBin();
+
+  void buildSpineHrefIndex();
+  int findSpineIndex(const std::string& href);
 
   uint32_t writeSpineEntry(FsFile& file, const SpineEntry& entry) const;
   uint32_t writeTocEntry(FsFile& file, const TocEntry& entry) const;
@@ -61,7 +90,13 @@ class BookMetadataCache {
   BookMetadata coreMetadata;
 
   explicit BookMetadataCache(std::string cachePath)
-      : cachePath(std::move(cachePath)), lutOffset(0), spineCount(0), tocCount(0), loaded(false), buildMode(false) {}
+      : cachePath(std::move(cachePath)),
+        lutOffset(0),
+        spineCount(0),
+        tocCount(0),
+        loaded(false),
+        tocLoaded(false),
+        buildMode(false) {}
   ~BookMetadataCache() = default;
 
   // Building phase (stream to disk immediately)
@@ -69,20 +104,30 @@ class BookMetadataCache {
   bool beginContentOpfPass();
   void createSpineEntry(const std::string& href);
   bool endContentOpfPass();
-  bool beginTocPass();
-  void createTocEntry(const std::string& title, const std::string& href, const std::string& anchor, uint8_t level);
-  bool endTocPass();
   bool endWrite();
   bool cleanupTmpFiles() const;
 
-  // Post-processing to update mappings and sizes
-  bool buildBookBin(const std::string& epubPath, const BookMetadata& metadata);
+  // Post-processing to update sizes
+  bool buildBookBin(ZipFile& zip, const BookMetadata& metadata);
+
+  // Deferred TOC pass, run against a loaded cache and persisted to toc.bin
+  bool beginTocPass();
+  void createTocEntry(const std::string& title, const std::string& href, const std::string& anchor, uint8_t level);
+  bool endTocPass();
 
   // Reading phase (read mode)
   bool load();
+  bool loadToc();
   SpineEntry getSpineEntry(int index);
   TocEntry getTocEntry(int index);
+  // Resident lookups, no SD access
+  size_t getCumulativeSpineSize(int index) const;
+  int16_t getTocIndexForSpine(int index) const;
+  int16_t getSpineIndexForToc(int index) const;
+  // Only reads the href of spine entries whose hash matches
+  int getSpineIndexForHref(const std::string& href);
   int getSpineCount() const { return spineCount; }
   int getTocCount() const { return tocCount; }
   bool isLoaded() const { return loaded; }
+  bool isTocLoaded() const { return tocLoaded; }
 };
@@ -0,0 +1,169 @@
+#include "BookPageIndex.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+#include <Serialization.h>
+
+#include <algorithm>
+
+#include "BookStyles.h"
+#include "Epub.h"
+#include "Section.h"
+
+namespace {
+constexpr uint8_t PAGES_FILE_VERSION = 1;
+}  // namespace
+
+void BookPageIndex::selectLayout(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                                 const uint16_t viewportWidth, const uint16_t viewportHeight) {
+  filePath = Section::getLayoutDir(*epub, fontId, lineCompression, extraParagraphSpacing, viewportWidth,
+                                   viewportHeight) +
+             "/pages.bin";
+}
+
+bool BookPageIndex::load(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                         const uint16_t viewportWidth, const uint16_t viewportHeight) {
+  chapterStarts.clear();
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
+
+  FsFile file;
+  if (!SdMan.exists(filePath.c_str()) || !SdMan.openFileForRead("BPI", filePath, file)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint8_t sectionVersion;
+  uint16_t spineCount;
+  serialization::readPod(file, version);
+  serialization::readPod(file, sectionVersion);
+  serialization::readPod(file, spineCount);
+  // Section files of another version are rebuilt with page counts the index doesn't know about
+  if (version != PAGES_FILE_VERSION || sectionVersion != Section::getFileVersion() ||
+      spineCount != epub->getSpineItemsCount() ||
+      file.size() != sizeof(version) + sizeof(sectionVersion) + sizeof(spineCount) +
+                         sizeof(uint32_t) * (spineCount + 1)) {
+    Serial.printf("[%lu] [BPI] Ignoring outdated or damaged page index\n", millis());
+    file.close();
+    SdMan.remove(filePath.c_str());
+    return false;
+  }
+
+  chapterStarts.resize(spineCount + 1);
+  for (auto& start : chapterStarts) {
+    serialization::readPod(file, start);
+  }
+  file.close();
+
+  if (!std::is_sorted(chapterStarts.begin(), chapterStarts.end())) {
+    Serial.printf("[%lu] [BPI] Ignoring damaged page index\n", millis());
+    clear();
+    return false;
+  }
+  Serial.printf("[%lu] [BPI] Loaded page index: %u pages\n", millis(), static_cast<unsigned>(getPageCount()));
+  return true;
+}
+
+bool BookPageIndex::build(GfxRenderer& renderer, const int fontId, const float lineCompression,
+                          const bool extraParagraphSpacing, const uint16_t viewportWidth,
+                          const uint16_t viewportHeight, const std::function<void(int)>& progressFn) {
+  const unsigned long start = millis();
+  chapterStarts.clear();
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
+
+  // Loaded once for all the chapters that have to be parsed, an empty table lays them out without styles
+  BookStyles styles;
+  if (!styles.load(epub->getStylesPath())) {
+    Serial.printf("[%lu] [BPI] No style table, indexing without styles\n", millis());
+  }
+
+  const int spineCount = epub->getSpineItemsCount();
+  const size_t bookSize = epub->getBookSize();
+  std::vector<uint32_t> starts;
+  starts.reserve(spineCount + 1);
+  uint32_t pages = 0;
+  int lastProgress = -1;
+  int chaptersBuilt = 0;
+
+  for (int spineIndex = 0; spineIndex < spineCount; spineIndex++) {
+    starts.push_back(pages);
+
+    const size_t doneSize = spineIndex > 0 ? epub->getCumulativeSpineItemSize(spineIndex - 1) : 0;
+    const size_t chapterSize = epub->getCumulativeSpineItemSize(spineIndex) - doneSize;
+    const auto reportProgress = [&](const int chapterProgress) {
+      if (!progressFn || bookSize == 0) {
+        return;
+      }
+      const int progress =
+          static_cast<int>((doneSize + static_cast<uint64_t>(chapterSize) * chapterProgress / 100) * 100 / bookSize);
+      if (progress != lastProgress) {
+        lastProgress = progress;
+        progressFn(progress);
+      }
+    };
+
+    // Only one chapter's build is held at a time, its section is done with before the next one starts
+    Section section(epub, spineIndex, renderer);
+    section.setSharedStyles(&styles);
+    if (section.loadSectionFile(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight)) {
+      pages += section.pageCount;
+    } else if (section.createSectionFile(fontId, lineCompression, extraParagraphSpacing, viewportWidth,
+                                         viewportHeight, nullptr, reportProgress)) {
+      pages += section.pageCount;
+      chaptersBuilt++;
+    } else {
+      Serial.printf("[%lu] [BPI] Failed to build section %d, counting it as empty\n", millis(), spineIndex);
+    }
+    reportProgress(100);
+  }
+  starts.push_back(pages);
+
+  FsFile file;
+  if (!SdMan.openFileForWrite("BPI", filePath, file)) {
+    return false;
+  }
+  serialization::writePod(file, PAGES_FILE_VERSION);
+  serialization::writePod(file, Section::getFileVersion());
+  serialization::writePod(file, static_cast<uint16_t>(spineCount));
+  for (const auto chapterStart : starts) {
+    serialization::writePod(file, chapterStart);
+  }
+  file.close();
+
+  chapterStarts = std::move(starts);
+  Serial.printf("[%lu] [BPI] Indexed %d chapters (%d built) in %lums: %u pages\n", millis(), spineCount,
+                chaptersBuilt, millis() - start, static_cast<unsigned>(pages));
+  return true;
+}
+
+void BookPageIndex::clear() {
+  chapterStarts.clear();
+  chapterStarts.shrink_to_fit();
+  if (!filePath.empty() && SdMan.exists(filePath.c_str())) {
+    SdMan.remove(filePath.c_str());
+  }
+}
+
+uint32_t BookPageIndex::getChapterPageCount(const int spineIndex) const {
+  if (spineIndex < 0 || spineIndex + 1 >= static_cast<int>(chapterStarts.size())) {
+    return 0;
+  }
+  return chapterStarts[spineIndex + 1] - chapterStarts[spineIndex];
+}
+
+uint32_t BookPageIndex::getBookPage(const int spineIndex, const int page) const {
+  if (spineIndex < 0 || spineIndex + 1 >= static_cast<int>(chapterStarts.size())) {
+    return 0;
+  }
+  return chapterStarts[spineIndex] + page;
+}
+
+bool BookPageIndex::findPage(const uint32_t bookPage, int* spineIndex, int* page) const {
+  if (bookPage >= getPageCount()) {
+    return false;
+  }
+  // The last chapter starting at or before the page, chapters without pages start where the next one does
+  const auto it = std::upper_bound(chapterStarts.begin(), chapterStarts.end(), bookPage) - 1;
+  *spineIndex = static_cast<int>(it - chapterStarts.begin());
+  *page = static_cast<int>(bookPage - *it);
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Epub;
+class GfxRenderer;
+
+// Book-wide page numbers for one layout. Indexing the book lays out every chapter that isn't already (one after the
+// other, sharing the book's styles) and keeps the page each chapter starts on in sections/<layout>/pages.bin, so a
+// page of a chapter can be given its page in the book and a page of the book found in its chapter with a binary search.
+class BookPageIndex {
+  std::shared_ptr<Epub> epub;
+  // pages.bin in the layout's directory, set by load or build
+  std::string filePath;
+  // Book page each spine item starts on, followed by the number of pages in the book. Empty if not indexed.
+  std::vector<uint32_t> chapterStarts;
+
+  void selectLayout(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
+                    uint16_t viewportHeight);
+
+ public:
+  explicit BookPageIndex(const std::shared_ptr<Epub>& epub) : epub(epub) {}
+
+  // Loads the index of a book indexed before in this layout, false if it hasn't been
+  bool load(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
+            uint16_t viewportHeight);
+  // Paginates every chapter in this layout and writes the index. Chapters that fail to build count as having no pages.
+  // progressFn is given the share of the book done so far (0-100).
+  bool build(GfxRenderer& renderer, int fontId, float lineCompression, bool extraParagraphSpacing,
+             uint16_t viewportWidth, uint16_t viewportHeight, const std::function<void(int)>& progressFn = nullptr);
+  // Forgets the index and removes its file, e.g. once a chapter turns out to have a different page count
+  void clear();
+
+  bool isLoaded() const { return !chapterStarts.empty(); }
+  uint32_t getPageCount() const { return isLoaded() ? chapterStarts.back() : 0; }
+  uint32_t getChapterPageCount(int spineIndex) const;
+  // Page of the book that is this page of a chapter, counting from 0
+  uint32_t getBookPage(int spineIndex, int page) const;
+  // Chapter and page in it of a page of the book, false if it is past the end of the book
+  bool findPage(uint32_t bookPage, int* spineIndex, int* page) const;
+};
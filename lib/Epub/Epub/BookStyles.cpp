@@ -0,0 +1,185 @@
+#include "BookStyles.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr uint8_t CSS_FILE_VERSION = 1;
+// Rules are held in memory while the stylesheets are parsed and while a chapter is, generated stylesheets can have
+// thousands of selectors that are mostly never matched by anything the reader lays out
+constexpr size_t MAX_RULES = 2048;
+constexpr uint32_t RULE_RECORD_SIZE = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint8_t);
+
+// FNV-1a, only used to look up selectors. A collision applies a rule to the wrong element, rare enough with the few
+// hundred selectors of a book to not be worth storing the selectors themselves.
+constexpr uint32_t FNV_OFFSET = 2166136261u;
+
+uint32_t hashBytes(uint32_t hash, const char* s, const size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(s[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool isClassSeparator(const char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+}  // namespace
+
+void CssStyle::apply(const CssStyle& other) {
+  if (other.flags & HAS_BOLD) {
+    flags = (flags & ~BOLD) | (other.flags & (HAS_BOLD | BOLD));
+  }
+  if (other.flags & HAS_ITALIC) {
+    flags = (flags & ~ITALIC) | (other.flags & (HAS_ITALIC | ITALIC));
+  }
+  if (other.flags & HAS_ALIGN) {
+    flags |= HAS_ALIGN;
+    align = other.align;
+  }
+  if (other.flags & HAS_DISPLAY) {
+    flags = (flags & ~HIDDEN) | (other.flags & (HAS_DISPLAY | HIDDEN));
+  }
+}
+
+void BookStyles::Builder::addRule(const char* selector, const size_t length, const CssStyle& style) {
+  if (style.isEmpty()) {
+    return;
+  }
+  if (rules.size() >= MAX_RULES) {
+    Serial.printf("[%lu] [CSS] Too many style rules, ignoring %.*s\n", millis(), static_cast<int>(length), selector);
+    return;
+  }
+  rules.push_back({hashBytes(FNV_OFFSET, selector, length), style});
+}
+
+bool BookStyles::Builder::write(const std::string& path) {
+  // Stable, so rules for the same selector stay in stylesheet order and later ones win when merged
+  std::stable_sort(rules.begin(), rules.end(),
+                   [](const Rule& a, const Rule& b) { return a.selectorHash < b.selectorHash; });
+  std::vector<Rule> merged;
+  merged.reserve(rules.size());
+  for (const auto& rule : rules) {
+    if (!merged.empty() && merged.back().selectorHash == rule.selectorHash) {
+      merged.back().style.apply(rule.style);
+    } else {
+      merged.push_back(rule);
+    }
+  }
+  rules.clear();
+  rules.shrink_to_fit();
+
+  FsFile file;
+  if (!SdMan.openFileForWrite("CSS", path, file)) {
+    return false;
+  }
+  serialization::writePod(file, CSS_FILE_VERSION);
+  serialization::writePod(file, static_cast<uint16_t>(merged.size()));
+  for (const auto& rule : merged) {
+    serialization::writePod(file, rule.selectorHash);
+    serialization::writePod(file, rule.style.flags);
+    serialization::writePod(file, static_cast<uint8_t>(rule.style.align));
+  }
+  const bool written = file.size() == sizeof(CSS_FILE_VERSION) + sizeof(uint16_t) + merged.size() * RULE_RECORD_SIZE;
+  file.close();
+  if (!written) {
+    Serial.printf("[%lu] [CSS] Failed to write %s\n", millis(), path.c_str());
+    SdMan.remove(path.c_str());
+    return false;
+  }
+  Serial.printf("[%lu] [CSS] Wrote %u style rules\n", millis(), static_cast<unsigned>(merged.size()));
+  return true;
+}
+
+bool BookStyles::isCurrent(const std::string& path) {
+  FsFile file;
+  if (!SdMan.exists(path.c_str()) || !SdMan.openFileForRead("CSS", path, file)) {
+    return false;
+  }
+  uint8_t version = 0;
+  serialization::readPod(file, version);
+  file.close();
+  return version == CSS_FILE_VERSION;
+}
+
+bool BookStyles::load(const std::string& path) {
+  rules.clear();
+  FsFile file;
+  if (!SdMan.openFileForRead("CSS", path, file)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint16_t count;
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  if (version != CSS_FILE_VERSION || count > MAX_RULES ||
+      file.size() != sizeof(version) + sizeof(count) + count * RULE_RECORD_SIZE) {
+    Serial.printf("[%lu] [CSS] Ignoring unknown or damaged style table (version %u)\n", millis(), version);
+    file.close();
+    return false;
+  }
+
+  rules.resize(count);
+  for (auto& rule : rules) {
+    uint8_t align;
+    serialization::readPod(file, rule.selectorHash);
+    serialization::readPod(file, rule.style.flags);
+    serialization::readPod(file, align);
+    rule.style.align = static_cast<TextBlock::Style>(align);
+  }
+  file.close();
+  return true;
+}
+
+const CssStyle* BookStyles::find(const uint32_t selectorHash) const {
+  const auto it = std::lower_bound(rules.begin(), rules.end(), selectorHash,
+                                   [](const Rule& rule, const uint32_t hash) { return rule.selectorHash < hash; });
+  return it != rules.end() && it->selectorHash == selectorHash ? &it->style : nullptr;
+}
+
+CssStyle BookStyles::resolve(const char* tag, const char* classAttr, const char* id) const {
+  CssStyle style;
+  if (rules.empty()) {
+    return style;
+  }
+
+  const uint32_t tagHash = hashBytes(FNV_OFFSET, tag, strlen(tag));
+  if (const auto* rule = find(tagHash)) {
+    style.apply(*rule);
+  }
+
+  if (classAttr) {
+    // .class for every class first, then tag.class, which is more specific
+    const uint32_t dotHash = hashBytes(FNV_OFFSET, ".", 1);
+    const uint32_t tagDotHash = hashBytes(tagHash, ".", 1);
+    for (const uint32_t prefixHash : {dotHash, tagDotHash}) {
+      const char* c = classAttr;
+      while (*c) {
+        while (isClassSeparator(*c)) {
+          c++;
+        }
+        const char* end = c;
+        while (*end && !isClassSeparator(*end)) {
+          end++;
+        }
+        if (end > c) {
+          if (const auto* rule = find(hashBytes(prefixHash, c, end - c))) {
+            style.apply(*rule);
+          }
+        }
+        c = end;
+      }
+    }
+  }
+
+  if (id && *id) {
+    if (const auto* rule = find(hashBytes(hashBytes(FNV_OFFSET, "#", 1), id, strlen(id)))) {
+      style.apply(*rule);
+    }
+  }
+  return style;
+}
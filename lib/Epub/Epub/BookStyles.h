@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "blocks/TextBlock.h"
+
+// What a CSS rule says about an element, limited to what the page builder can honour. Each property is only applied
+// if the rule sets it, so rules can be layered from least to most specific.
+struct CssStyle {
+  enum : uint8_t {
+    HAS_BOLD = 1 << 0,
+    BOLD = 1 << 1,
+    HAS_ITALIC = 1 << 2,
+    ITALIC = 1 << 3,
+    HAS_ALIGN = 1 << 4,
+    HAS_DISPLAY = 1 << 5,
+    HIDDEN = 1 << 6,  // display: none
+  };
+  uint8_t flags = 0;
+  TextBlock::Style align = TextBlock::JUSTIFIED;
+
+  bool isEmpty() const { return flags == 0; }
+  // Properties set by the other style override these
+  void apply(const CssStyle& other);
+};
+
+// The book's stylesheets compiled down to a table from simple selectors (tag, .class, tag.class and #id) to styles,
+// written to css.bin when the book is first loaded so chapters don't read any CSS while they are parsed. Selectors are
+// kept as hashes, resolving an element is a binary search per selector it could match.
+class BookStyles {
+  struct Rule {
+    uint32_t selectorHash;
+    CssStyle style;
+  };
+  std::vector<Rule> rules;
+
+  const CssStyle* find(uint32_t selectorHash) const;
+
+ public:
+  // Collects rules while the stylesheets are parsed, in stylesheet order
+  class Builder {
+    std::vector<Rule> rules;
+
+   public:
+    // Selector is one of tag, .class, tag.class or #id
+    void addRule(const char* selector, size_t length, const CssStyle& style);
+    size_t size() const { return rules.size(); }
+    // Rules for the same selector are merged, later ones overriding earlier ones
+    bool write(const std::string& path);
+  };
+
+  bool load(const std::string& path);
+  bool isEmpty() const { return rules.empty(); }
+  size_t size() const { return rules.size(); }
+  // Whether the file is a table this firmware can read, books cached without one are loaded again to compile it
+  static bool isCurrent(const std::string& path);
+
+  // Layers the rules matching an element from least to most specific: tag, .class, tag.class, #id. The class attribute
+  // may list several classes separated by whitespace, id and classAttr may be null.
+  CssStyle resolve(const char* tag, const char* classAttr, const char* id) const;
+};
@@ -0,0 +1,168 @@
+#include "ChapterPageBuilder.h"
+
+#include <GfxRenderer.h>
+#include <HardwareSerial.h>
+
+#include "Page.h"
+
+ChapterPageBuilder::ChapterPageBuilder(GfxRenderer& renderer, const int fontId, const float lineCompression,
+                                       const bool extraParagraphSpacing, const uint16_t viewportWidth,
+                                       const uint16_t viewportHeight,
+                                       const std::function<void(std::unique_ptr<Page>)>& completePageFn,
+                                       const std::function<void(const std::string& id, uint16_t page)>& anchorFn,
+                                       const std::function<std::unique_ptr<PageImage>(const std::string& src)>& imageFn)
+    : renderer(renderer),
+      fontId(fontId),
+      lineCompression(lineCompression),
+      extraParagraphSpacing(extraParagraphSpacing),
+      viewportWidth(viewportWidth),
+      viewportHeight(viewportHeight),
+      completePageFn(completePageFn),
+      anchorFn(anchorFn),
+      imageFn(imageFn) {}
+
+ChapterPageBuilder::~ChapterPageBuilder() = default;
+
+// start a new text block if needed
+void ChapterPageBuilder::startNewTextBlock(const TextBlock::Style style) {
+  if (currentTextBlock) {
+    // already have a text block running and it is empty - just reuse it
+    if (currentTextBlock->isEmpty()) {
+      currentTextBlock->setStyle(style);
+      return;
+    }
+
+    makePages();
+    // Laying it out used up all of its words, its buffers are kept for this one
+    currentTextBlock->setStyle(style);
+  } else {
+    currentTextBlock.reset(new ParsedText(style, extraParagraphSpacing));
+  }
+
+  // Anchors after the last word of the previous text block land with the first word of this one
+  for (auto& anchor : pendingAnchors) {
+    anchor.word = 0;
+  }
+  textBlockWords = 0;
+}
+
+void ChapterPageBuilder::addWord(const char* word, const size_t length, const EpdFontFamily::Style fontStyle) {
+  if (length == 0) {
+    return;
+  }
+  currentTextBlock->addWord(word, length, fontStyle);
+  textBlockWords++;
+}
+
+void ChapterPageBuilder::addAnchor(std::string id) {
+  if (anchorFn && !id.empty()) {
+    pendingAnchors.push_back({std::move(id), textBlockWords});
+  }
+}
+
+void ChapterPageBuilder::resolveAnchors(const size_t wordsLaidOut) {
+  if (pendingAnchors.empty()) {
+    return;
+  }
+  auto it = pendingAnchors.begin();
+  while (it != pendingAnchors.end()) {
+    if (it->word < wordsLaidOut) {
+      anchorFn(it->id, completedPages);
+      it = pendingAnchors.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ChapterPageBuilder::addImage(const std::string& src) {
+  if (!imageFn) {
+    return;
+  }
+  auto image = imageFn(src);
+  if (!image) {
+    return;
+  }
+
+  if (!currentPage) {
+    currentPage.reset(new Page());
+    currentPageNextY = 0;
+  }
+  if (currentPageNextY > 0 && currentPageNextY + image->height > viewportHeight) {
+    completePageFn(std::move(currentPage));
+    currentPage.reset(new Page());
+    currentPageNextY = 0;
+    completedPages++;
+  }
+  // Anchors since the last text block was laid out were on or before the image
+  resolveAnchors(SIZE_MAX);
+
+  image->xPos = (viewportWidth - image->width) / 2;
+  image->yPos = currentPageNextY;
+  currentPageNextY += image->height;
+  currentPage->elements.push_back(std::move(image));
+}
+
+void ChapterPageBuilder::layoutLongTextBlock() {
+  // Perform the layout and consume out all but the last line, there should be enough here to build out 1-2 full pages
+  // and doing this will free up a lot of memory
+  if (currentTextBlock->size() > MAX_TEXT_BLOCK_WORDS) {
+    Serial.printf("[%lu] [CPB] Text block too long, splitting into multiple pages\n", millis());
+    if (!currentPage) {
+      currentPage.reset(new Page());
+      currentPageNextY = 0;
+    }
+    currentTextBlock->layoutAndExtractLines(
+        renderer, fontId, viewportWidth,
+        [this](const std::shared_ptr<TextBlock>& textBlock) { addLineToPage(textBlock); }, false);
+  }
+}
+
+void ChapterPageBuilder::finish() {
+  // Process last page if there is still text
+  if (currentTextBlock) {
+    makePages();
+    // Anchors with no words after them land on the last page
+    resolveAnchors(SIZE_MAX);
+    completePageFn(std::move(currentPage));
+    currentPage.reset();
+    currentTextBlock.reset();
+  }
+}
+
+void ChapterPageBuilder::addLineToPage(std::shared_ptr<TextBlock> line) {
+  const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
+
+  if (currentPageNextY + lineHeight > viewportHeight) {
+    completePageFn(std::move(currentPage));
+    currentPage.reset(new Page());
+    currentPageNextY = 0;
+    completedPages++;
+  }
+  // The line's words have already been taken out of the text block
+  resolveAnchors(textBlockWords - currentTextBlock->size());
+
+  currentPage->elements.push_back(std::make_shared<PageLine>(line, 0, currentPageNextY));
+  currentPageNextY += lineHeight;
+}
+
+void ChapterPageBuilder::makePages() {
+  if (!currentTextBlock) {
+    Serial.printf("[%lu] [CPB] !! No text block to make pages for !!\n", millis());
+    return;
+  }
+
+  if (!currentPage) {
+    currentPage.reset(new Page());
+    currentPageNextY = 0;
+  }
+
+  const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
+  currentTextBlock->layoutAndExtractLines(
+      renderer, fontId, viewportWidth,
+      [this](const std::shared_ptr<TextBlock>& textBlock) { addLineToPage(textBlock); });
+  // Extra paragraph spacing if enabled
+  if (extraParagraphSpacing) {
+    currentPageNextY += lineHeight / 2;
+  }
+}
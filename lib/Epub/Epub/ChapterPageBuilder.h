@@ -0,0 +1,75 @@
+#pragma once
+
+#include <EpdFontFamily.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ParsedText.h"
+#include "blocks/TextBlock.h"
+
+class Page;
+class PageImage;
+class GfxRenderer;
+
+// Lays a chapter's words out into pages, one text block (paragraph, heading, ...) at a time. It is fed either by the
+// XHTML parser or by replaying the tokens the parser recorded, so both produce exactly the same pages.
+class ChapterPageBuilder {
+  GfxRenderer& renderer;
+  int fontId;
+  float lineCompression;
+  bool extraParagraphSpacing;
+  uint16_t viewportWidth;
+  uint16_t viewportHeight;
+  std::function<void(std::unique_ptr<Page>)> completePageFn;
+  std::function<void(const std::string& id, uint16_t page)> anchorFn;
+  std::function<std::unique_ptr<PageImage>(const std::string& src)> imageFn;
+  // Reused from one text block to the next, only reset at the end of the chapter
+  std::unique_ptr<ParsedText> currentTextBlock;
+  std::unique_ptr<Page> currentPage;
+  int16_t currentPageNextY = 0;
+  uint16_t completedPages = 0;
+  // Words added to the current text block, the ones not still in it have been laid out
+  size_t textBlockWords = 0;
+  // Anchors land on the page of the word that follows them, which isn't known until that word is laid out
+  struct PendingAnchor {
+    std::string id;
+    size_t word;
+  };
+  std::vector<PendingAnchor> pendingAnchors;
+
+  void makePages();
+  void addLineToPage(std::shared_ptr<TextBlock> line);
+  void resolveAnchors(size_t wordsLaidOut);
+
+ public:
+  // Text blocks with more words than this are laid out early, all but their last line, to bound memory use.
+  // Spotted when reading Intermezzo, there are some really long text blocks in there.
+  static constexpr size_t MAX_TEXT_BLOCK_WORDS = 750;
+
+  explicit ChapterPageBuilder(GfxRenderer& renderer, const int fontId, const float lineCompression,
+                              const bool extraParagraphSpacing, const uint16_t viewportWidth,
+                              const uint16_t viewportHeight,
+                              const std::function<void(std::unique_ptr<Page>)>& completePageFn,
+                              const std::function<void(const std::string& id, uint16_t page)>& anchorFn = nullptr,
+                              const std::function<std::unique_ptr<PageImage>(const std::string& src)>& imageFn =
+                                  nullptr);
+  ~ChapterPageBuilder();
+
+  // Lays out the current text block (unless it is still empty, then it is reused) and starts a new one
+  void startNewTextBlock(TextBlock::Style style);
+  TextBlock::Style getTextBlockStyle() const { return currentTextBlock->getStyle(); }
+  // The word is copied, it doesn't need to outlive the call
+  void addWord(const char* word, size_t length, EpdFontFamily::Style fontStyle);
+  // Marks where an element with this id starts, its page is reported through anchorFn once it is known
+  void addAnchor(std::string id);
+  // Places an image below the laid out text, on a page of its own if it doesn't fit. The image comes from imageFn,
+  // which fits it in the viewport and returns nullptr if it can't be shown. Call between text blocks.
+  void addImage(const std::string& src);
+  // Lays out all but the last line of the current text block if it has grown past MAX_TEXT_BLOCK_WORDS
+  void layoutLongTextBlock();
+  // Lays out what is left and completes the last page
+  void finish();
+};
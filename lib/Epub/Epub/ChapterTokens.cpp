@@ -0,0 +1,233 @@
+#include "ChapterTokens.h"
+
+#include <HardwareSerial.h>
+#include <Serialization.h>
+
+#include <cstring>
+
+#include "ChapterPageBuilder.h"
+#include "parsers/ChapterHtmlSlimParser.h"
+
+namespace {
+constexpr uint8_t TOKENS_FILE_VERSION = 4;
+constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+
+// Minimum stream size (in bytes) to show progress bar - smaller chapters don't benefit from it
+constexpr uint32_t MIN_SIZE_FOR_PROGRESS = 50 * 1024;  // 50KB
+
+// Word: the tag is its font style, followed by a u8 length and the word's bytes
+constexpr uint8_t TOKEN_WORD = 0x00;
+// Most words are short enough for their length to fit in the tag: 1ssLLLLL, followed by the word's bytes
+constexpr uint8_t TOKEN_SHORT_WORD = 0x80;
+constexpr size_t MAX_SHORT_WORD_SIZE = 0x1F;
+// New text block: the low bits are its alignment
+constexpr uint8_t TOKEN_TEXT_BLOCK = 0x10;
+// The parser checked whether the text block had grown too long (see ChapterPageBuilder::layoutLongTextBlock)
+constexpr uint8_t TOKEN_LONG_TEXT_BLOCK_CHECK = 0x20;
+// An element's id, followed by a u8 length and the id's bytes
+constexpr uint8_t TOKEN_ANCHOR = 0x30;
+// An image's src as written in the chapter, followed by a u8 length and its bytes
+constexpr uint8_t TOKEN_IMAGE = 0x40;
+
+// Entities only ever shrink a word, so a word the parser cut off at MAX_WORD_SIZE always fits the length byte
+static_assert(MAX_WORD_SIZE <= UINT8_MAX, "Word length must fit in a byte");
+// Tag, length and the longest word
+constexpr size_t MAX_TOKEN_SIZE = 2 + UINT8_MAX;
+}  // namespace
+
+void ChapterTokenWriter::put(const void* data, const size_t length) {
+  if (bufferLength + length > sizeof(buffer)) {
+    flush();
+  }
+  memcpy(buffer + bufferLength, data, length);
+  bufferLength += length;
+  streamSize += length;
+}
+
+void ChapterTokenWriter::flush() {
+  if (bufferLength > 0 && file.write(buffer, bufferLength) != bufferLength) {
+    failed = true;
+  }
+  bufferLength = 0;
+}
+
+void ChapterTokenWriter::begin() {
+  serialization::writePod(file, TOKENS_FILE_VERSION);
+  serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for stream size
+}
+
+void ChapterTokenWriter::textBlock(const TextBlock::Style style) {
+  const uint8_t tag = TOKEN_TEXT_BLOCK | style;
+  put(&tag, sizeof(tag));
+}
+
+void ChapterTokenWriter::word(const char* word, const size_t length, const EpdFontFamily::Style fontStyle) {
+  if (length == 0) {
+    return;
+  }
+  if (length > UINT8_MAX) {
+    Serial.printf("[%lu] [CTK] Word too long to record (%u bytes)\n", millis(), static_cast<unsigned>(length));
+    failed = true;
+    return;
+  }
+  if (length <= MAX_SHORT_WORD_SIZE) {
+    const uint8_t tag = TOKEN_SHORT_WORD | fontStyle << 5 | length;
+    put(&tag, sizeof(tag));
+  } else {
+    const uint8_t header[] = {static_cast<uint8_t>(TOKEN_WORD | fontStyle), static_cast<uint8_t>(length)};
+    put(header, sizeof(header));
+  }
+  put(word, length);
+}
+
+void ChapterTokenWriter::anchor(const std::string& id) {
+  if (id.size() > UINT8_MAX) {
+    Serial.printf("[%lu] [CTK] Anchor too long to record (%u bytes)\n", millis(), static_cast<unsigned>(id.size()));
+    failed = true;
+    return;
+  }
+  const uint8_t header[] = {TOKEN_ANCHOR, static_cast<uint8_t>(id.size())};
+  put(header, sizeof(header));
+  put(id.data(), id.size());
+}
+
+void ChapterTokenWriter::image(const std::string& src) {
+  if (src.size() > UINT8_MAX) {
+    Serial.printf("[%lu] [CTK] Image src too long to record (%u bytes)\n", millis(), static_cast<unsigned>(src.size()));
+    failed = true;
+    return;
+  }
+  const uint8_t header[] = {TOKEN_IMAGE, static_cast<uint8_t>(src.size())};
+  put(header, sizeof(header));
+  put(src.data(), src.size());
+}
+
+void ChapterTokenWriter::longTextBlockCheck() {
+  const uint8_t tag = TOKEN_LONG_TEXT_BLOCK_CHECK;
+  put(&tag, sizeof(tag));
+}
+
+bool ChapterTokenWriter::finish() {
+  flush();
+  if (failed) {
+    return false;
+  }
+  file.seek(sizeof(TOKENS_FILE_VERSION));
+  serialization::writePod(file, streamSize);
+  return true;
+}
+
+void ChapterTokenReplayer::reportProgress() {
+  // Update progress (call every 10% change to avoid too frequent updates)
+  // Only show progress for larger chapters where rendering overhead is worth it
+  if (!progressFn || streamSize < MIN_SIZE_FOR_PROGRESS) {
+    return;
+  }
+  const int progress = static_cast<int>((static_cast<uint64_t>(file.position() - HEADER_SIZE) * 100) / streamSize);
+  if (lastProgress / 10 != progress / 10) {
+    lastProgress = progress;
+    progressFn(progress);
+  }
+}
+
+void ChapterTokenReplayer::refill() {
+  // Keeps at least a whole token buffered so tokens are decoded straight from the buffer
+  if (bufferLength - bufferPosition >= MAX_TOKEN_SIZE) {
+    return;
+  }
+  memmove(buffer, buffer + bufferPosition, bufferLength - bufferPosition);
+  bufferLength -= bufferPosition;
+  bufferPosition = 0;
+  const int len = file.read(buffer + bufferLength, sizeof(buffer) - bufferLength);
+  if (len > 0) {
+    bufferLength += len;
+    reportProgress();
+  }
+}
+
+bool ChapterTokenReplayer::begin() {
+  uint8_t version;
+  serialization::readPod(file, version);
+  serialization::readPod(file, streamSize);
+  // The stream size is written last, a file without the right one was never finished
+  if (version != TOKENS_FILE_VERSION || streamSize == 0 || streamSize != file.size() - HEADER_SIZE) {
+    Serial.printf("[%lu] [CTK] Ignoring unknown or incomplete tokens file (version %u)\n", millis(), version);
+    return false;
+  }
+
+  bytesRead = 0;
+  lastProgress = -1;
+  bufferLength = 0;
+  bufferPosition = 0;
+  return true;
+}
+
+bool ChapterTokenReplayer::replayNext(const size_t maxBytes, bool* done) {
+  *done = false;
+
+  const uint32_t sliceStart = bytesRead;
+  while (bytesRead < streamSize && bytesRead - sliceStart < maxBytes) {
+    refill();
+    const uint8_t* token = buffer + bufferPosition;
+    const size_t available = bufferLength - bufferPosition;
+    if (available == 0) {
+      Serial.printf("[%lu] [CTK] Tokens read error\n", millis());
+      return false;
+    }
+
+    size_t tokenSize = 1;
+    const uint8_t tag = token[0];
+    if (tag & TOKEN_SHORT_WORD) {
+      const size_t length = tag & MAX_SHORT_WORD_SIZE;
+      if (available < 1 + length) {
+        Serial.printf("[%lu] [CTK] Bad word token\n", millis());
+        return false;
+      }
+      tokenSize = 1 + length;
+      pages.addWord(reinterpret_cast<const char*>(token + 1), length,
+                    static_cast<EpdFontFamily::Style>((tag >> 5) & 0x03));
+    } else if ((tag & ~0x03) == TOKEN_WORD) {
+      if (available < 2 || available < 2 + token[1]) {
+        Serial.printf("[%lu] [CTK] Bad word token\n", millis());
+        return false;
+      }
+      tokenSize = 2 + token[1];
+      pages.addWord(reinterpret_cast<const char*>(token + 2), token[1], static_cast<EpdFontFamily::Style>(tag));
+    } else if ((tag & ~0x03) == TOKEN_TEXT_BLOCK) {
+      pages.startNewTextBlock(static_cast<TextBlock::Style>(tag & 0x03));
+    } else if (tag == TOKEN_LONG_TEXT_BLOCK_CHECK) {
+      pages.layoutLongTextBlock();
+    } else if (tag == TOKEN_ANCHOR) {
+      if (available < 2 || available < 2 + token[1]) {
+        Serial.printf("[%lu] [CTK] Bad anchor token\n", millis());
+        return false;
+      }
+      tokenSize = 2 + token[1];
+      pages.addAnchor(std::string(reinterpret_cast<const char*>(token + 2), token[1]));
+    } else if (tag == TOKEN_IMAGE) {
+      if (available < 2 || available < 2 + token[1]) {
+        Serial.printf("[%lu] [CTK] Bad image token\n", millis());
+        return false;
+      }
+      tokenSize = 2 + token[1];
+      pages.addImage(std::string(reinterpret_cast<const char*>(token + 2), token[1]));
+    } else {
+      Serial.printf("[%lu] [CTK] Unknown token 0x%02x\n", millis(), tag);
+      return false;
+    }
+    bufferPosition += tokenSize;
+    bytesRead += tokenSize;
+  }
+
+  if (bytesRead > streamSize) {
+    Serial.printf("[%lu] [CTK] Token overruns the end of the stream\n", millis());
+    return false;
+  }
+  if (bytesRead < streamSize) {
+    return true;
+  }
+
+  pages.finish();
+  *done = true;
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <EpdFontFamily.h>
+#include <SdFat.h>
+
+#include <functional>
+#include <string>
+
+#include "blocks/TextBlock.h"
+
+class ChapterPageBuilder;
+
+// A chapter boiled down to what the page builder is fed: text blocks, words and their styles, anchors and images.
+// Laying a chapter out again (another font, orientation, spacing) replays these instead of inflating and parsing its
+// XHTML. Images are recorded by src, each layout decodes them to its own size.
+
+// Records tokens to a file, buffered so each word isn't a separate SD card write
+class ChapterTokenWriter {
+  FsFile& file;
+  uint8_t buffer[256] = {};
+  size_t bufferLength = 0;
+  uint32_t streamSize = 0;
+  bool failed = false;
+
+  void put(const void* data, size_t length);
+  void flush();
+
+ public:
+  explicit ChapterTokenWriter(FsFile& file) : file(file) {}
+  ~ChapterTokenWriter() = default;
+
+  void begin();
+  void textBlock(TextBlock::Style style);
+  void word(const char* word, size_t length, EpdFontFamily::Style fontStyle);
+  void anchor(const std::string& id);
+  void image(const std::string& src);
+  void longTextBlockCheck();
+  // Writes the stream size into the header, which is what marks the file as complete. False if any write failed.
+  bool finish();
+};
+
+// Feeds a recorded chapter to a page builder, a slice at a time like the parser
+class ChapterTokenReplayer {
+  FsFile& file;
+  ChapterPageBuilder& pages;
+  std::function<void(int)> progressFn;  // Progress callback (0-100)
+  uint8_t buffer[512] = {};
+  size_t bufferLength = 0;
+  size_t bufferPosition = 0;
+  uint32_t streamSize = 0;
+  uint32_t bytesRead = 0;
+  int lastProgress = -1;
+
+  void reportProgress();
+  void refill();
+
+ public:
+  explicit ChapterTokenReplayer(FsFile& file, ChapterPageBuilder& pages,
+                                const std::function<void(int)>& progressFn = nullptr)
+      : file(file), pages(pages), progressFn(progressFn) {}
+  ~ChapterTokenReplayer() = default;
+
+  // False if the file is from another version or was never finished
+  bool begin();
+  // Replays at least maxBytes of tokens unless the chapter ends first, the last page is completed along with it
+  bool replayNext(size_t maxBytes, bool* done);
+  uint32_t getSize() const { return streamSize; }
+};
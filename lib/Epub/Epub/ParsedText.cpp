@@ -4,16 +4,21 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <limits>
 #include <vector>
 
 constexpr int MAX_COST = std::numeric_limits<int>::max();
 
-void ParsedText::addWord(std::string word, const EpdFontFamily::Style fontStyle) {
-  if (word.empty()) return;
+void ParsedText::addWord(const char* word, size_t length, const EpdFontFamily::Style fontStyle) {
+  // Words are null terminated in the arena, anything after a stray null byte wouldn't be shown anyway
+  length = strnlen(word, length);
+  if (length == 0) return;
 
-  words.push_back(std::move(word));
+  wordOffsets.push_back(wordText.size());
+  wordText.insert(wordText.end(), word, word + length);
+  wordText.push_back('\0');
   wordStyles.push_back(fontStyle);
 }
 
@@ -21,54 +26,47 @@ void ParsedText::addWord(std::string word, const EpdFontFamily::Style fontStyle)
 void ParsedText::layoutAndExtractLines(const GfxRenderer& renderer, const int fontId, const uint16_t viewportWidth,
                                        const std::function<void(std::shared_ptr<TextBlock>)>& processLine,
                                        const bool includeLastLine) {
-  if (words.empty()) {
+  if (isEmpty()) {
     return;
   }
 
   const int pageWidth = viewportWidth;
   const int spaceWidth = renderer.getSpaceWidth(fontId);
-  const auto wordWidths = calculateWordWidths(renderer, fontId);
-  const auto lineBreakIndices = computeLineBreaks(pageWidth, spaceWidth, wordWidths);
+  calculateWordWidths(renderer, fontId);
+  computeLineBreaks(pageWidth, spaceWidth);
   const size_t lineCount = includeLastLine ? lineBreakIndices.size() : lineBreakIndices.size() - 1;
 
   for (size_t i = 0; i < lineCount; ++i) {
-    extractLine(i, pageWidth, spaceWidth, wordWidths, lineBreakIndices, processLine);
+    extractLine(i, pageWidth, spaceWidth, processLine);
   }
+  removeConsumedWords();
 }
 
-std::vector<uint16_t> ParsedText::calculateWordWidths(const GfxRenderer& renderer, const int fontId) {
-  const size_t totalWordCount = words.size();
-
-  std::vector<uint16_t> wordWidths;
-  wordWidths.reserve(totalWordCount);
-
+void ParsedText::calculateWordWidths(const GfxRenderer& renderer, const int fontId) {
   // add em-space at the beginning of first word in paragraph to indent
   if (!extraParagraphSpacing) {
-    std::string& first_word = words.front();
-    first_word.insert(0, "\xe2\x80\x83");
+    constexpr char emSpace[] = "\xe2\x80\x83";
+    constexpr size_t emSpaceLength = sizeof(emSpace) - 1;
+    wordText.insert(wordText.begin(), emSpace, emSpace + emSpaceLength);
+    for (size_t i = 1; i < wordOffsets.size(); i++) {
+      wordOffsets[i] += emSpaceLength;
+    }
   }
 
-  auto wordsIt = words.begin();
-  auto wordStylesIt = wordStyles.begin();
-
-  while (wordsIt != words.end()) {
-    wordWidths.push_back(renderer.getTextWidth(fontId, wordsIt->c_str(), *wordStylesIt));
-
-    std::advance(wordsIt, 1);
-    std::advance(wordStylesIt, 1);
+  wordWidths.clear();
+  wordWidths.reserve(wordOffsets.size());
+  for (size_t i = 0; i < wordOffsets.size(); i++) {
+    wordWidths.push_back(renderer.getTextWidth(fontId, &wordText[wordOffsets[i]], wordStyles[i]));
   }
-
-  return wordWidths;
 }
 
-std::vector<size_t> ParsedText::computeLineBreaks(const int pageWidth, const int spaceWidth,
-                                                  const std::vector<uint16_t>& wordWidths) const {
-  const size_t totalWordCount = words.size();
+void ParsedText::computeLineBreaks(const int pageWidth, const int spaceWidth) {
+  const size_t totalWordCount = wordOffsets.size();
 
   // DP table to store the minimum badness (cost) of lines starting at index i
-  std::vector<int> dp(totalWordCount);
+  dp.resize(totalWordCount);
   // 'ans[i]' stores the index 'j' of the *last word* in the optimal line starting at 'i'
-  std::vector<size_t> ans(totalWordCount);
+  ans.resize(totalWordCount);
 
   // Base Case
   dp[totalWordCount - 1] = 0;
@@ -121,7 +119,7 @@ std::vector<size_t> ParsedText::computeLineBreaks(const int pageWidth, const int
   }
 
   // Stores the index of the word that starts the next line (last_word_index + 1)
-  std::vector<size_t> lineBreakIndices;
+  lineBreakIndices.clear();
   size_t currentWordIndex = 0;
 
   while (currentWordIndex < totalWordCount) {
@@ -136,12 +134,9 @@ std::vector<size_t> ParsedText::computeLineBreaks(const int pageWidth, const int
     lineBreakIndices.push_back(nextBreakIndex);
     currentWordIndex = nextBreakIndex;
   }
-
-  return lineBreakIndices;
 }
 
 void ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const int spaceWidth,
-                             const std::vector<uint16_t>& wordWidths, const std::vector<size_t>& lineBreakIndices,
                              const std::function<void(std::shared_ptr<TextBlock>)>& processLine) {
   const size_t lineBreak = lineBreakIndices[breakIndex];
   const size_t lastBreakAt = breakIndex > 0 ? lineBreakIndices[breakIndex - 1] : 0;
@@ -172,24 +167,39 @@ void ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const
   }
 
   // Pre-calculate X positions for words
-  std::list<uint16_t> lineXPos;
+  std::vector<uint16_t> lineXPos;
+  lineXPos.reserve(lineWordCount);
   for (size_t i = lastBreakAt; i < lineBreak; i++) {
     const uint16_t currentWordWidth = wordWidths[i];
     lineXPos.push_back(xpos);
     xpos += currentWordWidth + spacing;
   }
 
-  // Iterators always start at the beginning as we are moving content with splice below
-  auto wordEndIt = words.begin();
-  auto wordStyleEndIt = wordStyles.begin();
-  std::advance(wordEndIt, lineWordCount);
-  std::advance(wordStyleEndIt, lineWordCount);
+  // The line takes a copy of its range of the arena, the words count as consumed before it is handed on
+  const size_t textEnd = lineBreak < wordOffsets.size() ? wordOffsets[lineBreak] : wordText.size();
+  std::vector<char> lineText(wordText.begin() + wordOffsets[lastBreakAt], wordText.begin() + textEnd);
+  std::vector<EpdFontFamily::Style> lineWordStyles(wordStyles.begin() + lastBreakAt, wordStyles.begin() + lineBreak);
+  consumedWords = lineBreak;
+
+  processLine(std::make_shared<TextBlock>(std::move(lineText), std::move(lineXPos), std::move(lineWordStyles), style));
+}
 
-  // *** CRITICAL STEP: CONSUME DATA USING SPLICE ***
-  std::list<std::string> lineWords;
-  lineWords.splice(lineWords.begin(), words, words.begin(), wordEndIt);
-  std::list<EpdFontFamily::Style> lineWordStyles;
-  lineWordStyles.splice(lineWordStyles.begin(), wordStyles, wordStyles.begin(), wordStyleEndIt);
+// Moves the words that are left (the last line of a long text block laid out early) to the front of the buffers
+void ParsedText::removeConsumedWords() {
+  if (consumedWords == wordOffsets.size()) {
+    wordText.clear();
+    wordOffsets.clear();
+    wordStyles.clear();
+    consumedWords = 0;
+    return;
+  }
 
-  processLine(std::make_shared<TextBlock>(std::move(lineWords), std::move(lineXPos), std::move(lineWordStyles), style));
+  const uint32_t textStart = wordOffsets[consumedWords];
+  wordText.erase(wordText.begin(), wordText.begin() + textStart);
+  wordOffsets.erase(wordOffsets.begin(), wordOffsets.begin() + consumedWords);
+  for (auto& offset : wordOffsets) {
+    offset -= textStart;
+  }
+  wordStyles.erase(wordStyles.begin(), wordStyles.begin() + consumedWords);
+  consumedWords = 0;
 }
@@ -3,37 +3,48 @@
 #include <EpdFontFamily.h>
 
 #include <functional>
-#include <list>
 #include <memory>
-#include <string>
 #include <vector>
 
 #include "blocks/TextBlock.h"
 
 class GfxRenderer;
 
+// The words of a text block waiting to be laid out. Their bytes are appended to one arena, each null terminated, with
+// parallel arrays for where each word starts and its style, so adding a word doesn't allocate once the buffers have
+// grown to the size of a paragraph. Lines are cut out of the arrays as ranges of word indexes. The page builder keeps
+// one for the whole chapter, every buffer is reused by the next text block.
 class ParsedText {
-  std::list<std::string> words;
-  std::list<EpdFontFamily::Style> wordStyles;
+  std::vector<char> wordText;
+  std::vector<uint32_t> wordOffsets;
+  std::vector<EpdFontFamily::Style> wordStyles;
+  // Words at the front that have been laid out, only set while lines are being extracted
+  size_t consumedWords = 0;
   TextBlock::Style style;
   bool extraParagraphSpacing;
 
-  std::vector<size_t> computeLineBreaks(int pageWidth, int spaceWidth, const std::vector<uint16_t>& wordWidths) const;
-  void extractLine(size_t breakIndex, int pageWidth, int spaceWidth, const std::vector<uint16_t>& wordWidths,
-                   const std::vector<size_t>& lineBreakIndices,
+  // Layout scratch, sized to the text block and kept for the next one
+  std::vector<uint16_t> wordWidths;
+  std::vector<int> dp;
+  std::vector<size_t> ans;
+  std::vector<size_t> lineBreakIndices;
+
+  void computeLineBreaks(int pageWidth, int spaceWidth);
+  void extractLine(size_t breakIndex, int pageWidth, int spaceWidth,
                    const std::function<void(std::shared_ptr<TextBlock>)>& processLine);
-  std::vector<uint16_t> calculateWordWidths(const GfxRenderer& renderer, int fontId);
+  void calculateWordWidths(const GfxRenderer& renderer, int fontId);
+  void removeConsumedWords();
 
  public:
   explicit ParsedText(const TextBlock::Style style, const bool extraParagraphSpacing)
       : style(style), extraParagraphSpacing(extraParagraphSpacing) {}
   ~ParsedText() = default;
 
-  void addWord(std::string word, EpdFontFamily::Style fontStyle);
+  void addWord(const char* word, size_t length, EpdFontFamily::Style fontStyle);
   void setStyle(const TextBlock::Style style) { this->style = style; }
   TextBlock::Style getStyle() const { return style; }
-  size_t size() const { return words.size(); }
-  bool isEmpty() const { return words.empty(); }
+  size_t size() const { return wordOffsets.size() - consumedWords; }
+  bool isEmpty() const { return size() == 0; }
   void layoutAndExtractLines(const GfxRenderer& renderer, int fontId, uint16_t viewportWidth,
                              const std::function<void(std::shared_ptr<TextBlock>)>& processLine,
                              bool includeLastLine = true);
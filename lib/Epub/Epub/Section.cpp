@@ -1,17 +1,208 @@
 #include "Section.h"
 
+#include <Bitmap.h>
+#include <FsHelpers.h>
+#include <JpegToBmpConverter.h>
 #include <SDCardManager.h>
+#include <SectionLayouts.h>
 #include <Serialization.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "BookStyles.h"
+#include "ChapterPageBuilder.h"
+#include "ChapterTokens.h"
 #include "Page.h"
 #include "parsers/ChapterHtmlSlimParser.h"
 
 namespace {
-constexpr uint8_t SECTION_FILE_VERSION = 8;
+constexpr uint8_t SECTION_FILE_VERSION = 11;
 constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(int) + sizeof(float) + sizeof(bool) + sizeof(uint16_t) +
                                  sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint32_t);
+// Anchors are held in memory until the chapter is built, chapters with an id on every paragraph can have thousands
+constexpr size_t MAX_ANCHORS = 2048;
+constexpr uint32_t ANCHOR_RECORD_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+
+// FNV-1a
+template <typename T>
+uint32_t hashPod(uint32_t hash, const T& value) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+uint32_t anchorHash(const std::string& id) {
+  uint32_t hash = 2166136261u;
+  for (const char c : id) {
+    hash = hashPod(hash, c);
+  }
+  return hash;
+}
+
+// Removes the <spineIndex>_<n>.bmp images kept next to a section file
+void removeImages(const std::string& sectionPath) {
+  const auto slash = sectionPath.find_last_of('/');
+  const auto dirPath = sectionPath.substr(0, slash);
+  const auto prefix = sectionPath.substr(slash + 1, sectionPath.size() - slash - 5) + "_";
+  auto dir = SdMan.open(dirPath.c_str());
+  if (!dir || !dir.isDirectory()) {
+    dir.close();
+    return;
+  }
+
+  // Names are gathered first so the directory isn't changed while it is being listed
+  std::vector<std::string> names;
+  char name[32];
+  for (auto file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    const size_t length = strlen(name);
+    if (length > prefix.size() + 4 && strncmp(name, prefix.c_str(), prefix.size()) == 0 &&
+        strcmp(name + length - 4, ".bmp") == 0) {
+      names.emplace_back(name);
+    }
+    file.close();
+  }
+  dir.close();
+
+  for (const auto& imageName : names) {
+    SdMan.remove((dirPath + "/" + imageName).c_str());
+  }
+}
+
+size_t readEntry(void* context, uint8_t* buffer, const size_t size) {
+  return static_cast<ZipFile::EntryReader*>(context)->read(buffer, size);
+}
+
+bool isJpeg(const std::string& href) {
+  std::string extension = href.substr(href.find_last_of('.') + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](const unsigned char c) { return std::tolower(c); });
+  return extension == "jpg" || extension == "jpeg";
+}
+
+uint32_t layoutKey(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                   const uint16_t viewportWidth, const uint16_t viewportHeight) {
+  uint32_t key = 2166136261u;
+  key = hashPod(key, fontId);
+  key = hashPod(key, lineCompression);
+  key = hashPod(key, extraParagraphSpacing);
+  key = hashPod(key, viewportWidth);
+  key = hashPod(key, viewportHeight);
+  return key;
+}
 }  // namespace
 
+std::string Section::getLayoutDir(const Epub& epub, const int fontId, const float lineCompression,
+                                  const bool extraParagraphSpacing, const uint16_t viewportWidth,
+                                  const uint16_t viewportHeight) {
+  const uint32_t key = layoutKey(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
+  return epub.getCachePath() + "/sections/" + SectionLayouts::dirName(key);
+}
+
+uint8_t Section::getFileVersion() { return SECTION_FILE_VERSION; }
+
+void Section::selectLayout(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                           const uint16_t viewportWidth, const uint16_t viewportHeight) {
+  const uint32_t key = layoutKey(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
+
+  const auto sectionsDir = epub->getCachePath() + "/sections";
+  filePath = sectionsDir + "/" + SectionLayouts::dirName(key) + "/" + std::to_string(spineIndex) + ".bin";
+  SectionLayouts::select(sectionsDir, key);
+}
+
+void Section::onAnchor(const std::string& id, const uint16_t page) {
+  if (anchors.size() == MAX_ANCHORS) {
+    Serial.printf("[%lu] [SCT] Too many anchors, ignoring %s\n", millis(), id.c_str());
+    return;
+  }
+  anchors.push_back({anchorHash(id), page});
+}
+
+std::unique_ptr<PageImage> Section::onImage(const std::string& src, const uint16_t maxWidth,
+                                            const uint16_t maxHeight) {
+  // Relative to the chapter, remote and data: URIs aren't in the book
+  if (src.empty() || src.find(':') != std::string::npos) {
+    return nullptr;
+  }
+  const auto chapterHref = epub->getSpineItem(spineIndex).href;
+  const auto href = FsHelpers::normalisePath(chapterHref.substr(0, chapterHref.find_last_of('/') + 1) +
+                                             src.substr(0, src.find('#')));
+
+  for (const auto& image : images) {
+    if (image.href == href) {
+      if (image.bmpPath.empty()) {
+        return nullptr;
+      }
+      return std::unique_ptr<PageImage>(new PageImage(image.bmpPath, image.width, image.height, 0, 0));
+    }
+  }
+
+  images.push_back({href, "", 0, 0});
+  if (!isJpeg(href)) {
+    Serial.printf("[%lu] [SCT] Skipping image %s, only JPEG is supported\n", millis(), href.c_str());
+    return nullptr;
+  }
+
+  // Only read as far as the frame header while the chapter is parsed, the image is decoded once the chapter's reader is
+  // done. The chapter's reader holds the shared inflate workspace, so this one briefly has its own.
+  int jpegWidth, jpegHeight, width, height;
+  ZipFile::EntryReader reader;
+  const bool sized = epub->openItem(href, reader, 512) &&
+                     JpegToBmpConverter::readJpegSize(readEntry, &reader, &jpegWidth, &jpegHeight) &&
+                     JpegToBmpConverter::getOutputSize(jpegWidth, jpegHeight, maxWidth, maxHeight, &width, &height);
+  reader.close();
+  if (!sized) {
+    Serial.printf("[%lu] [SCT] Skipping image %s, no baseline JPEG frame header found\n", millis(), href.c_str());
+    return nullptr;
+  }
+
+  const auto bmpPath = filePath.substr(0, filePath.size() - 4) + "_" + std::to_string(images.size() - 1) + ".bmp";
+  images.back() = {href, bmpPath, static_cast<uint16_t>(width), static_cast<uint16_t>(height)};
+  if (firstImagePage < 0) {
+    firstImagePage = pageCount;
+  }
+  return std::unique_ptr<PageImage>(new PageImage(bmpPath, images.back().width, images.back().height, 0, 0));
+}
+
+bool Section::beginImage(const Image& image) {
+  // Scaled to fit the page and dithered here, so turning to the page only has to draw it
+  imageReader.reset(new ZipFile::EntryReader());
+  imageConverter.reset(new JpegToBmpConverter());
+  if (!epub->openItem(image.href, *imageReader, 1024) || !SdMan.openFileForWrite("SCT", image.bmpPath, imageFile) ||
+      !imageConverter->begin(readEntry, imageReader.get(), imageFile, imageMaxWidth, imageMaxHeight)) {
+    endImage(image, false);
+    return false;
+  }
+  return true;
+}
+
+void Section::endImage(const Image& image, const bool converted) {
+  imageConverter.reset();
+  imageReader.reset();
+  imageFile.close();
+
+  // The page was laid out with the size from the frame header, an image that turns out otherwise isn't drawn
+  bool matches = false;
+  FsFile bmpFile;
+  if (converted && SdMan.openFileForRead("SCT", image.bmpPath, bmpFile)) {
+    Bitmap bitmap(bmpFile);
+    matches = bitmap.parseHeaders() == BmpReaderError::Ok && bitmap.getWidth() == image.width &&
+              bitmap.getHeight() == image.height;
+    bmpFile.close();
+  }
+  if (!matches) {
+    Serial.printf("[%lu] [SCT] Failed to decode image %s\n", millis(), image.href.c_str());
+    SdMan.remove(image.bmpPath.c_str());
+  } else {
+    Serial.printf("[%lu] [SCT] Decoded image %s (%ux%u)\n", millis(), image.href.c_str(), image.width, image.height);
+  }
+}
+
 uint32_t Section::onPageComplete(std::unique_ptr<Page> page) {
   if (!file) {
     Serial.printf("[%lu] [SCT] File not open for writing page %d\n", millis(), pageCount);
@@ -51,6 +242,7 @@ void Section::writeSectionFileHeader(const int fontId, const float lineCompressi
 
 bool Section::loadSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
                               const uint16_t viewportWidth, const uint16_t viewportHeight) {
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
   if (!SdMan.openFileForRead("SCT", filePath, file)) {
     return false;
   }
@@ -86,14 +278,23 @@ bool Section::loadSectionFile(const int fontId, const float lineCompression, con
     }
   }
 
+  uint32_t lutOffset;
   serialization::readPod(file, pageCount);
+  serialization::readPod(file, lutOffset);
   file.close();
+  // The LUT offset is written last, a file without one was never finished (e.g. power was lost mid build)
+  if (lutOffset == 0) {
+    Serial.printf("[%lu] [SCT] Deserialization failed: Section file is incomplete\n", millis());
+    clearCache();
+    return false;
+  }
   Serial.printf("[%lu] [SCT] Deserialization succeeded: %d pages\n", millis(), pageCount);
   return true;
 }
 
 // Your updated class method (assuming you are using the 'SD' object, which is a wrapper for a specific filesystem)
 bool Section::clearCache() const {
+  removeImages(filePath);
   if (!SdMan.exists(filePath.c_str())) {
     Serial.printf("[%lu] [SCT] Cache does not exist, no action needed\n", millis());
     return true;
@@ -108,81 +309,184 @@ bool Section::clearCache() const {
   return true;
 }
 
-bool Section::createSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
-                                const uint16_t viewportWidth, const uint16_t viewportHeight,
-                                const std::function<void()>& progressSetupFn,
-                                const std::function<void(int)>& progressFn) {
-  constexpr uint32_t MIN_SIZE_FOR_PROGRESS = 50 * 1024;  // 50KB
-  const auto localPath = epub->getSpineItem(spineIndex).href;
-  const auto tmpHtmlPath = epub->getCachePath() + "/.tmp_" + std::to_string(spineIndex) + ".html";
+Section::Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
+    : epub(epub),
+      spineIndex(spineIndex),
+      renderer(renderer),
+      tokensPath(epub->getCachePath() + "/tokens/" + std::to_string(spineIndex) + ".bin") {}
 
-  // Create cache directory if it doesn't exist
-  {
-    const auto sectionsDir = epub->getCachePath() + "/sections";
-    SdMan.mkdir(sectionsDir.c_str());
+Section::~Section() { abortSectionFile(); }
+
+bool Section::beginReplay(const std::function<void(int)>& progressFn) {
+  if (!SdMan.exists(tokensPath.c_str()) || !SdMan.openFileForRead("SCT", tokensPath, tokensFile)) {
+    return false;
   }
 
-  // Retry logic for SD card timing issues
-  bool success = false;
-  uint32_t fileSize = 0;
-  for (int attempt = 0; attempt < 3 && !success; attempt++) {
-    if (attempt > 0) {
-      Serial.printf("[%lu] [SCT] Retrying stream (attempt %d)...\n", millis(), attempt + 1);
-      delay(50);  // Brief delay before retry
-    }
+  tokenReplayer.reset(new ChapterTokenReplayer(tokensFile, *pageBuilder, progressFn));
+  if (!tokenReplayer->begin()) {
+    tokenReplayer.reset();
+    tokensFile.close();
+    SdMan.remove(tokensPath.c_str());
+    return false;
+  }
+  Serial.printf("[%lu] [SCT] Laying out chapter from its recorded tokens\n", millis());
+  return true;
+}
 
-    // Remove any incomplete file from previous attempt before retrying
-    if (SdMan.exists(tmpHtmlPath.c_str())) {
-      SdMan.remove(tmpHtmlPath.c_str());
-    }
+bool Section::beginParse(const std::function<void(int)>& progressFn) {
+  // The chapter is inflated straight into the parser, there is no temp copy of it on the SD card
+  buildReader.reset(new ZipFile::EntryReader());
+  if (!epub->openItem(epub->getSpineItem(spineIndex).href, *buildReader, 1024)) {
+    buildReadFailed = true;
+    return false;
+  }
 
-    FsFile tmpHtml;
-    if (!SdMan.openFileForWrite("SCT", tmpHtmlPath, tmpHtml)) {
-      continue;
-    }
-    success = epub->readItemContentsToStream(localPath, tmpHtml, 1024);
-    fileSize = tmpHtml.size();
-    tmpHtml.close();
+  // Recording is best effort, a chapter whose tokens can't be written is just parsed again next time
+  SdMan.mkdir((epub->getCachePath() + "/tokens").c_str());
+  if (SdMan.openFileForWrite("SCT", tokensPath, tokensFile)) {
+    tokenWriter.reset(new ChapterTokenWriter(tokensFile));
+    tokenWriter->begin();
+  }
 
-    // If streaming failed, remove the incomplete file immediately
-    if (!success && SdMan.exists(tmpHtmlPath.c_str())) {
-      SdMan.remove(tmpHtmlPath.c_str());
-      Serial.printf("[%lu] [SCT] Removed incomplete temp file after failed attempt\n", millis());
+  // A book whose stylesheets couldn't be compiled is laid out without them
+  if (!sharedStyles) {
+    buildStyles.reset(new BookStyles());
+    if (!buildStyles->load(epub->getStylesPath())) {
+      Serial.printf("[%lu] [SCT] No style table, parsing without styles\n", millis());
+      buildStyles.reset();
     }
   }
 
-  if (!success) {
-    Serial.printf("[%lu] [SCT] Failed to stream item contents to temp file after retries\n", millis());
-    return false;
-  }
+  buildParser.reset(new ChapterHtmlSlimParser(*buildReader, *pageBuilder, progressFn, tokenWriter.get(),
+                                              sharedStyles ? sharedStyles : buildStyles.get()));
+  return buildParser->begin();
+}
 
-  Serial.printf("[%lu] [SCT] Streamed temp HTML to %s (%d bytes)\n", millis(), tmpHtmlPath.c_str(), fileSize);
+void Section::resetBuild() {
+  // The parser and replayer feed the page builder, which goes last
+  buildParser.reset();
+  buildStyles.reset();
+  buildReader.reset();
+  tokenReplayer.reset();
+  tokenWriter.reset();
+  tokensFile.close();
+  pageBuilder.reset();
+}
+
+bool Section::beginSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                               const uint16_t viewportWidth, const uint16_t viewportHeight,
+                               const std::function<void(int)>& progressFn) {
+  abortSectionFile();
+  buildReadFailed = false;
 
-  // Only show progress bar for larger chapters where rendering overhead is worth it
-  if (progressSetupFn && fileSize >= MIN_SIZE_FOR_PROGRESS) {
-    progressSetupFn();
+  // Create cache directory if it doesn't exist
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
+  SdMan.mkdir(filePath.substr(0, filePath.find_last_of('/')).c_str());
+
+  pageBuilder.reset(new ChapterPageBuilder(
+      renderer, fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight,
+      [this](std::unique_ptr<Page> page) { lut.emplace_back(this->onPageComplete(std::move(page))); },
+      [this](const std::string& id, const uint16_t page) { onAnchor(id, page); },
+      [this, viewportWidth, viewportHeight](const std::string& src) {
+        return onImage(src, viewportWidth, viewportHeight);
+      }));
+  if (!beginReplay(progressFn) && !beginParse(progressFn)) {
+    abortSectionFile();
+    return false;
   }
 
-  if (!SdMan.openFileForWrite("SCT", filePath, file)) {
+  // Opened for reading too, pages are loaded back from the file while the rest of the chapter is still being built
+  file = SdMan.open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) {
+    Serial.printf("[%lu] [SCT] Failed to open %s for writing\n", millis(), filePath.c_str());
+    abortSectionFile();
     return false;
   }
+  pageCount = 0;
+  lut.clear();
+  anchors.clear();
+  images.clear();
+  nextImage = 0;
+  imageMaxWidth = viewportWidth;
+  imageMaxHeight = viewportHeight;
+  firstImagePage = -1;
   writeSectionFileHeader(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight);
-  std::vector<uint32_t> lut = {};
+  return true;
+}
 
-  ChapterHtmlSlimParser visitor(
-      tmpHtmlPath, renderer, fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight,
-      [this, &lut](std::unique_ptr<Page> page) { lut.emplace_back(this->onPageComplete(std::move(page))); },
-      progressFn);
-  success = visitor.parseAndBuildPages();
+Section::BuildStatus Section::continueSectionFile(const size_t maxBytes) {
+  if (!isBuilding()) {
+    return BuildStatus::Failed;
+  }
 
-  SdMan.remove(tmpHtmlPath.c_str());
-  if (!success) {
-    Serial.printf("[%lu] [SCT] Failed to parse XML and build pages\n", millis());
-    file.close();
-    SdMan.remove(filePath.c_str());
-    return false;
+  if (pageBuilder) {
+    bool done = false;
+    if (tokenReplayer) {
+      if (!tokenReplayer->replayNext(maxBytes, &done)) {
+        Serial.printf("[%lu] [SCT] Failed to replay chapter tokens\n", millis());
+        // Most likely a damaged tokens file, drop it so that a retry parses the chapter instead
+        buildReadFailed = true;
+        abortSectionFile();
+        SdMan.remove(tokensPath.c_str());
+        return BuildStatus::Failed;
+      }
+    } else if (!buildParser->parseNext(maxBytes, &done)) {
+      Serial.printf("[%lu] [SCT] Failed to parse XML and build pages\n", millis());
+      buildReadFailed = buildReader->hasFailed();
+      abortSectionFile();
+      return BuildStatus::Failed;
+    }
+    if (!done) {
+      return BuildStatus::InProgress;
+    }
+
+    if (tokenWriter && !tokenWriter->finish()) {
+      Serial.printf("[%lu] [SCT] Failed to record chapter tokens\n", millis());
+      tokensFile.close();
+      SdMan.remove(tokensPath.c_str());
+    }
+    // The chapter's reader holds the shared inflate workspace, images are only decoded once it is released
+    resetBuild();
+    decodingImages = true;
+    // A build done a step at a time decodes the images in steps of their own
+    if (nextImage < images.size() && maxBytes != SIZE_MAX) {
+      return BuildStatus::InProgress;
+    }
   }
 
+  // A step ends once about maxBytes of JPEG data have been decoded, a row of MCUs always counts for at least a byte
+  size_t decodedBytes = 0;
+  while (nextImage < images.size() && decodedBytes < maxBytes) {
+    const auto& image = images[nextImage];
+    if (!imageConverter) {
+      // Images that couldn't be sized have no bmpPath, they were left out of the pages
+      if (!image.bmpPath.empty() && beginImage(image)) {
+        decodedBytes += imageReader->getPosition();
+      } else {
+        nextImage++;
+      }
+      continue;
+    }
+
+    const size_t position = imageReader->getPosition();
+    const auto status = imageConverter->decodeNextRow();
+    decodedBytes += std::max<size_t>(imageReader->getPosition() - position, 1);
+    if (status != JpegToBmpConverter::Status::More) {
+      endImage(image, status == JpegToBmpConverter::Status::Done);
+      nextImage++;
+    }
+  }
+  if (nextImage < images.size()) {
+    return BuildStatus::InProgress;
+  }
+  decodingImages = false;
+  images.clear();
+  images.shrink_to_fit();
+
+  return finishSectionFile() ? BuildStatus::Done : BuildStatus::Failed;
+}
+
+bool Section::finishSectionFile() {
   const uint32_t lutOffset = file.position();
   bool hasFailedLutRecords = false;
   // Write LUT
@@ -193,6 +497,22 @@ bool Section::createSectionFile(const int fontId, const float lineCompression, c
     }
     serialization::writePod(file, pos);
   }
+  lut.clear();
+  lut.shrink_to_fit();
+
+  // Anchors come in page order, for ids that share a hash the stable sort keeps the earliest page first
+  std::stable_sort(anchors.begin(), anchors.end(),
+                   [](const Anchor& a, const Anchor& b) { return a.idHash < b.idHash; });
+  anchors.erase(std::unique(anchors.begin(), anchors.end(),
+                            [](const Anchor& a, const Anchor& b) { return a.idHash == b.idHash; }),
+                anchors.end());
+  serialization::writePod(file, static_cast<uint16_t>(anchors.size()));
+  for (const auto& anchor : anchors) {
+    serialization::writePod(file, anchor.idHash);
+    serialization::writePod(file, anchor.page);
+  }
+  anchors.clear();
+  anchors.shrink_to_fit();
 
   if (hasFailedLutRecords) {
     Serial.printf("[%lu] [SCT] Failed to write LUT due to invalid page positions\n", millis());
@@ -209,7 +529,90 @@ bool Section::createSectionFile(const int fontId, const float lineCompression, c
   return true;
 }
 
+void Section::abortSectionFile() {
+  if (!isBuilding()) {
+    return;
+  }
+
+  // Tokens are only recorded by a parse that gets to the end of the chapter
+  const bool recordingTokens = tokenWriter != nullptr;
+  resetBuild();
+  if (recordingTokens) {
+    SdMan.remove(tokensPath.c_str());
+  }
+  lut.clear();
+  lut.shrink_to_fit();
+  anchors.clear();
+  anchors.shrink_to_fit();
+  imageConverter.reset();
+  imageReader.reset();
+  imageFile.close();
+  // Images decoded so far belong to the partial file, the others may be left from an earlier build of the chapter
+  for (const auto& image : images) {
+    if (!image.bmpPath.empty() && SdMan.exists(image.bmpPath.c_str())) {
+      SdMan.remove(image.bmpPath.c_str());
+    }
+  }
+  images.clear();
+  images.shrink_to_fit();
+  decodingImages = false;
+  nextImage = 0;
+  // The partial file has no LUT offset yet so it would never load, remove it rather than leave it lying around
+  file.close();
+  SdMan.remove(filePath.c_str());
+}
+
+bool Section::createSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                                const uint16_t viewportWidth, const uint16_t viewportHeight,
+                                const std::function<void()>& progressSetupFn,
+                                const std::function<void(int)>& progressFn) {
+  constexpr uint32_t MIN_SIZE_FOR_PROGRESS = 50 * 1024;  // 50KB
+
+  // Retry logic for SD card timing issues, a chapter that fails to parse is not retried
+  for (int attempt = 0; attempt < 3; attempt++) {
+    if (attempt > 0) {
+      Serial.printf("[%lu] [SCT] Retrying build (attempt %d)...\n", millis(), attempt + 1);
+      delay(50);  // Brief delay before retry
+    }
+
+    if (!beginSectionFile(fontId, lineCompression, extraParagraphSpacing, viewportWidth, viewportHeight,
+                          progressFn)) {
+      if (buildReadFailed) {
+        continue;
+      }
+      return false;
+    }
+
+    // Only show progress bar for larger chapters where rendering overhead is worth it
+    const uint32_t buildSize = tokenReplayer ? tokenReplayer->getSize() : buildReader->getSize();
+    if (attempt == 0 && progressSetupFn && buildSize >= MIN_SIZE_FOR_PROGRESS) {
+      progressSetupFn();
+    }
+
+    const auto status = continueSectionFile(SIZE_MAX);
+    if (status == BuildStatus::Done) {
+      return true;
+    }
+    if (!buildReadFailed) {
+      return false;
+    }
+  }
+  return false;
+}
+
 std::unique_ptr<Page> Section::loadPageFromSectionFile() {
+  // The LUT is still in memory, the file is left positioned for the next page to be appended
+  if (isBuilding()) {
+    if (currentPage < 0 || currentPage >= static_cast<int>(lut.size())) {
+      return nullptr;
+    }
+    const uint32_t end = file.position();
+    file.seek(lut[currentPage]);
+    auto page = Page::deserialize(file);
+    file.seek(end);
+    return page;
+  }
+
   if (!SdMan.openFileForRead("SCT", filePath, file)) {
     return nullptr;
   }
@@ -226,3 +629,58 @@ std::unique_ptr<Page> Section::loadPageFromSectionFile() {
   file.close();
   return page;
 }
+
+int Section::getPageForAnchor(const std::string& id) {
+  const uint32_t idHash = anchorHash(id);
+
+  // Only the anchors on pages built so far are known, in page order
+  if (isBuilding()) {
+    for (const auto& anchor : anchors) {
+      if (anchor.idHash == idHash) {
+        return anchor.page;
+      }
+    }
+    return -1;
+  }
+
+  if (!SdMan.openFileForRead("SCT", filePath, file)) {
+    return -1;
+  }
+
+  file.seek(HEADER_SIZE - sizeof(uint32_t));
+  uint32_t lutOffset;
+  serialization::readPod(file, lutOffset);
+  const uint32_t anchorsOffset = lutOffset + sizeof(uint32_t) * pageCount;
+  file.seek(anchorsOffset);
+  uint16_t anchorCount = 0;
+  serialization::readPod(file, anchorCount);
+
+  // Binary search for the first record with this hash
+  uint16_t low = 0;
+  uint16_t high = anchorCount;
+  while (low < high) {
+    const uint16_t mid = low + (high - low) / 2;
+    uint32_t midHash;
+    file.seek(anchorsOffset + sizeof(anchorCount) + ANCHOR_RECORD_SIZE * mid);
+    serialization::readPod(file, midHash);
+    if (midHash < idHash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  int page = -1;
+  if (low < anchorCount) {
+    uint32_t foundHash;
+    uint16_t foundPage;
+    file.seek(anchorsOffset + sizeof(anchorCount) + ANCHOR_RECORD_SIZE * low);
+    serialization::readPod(file, foundHash);
+    serialization::readPod(file, foundPage);
+    if (foundHash == idHash) {
+      page = foundPage;
+    }
+  }
+  file.close();
+  return page;
+}
@@ -1,38 +1,126 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "Epub.h"
 
+class BookStyles;
 class Page;
+class PageImage;
 class GfxRenderer;
+class JpegToBmpConverter;
+class ChapterHtmlSlimParser;
+class ChapterPageBuilder;
+class ChapterTokenReplayer;
+class ChapterTokenWriter;
 
 class Section {
   std::shared_ptr<Epub> epub;
   const int spineIndex;
   GfxRenderer& renderer;
+  // sections/<layout>/<spineIndex>.bin, set once the layout parameters are known
   std::string filePath;
   FsFile file;
+  // tokens/<spineIndex>.bin, the chapter's words as parsed, shared by every layout
+  std::string tokensPath;
+  // Only set while a build started with beginSectionFile is in progress. Pages come from replaying the chapter's
+  // tokens if they were recorded by an earlier build, otherwise from parsing the chapter (recording its tokens).
+  std::unique_ptr<ChapterPageBuilder> pageBuilder;
+  FsFile tokensFile;
+  std::unique_ptr<ChapterTokenReplayer> tokenReplayer;
+  std::unique_ptr<ChapterTokenWriter> tokenWriter;
+  std::unique_ptr<ZipFile::EntryReader> buildReader;
+  // Only loaded when the chapter is parsed, recorded tokens already have the styles applied
+  std::unique_ptr<BookStyles> buildStyles;
+  // Styles loaded once by the caller for a run over many chapters, used instead of loading css.bin for each of them
+  const BookStyles* sharedStyles = nullptr;
+  std::unique_ptr<ChapterHtmlSlimParser> buildParser;
+  std::vector<uint32_t> lut;
+  // Pages element ids landed on, collected while building and written after the LUT
+  struct Anchor {
+    uint32_t idHash;
+    uint16_t page;
+  };
+  std::vector<Anchor> anchors;
+  // Images of the chapter being built, kept next to its section file as <spineIndex>_<n>.bmp. Pages are laid out with
+  // the size read from each JPEG's frame header, the images are decoded once the whole chapter has been read. One that
+  // is used more than once is only decoded once, one that can't be decoded has no bmpPath.
+  struct Image {
+    std::string href;
+    std::string bmpPath;
+    uint16_t width;
+    uint16_t height;
+  };
+  std::vector<Image> images;
+  // Set once the chapter has been read to the end and its reader released, until every image is decoded. Images are
+  // decoded a row of MCUs at a time, straight from the zip.
+  bool decodingImages = false;
+  size_t nextImage = 0;
+  std::unique_ptr<ZipFile::EntryReader> imageReader;
+  std::unique_ptr<JpegToBmpConverter> imageConverter;
+  FsFile imageFile;
+  uint16_t imageMaxWidth = 0;
+  uint16_t imageMaxHeight = 0;
+  int firstImagePage = -1;
+  // Whether the last build stopped because the chapter (or its tokens) couldn't be read, as opposed to failing to parse
+  bool buildReadFailed = false;
 
+  bool beginReplay(const std::function<void(int)>& progressFn);
+  bool beginParse(const std::function<void(int)>& progressFn);
+  void resetBuild();
+
+  // Points filePath at the section file for these layout parameters and marks them as the most recently used layout,
+  // evicting the sections of the least recently used one if there are now too many
+  void selectLayout(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
+                    uint16_t viewportHeight);
   void writeSectionFileHeader(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
                               uint16_t viewportHeight);
   uint32_t onPageComplete(std::unique_ptr<Page> page);
+  void onAnchor(const std::string& id, uint16_t page);
+  std::unique_ptr<PageImage> onImage(const std::string& src, uint16_t maxWidth, uint16_t maxHeight);
+  bool beginImage(const Image& image);
+  // Keeps the image's BMP only if it was converted in full
+  void endImage(const Image& image, bool converted);
+  bool finishSectionFile();
 
  public:
   uint16_t pageCount = 0;
   int currentPage = 0;
 
-  explicit Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
-      : epub(epub),
-        spineIndex(spineIndex),
-        renderer(renderer),
-        filePath(epub->getCachePath() + "/sections/" + std::to_string(spineIndex) + ".bin") {}
-  ~Section() = default;
+  explicit Section(const std::shared_ptr<Epub>& epub, int spineIndex, GfxRenderer& renderer);
+  ~Section();
+  // sections/<layout> of the book, where the section files for these layout parameters are kept
+  static std::string getLayoutDir(const Epub& epub, int fontId, float lineCompression, bool extraParagraphSpacing,
+                                  uint16_t viewportWidth, uint16_t viewportHeight);
+  // Section files of another version are rebuilt, so anything derived from their page counts is stale too
+  static uint8_t getFileVersion();
   bool loadSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
                        uint16_t viewportHeight);
   bool clearCache() const;
   bool createSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
                          uint16_t viewportHeight, const std::function<void()>& progressSetupFn = nullptr,
                          const std::function<void(int)>& progressFn = nullptr);
+  // Also works during a build, for the pages written so far (pageCount)
   std::unique_ptr<Page> loadPageFromSectionFile();
+  // Page the element with this id starts on, or -1 if it isn't in the chapter (or, during a build, not reached yet)
+  int getPageForAnchor(const std::string& id);
+
+  // Builds the section file a slice at a time instead of all at once, so it can be done while the reader is idle.
+  // Begin once, then call continueSectionFile until it stops returning InProgress. Abort removes the partial file,
+  // and destroying the section aborts an unfinished build.
+  enum class BuildStatus { InProgress, Done, Failed };
+  bool beginSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint16_t viewportWidth,
+                        uint16_t viewportHeight, const std::function<void(int)>& progressFn = nullptr);
+  BuildStatus continueSectionFile(size_t maxBytes);
+  void abortSectionFile();
+  bool isBuilding() const { return pageBuilder != nullptr || decodingImages; }
+  // Until the whole chapter has been read, after that every page and anchor is known while its images are decoded
+  bool isPaginating() const { return pageBuilder != nullptr; }
+  // First page of the last build that has an image on it or after it, -1 if the chapter has none. Those pages may have
+  // been drawn during the build, before their images were decoded.
+  int getFirstImagePage() const { return firstImagePage; }
+  int getSpineIndex() const { return spineIndex; }
+  // Null (the default) loads css.bin for each build, the styles must outlive the section
+  void setSharedStyles(const BookStyles* styles) { sharedStyles = styles; }
 };
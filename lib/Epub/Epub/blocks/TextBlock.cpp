@@ -3,37 +3,44 @@
 #include <GfxRenderer.h>
 #include <Serialization.h>
 
+#include <algorithm>
+#include <cstring>
+
+size_t TextBlock::wordCount() const { return std::count(wordText.begin(), wordText.end(), '\0'); }
+
 void TextBlock::render(const GfxRenderer& renderer, const int fontId, const int x, const int y) const {
-  // Validate iterator bounds before rendering
-  if (words.size() != wordXpos.size() || words.size() != wordStyles.size()) {
+  // Validate bounds before rendering
+  const size_t words = wordCount();
+  if (words != wordXpos.size() || words != wordStyles.size()) {
     Serial.printf("[%lu] [TXB] Render skipped: size mismatch (words=%u, xpos=%u, styles=%u)\n", millis(),
-                  (uint32_t)words.size(), (uint32_t)wordXpos.size(), (uint32_t)wordStyles.size());
+                  (uint32_t)words, (uint32_t)wordXpos.size(), (uint32_t)wordStyles.size());
     return;
   }
 
-  auto wordIt = words.begin();
-  auto wordStylesIt = wordStyles.begin();
-  auto wordXposIt = wordXpos.begin();
-
-  for (size_t i = 0; i < words.size(); i++) {
-    renderer.drawText(fontId, *wordXposIt + x, y, wordIt->c_str(), true, *wordStylesIt);
-
-    std::advance(wordIt, 1);
-    std::advance(wordStylesIt, 1);
-    std::advance(wordXposIt, 1);
+  const char* word = wordText.data();
+  for (size_t i = 0; i < words; i++) {
+    renderer.drawText(fontId, wordXpos[i] + x, y, word, true, wordStyles[i]);
+    word += strlen(word) + 1;
   }
 }
 
 bool TextBlock::serialize(FsFile& file) const {
-  if (words.size() != wordXpos.size() || words.size() != wordStyles.size()) {
+  const size_t words = wordCount();
+  if (words != wordXpos.size() || words != wordStyles.size()) {
     Serial.printf("[%lu] [TXB] Serialization failed: size mismatch (words=%u, xpos=%u, styles=%u)\n", millis(),
-                  words.size(), wordXpos.size(), wordStyles.size());
+                  words, wordXpos.size(), wordStyles.size());
     return false;
   }
 
-  // Word data
-  serialization::writePod(file, static_cast<uint16_t>(words.size()));
-  for (const auto& w : words) serialization::writeString(file, w);
+  // Word data, each written as a length prefixed string
+  serialization::writePod(file, static_cast<uint16_t>(words));
+  const char* word = wordText.data();
+  for (size_t i = 0; i < words; i++) {
+    const uint32_t length = strlen(word);
+    serialization::writePod(file, length);
+    file.write(reinterpret_cast<const uint8_t*>(word), length);
+    word += length + 1;
+  }
   for (auto x : wordXpos) serialization::writePod(file, x);
   for (auto s : wordStyles) serialization::writePod(file, s);
 
@@ -45,9 +52,9 @@ bool TextBlock::serialize(FsFile& file) const {
 
 std::unique_ptr<TextBlock> TextBlock::deserialize(FsFile& file) {
   uint16_t wc;
-  std::list<std::string> words;
-  std::list<uint16_t> wordXpos;
-  std::list<EpdFontFamily::Style> wordStyles;
+  std::vector<char> wordText;
+  std::vector<uint16_t> wordXpos;
+  std::vector<EpdFontFamily::Style> wordStyles;
   Style style;
 
   // Word count
@@ -59,16 +66,28 @@ std::unique_ptr<TextBlock> TextBlock::deserialize(FsFile& file) {
     return nullptr;
   }
 
-  // Word data
-  words.resize(wc);
+  // Word data, read straight into the block's text
+  wordText.reserve(wc * 8);
+  for (uint16_t i = 0; i < wc; i++) {
+    uint32_t length;
+    serialization::readPod(file, length);
+    if (length > UINT16_MAX) {
+      Serial.printf("[%lu] [TXB] Deserialization failed: word length %u exceeds maximum\n", millis(), length);
+      return nullptr;
+    }
+    const size_t start = wordText.size();
+    wordText.resize(start + length + 1);
+    file.read(&wordText[start], length);
+    wordText[start + length] = '\0';
+  }
   wordXpos.resize(wc);
   wordStyles.resize(wc);
-  for (auto& w : words) serialization::readString(file, w);
   for (auto& x : wordXpos) serialization::readPod(file, x);
   for (auto& s : wordStyles) serialization::readPod(file, s);
 
   // Block style
   serialization::readPod(file, style);
 
-  return std::unique_ptr<TextBlock>(new TextBlock(std::move(words), std::move(wordXpos), std::move(wordStyles), style));
+  return std::unique_ptr<TextBlock>(
+      new TextBlock(std::move(wordText), std::move(wordXpos), std::move(wordStyles), style));
 }
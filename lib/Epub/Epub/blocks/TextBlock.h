@@ -2,9 +2,8 @@
 #include <EpdFontFamily.h>
 #include <SdFat.h>
 
-#include <list>
 #include <memory>
-#include <string>
+#include <vector>
 
 #include "Block.h"
 
@@ -19,19 +18,25 @@ class TextBlock final : public Block {
   };
 
  private:
-  std::list<std::string> words;
-  std::list<uint16_t> wordXpos;
-  std::list<EpdFontFamily::Style> wordStyles;
+  // The words back to back, each null terminated, in the same order as their positions and styles
+  std::vector<char> wordText;
+  std::vector<uint16_t> wordXpos;
+  std::vector<EpdFontFamily::Style> wordStyles;
   Style style;
 
+  size_t wordCount() const;
+
  public:
-  explicit TextBlock(std::list<std::string> words, std::list<uint16_t> word_xpos,
-                     std::list<EpdFontFamily::Style> word_styles, const Style style)
-      : words(std::move(words)), wordXpos(std::move(word_xpos)), wordStyles(std::move(word_styles)), style(style) {}
+  explicit TextBlock(std::vector<char> word_text, std::vector<uint16_t> word_xpos,
+                     std::vector<EpdFontFamily::Style> word_styles, const Style style)
+      : wordText(std::move(word_text)),
+        wordXpos(std::move(word_xpos)),
+        wordStyles(std::move(word_styles)),
+        style(style) {}
   ~TextBlock() override = default;
   void setStyle(const Style style) { this->style = style; }
   Style getStyle() const { return style; }
-  bool isEmpty() override { return words.empty(); }
+  bool isEmpty() override { return wordXpos.empty(); }
   void layout(GfxRenderer& renderer) override {};
   // given a renderer works out where to break the words into lines
   void render(const GfxRenderer& renderer, int fontId, int x, int y) const;
@@ -3,161 +3,200 @@
 
 #include "htmlEntities.h"
 
+#include <algorithm>
 #include <cstring>
-#include <unordered_map>
+#include <iterator>
 
-const int MAX_ENTITY_LENGTH = 10;
+namespace {
+// Longest entity name or numeric reference looked at, between the '&' and the ';'
+constexpr size_t MAX_ENTITY_NAME_LENGTH = 9;
+
+struct HtmlEntity {
+  char name[9];
+  char utf8[4];
+};
 
 // Use book: entities_ww2.epub to test this (Page 7: Entities parser test)
-// Note the supported keys are only in lowercase
-// Store the mappings in a unordered hash map
-static std::unordered_map<std::string, std::string> entity_lookup(
-    {{"&quot;", "\""},  {"&frasl;", "⁄"},   {"&amp;", "&"},      {"&lt;", "<"},     {"&gt;", ">"},
-     {"&Agrave;", "À"}, {"&Aacute;", "Á"},  {"&Acirc;", "Â"},    {"&Atilde;", "Ã"}, {"&Auml;", "Ä"},
-     {"&Aring;", "Å"},  {"&AElig;", "Æ"},   {"&Ccedil;", "Ç"},   {"&Egrave;", "È"}, {"&Eacute;", "É"},
-     {"&Ecirc;", "Ê"},  {"&Euml;", "Ë"},    {"&Igrave;", "Ì"},   {"&Iacute;", "Í"}, {"&Icirc;", "Î"},
-     {"&Iuml;", "Ï"},   {"&ETH;", "Ð"},     {"&Ntilde;", "Ñ"},   {"&Ograve;", "Ò"}, {"&Oacute;", "Ó"},
-     {"&Ocirc;", "Ô"},  {"&Otilde;", "Õ"},  {"&Ouml;", "Ö"},     {"&Oslash;", "Ø"}, {"&Ugrave;", "Ù"},
-     {"&Uacute;", "Ú"}, {"&Ucirc;", "Û"},   {"&Uuml;", "Ü"},     {"&Yacute;", "Ý"}, {"&THORN;", "Þ"},
-     {"&szlig;", "ß"},  {"&agrave;", "à"},  {"&aacute;", "á"},   {"&acirc;", "â"},  {"&atilde;", "ã"},
-     {"&auml;", "ä"},   {"&aring;", "å"},   {"&aelig;", "æ"},    {"&ccedil;", "ç"}, {"&egrave;", "è"},
-     {"&eacute;", "é"}, {"&ecirc;", "ê"},   {"&euml;", "ë"},     {"&igrave;", "ì"}, {"&iacute;", "í"},
-     {"&icirc;", "î"},  {"&iuml;", "ï"},    {"&eth;", "ð"},      {"&ntilde;", "ñ"}, {"&ograve;", "ò"},
-     {"&oacute;", "ó"}, {"&ocirc;", "ô"},   {"&otilde;", "õ"},   {"&ouml;", "ö"},   {"&oslash;", "ø"},
-     {"&ugrave;", "ù"}, {"&uacute;", "ú"},  {"&ucirc;", "û"},    {"&uuml;", "ü"},   {"&yacute;", "ý"},
-     {"&thorn;", "þ"},  {"&yuml;", "ÿ"},    {"&nbsp;", " "},     {"&iexcl;", "¡"},  {"&cent;", "¢"},
-     {"&pound;", "£"},  {"&curren;", "¤"},  {"&yen;", "¥"},      {"&brvbar;", "¦"}, {"&sect;", "§"},
-     {"&uml;", "¨"},    {"&copy;", "©"},    {"&ordf;", "ª"},     {"&laquo;", "«"},  {"&not;", "¬"},
-     {"&shy;", "­"},    {"&reg;", "®"},     {"&macr;", "¯"},     {"&deg;", "°"},    {"&plusmn;", "±"},
-     {"&sup2;", "²"},   {"&sup3;", "³"},    {"&acute;", "´"},    {"&micro;", "µ"},  {"&para;", "¶"},
-     {"&cedil;", "¸"},  {"&sup1;", "¹"},    {"&ordm;", "º"},     {"&raquo;", "»"},  {"&frac14;", "¼"},
-     {"&frac12;", "½"}, {"&frac34;", "¾"},  {"&iquest;", "¿"},   {"&times;", "×"},  {"&divide;", "÷"},
-     {"&forall;", "∀"}, {"&part;", "∂"},    {"&exist;", "∃"},    {"&empty;", "∅"},  {"&nabla;", "∇"},
-     {"&isin;", "∈"},   {"&notin;", "∉"},   {"&ni;", "∋"},       {"&prod;", "∏"},   {"&sum;", "∑"},
-     {"&minus;", "−"},  {"&lowast;", "∗"},  {"&radic;", "√"},    {"&prop;", "∝"},   {"&infin;", "∞"},
-     {"&ang;", "∠"},    {"&and;", "∧"},     {"&or;", "∨"},       {"&cap;", "∩"},    {"&cup;", "∪"},
-     {"&int;", "∫"},    {"&there4;", "∴"},  {"&sim;", "∼"},      {"&cong;", "≅"},   {"&asymp;", "≈"},
-     {"&ne;", "≠"},     {"&equiv;", "≡"},   {"&le;", "≤"},       {"&ge;", "≥"},     {"&sub;", "⊂"},
-     {"&sup;", "⊃"},    {"&nsub;", "⊄"},    {"&sube;", "⊆"},     {"&supe;", "⊇"},   {"&oplus;", "⊕"},
-     {"&otimes;", "⊗"}, {"&perp;", "⊥"},    {"&sdot;", "⋅"},     {"&Alpha;", "Α"},  {"&Beta;", "Β"},
-     {"&Gamma;", "Γ"},  {"&Delta;", "Δ"},   {"&Epsilon;", "Ε"},  {"&Zeta;", "Ζ"},   {"&Eta;", "Η"},
-     {"&Theta;", "Θ"},  {"&Iota;", "Ι"},    {"&Kappa;", "Κ"},    {"&Lambda;", "Λ"}, {"&Mu;", "Μ"},
-     {"&Nu;", "Ν"},     {"&Xi;", "Ξ"},      {"&Omicron;", "Ο"},  {"&Pi;", "Π"},     {"&Rho;", "Ρ"},
-     {"&Sigma;", "Σ"},  {"&Tau;", "Τ"},     {"&Upsilon;", "Υ"},  {"&Phi;", "Φ"},    {"&Chi;", "Χ"},
-     {"&Psi;", "Ψ"},    {"&Omega;", "Ω"},   {"&alpha;", "α"},    {"&beta;", "β"},   {"&gamma;", "γ"},
-     {"&delta;", "δ"},  {"&epsilon;", "ε"}, {"&zeta;", "ζ"},     {"&eta;", "η"},    {"&theta;", "θ"},
-     {"&iota;", "ι"},   {"&kappa;", "κ"},   {"&lambda;", "λ"},   {"&mu;", "μ"},     {"&nu;", "ν"},
-     {"&xi;", "ξ"},     {"&omicron;", "ο"}, {"&pi;", "π"},       {"&rho;", "ρ"},    {"&sigmaf;", "ς"},
-     {"&sigma;", "σ"},  {"&tau;", "τ"},     {"&upsilon;", "υ"},  {"&phi;", "φ"},    {"&chi;", "χ"},
-     {"&psi;", "ψ"},    {"&omega;", "ω"},   {"&thetasym;", "ϑ"}, {"&upsih;", "ϒ"},  {"&piv;", "ϖ"},
-     {"&OElig;", "Œ"},  {"&oelig;", "œ"},   {"&Scaron;", "Š"},   {"&scaron;", "š"}, {"&Yuml;", "Ÿ"},
-     {"&fnof;", "ƒ"},   {"&circ;", "ˆ"},    {"&tilde;", "˜"},    {"&ensp;", ""},    {"&emsp;", ""},
-     {"&thinsp;", ""},  {"&zwnj;", "‌"},  {"&zwj;", "‍"},    {"&lrm;", "‎"},  {"&rlm;", "‏"},
-     {"&ndash;", "–"},  {"&mdash;", "—"},   {"&lsquo;", "‘"},    {"&rsquo;", "’"},  {"&sbquo;", "‚"},
-     {"&ldquo;", "“"},  {"&rdquo;", "”"},   {"&bdquo;", "„"},    {"&dagger;", "†"}, {"&Dagger;", "‡"},
-     {"&bull;", "•"},   {"&hellip;", "…"},  {"&permil;", "‰"},   {"&prime;", "′"},  {"&Prime;", "″"},
-     {"&lsaquo;", "‹"}, {"&rsaquo;", "›"},  {"&oline;", "‾"},    {"&euro;", "€"},   {"&trade;", "™"},
-     {"&larr;", "←"},   {"&uarr;", "↑"},    {"&rarr;", "→"},     {"&darr;", "↓"},   {"&harr;", "↔"},
-     {"&crarr;", "↵"},  {"&lceil;", "⌈"},   {"&rceil;", "⌉"},    {"&lfloor;", "⌊"}, {"&rfloor;", "⌋"},
-     {"&loz;", "◊"},    {"&spades;", "♠"},  {"&clubs;", "♣"},    {"&hearts;", "♥"}, {"&diams;", "♦"}});
+// Sorted by name (byte order, so uppercase first) to be binary searched. Being constexpr it stays in flash instead of
+// taking up heap like the hash map this used to be.
+constexpr HtmlEntity HTML_ENTITIES[] = {
+    {"AElig", "Æ"},          {"Aacute", "Á"},  {"Acirc", "Â"},      {"Agrave", "À"},         {"Alpha", "Α"},
+    {"Aring", "Å"},          {"Atilde", "Ã"},  {"Auml", "Ä"},       {"Beta", "Β"},           {"Ccedil", "Ç"},
+    {"Chi", "Χ"},            {"Dagger", "‡"},  {"Delta", "Δ"},      {"ETH", "Ð"},            {"Eacute", "É"},
+    {"Ecirc", "Ê"},          {"Egrave", "È"},  {"Epsilon", "Ε"},    {"Eta", "Η"},            {"Euml", "Ë"},
+    {"Gamma", "Γ"},          {"Iacute", "Í"},  {"Icirc", "Î"},      {"Igrave", "Ì"},         {"Iota", "Ι"},
+    {"Iuml", "Ï"},           {"Kappa", "Κ"},   {"Lambda", "Λ"},     {"Mu", "Μ"},             {"Ntilde", "Ñ"},
+    {"Nu", "Ν"},             {"OElig", "Œ"},   {"Oacute", "Ó"},     {"Ocirc", "Ô"},          {"Ograve", "Ò"},
+    {"Omega", "Ω"},          {"Omicron", "Ο"}, {"Oslash", "Ø"},     {"Otilde", "Õ"},         {"Ouml", "Ö"},
+    {"Phi", "Φ"},            {"Pi", "Π"},      {"Prime", "″"},      {"Psi", "Ψ"},            {"Rho", "Ρ"},
+    {"Scaron", "Š"},         {"Sigma", "Σ"},   {"THORN", "Þ"},      {"Tau", "Τ"},            {"Theta", "Θ"},
+    {"Uacute", "Ú"},         {"Ucirc", "Û"},   {"Ugrave", "Ù"},     {"Upsilon", "Υ"},        {"Uuml", "Ü"},
+    {"Xi", "Ξ"},             {"Yacute", "Ý"},  {"Yuml", "Ÿ"},       {"Zeta", "Ζ"},           {"aacute", "á"},
+    {"acirc", "â"},          {"acute", "´"},   {"aelig", "æ"},      {"agrave", "à"},         {"alpha", "α"},
+    {"amp", "&"},            {"and", "∧"},     {"ang", "∠"},        {"aring", "å"},          {"asymp", "≈"},
+    {"atilde", "ã"},         {"auml", "ä"},    {"bdquo", "„"},      {"beta", "β"},           {"brvbar", "¦"},
+    {"bull", "•"},           {"cap", "∩"},     {"ccedil", "ç"},     {"cedil", "¸"},          {"cent", "¢"},
+    {"chi", "χ"},            {"circ", "ˆ"},    {"clubs", "♣"},      {"cong", "≅"},           {"copy", "©"},
+    {"crarr", "↵"},          {"cup", "∪"},     {"curren", "¤"},     {"dagger", "†"},         {"darr", "↓"},
+    {"deg", "°"},            {"delta", "δ"},   {"diams", "♦"},      {"divide", "÷"},         {"eacute", "é"},
+    {"ecirc", "ê"},          {"egrave", "è"},  {"empty", "∅"},      {"emsp", ""},            {"ensp", ""},
+    {"epsilon", "ε"},        {"equiv", "≡"},   {"eta", "η"},        {"eth", "ð"},            {"euml", "ë"},
+    {"euro", "€"},           {"exist", "∃"},   {"fnof", "ƒ"},       {"forall", "∀"},         {"frac12", "½"},
+    {"frac14", "¼"},         {"frac34", "¾"},  {"frasl", "⁄"},      {"gamma", "γ"},          {"ge", "≥"},
+    {"gt", ">"},             {"harr", "↔"},    {"hearts", "♥"},     {"hellip", "…"},         {"iacute", "í"},
+    {"icirc", "î"},          {"iexcl", "¡"},   {"igrave", "ì"},     {"infin", "∞"},          {"int", "∫"},
+    {"iota", "ι"},           {"iquest", "¿"},  {"isin", "∈"},       {"iuml", "ï"},           {"kappa", "κ"},
+    {"lambda", "λ"},         {"laquo", "«"},   {"larr", "←"},       {"lceil", "⌈"},          {"ldquo", "“"},
+    {"le", "≤"},             {"lfloor", "⌊"},  {"lowast", "∗"},     {"loz", "◊"},            {"lrm", "\xE2\x80\x8E"},
+    {"lsaquo", "‹"},         {"lsquo", "‘"},   {"lt", "<"},         {"macr", "¯"},           {"mdash", "—"},
+    {"micro", "µ"},          {"minus", "−"},   {"mu", "μ"},         {"nabla", "∇"},          {"nbsp", " "},
+    {"ndash", "–"},          {"ne", "≠"},      {"ni", "∋"},         {"not", "¬"},            {"notin", "∉"},
+    {"nsub", "⊄"},           {"ntilde", "ñ"},  {"nu", "ν"},         {"oacute", "ó"},         {"ocirc", "ô"},
+    {"oelig", "œ"},          {"ograve", "ò"},  {"oline", "‾"},      {"omega", "ω"},          {"omicron", "ο"},
+    {"oplus", "⊕"},          {"or", "∨"},      {"ordf", "ª"},       {"ordm", "º"},           {"oslash", "ø"},
+    {"otilde", "õ"},         {"otimes", "⊗"},  {"ouml", "ö"},       {"para", "¶"},           {"part", "∂"},
+    {"permil", "‰"},         {"perp", "⊥"},    {"phi", "φ"},        {"pi", "π"},             {"piv", "ϖ"},
+    {"plusmn", "±"},         {"pound", "£"},   {"prime", "′"},      {"prod", "∏"},           {"prop", "∝"},
+    {"psi", "ψ"},            {"quot", "\""},   {"radic", "√"},      {"raquo", "»"},          {"rarr", "→"},
+    {"rceil", "⌉"},          {"rdquo", "”"},   {"reg", "®"},        {"rfloor", "⌋"},         {"rho", "ρ"},
+    {"rlm", "\xE2\x80\x8F"}, {"rsaquo", "›"},  {"rsquo", "’"},      {"sbquo", "‚"},          {"scaron", "š"},
+    {"sdot", "⋅"},           {"sect", "§"},    {"shy", "\xC2\xAD"}, {"sigma", "σ"},          {"sigmaf", "ς"},
+    {"sim", "∼"},            {"spades", "♠"},  {"sub", "⊂"},        {"sube", "⊆"},           {"sum", "∑"},
+    {"sup", "⊃"},            {"sup1", "¹"},    {"sup2", "²"},       {"sup3", "³"},           {"supe", "⊇"},
+    {"szlig", "ß"},          {"tau", "τ"},     {"there4", "∴"},     {"theta", "θ"},          {"thetasym", "ϑ"},
+    {"thinsp", ""},          {"thorn", "þ"},   {"tilde", "˜"},      {"times", "×"},          {"trade", "™"},
+    {"uacute", "ú"},         {"uarr", "↑"},    {"ucirc", "û"},      {"ugrave", "ù"},         {"uml", "¨"},
+    {"upsih", "ϒ"},          {"upsilon", "υ"}, {"uuml", "ü"},       {"xi", "ξ"},             {"yacute", "ý"},
+    {"yen", "¥"},            {"yuml", "ÿ"},    {"zeta", "ζ"},       {"zwj", "\xE2\x80\x8D"}, {"zwnj", "\xE2\x80\x8C"}
+};
 
-// converts from a unicode code point to the utf8 equivalent
-void convert_to_utf8(const int code, std::string& res) {
-  // convert to a utf8 sequence
-  if (code < 0x80) {
-    res += static_cast<char>(code);
-  } else if (code < 0x800) {
-    res += static_cast<char>(0xc0 | (code >> 6));
-    res += static_cast<char>(0x80 | (code & 0x3f));
-  } else if (code < 0x10000) {
-    res += static_cast<char>(0xe0 | (code >> 12));
-    res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
-    res += static_cast<char>(0x80 | (code & 0x3f));
-  } else if (code < 0x200000) {
-    res += static_cast<char>(0xf0 | (code >> 18));
-    res += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
-    res += static_cast<char>(0x80 | (code & 0x3f));
-  } else if (code < 0x4000000) {
-    res += static_cast<char>(0xf8 | (code >> 24));
-    res += static_cast<char>(0x80 | ((code >> 18) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
-    res += static_cast<char>(0x80 | (code & 0x3f));
-  } else if (code < 0x80000000) {
-    res += static_cast<char>(0xfc | (code >> 30));
-    res += static_cast<char>(0x80 | ((code >> 24) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 18) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
-    res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+constexpr int compareNames(const char* a, const char* b) {
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+constexpr bool isSorted() {
+  for (size_t i = 1; i < std::size(HTML_ENTITIES); i++) {
+    if (compareNames(HTML_ENTITIES[i - 1].name, HTML_ENTITIES[i].name) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(isSorted(), "HTML_ENTITIES must be sorted by name");
+
+// Compares an entity's name with a name that isn't null terminated
+int compareName(const HtmlEntity& entity, const char* name, const size_t length) {
+  const int result = strncmp(entity.name, name, length);
+  if (result != 0) {
+    return result;
   }
+  return entity.name[length] == '\0' ? 0 : 1;
 }
 
-// handles numeric entities - e.g. &#1234; or &#x1234;
-bool process_numeric_entity(const std::string& entity, std::string& res) {
-  int code = 0;
-  // is it hex?
-  if (entity[2] == 'x' || entity[2] == 'X') {
-    // parse the hex code
-    code = strtol(entity.substr(3, entity.size() - 3).c_str(), nullptr, 16);
-  } else {
-    code = strtol(entity.substr(2, entity.size() - 3).c_str(), nullptr, 10);
+const HtmlEntity* findEntity(const char* name, const size_t length) {
+  const auto* end = std::end(HTML_ENTITIES);
+  const auto* it = std::lower_bound(
+      std::begin(HTML_ENTITIES), end, name,
+      [length](const HtmlEntity& entity, const char* key) { return compareName(entity, key, length) < 0; });
+  return it != end && compareName(*it, name, length) == 0 ? it : nullptr;
+}
+}  // namespace
+
+size_t decodeCharacterReference(const char* digits, const size_t length, char* out) {
+  const bool hex = length > 0 && (digits[0] == 'x' || digits[0] == 'X');
+  size_t i = hex ? 1 : 0;
+  if (i == length) {
+    return 0;
   }
-  if (code != 0) {
-    // special handling for nbsp
-    if (code == 0xA0) {
-      res += " ";
+  uint32_t code = 0;
+  for (; i < length; i++) {
+    const char c = digits[i];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (hex && c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (hex && c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
     } else {
-      convert_to_utf8(code, res);
+      return 0;
+    }
+    code = code * (hex ? 16 : 10) + digit;
+    if (code > 0x10FFFF) {
+      return 0;
     }
-    return true;
   }
-  return false;
-}
+  if (code == 0 || (code >= 0xD800 && code <= 0xDFFF)) {
+    return 0;
+  }
 
-// handles named entities - e.g. &amp;
-bool process_string_entity(const std::string& entity, std::string& res) {
-  // it's a named entity - find it in the lookup table
-  // find it in the map
-  const auto it = entity_lookup.find(entity);
-  if (it != entity_lookup.end()) {
-    res += it->second;
-    return true;
+  // convert to a utf8 sequence
+  if (code < 0x80) {
+    out[0] = static_cast<char>(code);
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = static_cast<char>(0xc0 | (code >> 6));
+    out[1] = static_cast<char>(0x80 | (code & 0x3f));
+    return 2;
   }
-  return false;
+  if (code < 0x10000) {
+    out[0] = static_cast<char>(0xe0 | (code >> 12));
+    out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (code & 0x3f));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xf0 | (code >> 18));
+  out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+  out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+  out[3] = static_cast<char>(0x80 | (code & 0x3f));
+  return 4;
 }
 
-// replace all the entities in the string
-std::string replaceHtmlEntities(const char* text) {
-  std::string res;
-  res.reserve(strlen(text));
-  for (int i = 0; i < strlen(text); ++i) {
-    bool flag = false;
+size_t decodeHtmlEntities(char* text, const size_t length) {
+  size_t written = 0;
+  size_t i = 0;
+  while (i < length) {
     // do we have a potential entity?
     if (text[i] == '&') {
       // find the end of the entity
-      int j = i + 1;
-      while (j < strlen(text) && text[j] != ';' && j - i < MAX_ENTITY_LENGTH) {
-        j++;
+      size_t end = i + 1;
+      while (end < length && text[end] != ';' && end - i <= MAX_ENTITY_NAME_LENGTH) {
+        end++;
       }
-      if (j - i > 2) {
-        char entity[j - i + 1];
-        strncpy(entity, text + i, j - i);
-        // is it a numeric code?
-        if (entity[1] == '#') {
-          flag = process_numeric_entity(entity, res);
-        } else {
-          flag = process_string_entity(entity, res);
+      if (end < length && text[end] == ';' && end - i > 2) {
+        const char* name = text + i + 1;
+        const size_t nameLength = end - i - 1;
+        char decoded[4];
+        size_t decodedLength = 0;
+        bool found = false;
+        if (name[0] == '#') {
+          decodedLength = decodeCharacterReference(name + 1, nameLength - 1, decoded);
+          found = decodedLength > 0;
+          // special handling for nbsp, the same as &nbsp;
+          if (decodedLength == 2 && decoded[0] == '\xC2' && decoded[1] == '\xA0') {
+            decoded[0] = ' ';
+            decodedLength = 1;
+          }
+        } else if (const HtmlEntity* entity = findEntity(name, nameLength)) {
+          decodedLength = strlen(entity->utf8);
+          memcpy(decoded, entity->utf8, decodedLength);
+          found = true;
         }
-        // skip past the entity if we successfully decoded it
-        if (flag) {
-          i = j;
+        // Never longer than the entity it replaces, so it can't overwrite what is still to be read
+        if (found) {
+          memcpy(text + written, decoded, decodedLength);
+          written += decodedLength;
+          i = end + 1;
+          continue;
         }
       }
     }
-    if (!flag) {
-      res += text[i];
-    }
+    text[written++] = text[i++];
   }
-  return res;
+  return written;
 }
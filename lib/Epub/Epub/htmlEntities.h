@@ -2,6 +2,13 @@
 // https://github.com/atomic14/diy-esp32-epub-reader/blob/2c2f57fdd7e2a788d14a0bcb26b9e845a47aac42/lib/Epub/RubbishHtmlParser/htmlEntities.cpp
 
 #pragma once
-#include <string>
+#include <cstddef>
+#include <cstdint>
 
-std::string replaceHtmlEntities(const char* text);
+// Decodes the entities (&amp;, &eacute;, &#233;, ...) in text in place and returns its new length. Decoded text is
+// never longer, unknown entities are left as they are.
+size_t decodeHtmlEntities(char* text, size_t length);
+
+// Writes the UTF-8 of a numeric character reference, given what follows its "&#" (e.g. "233" or "xE9"), to out which
+// needs room for 4 bytes. Returns the number of bytes written, 0 if it isn't a valid reference.
+size_t decodeCharacterReference(const char* digits, size_t length, char* out);
@@ -1,58 +1,87 @@
 #include "ChapterHtmlSlimParser.h"
 
-#include <GfxRenderer.h>
 #include <HardwareSerial.h>
-#include <SDCardManager.h>
 #include <expat.h>
 
-#include "../Page.h"
+#include "../BookStyles.h"
+#include "../ChapterTokens.h"
 #include "../htmlEntities.h"
-
-const char* HEADER_TAGS[] = {"h1", "h2", "h3", "h4", "h5", "h6"};
-constexpr int NUM_HEADER_TAGS = sizeof(HEADER_TAGS) / sizeof(HEADER_TAGS[0]);
+#include "CssParser.h"
+#include "XhtmlTags.h"
 
 // Minimum file size (in bytes) to show progress bar - smaller chapters don't benefit from it
 constexpr size_t MIN_SIZE_FOR_PROGRESS = 50 * 1024;  // 50KB
 
-const char* BLOCK_TAGS[] = {"p", "li", "div", "br", "blockquote"};
-constexpr int NUM_BLOCK_TAGS = sizeof(BLOCK_TAGS) / sizeof(BLOCK_TAGS[0]);
-
-const char* BOLD_TAGS[] = {"b", "strong"};
-constexpr int NUM_BOLD_TAGS = sizeof(BOLD_TAGS) / sizeof(BOLD_TAGS[0]);
-
-const char* ITALIC_TAGS[] = {"i", "em"};
-constexpr int NUM_ITALIC_TAGS = sizeof(ITALIC_TAGS) / sizeof(ITALIC_TAGS[0]);
-
-const char* IMAGE_TAGS[] = {"img"};
-constexpr int NUM_IMAGE_TAGS = sizeof(IMAGE_TAGS) / sizeof(IMAGE_TAGS[0]);
-
-const char* SKIP_TAGS[] = {"head", "table"};
-constexpr int NUM_SKIP_TAGS = sizeof(SKIP_TAGS) / sizeof(SKIP_TAGS[0]);
+// Words between checks whether a text block past ChapterPageBuilder::MAX_TEXT_BLOCK_WORDS needs splitting
+constexpr size_t LONG_TEXT_BLOCK_CHECK_WORDS = 32;
 
 bool isWhitespace(const char c) { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
 
-// given the start and end of a tag, check to see if it matches a known tag
-bool matches(const char* tag_name, const char* possible_tags[], const int possible_tag_count) {
-  for (int i = 0; i < possible_tag_count; i++) {
-    if (strcmp(tag_name, possible_tags[i]) == 0) {
-      return true;
+void ChapterHtmlSlimParser::startNewTextBlock(const TextBlock::Style style) {
+  if (tokenWriter) {
+    tokenWriter->textBlock(style);
+  }
+  wordsInTextBlock = 0;
+  pages.startNewTextBlock(style);
+}
+
+void ChapterHtmlSlimParser::addAnchor(const XML_Char** atts) {
+  if (atts == nullptr) {
+    return;
+  }
+  for (int i = 0; atts[i]; i += 2) {
+    if (strcmp(atts[i], "id") == 0) {
+      if (tokenWriter) {
+        tokenWriter->anchor(atts[i + 1]);
+      }
+      pages.addAnchor(atts[i + 1]);
+      return;
     }
   }
-  return false;
 }
 
-// start a new text block if needed
-void ChapterHtmlSlimParser::startNewTextBlock(const TextBlock::Style style) {
-  if (currentTextBlock) {
-    // already have a text block running and it is empty - just reuse it
-    if (currentTextBlock->isEmpty()) {
-      currentTextBlock->setStyle(style);
+EpdFontFamily::Style ChapterHtmlSlimParser::currentFontStyle() const {
+  return styleStack.empty() ? EpdFontFamily::REGULAR : styleStack.back().fontStyle;
+}
+
+void ChapterHtmlSlimParser::addImage(const XML_Char** atts) {
+  if (atts == nullptr) {
+    return;
+  }
+  for (int i = 0; atts[i]; i += 2) {
+    if (strcmp(atts[i], "src") == 0 || strcmp(atts[i], "xlink:href") == 0 || strcmp(atts[i], "href") == 0) {
+      if (tokenWriter) {
+        tokenWriter->image(atts[i + 1]);
+      }
+      pages.addImage(atts[i + 1]);
       return;
     }
+  }
+}
 
-    makePages();
+void ChapterHtmlSlimParser::flushPartWord(const EpdFontFamily::Style fontStyle) {
+  size_t length = partWordBufferIndex;
+  if (partWordHasEntity) {
+    length = decodeHtmlEntities(partWordBuffer, length);
+    partWordHasEntity = false;
+  }
+  partWordBufferIndex = 0;
+  if (tokenWriter) {
+    tokenWriter->word(partWordBuffer, length, fontStyle);
+  }
+  wordsInTextBlock++;
+  pages.addWord(partWordBuffer, length, fontStyle);
+
+  // How much of a long text block the page builder still holds depends on the layout, so every check that could
+  // split it is recorded and the split itself is left to whichever layout replays the tokens. Checking by word count
+  // rather than as text arrives keeps the pages the same however the chapter's text is split up by the parser.
+  if (wordsInTextBlock > ChapterPageBuilder::MAX_TEXT_BLOCK_WORDS &&
+      wordsInTextBlock % LONG_TEXT_BLOCK_CHECK_WORDS == 0) {
+    if (tokenWriter) {
+      tokenWriter->longTextBlockCheck();
+    }
+    pages.layoutLongTextBlock();
   }
-  currentTextBlock.reset(new ParsedText(style, extraParagraphSpacing));
 }
 
 void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char* name, const XML_Char** atts) {
@@ -64,15 +93,45 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     return;
   }
 
-  if (matches(name, IMAGE_TAGS, NUM_IMAGE_TAGS)) {
-    // TODO: Start processing image tags
+  const char* classAttr = nullptr;
+  const char* id = nullptr;
+  const char* styleAttr = nullptr;
+  if (atts != nullptr) {
+    for (int i = 0; atts[i]; i += 2) {
+      if (strcmp(atts[i], "class") == 0) {
+        classAttr = atts[i + 1];
+      } else if (strcmp(atts[i], "id") == 0) {
+        id = atts[i + 1];
+      } else if (strcmp(atts[i], "style") == 0) {
+        styleAttr = atts[i + 1];
+      }
+    }
+  }
+  CssStyle css;
+  if (self->styles) {
+    css = self->styles->resolve(name, classAttr, id);
+  }
+  if (styleAttr) {
+    CssParser::parseDeclarations(styleAttr, strlen(styleAttr), css);
+  }
+
+  const uint8_t tagClass = classifyTag(name);
+  if (tagClass & TAG_SKIP || css.flags & CssStyle::HIDDEN) {
+    // start skip
+    self->addAnchor(atts);
     self->skipUntilDepth = self->depth;
     self->depth += 1;
     return;
   }
 
-  if (matches(name, SKIP_TAGS, NUM_SKIP_TAGS)) {
-    // start skip
+  if (tagClass & TAG_IMAGE) {
+    // An image sits between the text before and after it, even inside a paragraph
+    if (self->partWordBufferIndex > 0) {
+      self->flushPartWord(self->currentFontStyle());
+    }
+    self->startNewTextBlock(self->pages.getTextBlockStyle());
+    self->addAnchor(atts);
+    self->addImage(atts);
     self->skipUntilDepth = self->depth;
     self->depth += 1;
     return;
@@ -83,6 +142,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     for (int i = 0; atts[i]; i += 2) {
       if (strcmp(atts[i], "role") == 0 && strcmp(atts[i + 1], "doc-pagebreak") == 0 ||
           strcmp(atts[i], "epub:type") == 0 && strcmp(atts[i + 1], "pagebreak") == 0) {
+        self->addAnchor(atts);
         self->skipUntilDepth = self->depth;
         self->depth += 1;
         return;
@@ -90,21 +150,47 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     }
   }
 
-  if (matches(name, HEADER_TAGS, NUM_HEADER_TAGS)) {
-    self->startNewTextBlock(TextBlock::CENTER_ALIGN);
-    self->boldUntilDepth = std::min(self->boldUntilDepth, self->depth);
-  } else if (matches(name, BLOCK_TAGS, NUM_BLOCK_TAGS)) {
-    if (strcmp(name, "br") == 0) {
-      self->startNewTextBlock(self->currentTextBlock->getStyle());
+  // Font style and alignment are inherited, the element's own tag and rules then override them
+  InheritedStyle style = self->styleStack.empty()
+                             ? InheritedStyle{self->depth, EpdFontFamily::REGULAR, false, TextBlock::JUSTIFIED}
+                             : self->styleStack.back();
+  style.depth = self->depth;
+  uint8_t fontStyle = style.fontStyle;
+  const bool isHeader = tagClass & TAG_HEADER;
+  if (tagClass & (TAG_HEADER | TAG_BOLD)) {
+    fontStyle |= EpdFontFamily::BOLD;
+  } else if (tagClass & TAG_ITALIC) {
+    fontStyle |= EpdFontFamily::ITALIC;
+  }
+  if (css.flags & CssStyle::HAS_BOLD) {
+    fontStyle = css.flags & CssStyle::BOLD ? fontStyle | EpdFontFamily::BOLD : fontStyle & ~EpdFontFamily::BOLD;
+  }
+  if (css.flags & CssStyle::HAS_ITALIC) {
+    fontStyle = css.flags & CssStyle::ITALIC ? fontStyle | EpdFontFamily::ITALIC : fontStyle & ~EpdFontFamily::ITALIC;
+  }
+  if (css.flags & CssStyle::HAS_ALIGN) {
+    style.hasAlign = true;
+    style.align = css.align;
+  }
+
+  if (isHeader) {
+    // Headers are centred unless a rule for them says otherwise, what they are inside of doesn't matter
+    self->startNewTextBlock(css.flags & CssStyle::HAS_ALIGN ? css.align : TextBlock::CENTER_ALIGN);
+  } else if (tagClass & TAG_BLOCK) {
+    if (tagClass & TAG_LINE_BREAK) {
+      self->startNewTextBlock(self->pages.getTextBlockStyle());
     } else {
-      self->startNewTextBlock(TextBlock::JUSTIFIED);
+      self->startNewTextBlock(style.hasAlign ? style.align : TextBlock::JUSTIFIED);
     }
-  } else if (matches(name, BOLD_TAGS, NUM_BOLD_TAGS)) {
-    self->boldUntilDepth = std::min(self->boldUntilDepth, self->depth);
-  } else if (matches(name, ITALIC_TAGS, NUM_ITALIC_TAGS)) {
-    self->italicUntilDepth = std::min(self->italicUntilDepth, self->depth);
   }
 
+  if (fontStyle != style.fontStyle || css.flags & CssStyle::HAS_ALIGN) {
+    style.fontStyle = static_cast<EpdFontFamily::Style>(fontStyle);
+    self->styleStack.push_back(style);
+  }
+
+  // After any new text block, so an id on a heading or paragraph lands with its first word
+  self->addAnchor(atts);
   self->depth += 1;
 }
 
@@ -116,22 +202,13 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
     return;
   }
 
-  EpdFontFamily::Style fontStyle = EpdFontFamily::REGULAR;
-  if (self->boldUntilDepth < self->depth && self->italicUntilDepth < self->depth) {
-    fontStyle = EpdFontFamily::BOLD_ITALIC;
-  } else if (self->boldUntilDepth < self->depth) {
-    fontStyle = EpdFontFamily::BOLD;
-  } else if (self->italicUntilDepth < self->depth) {
-    fontStyle = EpdFontFamily::ITALIC;
-  }
+  const EpdFontFamily::Style fontStyle = self->currentFontStyle();
 
   for (int i = 0; i < len; i++) {
     if (isWhitespace(s[i])) {
       // Currently looking at whitespace, if there's anything in the partWordBuffer, flush it
       if (self->partWordBufferIndex > 0) {
-        self->partWordBuffer[self->partWordBufferIndex] = '\0';
-        self->currentTextBlock->addWord(std::move(replaceHtmlEntities(self->partWordBuffer)), fontStyle);
-        self->partWordBufferIndex = 0;
+        self->flushPartWord(fontStyle);
       }
       // Skip the whitespace char
       continue;
@@ -139,24 +216,14 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
 
     // If we're about to run out of space, then cut the word off and start a new one
     if (self->partWordBufferIndex >= MAX_WORD_SIZE) {
-      self->partWordBuffer[self->partWordBufferIndex] = '\0';
-      self->currentTextBlock->addWord(std::move(replaceHtmlEntities(self->partWordBuffer)), fontStyle);
-      self->partWordBufferIndex = 0;
+      self->flushPartWord(fontStyle);
     }
 
+    if (s[i] == '&') {
+      self->partWordHasEntity = true;
+    }
     self->partWordBuffer[self->partWordBufferIndex++] = s[i];
   }
-
-  // If we have > 750 words buffered up, perform the layout and consume out all but the last line
-  // There should be enough here to build out 1-2 full pages and doing this will free up a lot of
-  // memory.
-  // Spotted when reading Intermezzo, there are some really long text blocks in there.
-  if (self->currentTextBlock->size() > 750) {
-    Serial.printf("[%lu] [EHP] Text block too long, splitting into multiple pages\n", millis());
-    self->currentTextBlock->layoutAndExtractLines(
-        self->renderer, self->fontId, self->viewportWidth,
-        [self](const std::shared_ptr<TextBlock>& textBlock) { self->addLineToPage(textBlock); }, false);
-  }
 }
 
 void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* name) {
@@ -165,25 +232,19 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
   if (self->partWordBufferIndex > 0) {
     // Only flush out part word buffer if we're closing a block tag or are at the top of the HTML file.
     // We don't want to flush out content when closing inline tags like <span>.
-    // Currently this also flushes out on closing <b> and <i> tags, but they are line tags so that shouldn't happen,
-    // text styling needs to be overhauled to fix it.
-    const bool shouldBreakText =
-        matches(name, BLOCK_TAGS, NUM_BLOCK_TAGS) || matches(name, HEADER_TAGS, NUM_HEADER_TAGS) ||
-        matches(name, BOLD_TAGS, NUM_BOLD_TAGS) || matches(name, ITALIC_TAGS, NUM_ITALIC_TAGS) || self->depth == 1;
+    // Currently this also flushes out on closing <b> and <i> tags (and any other element that changed the font style),
+    // but they are line tags so that shouldn't happen, text styling needs to be overhauled to fix it.
+    bool closesFontStyle = false;
+    if (!self->styleStack.empty() && self->styleStack.back().depth == self->depth - 1) {
+      const auto& styles = self->styleStack;
+      const auto outerFontStyle = styles.size() > 1 ? styles.end()[-2].fontStyle : EpdFontFamily::REGULAR;
+      closesFontStyle = styles.back().fontStyle != outerFontStyle;
+    }
+    const bool shouldBreakText = classifyTag(name) & (TAG_BLOCK | TAG_HEADER | TAG_BOLD | TAG_ITALIC) ||
+                                 closesFontStyle || self->depth == 1;
 
     if (shouldBreakText) {
-      EpdFontFamily::Style fontStyle = EpdFontFamily::REGULAR;
-      if (self->boldUntilDepth < self->depth && self->italicUntilDepth < self->depth) {
-        fontStyle = EpdFontFamily::BOLD_ITALIC;
-      } else if (self->boldUntilDepth < self->depth) {
-        fontStyle = EpdFontFamily::BOLD;
-      } else if (self->italicUntilDepth < self->depth) {
-        fontStyle = EpdFontFamily::ITALIC;
-      }
-
-      self->partWordBuffer[self->partWordBufferIndex] = '\0';
-      self->currentTextBlock->addWord(std::move(replaceHtmlEntities(self->partWordBuffer)), fontStyle);
-      self->partWordBufferIndex = 0;
+      self->flushPartWord(self->currentFontStyle());
     }
   }
 
@@ -194,70 +255,89 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
     self->skipUntilDepth = INT_MAX;
   }
 
-  // Leaving bold
-  if (self->boldUntilDepth == self->depth) {
-    self->boldUntilDepth = INT_MAX;
+  // Leaving an element that set a style
+  if (!self->styleStack.empty() && self->styleStack.back().depth == self->depth) {
+    self->styleStack.pop_back();
   }
+}
+
+ChapterHtmlSlimParser::~ChapterHtmlSlimParser() { freeParser(); }
 
-  // Leaving italic
-  if (self->italicUntilDepth == self->depth) {
-    self->italicUntilDepth = INT_MAX;
+void ChapterHtmlSlimParser::freeParser() {
+#if CHAPTER_PARSER_EXPAT
+  if (parser) {
+    XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
+    XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
+    XML_SetCharacterDataHandler(parser, nullptr);
+    XML_ParserFree(parser);
+    parser = nullptr;
   }
+#else
+  tokenizer.reset();
+#endif
 }
 
-bool ChapterHtmlSlimParser::parseAndBuildPages() {
+bool ChapterHtmlSlimParser::begin() {
   startNewTextBlock(TextBlock::JUSTIFIED);
 
-  const XML_Parser parser = XML_ParserCreate(nullptr);
-  int done;
-
+#if CHAPTER_PARSER_EXPAT
+  parser = XML_ParserCreate(nullptr);
   if (!parser) {
     Serial.printf("[%lu] [EHP] Couldn't allocate memory for parser\n", millis());
     return false;
   }
 
-  FsFile file;
-  if (!SdMan.openFileForRead("EHP", filepath, file)) {
-    XML_ParserFree(parser);
-    return false;
-  }
-
-  // Get file size for progress calculation
-  const size_t totalSize = file.size();
-  size_t bytesRead = 0;
-  int lastProgress = -1;
-
   XML_SetUserData(parser, this);
   XML_SetElementHandler(parser, startElement, endElement);
   XML_SetCharacterDataHandler(parser, characterData);
+#else
+  tokenizer.reset(new XhtmlTokenizer(this, startElement, endElement, characterData));
+#endif
+
+  // Get entry size for progress calculation
+  totalSize = reader.getSize();
+  bytesRead = 0;
+  lastProgress = -1;
+  return true;
+}
 
+bool ChapterHtmlSlimParser::parseNext(const size_t maxBytes, bool* done) {
+  *done = false;
+#if CHAPTER_PARSER_EXPAT
+  if (!parser) {
+    return false;
+  }
+#else
+  if (!tokenizer) {
+    return false;
+  }
+#endif
+
+  size_t parsed = 0;
   do {
+#if CHAPTER_PARSER_EXPAT
     void* const buf = XML_GetBuffer(parser, 1024);
     if (!buf) {
       Serial.printf("[%lu] [EHP] Couldn't allocate memory for buffer\n", millis());
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
+      freeParser();
       return false;
     }
+#else
+    char* const buf = readBuffer;
+#endif
 
-    const size_t len = file.read(buf, 1024);
+    const size_t len = reader.read(buf, 1024);
 
-    if (len == 0 && file.available() > 0) {
-      Serial.printf("[%lu] [EHP] File read error\n", millis());
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
+    if (reader.hasFailed()) {
+      Serial.printf("[%lu] [EHP] Chapter read error\n", millis());
+      freeParser();
       return false;
     }
 
     // Update progress (call every 10% change to avoid too frequent updates)
     // Only show progress for larger chapters where rendering overhead is worth it
     bytesRead += len;
+    parsed += len;
     if (progressFn && totalSize >= MIN_SIZE_FOR_PROGRESS) {
       const int progress = static_cast<int>((bytesRead * 100) / totalSize);
       if (lastProgress / 10 != progress / 10) {
@@ -266,67 +346,37 @@ bool ChapterHtmlSlimParser::parseAndBuildPages() {
       }
     }
 
-    done = file.available() == 0;
+    *done = reader.getPosition() == totalSize;
 
-    if (XML_ParseBuffer(parser, static_cast<int>(len), done) == XML_STATUS_ERROR) {
+#if CHAPTER_PARSER_EXPAT
+    if (XML_ParseBuffer(parser, static_cast<int>(len), *done) == XML_STATUS_ERROR) {
       Serial.printf("[%lu] [EHP] Parse error at line %lu:\n%s\n", millis(), XML_GetCurrentLineNumber(parser),
                     XML_ErrorString(XML_GetErrorCode(parser)));
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
+      freeParser();
+      *done = false;
       return false;
     }
-  } while (!done);
-
-  XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-  XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-  XML_SetCharacterDataHandler(parser, nullptr);
-  XML_ParserFree(parser);
-  file.close();
-
-  // Process last page if there is still text
-  if (currentTextBlock) {
-    makePages();
-    completePageFn(std::move(currentPage));
-    currentPage.reset();
-    currentTextBlock.reset();
-  }
-
-  return true;
-}
-
-void ChapterHtmlSlimParser::addLineToPage(std::shared_ptr<TextBlock> line) {
-  const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
+#else
+    if (!tokenizer->parse(buf, len, *done)) {
+      Serial.printf("[%lu] [EHP] Parse error\n", millis());
+      freeParser();
+      *done = false;
+      return false;
+    }
+#endif
+  } while (!*done && parsed < maxBytes);
 
-  if (currentPageNextY + lineHeight > viewportHeight) {
-    completePageFn(std::move(currentPage));
-    currentPage.reset(new Page());
-    currentPageNextY = 0;
+  if (!*done) {
+    return true;
   }
 
-  currentPage->elements.push_back(std::make_shared<PageLine>(line, 0, currentPageNextY));
-  currentPageNextY += lineHeight;
-}
-
-void ChapterHtmlSlimParser::makePages() {
-  if (!currentTextBlock) {
-    Serial.printf("[%lu] [EHP] !! No text block to make pages for !!\n", millis());
-    return;
-  }
+  freeParser();
+  pages.finish();
 
-  if (!currentPage) {
-    currentPage.reset(new Page());
-    currentPageNextY = 0;
-  }
+  return true;
+}
 
-  const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
-  currentTextBlock->layoutAndExtractLines(
-      renderer, fontId, viewportWidth,
-      [this](const std::shared_ptr<TextBlock>& textBlock) { addLineToPage(textBlock); });
-  // Extra paragraph spacing if enabled
-  if (extraParagraphSpacing) {
-    currentPageNextY += lineHeight / 2;
-  }
+bool ChapterHtmlSlimParser::parseAndBuildPages() {
+  bool done = false;
+  return begin() && parseNext(SIZE_MAX, &done);
 }
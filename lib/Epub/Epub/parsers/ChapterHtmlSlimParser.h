@@ -1,64 +1,87 @@
 #pragma once
 
+#include <ZipFile.h>
 #include <expat.h>
 
 #include <climits>
 #include <functional>
 #include <memory>
+#include <vector>
 
-#include "../ParsedText.h"
-#include "../blocks/TextBlock.h"
+#include "../ChapterPageBuilder.h"
+#include "XhtmlTokenizer.h"
 
-class Page;
-class GfxRenderer;
+class BookStyles;
+class ChapterTokenWriter;
 
 #define MAX_WORD_SIZE 200
 
+// Chapters are tokenized by XhtmlTokenizer, which also reads the sloppy HTML some books are made of. Building with
+// -DCHAPTER_PARSER_EXPAT=1 parses them with expat instead, which gives up on any chapter that isn't well-formed XML.
+#ifndef CHAPTER_PARSER_EXPAT
+#define CHAPTER_PARSER_EXPAT 0
+#endif
+
 class ChapterHtmlSlimParser {
-  const std::string& filepath;
-  GfxRenderer& renderer;
-  std::function<void(std::unique_ptr<Page>)> completePageFn;
+  // Chapter XHTML is pulled straight out of the zip as the parser needs it
+  ZipFile::EntryReader& reader;
+  ChapterPageBuilder& pages;
   std::function<void(int)> progressFn;  // Progress callback (0-100)
   int depth = 0;
   int skipUntilDepth = INT_MAX;
-  int boldUntilDepth = INT_MAX;
-  int italicUntilDepth = INT_MAX;
+  // Open elements that changed the font style or set an alignment, innermost last. Each holds what it and the
+  // elements inside it inherit, so closing one restores the style of the one around it.
+  struct InheritedStyle {
+    int depth;
+    EpdFontFamily::Style fontStyle;
+    bool hasAlign;
+    TextBlock::Style align;
+  };
+  std::vector<InheritedStyle> styleStack;
+  // Optional, the book's stylesheets. Inline style attributes are applied either way.
+  const BookStyles* styles;
   // buffer for building up words from characters, will auto break if longer than this
   // leave one char at end for null pointer
   char partWordBuffer[MAX_WORD_SIZE + 1] = {};
   int partWordBufferIndex = 0;
-  std::unique_ptr<ParsedText> currentTextBlock = nullptr;
-  std::unique_ptr<Page> currentPage = nullptr;
-  int16_t currentPageNextY = 0;
-  int fontId;
-  float lineCompression;
-  bool extraParagraphSpacing;
-  uint16_t viewportWidth;
-  uint16_t viewportHeight;
+  // Set when the part word has an '&', only then is it searched for entities to decode
+  bool partWordHasEntity = false;
+  // Words added since the current text block started, an upper bound on what the page builder still holds of it
+  size_t wordsInTextBlock = 0;
+  // Optional, records what is fed to the page builder so the chapter can be laid out again without parsing it
+  ChapterTokenWriter* tokenWriter;
+#if CHAPTER_PARSER_EXPAT
+  XML_Parser parser = nullptr;
+#else
+  std::unique_ptr<XhtmlTokenizer> tokenizer;
+  char readBuffer[1024] = {};
+#endif
+  size_t totalSize = 0;
+  size_t bytesRead = 0;
+  int lastProgress = -1;
 
+  void freeParser();
   void startNewTextBlock(TextBlock::Style style);
-  void makePages();
+  void flushPartWord(EpdFontFamily::Style fontStyle);
+  EpdFontFamily::Style currentFontStyle() const;
+  // Elements with an id can be linked to, e.g. by TOC entries that point into the middle of a chapter
+  void addAnchor(const XML_Char** atts);
+  void addImage(const XML_Char** atts);
   // XML callbacks
   static void XMLCALL startElement(void* userData, const XML_Char* name, const XML_Char** atts);
   static void XMLCALL characterData(void* userData, const XML_Char* s, int len);
   static void XMLCALL endElement(void* userData, const XML_Char* name);
 
  public:
-  explicit ChapterHtmlSlimParser(const std::string& filepath, GfxRenderer& renderer, const int fontId,
-                                 const float lineCompression, const bool extraParagraphSpacing,
-                                 const uint16_t viewportWidth, const uint16_t viewportHeight,
-                                 const std::function<void(std::unique_ptr<Page>)>& completePageFn,
-                                 const std::function<void(int)>& progressFn = nullptr)
-      : filepath(filepath),
-        renderer(renderer),
-        fontId(fontId),
-        lineCompression(lineCompression),
-        extraParagraphSpacing(extraParagraphSpacing),
-        viewportWidth(viewportWidth),
-        viewportHeight(viewportHeight),
-        completePageFn(completePageFn),
-        progressFn(progressFn) {}
-  ~ChapterHtmlSlimParser() = default;
+  explicit ChapterHtmlSlimParser(ZipFile::EntryReader& reader, ChapterPageBuilder& pages,
+                                 const std::function<void(int)>& progressFn = nullptr,
+                                 ChapterTokenWriter* tokenWriter = nullptr, const BookStyles* styles = nullptr)
+      : reader(reader), pages(pages), progressFn(progressFn), styles(styles), tokenWriter(tokenWriter) {}
+  ~ChapterHtmlSlimParser();
+  // Parses the whole chapter in one go
   bool parseAndBuildPages();
-  void addLineToPage(std::shared_ptr<TextBlock> line);
+  // Or a slice at a time: begin once, then parseNext until done is set. Each call reads at least maxBytes of the
+  // chapter (in 1024 byte chunks) unless it ends first, the last page is completed along with the chapter.
+  bool begin();
+  bool parseNext(size_t maxBytes, bool* done);
 };
@@ -4,11 +4,35 @@
 #include <HardwareSerial.h>
 #include <Serialization.h>
 
+#include <algorithm>
+
 #include "../BookMetadataCache.h"
 
 namespace {
 constexpr char MEDIA_TYPE_NCX[] = "application/x-dtbncx+xml";
+constexpr char MEDIA_TYPE_CSS[] = "text/css";
 constexpr char itemCacheFile[] = "/.items.bin";
+constexpr char itemHashFile[] = "/.items.hash";
+constexpr char itemIndexFile[] = "/.items.idx";
+constexpr uint8_t MIN_ITEM_BUCKET_BITS = 4;
+constexpr uint8_t MAX_ITEM_BUCKET_BITS = 11;
+// Index entries gathered in RAM per scan of the hashes while building the index
+constexpr uint32_t ITEM_INDEX_RUN_SIZE = 1024;
+
+struct ItemIndexEntry {
+  uint32_t idHash;
+  uint32_t itemOffset;  // Offset of the item in the item store
+};
+
+// FNV-1a, only used to spread item ids across the index
+uint32_t hashItemId(const char* id) {
+  uint32_t hash = 2166136261u;
+  for (; *id; id++) {
+    hash ^= static_cast<uint8_t>(*id);
+    hash *= 16777619u;
+  }
+  return hash;
+}
 }  // namespace
 
 bool ContentOpfParser::setup() {
@@ -35,9 +59,115 @@ ContentOpfParser::~ContentOpfParser() {
   if (tempItemStore) {
     tempItemStore.close();
   }
-  if (SdMan.exists((cachePath + itemCacheFile).c_str())) {
-    SdMan.remove((cachePath + itemCacheFile).c_str());
+  if (tempItemHashes) {
+    tempItemHashes.close();
+  }
+  if (tempItemIndex) {
+    tempItemIndex.close();
+  }
+  for (const char* tempFile : {itemCacheFile, itemHashFile, itemIndexFile}) {
+    if (SdMan.exists((cachePath + tempFile).c_str())) {
+      SdMan.remove((cachePath + tempFile).c_str());
+    }
+  }
+}
+
+bool ContentOpfParser::buildItemIndex() {
+  const auto start = millis();
+
+  if (!SdMan.openFileForRead("COF", cachePath + itemHashFile, tempItemHashes)) {
+    return false;
+  }
+
+  // Aim for a handful of items per bucket so resolving an idref only reads a short run of the index
+  itemIndexBucketBits = MIN_ITEM_BUCKET_BITS;
+  while (itemIndexBucketBits < MAX_ITEM_BUCKET_BITS && (itemCount >> itemIndexBucketBits) > 8) {
+    itemIndexBucketBits++;
+  }
+  const uint32_t bucketCount = 1u << itemIndexBucketBits;
+  const uint8_t bucketShift = 32 - itemIndexBucketBits;
+
+  // Pass 1: count the items falling in each bucket
+  ItemIndexEntry entry;
+  itemIndexFanout.assign(bucketCount, 0);
+  while (tempItemHashes.read(&entry, sizeof(entry)) == static_cast<int>(sizeof(entry))) {
+    itemIndexFanout[entry.idHash >> bucketShift]++;
+  }
+
+  std::vector<uint32_t> cursors(bucketCount);
+  uint32_t cumulative = 0;
+  uint32_t maxBucketSize = 0;
+  for (uint32_t b = 0; b < bucketCount; b++) {
+    cursors[b] = cumulative;
+    maxBucketSize = std::max(maxBucketSize, itemIndexFanout[b]);
+    cumulative += itemIndexFanout[b];
+    itemIndexFanout[b] = cumulative;
+  }
+
+  if (!SdMan.openFileForWrite("COF", cachePath + itemIndexFile, tempItemIndex)) {
+    tempItemHashes.close();
+    itemIndexFanout.clear();
+    return false;
+  }
+
+  // Pass 2: gather runs of whole buckets in RAM, one scan of the hashes per run, and append each run to the index.
+  // Items keep their manifest order within a bucket, so the first of any duplicate ids wins.
+  std::vector<ItemIndexEntry> run(std::min(std::max(ITEM_INDEX_RUN_SIZE, maxBucketSize), cumulative));
+  uint32_t firstBucket = 0;
+  while (firstBucket < bucketCount) {
+    const uint32_t runStart = cursors[firstBucket];
+    uint32_t endBucket = firstBucket + 1;
+    while (endBucket < bucketCount && itemIndexFanout[endBucket] - runStart <= run.size()) {
+      endBucket++;
+    }
+    const uint32_t runSize = itemIndexFanout[endBucket - 1] - runStart;
+
+    if (runSize > 0) {
+      tempItemHashes.seek(0);
+      while (tempItemHashes.read(&entry, sizeof(entry)) == static_cast<int>(sizeof(entry))) {
+        const uint32_t bucket = entry.idHash >> bucketShift;
+        if (bucket >= firstBucket && bucket < endBucket) {
+          run[cursors[bucket]++ - runStart] = entry;
+        }
+      }
+      tempItemIndex.write(reinterpret_cast<const uint8_t*>(run.data()), sizeof(ItemIndexEntry) * runSize);
+    }
+    firstBucket = endBucket;
+  }
+
+  tempItemHashes.close();
+  tempItemIndex.close();
+  Serial.printf("[%lu] [COF] Indexed %u manifest items in %lums\n", millis(), itemCount, millis() - start);
+  return true;
+}
+
+bool ContentOpfParser::findItemHref(const char* itemId, std::string& href) {
+  if (itemIndexFanout.empty() || !tempItemIndex) {
+    return false;
+  }
+
+  const uint32_t hash = hashItemId(itemId);
+  const uint32_t bucket = hash >> (32 - itemIndexBucketBits);
+  const uint32_t bucketStart = bucket == 0 ? 0 : itemIndexFanout[bucket - 1];
+
+  // Items with a matching hash are checked against the item store, a collision moves on to the next one
+  ItemIndexEntry entry;
+  std::string storedId;
+  tempItemIndex.seek(sizeof(ItemIndexEntry) * bucketStart);
+  for (uint32_t i = bucketStart; i < itemIndexFanout[bucket]; i++) {
+    serialization::readPod(tempItemIndex, entry);
+    if (entry.idHash != hash) {
+      continue;
+    }
+
+    tempItemStore.seek(entry.itemOffset);
+    serialization::readString(tempItemStore, storedId);
+    if (storedId == itemId) {
+      serialization::readString(tempItemStore, href);
+      return true;
+    }
   }
+  return false;
 }
 
 size_t ContentOpfParser::write(const uint8_t data) { return write(&data, 1); }
@@ -109,7 +239,8 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
 
   if (self->state == IN_PACKAGE && (strcmp(name, "manifest") == 0 || strcmp(name, "opf:manifest") == 0)) {
     self->state = IN_MANIFEST;
-    if (!SdMan.openFileForWrite("COF", self->cachePath + itemCacheFile, self->tempItemStore)) {
+    if (!SdMan.openFileForWrite("COF", self->cachePath + itemCacheFile, self->tempItemStore) ||
+        !SdMan.openFileForWrite("COF", self->cachePath + itemHashFile, self->tempItemHashes)) {
       Serial.printf(
           "[%lu] [COF] Couldn't open temp items file for writing. This is probably going to be a fatal error.\n",
           millis());
@@ -119,7 +250,8 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
 
   if (self->state == IN_PACKAGE && (strcmp(name, "spine") == 0 || strcmp(name, "opf:spine") == 0)) {
     self->state = IN_SPINE;
-    if (!SdMan.openFileForRead("COF", self->cachePath + itemCacheFile, self->tempItemStore)) {
+    if (!SdMan.openFileForRead("COF", self->cachePath + itemCacheFile, self->tempItemStore) ||
+        !SdMan.openFileForRead("COF", self->cachePath + itemIndexFile, self->tempItemIndex)) {
       Serial.printf(
           "[%lu] [COF] Couldn't open temp items file for reading. This is probably going to be a fatal error.\n",
           millis());
@@ -172,9 +304,12 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
       }
     }
 
-    // Write items down to SD card
+    // Write items down to SD card, along with the hash of their id for the index
+    const ItemIndexEntry entry = {hashItemId(itemId.c_str()), static_cast<uint32_t>(self->tempItemStore.position())};
     serialization::writeString(self->tempItemStore, itemId);
     serialization::writeString(self->tempItemStore, href);
+    serialization::writePod(self->tempItemHashes, entry);
+    self->itemCount++;
 
     if (itemId == self->coverItemId) {
       self->coverItemHref = href;
@@ -188,6 +323,10 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
                       href.c_str());
       }
     }
+
+    if (mediaType == MEDIA_TYPE_CSS) {
+      self->stylesheetHrefs.push_back(href);
+    }
     return;
   }
 
@@ -197,20 +336,10 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
     if (self->state == IN_SPINE && (strcmp(name, "itemref") == 0 || strcmp(name, "opf:itemref") == 0)) {
       for (int i = 0; atts[i]; i += 2) {
         if (strcmp(atts[i], "idref") == 0) {
-          const std::string idref = atts[i + 1];
-          // Resolve the idref to href using items map
-          // TODO: This lookup is slow as need to scan through all items each time.
-          //       It can take up to 200ms per item when getting to 1500 items.
-          self->tempItemStore.seek(0);
-          std::string itemId;
+          // Resolve the idref to href using the item index
           std::string href;
-          while (self->tempItemStore.available()) {
-            serialization::readString(self->tempItemStore, itemId);
-            serialization::readString(self->tempItemStore, href);
-            if (itemId == idref) {
-              self->cache->createSpineEntry(href);
-              break;
-            }
+          if (self->findItemHref(atts[i + 1], href)) {
+            self->cache->createSpineEntry(href);
           }
         }
       }
@@ -263,6 +392,7 @@ void XMLCALL ContentOpfParser::endElement(void* userData, const XML_Char* name)
   if (self->state == IN_SPINE && (strcmp(name, "spine") == 0 || strcmp(name, "opf:spine") == 0)) {
     self->state = IN_PACKAGE;
     self->tempItemStore.close();
+    self->tempItemIndex.close();
     return;
   }
 
@@ -275,6 +405,10 @@ void XMLCALL ContentOpfParser::endElement(void* userData, const XML_Char* name)
   if (self->state == IN_MANIFEST && (strcmp(name, "manifest") == 0 || strcmp(name, "opf:manifest") == 0)) {
     self->state = IN_PACKAGE;
     self->tempItemStore.close();
+    self->tempItemHashes.close();
+    if (!self->buildItemIndex()) {
+      Serial.printf("[%lu] [COF] Couldn't build manifest item index, spine items won't resolve\n", millis());
+    }
     return;
   }
 
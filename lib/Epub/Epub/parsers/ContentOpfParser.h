@@ -1,6 +1,8 @@
 #pragma once
 #include <Print.h>
 
+#include <vector>
+
 #include "Epub.h"
 #include "expat.h"
 
@@ -25,8 +27,19 @@ class ContentOpfParser final : public Print {
   ParserState state = START;
   BookMetadataCache* cache;
   FsFile tempItemStore;
+  // Hash of each manifest item id and its offset in the item store, in manifest order
+  FsFile tempItemHashes;
+  // The same entries grouped into buckets by hash, used to resolve spine idrefs
+  FsFile tempItemIndex;
+  // Cumulative number of index entries up to and including each bucket
+  std::vector<uint32_t> itemIndexFanout;
+  uint8_t itemIndexBucketBits = 0;
+  uint32_t itemCount = 0;
   std::string coverItemId;
 
+  bool buildItemIndex();
+  bool findItemHref(const char* itemId, std::string& href);
+
   static void startElement(void* userData, const XML_Char* name, const XML_Char** atts);
   static void characterData(void* userData, const XML_Char* s, int len);
   static void endElement(void* userData, const XML_Char* name);
@@ -35,6 +48,8 @@ class ContentOpfParser final : public Print {
   std::string title;
   std::string author;
   std::string tocNcxPath;
+  // Manifest order, which is the order most books link them in
+  std::vector<std::string> stylesheetHrefs;
   std::string coverItemHref;
   std::string textReferenceHref;
 
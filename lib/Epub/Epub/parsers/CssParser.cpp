@@ -0,0 +1,258 @@
+#include "CssParser.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Longer selector lists and declaration blocks are ignored, they are never all simple selectors or short properties
+constexpr size_t MAX_SELECTORS_SIZE = 1024;
+constexpr size_t MAX_DECLARATIONS_SIZE = 1024;
+// Longest selector kept, tag.class
+constexpr size_t MAX_SELECTOR_SIZE = 64;
+// Longest property name or value that is looked at, the ones honoured are all shorter
+constexpr size_t MAX_PROPERTY_SIZE = 16;
+
+bool isCssWhitespace(const char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f'; }
+
+bool isNameChar(const char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+void trim(const char*& start, const char*& end) {
+  while (start < end && isCssWhitespace(*start)) {
+    start++;
+  }
+  while (end > start && isCssWhitespace(*(end - 1))) {
+    end--;
+  }
+}
+
+// Copies a property name or value lowercased into out, false if it is too long to be one that is honoured
+bool lowercase(const char* start, const char* end, char (&out)[MAX_PROPERTY_SIZE + 1]) {
+  if (end - start > static_cast<ptrdiff_t>(MAX_PROPERTY_SIZE)) {
+    return false;
+  }
+  size_t i = 0;
+  for (; start < end; start++) {
+    out[i++] = static_cast<char>(std::tolower(static_cast<unsigned char>(*start)));
+  }
+  out[i] = '\0';
+  return true;
+}
+
+void applyProperty(const char* name, const char* value, CssStyle& style) {
+  if (strcmp(name, "font-weight") == 0) {
+    const bool numeric = std::isdigit(static_cast<unsigned char>(value[0]));
+    if (strcmp(value, "bold") == 0 || strcmp(value, "bolder") == 0 || (numeric && atoi(value) >= 600)) {
+      style.flags |= CssStyle::HAS_BOLD | CssStyle::BOLD;
+    } else if (strcmp(value, "normal") == 0 || strcmp(value, "lighter") == 0 || numeric) {
+      style.flags = (style.flags | CssStyle::HAS_BOLD) & ~CssStyle::BOLD;
+    }
+  } else if (strcmp(name, "font-style") == 0) {
+    if (strcmp(value, "italic") == 0 || strcmp(value, "oblique") == 0) {
+      style.flags |= CssStyle::HAS_ITALIC | CssStyle::ITALIC;
+    } else if (strcmp(value, "normal") == 0) {
+      style.flags = (style.flags | CssStyle::HAS_ITALIC) & ~CssStyle::ITALIC;
+    }
+  } else if (strcmp(name, "text-align") == 0) {
+    if (strcmp(value, "left") == 0 || strcmp(value, "start") == 0) {
+      style.align = TextBlock::LEFT_ALIGN;
+    } else if (strcmp(value, "right") == 0 || strcmp(value, "end") == 0) {
+      style.align = TextBlock::RIGHT_ALIGN;
+    } else if (strcmp(value, "center") == 0) {
+      style.align = TextBlock::CENTER_ALIGN;
+    } else if (strcmp(value, "justify") == 0) {
+      style.align = TextBlock::JUSTIFIED;
+    } else {
+      return;
+    }
+    style.flags |= CssStyle::HAS_ALIGN;
+  } else if (strcmp(name, "display") == 0) {
+    if (strcmp(value, "none") == 0) {
+      style.flags |= CssStyle::HAS_DISPLAY | CssStyle::HIDDEN;
+    } else {
+      style.flags = (style.flags | CssStyle::HAS_DISPLAY) & ~CssStyle::HIDDEN;
+    }
+  }
+}
+
+// Turns a simple selector into the key the style table is looked up by: tag (lowercased), .class, tag.class or #id.
+// A tag in front of an id is dropped, ids are unique within a chapter. Returns the key's length, 0 if it isn't simple.
+size_t selectorKey(const char* start, const char* end, char (&key)[MAX_SELECTOR_SIZE + 1]) {
+  if (start == end || end - start > static_cast<ptrdiff_t>(MAX_SELECTOR_SIZE)) {
+    return 0;
+  }
+  size_t length = 0;
+  const char* c = start;
+  while (c < end && isNameChar(*c)) {
+    key[length++] = static_cast<char>(std::tolower(static_cast<unsigned char>(*c)));
+    c++;
+  }
+  if (c == end) {
+    return length;
+  }
+  if (*c == '#') {
+    length = 0;
+  } else if (*c != '.') {
+    return 0;
+  }
+  key[length++] = *c++;
+  const char* name = c;
+  while (c < end && isNameChar(*c)) {
+    key[length++] = *c++;
+  }
+  // Anything after the name (another class, a pseudo-class, a combinator) makes it more than a simple selector
+  if (c != end || c == name) {
+    return 0;
+  }
+  return length;
+}
+}  // namespace
+
+size_t CssParser::write(const uint8_t data) { return write(&data, 1); }
+
+size_t CssParser::write(const uint8_t* buffer, const size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    const char c = static_cast<char>(buffer[i]);
+    if (inComment) {
+      if (commentLast == '*' && c == '/') {
+        inComment = false;
+      }
+      commentLast = c;
+      continue;
+    }
+    if (pendingSlash) {
+      pendingSlash = false;
+      if (c == '*') {
+        inComment = true;
+        commentLast = 0;
+        continue;
+      }
+      process('/');
+    }
+    if (c == '/' && !quote) {
+      pendingSlash = true;
+      continue;
+    }
+    process(c);
+  }
+  return size;
+}
+
+void CssParser::process(const char c) {
+  switch (state) {
+    case SELECTOR:
+      if (c == '{') {
+        state = DECLARATIONS;
+        declarations.clear();
+      } else if (c == '}') {
+        // Stray close brace, start over with the next rule
+        selectors.clear();
+        overflow = false;
+      } else if (c == '@' && selectors.empty()) {
+        state = AT_RULE;
+      } else if (!selectors.empty() || !isCssWhitespace(c)) {
+        if (selectors.size() < MAX_SELECTORS_SIZE) {
+          selectors += c;
+        } else {
+          overflow = true;
+        }
+      }
+      break;
+    case DECLARATIONS:
+      if (quote) {
+        if (c == quote) {
+          quote = 0;
+        }
+      } else if (c == '"' || c == '\'') {
+        quote = c;
+      } else if (c == '}') {
+        endRule();
+        state = SELECTOR;
+        break;
+      }
+      if (declarations.size() < MAX_DECLARATIONS_SIZE) {
+        declarations += c;
+      } else {
+        overflow = true;
+      }
+      break;
+    case AT_RULE:
+      // Statements like @import and @charset end at a semicolon, the rest have a block that is skipped whole
+      if (c == ';') {
+        state = SELECTOR;
+      } else if (c == '{') {
+        state = SKIP_BLOCK;
+        skipDepth = 1;
+      }
+      break;
+    case SKIP_BLOCK:
+      if (c == '{') {
+        skipDepth++;
+      } else if (c == '}' && --skipDepth == 0) {
+        state = SELECTOR;
+      }
+      break;
+  }
+}
+
+void CssParser::endRule() {
+  if (!overflow) {
+    CssStyle style;
+    parseDeclarations(declarations.data(), declarations.size(), style);
+    if (!style.isEmpty()) {
+      // Simple selectors of a list are kept even if others in it aren't
+      const char* start = selectors.data();
+      const char* const selectorsEnd = start + selectors.size();
+      while (start < selectorsEnd) {
+        const char* end = static_cast<const char*>(memchr(start, ',', selectorsEnd - start));
+        if (!end) {
+          end = selectorsEnd;
+        }
+        const char* next = end + 1;
+        trim(start, end);
+        char key[MAX_SELECTOR_SIZE + 1];
+        const size_t length = selectorKey(start, end, key);
+        if (length > 0) {
+          rules.addRule(key, length, style);
+        }
+        start = next;
+      }
+    }
+  }
+  selectors.clear();
+  declarations.clear();
+  overflow = false;
+}
+
+void CssParser::parseDeclarations(const char* declarations, const size_t length, CssStyle& style) {
+  const char* start = declarations;
+  const char* const declarationsEnd = declarations + length;
+  while (start < declarationsEnd) {
+    const char* end = static_cast<const char*>(memchr(start, ';', declarationsEnd - start));
+    if (!end) {
+      end = declarationsEnd;
+    }
+    const char* next = end + 1;
+
+    const char* colon = static_cast<const char*>(memchr(start, ':', end - start));
+    if (colon) {
+      const char* nameStart = start;
+      const char* nameEnd = colon;
+      const char* valueStart = colon + 1;
+      const char* valueEnd = static_cast<const char*>(memchr(valueStart, '!', end - valueStart));  // !important
+      if (!valueEnd) {
+        valueEnd = end;
+      }
+      trim(nameStart, nameEnd);
+      trim(valueStart, valueEnd);
+      char name[MAX_PROPERTY_SIZE + 1];
+      char value[MAX_PROPERTY_SIZE + 1];
+      if (lowercase(nameStart, nameEnd, name) && lowercase(valueStart, valueEnd, value)) {
+        applyProperty(name, value, style);
+      }
+    }
+    start = next;
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <Print.h>
+
+#include <string>
+
+#include "../BookStyles.h"
+
+// Streams a stylesheet into the book's style table. Only rules whose selectors are all simple (tag, .class, tag.class
+// or #id, in a comma separated list) are kept: anything with combinators, pseudo-classes or attributes can't be matched
+// without a document tree, and at-rules (@media, @font-face, ...) are skipped whole.
+class CssParser final : public Print {
+  enum ParserState {
+    SELECTOR,
+    DECLARATIONS,
+    AT_RULE,
+    SKIP_BLOCK,
+  };
+
+  BookStyles::Builder& rules;
+  ParserState state = SELECTOR;
+  // Set when a '/' may start a comment, resolved by the next character
+  bool pendingSlash = false;
+  bool inComment = false;
+  // Previous character inside a comment, to find its closing */
+  char commentLast = 0;
+  // Quote character of the string being read in a declaration block, or 0
+  char quote = 0;
+  int skipDepth = 0;
+  std::string selectors;
+  std::string declarations;
+  // Selectors or declarations longer than anything worth honouring are dropped instead of growing without bound
+  bool overflow = false;
+
+  void process(char c);
+  void endRule();
+
+ public:
+  explicit CssParser(BookStyles::Builder& rules) : rules(rules) {}
+  ~CssParser() override = default;
+
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+
+  // Applies the declarations of a rule or style attribute (e.g. "font-weight: bold; text-align: center") to a style
+  static void parseDeclarations(const char* declarations, size_t length, CssStyle& style);
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// What the chapter parser and tokenizer need to know about a tag, looked up with a perfect hash instead of comparing
+// the name against every known tag
+enum XhtmlTagClass : uint8_t {
+  TAG_OTHER = 0,
+  TAG_HEADER = 1 << 0,
+  TAG_BLOCK = 1 << 1,
+  TAG_LINE_BREAK = 1 << 2,
+  TAG_BOLD = 1 << 3,
+  TAG_ITALIC = 1 << 4,
+  // <image> is how SVG wrappers (common for full page illustrations and covers) embed theirs
+  TAG_IMAGE = 1 << 5,
+  TAG_SKIP = 1 << 6,
+  // HTML elements that never have content, sloppy chapters don't close them
+  TAG_VOID = 1 << 7,
+};
+
+namespace xhtml_tags {
+struct KnownTag {
+  const char* name;
+  uint8_t tagClass;
+};
+
+constexpr KnownTag KNOWN_TAGS[] = {
+    {"h1", TAG_HEADER},
+    {"h2", TAG_HEADER},
+    {"h3", TAG_HEADER},
+    {"h4", TAG_HEADER},
+    {"h5", TAG_HEADER},
+    {"h6", TAG_HEADER},
+    {"p", TAG_BLOCK},
+    {"li", TAG_BLOCK},
+    {"div", TAG_BLOCK},
+    {"blockquote", TAG_BLOCK},
+    {"br", TAG_BLOCK | TAG_LINE_BREAK | TAG_VOID},
+    {"b", TAG_BOLD},
+    {"strong", TAG_BOLD},
+    {"i", TAG_ITALIC},
+    {"em", TAG_ITALIC},
+    {"img", TAG_IMAGE | TAG_VOID},
+    {"image", TAG_IMAGE},
+    {"head", TAG_SKIP},
+    {"table", TAG_SKIP},
+    {"area", TAG_VOID},
+    {"base", TAG_VOID},
+    {"col", TAG_VOID},
+    {"embed", TAG_VOID},
+    {"hr", TAG_VOID},
+    {"input", TAG_VOID},
+    {"link", TAG_VOID},
+    {"meta", TAG_VOID},
+    {"param", TAG_VOID},
+    {"source", TAG_VOID},
+    {"track", TAG_VOID},
+    {"wbr", TAG_VOID},
+};
+
+// The multipliers were searched for so that no two known tags share a slot, the static_assert below keeps it that way
+constexpr size_t TABLE_SIZE = 128;
+constexpr size_t hash(const char* name, const size_t length) {
+  return (static_cast<uint8_t>(name[0]) + 3 * static_cast<uint8_t>(name[length - 1]) + 24 * length) & (TABLE_SIZE - 1);
+}
+
+constexpr size_t constLength(const char* s) {
+  size_t length = 0;
+  while (s[length]) {
+    length++;
+  }
+  return length;
+}
+
+struct Table {
+  KnownTag slots[TABLE_SIZE];
+};
+
+constexpr Table buildTable() {
+  Table table{};
+  for (const auto& tag : KNOWN_TAGS) {
+    table.slots[hash(tag.name, constLength(tag.name))] = tag;
+  }
+  return table;
+}
+
+constexpr Table TABLE = buildTable();
+
+constexpr bool isPerfect() {
+  size_t used = 0;
+  for (const auto& slot : TABLE.slots) {
+    used += slot.name != nullptr;
+  }
+  return used == sizeof(KNOWN_TAGS) / sizeof(KNOWN_TAGS[0]);
+}
+static_assert(isPerfect(), "Known tags collide in the tag hash, search for other multipliers");
+}  // namespace xhtml_tags
+
+inline uint8_t classifyTag(const char* name, const size_t length) {
+  if (length == 0) {
+    return TAG_OTHER;
+  }
+  const auto& slot = xhtml_tags::TABLE.slots[xhtml_tags::hash(name, length)];
+  if (!slot.name || strncmp(slot.name, name, length) != 0 || slot.name[length] != '\0') {
+    return TAG_OTHER;
+  }
+  return slot.tagClass;
+}
+
+inline uint8_t classifyTag(const char* name) { return classifyTag(name, strlen(name)); }
@@ -0,0 +1,531 @@
+#include "XhtmlTokenizer.h"
+
+#include <HardwareSerial.h>
+
+#include <cstring>
+
+#include "../htmlEntities.h"
+#include "XhtmlTags.h"
+
+namespace {
+constexpr uint8_t UTF8_BOM[] = {0xEF, 0xBB, 0xBF};
+
+bool isSpace(const char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f'; }
+
+bool isAsciiAlpha(const char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+bool isAsciiAlnum(const char c) { return isAsciiAlpha(c) || (c >= '0' && c <= '9'); }
+
+bool isNameStart(const char c) {
+  return isAsciiAlpha(c) || c == '_' || c == ':' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+char predefinedEntity(const char* name) {
+  if (strcmp(name, "amp") == 0) return '&';
+  if (strcmp(name, "lt") == 0) return '<';
+  if (strcmp(name, "gt") == 0) return '>';
+  if (strcmp(name, "quot") == 0) return '"';
+  if (strcmp(name, "apos") == 0) return '\'';
+  return 0;
+}
+}  // namespace
+
+bool XhtmlTokenizer::parse(const char* data, const size_t length, const bool isFinal) {
+  if (failed) {
+    return false;
+  }
+
+  size_t i = 0;
+  while (i < length && !failed) {
+    const auto b = static_cast<uint8_t>(data[i]);
+    // A UTF-8 byte order mark isn't part of the document
+    if (position < sizeof(UTF8_BOM) && b == UTF8_BOM[position]) {
+      position++;
+      i++;
+      continue;
+    }
+    position = sizeof(UTF8_BOM);
+
+    // Line ends are normalised before anything else like an XML parser does, a CR LF pair or a lone CR is an LF
+    if (b == '\n' && lastWasCarriageReturn) {
+      lastWasCarriageReturn = false;
+      i++;
+      continue;
+    }
+    lastWasCarriageReturn = b == '\r';
+    if (lastWasCarriageReturn) {
+      process('\n');
+      i++;
+      continue;
+    }
+
+    // Most of a chapter is plain text, a run of it is reported straight from the input
+    if (state == TEXT && !inReference && !latin1) {
+      size_t end = i;
+      while (end < length && data[end] != '<' && data[end] != '&' && data[end] != '\r') {
+        end++;
+      }
+      if (end > i) {
+        if (depth > 0) {
+          flushText();
+          characterData(userData, data + i, static_cast<int>(end - i));
+        }
+        i = end;
+        continue;
+      }
+    }
+
+    if (latin1 && b >= 0x80) {
+      process(static_cast<char>(0xC0 | b >> 6));
+      process(static_cast<char>(0x80 | (b & 0x3F)));
+    } else {
+      process(static_cast<char>(b));
+    }
+    i++;
+  }
+
+  if (isFinal && !failed) {
+    if (inReference) {
+      endReference(false);
+    }
+    flushText();
+    while (depth > 0) {
+      closeElement();
+    }
+  }
+  return !failed;
+}
+
+void XhtmlTokenizer::process(const char c) {
+  if (inReference && (state == TEXT || state == ATTRIBUTE_VALUE_QUOTED || state == ATTRIBUTE_VALUE_UNQUOTED)) {
+    processReference(c);
+    return;
+  }
+
+  switch (state) {
+    case TEXT:
+      if (c == '<') {
+        state = TAG_OPEN;
+      } else if (c == '&') {
+        inReference = true;
+        referenceLength = 0;
+      } else {
+        textByte(c);
+      }
+      break;
+
+    case TAG_OPEN:
+      if (c == '/') {
+        flushText();
+        tagLength = 0;
+        state = END_TAG_NAME;
+      } else if (c == '!') {
+        markerLength = 0;
+        state = MARKUP_DECLARATION;
+      } else if (c == '?') {
+        markerLength = 0;
+        declarationLength = 0;
+        state = PROCESSING_INSTRUCTION;
+      } else if (isNameStart(c)) {
+        flushText();
+        tagLength = 0;
+        attributeCount = 0;
+        tagByte(c);
+        state = TAG_NAME;
+      } else {
+        // Not a tag after all
+        textByte('<');
+        state = TEXT;
+        process(c);
+      }
+      break;
+
+    case TAG_NAME:
+      if (isSpace(c)) {
+        tagByte('\0');
+        state = BEFORE_ATTRIBUTE_NAME;
+      } else if (c == '/') {
+        tagByte('\0');
+        state = SELF_CLOSING;
+      } else if (c == '>') {
+        tagByte('\0');
+        emitStartTag(false);
+      } else {
+        tagByte(c);
+      }
+      break;
+
+    case BEFORE_ATTRIBUTE_NAME:
+      if (c == '/') {
+        state = SELF_CLOSING;
+      } else if (c == '>') {
+        emitStartTag(false);
+      } else if (!isSpace(c)) {
+        beginAttribute();
+        tagByte(c);
+        state = ATTRIBUTE_NAME;
+      }
+      break;
+
+    case ATTRIBUTE_NAME:
+      if (isSpace(c)) {
+        endAttributeName();
+        state = AFTER_ATTRIBUTE_NAME;
+      } else if (c == '=') {
+        endAttributeName();
+        state = BEFORE_ATTRIBUTE_VALUE;
+      } else if (c == '/' || c == '>') {
+        // An attribute without a value, like HTML's boolean attributes
+        endAttributeName();
+        endAttribute();
+        state = BEFORE_ATTRIBUTE_NAME;
+        process(c);
+      } else {
+        tagByte(c);
+      }
+      break;
+
+    case AFTER_ATTRIBUTE_NAME:
+      if (c == '=') {
+        state = BEFORE_ATTRIBUTE_VALUE;
+      } else if (!isSpace(c)) {
+        endAttribute();
+        state = BEFORE_ATTRIBUTE_NAME;
+        process(c);
+      }
+      break;
+
+    case BEFORE_ATTRIBUTE_VALUE:
+      if (c == '"' || c == '\'') {
+        quote = c;
+        state = ATTRIBUTE_VALUE_QUOTED;
+      } else if (c == '>') {
+        endAttribute();
+        emitStartTag(false);
+      } else if (!isSpace(c)) {
+        state = ATTRIBUTE_VALUE_UNQUOTED;
+        process(c);
+      }
+      break;
+
+    case ATTRIBUTE_VALUE_QUOTED:
+      // Line breaks and tabs are normalised to spaces like an XML parser would
+      if (c == quote) {
+        endAttribute();
+        state = BEFORE_ATTRIBUTE_NAME;
+      } else if (c == '&') {
+        inReference = true;
+        referenceLength = 0;
+      } else if (c == '\n' || c == '\t') {
+        tagByte(' ');
+      } else {
+        tagByte(c);
+      }
+      break;
+
+    case ATTRIBUTE_VALUE_UNQUOTED:
+      if (isSpace(c)) {
+        endAttribute();
+        state = BEFORE_ATTRIBUTE_NAME;
+      } else if (c == '>') {
+        endAttribute();
+        emitStartTag(false);
+      } else if (c == '&') {
+        inReference = true;
+        referenceLength = 0;
+      } else {
+        tagByte(c);
+      }
+      break;
+
+    case SELF_CLOSING:
+      if (c == '>') {
+        emitStartTag(true);
+      } else {
+        // A stray '/' inside the tag
+        state = BEFORE_ATTRIBUTE_NAME;
+        process(c);
+      }
+      break;
+
+    case END_TAG_NAME:
+      if (c == '>') {
+        tagByte('\0');
+        emitEndTag();
+      } else if (isSpace(c)) {
+        tagByte('\0');
+        state = END_TAG_REST;
+      } else {
+        tagByte(c);
+      }
+      break;
+
+    case END_TAG_REST:
+      if (c == '>') {
+        emitEndTag();
+      }
+      break;
+
+    case MARKUP_DECLARATION: {
+      marker[markerLength++] = c;
+      const bool commentStart = markerLength <= 2 && strncmp(marker, "--", markerLength) == 0;
+      const bool cdataStart = markerLength <= 7 && strncmp(marker, "[CDATA[", markerLength) == 0;
+      if (commentStart && markerLength == 2) {
+        markerLength = 0;
+        state = COMMENT;
+      } else if (cdataStart && markerLength == 7) {
+        markerLength = 0;
+        state = CDATA;
+      } else if (!commentStart && !cdataStart) {
+        // A DOCTYPE or another declaration, the bytes read so far are part of it
+        char read[sizeof(marker)];
+        const size_t readLength = markerLength;
+        memcpy(read, marker, readLength);
+        markerLength = 0;
+        declarationBrackets = 0;
+        quote = 0;
+        state = DECLARATION;
+        for (size_t i = 0; i < readLength; i++) {
+          process(read[i]);
+        }
+      }
+      break;
+    }
+
+    case COMMENT:
+      if (c == '>' && markerLength >= 2) {
+        state = TEXT;
+      }
+      markerLength = c == '-' ? markerLength + 1 : 0;
+      break;
+
+    case CDATA:
+      if (c == ']') {
+        markerLength++;
+        break;
+      }
+      if (c == '>' && markerLength >= 2) {
+        markerLength -= 2;
+        state = TEXT;
+      }
+      for (; markerLength > 0; markerLength--) {
+        textByte(']');
+      }
+      if (state == CDATA) {
+        textByte(c);
+      }
+      break;
+
+    case DECLARATION:
+      // Skipped whole, including an internal subset in brackets
+      if (quote) {
+        if (c == quote) {
+          quote = 0;
+        }
+      } else if (c == '"' || c == '\'') {
+        quote = c;
+      } else if (c == '[') {
+        declarationBrackets++;
+      } else if (c == ']') {
+        declarationBrackets--;
+      } else if (c == '>' && declarationBrackets <= 0) {
+        state = TEXT;
+      }
+      break;
+
+    case PROCESSING_INSTRUCTION:
+      if (c == '>' && markerLength == 1) {
+        checkDeclaration();
+        state = TEXT;
+        break;
+      }
+      if (declarationLength < sizeof(declaration) - 1) {
+        declaration[declarationLength++] = c;
+      }
+      markerLength = c == '?' ? 1 : 0;
+      break;
+  }
+}
+
+void XhtmlTokenizer::processReference(const char c) {
+  if (c == ';') {
+    endReference(true);
+  } else if (referenceLength < MAX_REFERENCE_SIZE && (isAsciiAlnum(c) || (c == '#' && referenceLength == 0))) {
+    reference[referenceLength++] = c;
+  } else {
+    // Not a reference, the '&' and what followed it are text
+    endReference(false);
+    process(c);
+  }
+}
+
+void XhtmlTokenizer::endReference(const bool terminated) {
+  inReference = false;
+  reference[referenceLength] = '\0';
+  const bool inText = state == TEXT;
+
+  char decoded[4];
+  size_t decodedLength = 0;
+  if (terminated && referenceLength > 1 && reference[0] == '#') {
+    decodedLength = decodeCharacterReference(reference + 1, referenceLength - 1, decoded);
+  } else if (terminated) {
+    decoded[0] = predefinedEntity(reference);
+    decodedLength = decoded[0] ? 1 : 0;
+  }
+
+  if (decodedLength == 0) {
+    // Passed on as written, the chapter parser decodes HTML's named entities itself
+    if (inText) {
+      textByte('&');
+      for (size_t i = 0; i < referenceLength; i++) {
+        textByte(reference[i]);
+      }
+      if (terminated) {
+        textByte(';');
+      }
+    } else {
+      tagByte('&');
+      tagBytes(reference, referenceLength);
+      if (terminated) {
+        tagByte(';');
+      }
+    }
+    return;
+  }
+
+  if (inText) {
+    for (size_t i = 0; i < decodedLength; i++) {
+      textByte(decoded[i]);
+    }
+  } else {
+    tagBytes(decoded, decodedLength);
+  }
+}
+
+void XhtmlTokenizer::textByte(const char c) {
+  // Text outside the root element isn't content
+  if (depth == 0) {
+    return;
+  }
+  if (textLength == sizeof(text)) {
+    flushText();
+  }
+  text[textLength++] = c;
+}
+
+void XhtmlTokenizer::flushText() {
+  if (textLength > 0) {
+    characterData(userData, text, static_cast<int>(textLength));
+    textLength = 0;
+  }
+}
+
+void XhtmlTokenizer::tagByte(const char c) {
+  // The last byte is kept for a terminator, whatever doesn't fit is dropped along with its attribute
+  if (tagLength < MAX_TAG_SIZE - 1) {
+    tag[tagLength++] = c;
+  } else {
+    attributeDropped = true;
+  }
+}
+
+void XhtmlTokenizer::tagBytes(const char* bytes, const size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    tagByte(bytes[i]);
+  }
+}
+
+void XhtmlTokenizer::beginAttribute() {
+  attributeStart = tagLength;
+  attributeDropped = attributeCount == MAX_ATTRIBUTES;
+  if (!attributeDropped) {
+    attributeOffsets[2 * attributeCount] = static_cast<uint16_t>(tagLength);
+  }
+}
+
+void XhtmlTokenizer::endAttributeName() {
+  tagByte('\0');
+  if (!attributeDropped) {
+    attributeOffsets[2 * attributeCount + 1] = static_cast<uint16_t>(tagLength);
+  }
+}
+
+void XhtmlTokenizer::endAttribute() {
+  tagByte('\0');
+  if (attributeDropped) {
+    tagLength = attributeStart;
+  } else {
+    attributeCount++;
+  }
+}
+
+void XhtmlTokenizer::emitStartTag(const bool selfClosing) {
+  state = TEXT;
+  tag[MAX_TAG_SIZE - 1] = '\0';
+  const size_t nameLength = strlen(tag);
+  const bool closed = selfClosing || classifyTag(tag, nameLength) & TAG_VOID;
+
+  // Like HTML, a paragraph or list item ends one left open directly around it. Sloppy chapters often never close
+  // theirs, they would otherwise nest deeper with every one.
+  if (depth > 0 && (strcmp(tag, "p") == 0 || strcmp(tag, "li") == 0) &&
+      strcmp(openNames + openOffsets[depth - 1], tag) == 0) {
+    closeElement();
+  }
+
+  if (!closed && (depth == MAX_DEPTH || openNamesLength + nameLength + 1 > MAX_OPEN_NAMES_SIZE)) {
+    Serial.printf("[%lu] [XHT] Elements nested too deep\n", millis());
+    failed = true;
+    return;
+  }
+
+  for (size_t i = 0; i < 2 * attributeCount; i++) {
+    atts[i] = tag + attributeOffsets[i];
+  }
+  atts[2 * attributeCount] = nullptr;
+  startElement(userData, tag, atts);
+
+  if (closed) {
+    endElement(userData, tag);
+    return;
+  }
+  openOffsets[depth++] = static_cast<uint16_t>(openNamesLength);
+  memcpy(openNames + openNamesLength, tag, nameLength + 1);
+  openNamesLength += nameLength + 1;
+}
+
+void XhtmlTokenizer::emitEndTag() {
+  state = TEXT;
+  tag[MAX_TAG_SIZE - 1] = '\0';
+  // Closes the innermost open element with this name along with anything left open inside it
+  for (size_t i = depth; i-- > 0;) {
+    if (strcmp(openNames + openOffsets[i], tag) == 0) {
+      while (depth > i) {
+        closeElement();
+      }
+      return;
+    }
+  }
+}
+
+void XhtmlTokenizer::closeElement() {
+  depth--;
+  endElement(userData, openNames + openOffsets[depth]);
+  openNamesLength = openOffsets[depth];
+}
+
+void XhtmlTokenizer::checkDeclaration() {
+  // <?xml version="1.0" encoding="..."?>, anything but ISO-8859-1 is taken to be UTF-8
+  declaration[declarationLength] = '\0';
+  if (depth > 0 || strncmp(declaration, "xml", 3) != 0 || !isSpace(declaration[3])) {
+    return;
+  }
+  const char* encoding = strstr(declaration, "encoding");
+  if (!encoding) {
+    return;
+  }
+  encoding += strlen("encoding");
+  while (*encoding && (isSpace(*encoding) || *encoding == '=' || *encoding == '"' || *encoding == '\'')) {
+    encoding++;
+  }
+  latin1 = strncasecmp(encoding, "iso-8859-1", 10) == 0 || strncasecmp(encoding, "latin1", 6) == 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A streaming tokenizer for chapter XHTML, a stand-in for expat that only does what chapter parsing needs and reports
+// it through the same kind of callbacks. It never allocates, every buffer is a fixed size member.
+//
+// It is forgiving where expat gives up on the whole chapter: HTML void elements (<br>, <img>, ...) don't need closing,
+// attribute values don't need quotes, a stray '&' or '<' is text, an unclosed <p> or <li> is closed by the next one, a
+// close tag closes whatever was left open inside its element and one that matches nothing is ignored, and everything
+// still open at the end is closed. Character references and the five XML entities are decoded, other entities
+// (&nbsp;, ...) are passed through as text. Documents declared as ISO-8859-1 are converted to UTF-8. Comments,
+// processing instructions and DOCTYPEs are skipped, CDATA sections are text. Line ends are normalised to LF.
+class XhtmlTokenizer {
+ public:
+  using StartElementHandler = void (*)(void* userData, const char* name, const char** atts);
+  using EndElementHandler = void (*)(void* userData, const char* name);
+  using CharacterDataHandler = void (*)(void* userData, const char* s, int len);
+
+ private:
+  enum State : uint8_t {
+    TEXT,
+    TAG_OPEN,
+    TAG_NAME,
+    BEFORE_ATTRIBUTE_NAME,
+    ATTRIBUTE_NAME,
+    AFTER_ATTRIBUTE_NAME,
+    BEFORE_ATTRIBUTE_VALUE,
+    ATTRIBUTE_VALUE_QUOTED,
+    ATTRIBUTE_VALUE_UNQUOTED,
+    SELF_CLOSING,
+    END_TAG_NAME,
+    END_TAG_REST,
+    MARKUP_DECLARATION,
+    COMMENT,
+    CDATA,
+    DECLARATION,
+    PROCESSING_INSTRUCTION,
+  };
+
+  static constexpr size_t MAX_TAG_SIZE = 2048;
+  static constexpr size_t MAX_ATTRIBUTES = 32;
+  static constexpr size_t MAX_DEPTH = 256;
+  static constexpr size_t MAX_OPEN_NAMES_SIZE = 2048;
+  static constexpr size_t MAX_REFERENCE_SIZE = 32;
+
+  void* userData;
+  StartElementHandler startElement;
+  EndElementHandler endElement;
+  CharacterDataHandler characterData;
+
+  State state = TEXT;
+  bool failed = false;
+  // Bytes seen so far, to recognise a byte order mark and the XML declaration at the start of the document
+  uint32_t position = 0;
+  bool latin1 = false;
+  // A CR was read as an LF, so an LF right after it is dropped
+  bool lastWasCarriageReturn = false;
+
+  // Text waiting to be reported
+  char text[256] = {};
+  size_t textLength = 0;
+
+  // The tag being read: its name followed by its attributes' names and values, each null terminated
+  char tag[MAX_TAG_SIZE] = {};
+  size_t tagLength = 0;
+  // Where each attribute's name and value start in tag, then the pointers handed to the start element handler
+  uint16_t attributeOffsets[2 * MAX_ATTRIBUTES] = {};
+  size_t attributeCount = 0;
+  // Start of the attribute being read, dropped whole if it doesn't fit
+  size_t attributeStart = 0;
+  bool attributeDropped = false;
+  const char* atts[2 * MAX_ATTRIBUTES + 1] = {};
+  char quote = 0;
+
+  // Names of the open elements, each null terminated, and where each starts
+  char openNames[MAX_OPEN_NAMES_SIZE] = {};
+  size_t openNamesLength = 0;
+  uint16_t openOffsets[MAX_DEPTH] = {};
+  size_t depth = 0;
+
+  // Character or entity reference being read (after the '&'), in text or an attribute value
+  char reference[MAX_REFERENCE_SIZE + 1] = {};
+  size_t referenceLength = 0;
+  bool inReference = false;
+
+  // Progress through the markers that end comments (-->), CDATA sections (]]>) and processing instructions (?>), and
+  // what has been read of a markup declaration to tell which it is
+  char marker[8] = {};
+  size_t markerLength = 0;
+  int declarationBrackets = 0;
+  // The start of the XML declaration, to find its encoding
+  char declaration[96] = {};
+  size_t declarationLength = 0;
+
+  void process(char c);
+  void processReference(char c);
+  void endReference(bool terminated);
+  // Output of text and attribute values, references already decoded
+  void textByte(char c);
+  void flushText();
+  void tagByte(char c);
+  void tagBytes(const char* bytes, size_t length);
+  void beginAttribute();
+  void endAttributeName();
+  void endAttribute();
+  void emitStartTag(bool selfClosing);
+  void emitEndTag();
+  void closeElement();
+  void checkDeclaration();
+
+ public:
+  explicit XhtmlTokenizer(void* userData, StartElementHandler startElement, EndElementHandler endElement,
+                          CharacterDataHandler characterData)
+      : userData(userData), startElement(startElement), endElement(endElement), characterData(characterData) {}
+  ~XhtmlTokenizer() = default;
+
+  // Tokenizes the next part of the document, the last part (which may be empty) has isFinal set. False if the document
+  // nests its elements too deep to follow, nothing more is reported after that.
+  bool parse(const char* data, size_t length, bool isFinal);
+};
@@ -7,14 +7,6 @@
 #include <cstdio>
 #include <cstring>
 
-// Context structure for picojpeg callback
-struct JpegReadContext {
-  FsFile& file;
-  uint8_t buffer[512];
-  size_t bufferPos;
-  size_t bufferFilled;
-};
-
 // ============================================================================
 // IMAGE PROCESSING OPTIONS - Toggle these to test different configurations
 // ============================================================================
@@ -32,7 +24,12 @@ constexpr float CONTRAST_FACTOR = 1.15f;  // Contrast multiplier (1.0 = no chang
 constexpr bool USE_PRESCALE = true;     // true: scale image to target size before dithering
 constexpr int TARGET_MAX_WIDTH = 480;   // Max width for cover images (portrait display width)
 constexpr int TARGET_MAX_HEIGHT = 800;  // Max height for cover images (portrait display height)
+// Inline chapter images pass their own target size, the page's viewport
 // ============================================================================
+// Safety limits to prevent memory issues on ESP32
+constexpr int MAX_IMAGE_WIDTH = 2048;
+constexpr int MAX_IMAGE_HEIGHT = 3072;
+constexpr int MAX_MCU_ROW_BYTES = 65536;
 
 // Integer approximation of gamma correction (brightens midtones)
 // Uses a simple curve: out = 255 * sqrt(in/255) ≈ sqrt(in * 255)
@@ -395,18 +392,57 @@ void JpegToBmpConverter::writeBmpHeader(Print& bmpOut, const int width, const in
   }
 }
 
+// Everything a conversion in progress holds between rows
+struct JpegToBmpConverter::Decode {
+  ReadCallback read;
+  void* readContext;
+  uint8_t buffer[512];
+  size_t bufferPos;
+  size_t bufferFilled;
+  Print* bmpOut;
+  pjpeg_image_info_t imageInfo;
+  int outWidth;
+  int outHeight;
+  int bytesPerRow;
+  // Fixed-point (16.16) source pixels per output pixel
+  uint32_t scaleX_fp;
+  uint32_t scaleY_fp;
+  bool needsScaling;
+  uint8_t* rowBuffer;
+  // One MCU row worth of grayscale pixels
+  uint8_t* mcuRowBuffer;
+  AtkinsonDitherer* atkinsonDitherer;
+  FloydSteinbergDitherer* fsDitherer;
+  // For scaling: accumulate source rows into scaled output rows
+  uint32_t* rowAccum;          // Accumulator for each output X (32-bit for larger sums)
+  uint16_t* rowCount;          // Count of source pixels accumulated per output X
+  int currentOutY;             // Current output row being accumulated
+  uint32_t nextOutY_srcStart;  // Source Y where next output row starts (16.16 fixed point)
+  int mcuY;                    // Next row of MCUs to decode
+};
+
+namespace {
+// picojpeg keeps the state of its one decode in globals
+bool conversionInProgress = false;
+
+size_t readFile(void* context, uint8_t* buffer, const size_t size) {
+  const int read = static_cast<FsFile*>(context)->read(buffer, size);
+  return read > 0 ? read : 0;
+}
+}  // namespace
+
 // Callback function for picojpeg to read JPEG data
 unsigned char JpegToBmpConverter::jpegReadCallback(unsigned char* pBuf, const unsigned char buf_size,
                                                    unsigned char* pBytes_actually_read, void* pCallback_data) {
-  auto* context = static_cast<JpegReadContext*>(pCallback_data);
+  auto* context = static_cast<Decode*>(pCallback_data);
 
-  if (!context || !context->file) {
+  if (!context || !context->read) {
     return PJPG_STREAM_READ_ERROR;
   }
 
   // Check if we need to refill our context buffer
   if (context->bufferPos >= context->bufferFilled) {
-    context->bufferFilled = context->file.read(context->buffer, sizeof(context->buffer));
+    context->bufferFilled = context->read(context->readContext, context->buffer, sizeof(context->buffer));
     context->bufferPos = 0;
 
     if (context->bufferFilled == 0) {
@@ -427,208 +463,402 @@ unsigned char JpegToBmpConverter::jpegReadCallback(unsigned char* pBuf, const un
   return 0;  // Success
 }
 
-// Core function: Convert JPEG file to 2-bit BMP
-bool JpegToBmpConverter::jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut) {
+namespace {
+// Pulls a JPEG's bytes a few at a time, for walking its marker segments without holding them in memory
+class MarkerReader {
+  JpegToBmpConverter::ReadCallback read;
+  void* readContext;
+  uint8_t buffer[64];
+  size_t bufferPos = 0;
+  size_t bufferFilled = 0;
+
+ public:
+  MarkerReader(const JpegToBmpConverter::ReadCallback read, void* readContext) : read(read), readContext(readContext) {}
+
+  bool next(uint8_t* byte) {
+    if (bufferPos == bufferFilled) {
+      bufferFilled = read(readContext, buffer, sizeof(buffer));
+      bufferPos = 0;
+      if (bufferFilled == 0) {
+        return false;
+      }
+    }
+    *byte = buffer[bufferPos++];
+    return true;
+  }
+
+  bool next16(uint16_t* value) {
+    uint8_t high, low;
+    if (!next(&high) || !next(&low)) {
+      return false;
+    }
+    *value = (high << 8) | low;
+    return true;
+  }
+
+  bool skip(size_t count) {
+    while (count > 0) {
+      if (bufferPos == bufferFilled) {
+        bufferFilled = read(readContext, buffer, sizeof(buffer));
+        bufferPos = 0;
+        if (bufferFilled == 0) {
+          return false;
+        }
+      }
+      const size_t skipped = count < bufferFilled - bufferPos ? count : bufferFilled - bufferPos;
+      bufferPos += skipped;
+      count -= skipped;
+    }
+    return true;
+  }
+};
+}  // namespace
+
+bool JpegToBmpConverter::readJpegSize(const ReadCallback read, void* readContext, int* width, int* height) {
+  MarkerReader reader(read, readContext);
+  uint8_t byte;
+  if (!reader.next(&byte) || byte != 0xFF || !reader.next(&byte) || byte != 0xD8) {
+    return false;
+  }
+
+  // Segments before the frame header (tables, EXIF and its thumbnail, ICC profiles, comments) are skipped by length
+  while (true) {
+    uint8_t marker;
+    if (!reader.next(&byte) || byte != 0xFF || !reader.next(&marker)) {
+      return false;
+    }
+    // Fill bytes before a marker
+    while (marker == 0xFF) {
+      if (!reader.next(&marker)) {
+        return false;
+      }
+    }
+    // Markers without a length
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      continue;
+    }
+    // Scan data comes after the frame header, hierarchical (DHP) and end of image can't precede it either
+    if (marker == 0xDA || marker == 0xDE || marker == 0xD9) {
+      return false;
+    }
+    uint16_t length;
+    if (!reader.next16(&length) || length < 2) {
+      return false;
+    }
+    // Start of frame, every kind except DHT (C4), JPG (C8) and DAC (CC)
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      // picojpeg only decodes baseline
+      uint16_t frameHeight, frameWidth;
+      if (marker != 0xC0 || !reader.skip(1) || !reader.next16(&frameHeight) || !reader.next16(&frameWidth)) {
+        return false;
+      }
+      *height = frameHeight;
+      *width = frameWidth;
+      return *width > 0 && *height > 0;
+    }
+    if (!reader.skip(length - 2)) {
+      return false;
+    }
+  }
+}
+
+bool JpegToBmpConverter::getOutputSize(const int width, const int height, const int targetMaxWidth,
+                                       const int targetMaxHeight, int* outWidth, int* outHeight) {
+  if (width > MAX_IMAGE_WIDTH || height > MAX_IMAGE_HEIGHT) {
+    return false;
+  }
+
+  *outWidth = width;
+  *outHeight = height;
+  if (USE_PRESCALE && (width > targetMaxWidth || height > targetMaxHeight)) {
+    // Calculate scale to fit within target dimensions while maintaining aspect ratio
+    const float scaleToFitWidth = static_cast<float>(targetMaxWidth) / width;
+    const float scaleToFitHeight = static_cast<float>(targetMaxHeight) / height;
+    const float scale = (scaleToFitWidth < scaleToFitHeight) ? scaleToFitWidth : scaleToFitHeight;
+
+    *outWidth = static_cast<int>(width * scale);
+    *outHeight = static_cast<int>(height * scale);
+
+    // Ensure at least 1 pixel
+    if (*outWidth < 1) *outWidth = 1;
+    if (*outHeight < 1) *outHeight = 1;
+  }
+  return true;
+}
+
+bool JpegToBmpConverter::begin(const ReadCallback read, void* readContext, Print& bmpOut, const int targetMaxWidth,
+                               const int targetMaxHeight) {
+  end();
+  if (conversionInProgress) {
+    Serial.printf("[%lu] [JPG] Another JPEG is being converted\n", millis());
+    return false;
+  }
   Serial.printf("[%lu] [JPG] Converting JPEG to BMP\n", millis());
 
-  // Setup context for picojpeg callback
-  JpegReadContext context = {.file = jpegFile, .bufferPos = 0, .bufferFilled = 0};
+  decode = new Decode();
+  decode->read = read;
+  decode->readContext = readContext;
+  decode->bmpOut = &bmpOut;
+  conversionInProgress = true;
 
   // Initialize picojpeg decoder
-  pjpeg_image_info_t imageInfo;
-  const unsigned char status = pjpeg_decode_init(&imageInfo, jpegReadCallback, &context, 0);
+  pjpeg_image_info_t& imageInfo = decode->imageInfo;
+  const unsigned char status = pjpeg_decode_init(&imageInfo, jpegReadCallback, decode, 0);
   if (status != 0) {
     Serial.printf("[%lu] [JPG] JPEG decode init failed with error code: %d\n", millis(), status);
+    end();
     return false;
   }
 
   Serial.printf("[%lu] [JPG] JPEG dimensions: %dx%d, components: %d, MCUs: %dx%d\n", millis(), imageInfo.m_width,
                 imageInfo.m_height, imageInfo.m_comps, imageInfo.m_MCUSPerRow, imageInfo.m_MCUSPerCol);
 
-  // Safety limits to prevent memory issues on ESP32
-  constexpr int MAX_IMAGE_WIDTH = 2048;
-  constexpr int MAX_IMAGE_HEIGHT = 3072;
-  constexpr int MAX_MCU_ROW_BYTES = 65536;
-
-  if (imageInfo.m_width > MAX_IMAGE_WIDTH || imageInfo.m_height > MAX_IMAGE_HEIGHT) {
+  // Calculate output dimensions (pre-scale to fit display exactly)
+  int& outWidth = decode->outWidth;
+  int& outHeight = decode->outHeight;
+  if (!getOutputSize(imageInfo.m_width, imageInfo.m_height, targetMaxWidth, targetMaxHeight, &outWidth, &outHeight)) {
     Serial.printf("[%lu] [JPG] Image too large (%dx%d), max supported: %dx%d\n", millis(), imageInfo.m_width,
                   imageInfo.m_height, MAX_IMAGE_WIDTH, MAX_IMAGE_HEIGHT);
+    end();
     return false;
   }
-
-  // Calculate output dimensions (pre-scale to fit display exactly)
-  int outWidth = imageInfo.m_width;
-  int outHeight = imageInfo.m_height;
   // Use fixed-point scaling (16.16) for sub-pixel accuracy
-  uint32_t scaleX_fp = 65536;  // 1.0 in 16.16 fixed point
-  uint32_t scaleY_fp = 65536;
-  bool needsScaling = false;
-
-  if (USE_PRESCALE && (imageInfo.m_width > TARGET_MAX_WIDTH || imageInfo.m_height > TARGET_MAX_HEIGHT)) {
-    // Calculate scale to fit within target dimensions while maintaining aspect ratio
-    const float scaleToFitWidth = static_cast<float>(TARGET_MAX_WIDTH) / imageInfo.m_width;
-    const float scaleToFitHeight = static_cast<float>(TARGET_MAX_HEIGHT) / imageInfo.m_height;
-    const float scale = (scaleToFitWidth < scaleToFitHeight) ? scaleToFitWidth : scaleToFitHeight;
-
-    outWidth = static_cast<int>(imageInfo.m_width * scale);
-    outHeight = static_cast<int>(imageInfo.m_height * scale);
-
-    // Ensure at least 1 pixel
-    if (outWidth < 1) outWidth = 1;
-    if (outHeight < 1) outHeight = 1;
+  decode->scaleX_fp = 65536;  // 1.0 in 16.16 fixed point
+  decode->scaleY_fp = 65536;
 
+  if (outWidth != imageInfo.m_width || outHeight != imageInfo.m_height) {
     // Calculate fixed-point scale factors (source pixels per output pixel)
     // scaleX_fp = (srcWidth << 16) / outWidth
-    scaleX_fp = (static_cast<uint32_t>(imageInfo.m_width) << 16) / outWidth;
-    scaleY_fp = (static_cast<uint32_t>(imageInfo.m_height) << 16) / outHeight;
-    needsScaling = true;
+    decode->scaleX_fp = (static_cast<uint32_t>(imageInfo.m_width) << 16) / outWidth;
+    decode->scaleY_fp = (static_cast<uint32_t>(imageInfo.m_height) << 16) / outHeight;
+    decode->needsScaling = true;
 
     Serial.printf("[%lu] [JPG] Pre-scaling %dx%d -> %dx%d (fit to %dx%d)\n", millis(), imageInfo.m_width,
-                  imageInfo.m_height, outWidth, outHeight, TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT);
+                  imageInfo.m_height, outWidth, outHeight, targetMaxWidth, targetMaxHeight);
   }
 
   // Write BMP header with output dimensions
-  int bytesPerRow;
   if (USE_8BIT_OUTPUT) {
     writeBmpHeader8bit(bmpOut, outWidth, outHeight);
-    bytesPerRow = (outWidth + 3) / 4 * 4;
+    decode->bytesPerRow = (outWidth + 3) / 4 * 4;
   } else {
     writeBmpHeader(bmpOut, outWidth, outHeight);
-    bytesPerRow = (outWidth * 2 + 31) / 32 * 4;
+    decode->bytesPerRow = (outWidth * 2 + 31) / 32 * 4;
   }
 
   // Allocate row buffer
-  auto* rowBuffer = static_cast<uint8_t*>(malloc(bytesPerRow));
-  if (!rowBuffer) {
+  decode->rowBuffer = static_cast<uint8_t*>(malloc(decode->bytesPerRow));
+  if (!decode->rowBuffer) {
     Serial.printf("[%lu] [JPG] Failed to allocate row buffer\n", millis());
+    end();
     return false;
   }
 
   // Allocate a buffer for one MCU row worth of grayscale pixels
   // This is the minimal memory needed for streaming conversion
-  const int mcuPixelHeight = imageInfo.m_MCUHeight;
-  const int mcuRowPixels = imageInfo.m_width * mcuPixelHeight;
+  const int mcuRowPixels = imageInfo.m_width * imageInfo.m_MCUHeight;
 
   // Validate MCU row buffer size before allocation
   if (mcuRowPixels > MAX_MCU_ROW_BYTES) {
     Serial.printf("[%lu] [JPG] MCU row buffer too large (%d bytes), max: %d\n", millis(), mcuRowPixels,
                   MAX_MCU_ROW_BYTES);
-    free(rowBuffer);
+    end();
     return false;
   }
 
-  auto* mcuRowBuffer = static_cast<uint8_t*>(malloc(mcuRowPixels));
-  if (!mcuRowBuffer) {
+  decode->mcuRowBuffer = static_cast<uint8_t*>(malloc(mcuRowPixels));
+  if (!decode->mcuRowBuffer) {
     Serial.printf("[%lu] [JPG] Failed to allocate MCU row buffer (%d bytes)\n", millis(), mcuRowPixels);
-    free(rowBuffer);
+    end();
     return false;
   }
 
   // Create ditherer if enabled (only for 2-bit output)
   // Use OUTPUT dimensions for dithering (after prescaling)
-  AtkinsonDitherer* atkinsonDitherer = nullptr;
-  FloydSteinbergDitherer* fsDitherer = nullptr;
   if (!USE_8BIT_OUTPUT) {
     if (USE_ATKINSON) {
-      atkinsonDitherer = new AtkinsonDitherer(outWidth);
+      decode->atkinsonDitherer = new AtkinsonDitherer(outWidth);
     } else if (USE_FLOYD_STEINBERG) {
-      fsDitherer = new FloydSteinbergDitherer(outWidth);
+      decode->fsDitherer = new FloydSteinbergDitherer(outWidth);
     }
   }
 
-  // For scaling: accumulate source rows into scaled output rows
-  // We need to track which source Y maps to which output Y
+  // For scaling: track which source Y maps to which output Y
   // Using fixed-point: srcY_fp = outY * scaleY_fp (gives source Y in 16.16 format)
-  uint32_t* rowAccum = nullptr;    // Accumulator for each output X (32-bit for larger sums)
-  uint16_t* rowCount = nullptr;    // Count of source pixels accumulated per output X
-  int currentOutY = 0;             // Current output row being accumulated
-  uint32_t nextOutY_srcStart = 0;  // Source Y where next output row starts (16.16 fixed point)
+  if (decode->needsScaling) {
+    decode->rowAccum = new uint32_t[outWidth]();
+    decode->rowCount = new uint16_t[outWidth]();
+    decode->nextOutY_srcStart = decode->scaleY_fp;  // First boundary is at scaleY_fp (source Y for outY=1)
+  }
+  return true;
+}
 
-  if (needsScaling) {
-    rowAccum = new uint32_t[outWidth]();
-    rowCount = new uint16_t[outWidth]();
-    nextOutY_srcStart = scaleY_fp;  // First boundary is at scaleY_fp (source Y for outY=1)
+// Decodes one row of MCUs and writes the BMP rows it completes (top-down)
+JpegToBmpConverter::Status JpegToBmpConverter::decodeNextRow() {
+  if (!decode) {
+    return Status::Error;
   }
 
-  // Process MCUs row-by-row and write to BMP as we go (top-down)
+  const pjpeg_image_info_t& imageInfo = decode->imageInfo;
+  if (decode->mcuY >= imageInfo.m_MCUSPerCol) {
+    return Status::Done;
+  }
+  Print& bmpOut = *decode->bmpOut;
+  const int mcuY = decode->mcuY;
+  const int outWidth = decode->outWidth;
+  const int outHeight = decode->outHeight;
+  const int bytesPerRow = decode->bytesPerRow;
+  const uint32_t scaleX_fp = decode->scaleX_fp;
+  const uint32_t scaleY_fp = decode->scaleY_fp;
+  const bool needsScaling = decode->needsScaling;
+  uint8_t* rowBuffer = decode->rowBuffer;
+  uint8_t* mcuRowBuffer = decode->mcuRowBuffer;
+  AtkinsonDitherer* atkinsonDitherer = decode->atkinsonDitherer;
+  FloydSteinbergDitherer* fsDitherer = decode->fsDitherer;
+  uint32_t* rowAccum = decode->rowAccum;
+  uint16_t* rowCount = decode->rowCount;
+  int& currentOutY = decode->currentOutY;
+  uint32_t& nextOutY_srcStart = decode->nextOutY_srcStart;
   const int mcuPixelWidth = imageInfo.m_MCUWidth;
+  const int mcuPixelHeight = imageInfo.m_MCUHeight;
+  const int mcuRowPixels = imageInfo.m_width * mcuPixelHeight;
+
+  // Clear the MCU row buffer
+  memset(mcuRowBuffer, 0, mcuRowPixels);
 
-  for (int mcuY = 0; mcuY < imageInfo.m_MCUSPerCol; mcuY++) {
-    // Clear the MCU row buffer
-    memset(mcuRowBuffer, 0, mcuRowPixels);
+  // Decode one row of MCUs
+  for (int mcuX = 0; mcuX < imageInfo.m_MCUSPerRow; mcuX++) {
+    const unsigned char mcuStatus = pjpeg_decode_mcu();
+    if (mcuStatus != 0) {
+      if (mcuStatus == PJPG_NO_MORE_BLOCKS) {
+        Serial.printf("[%lu] [JPG] Unexpected end of blocks at MCU (%d, %d)\n", millis(), mcuX, mcuY);
+      } else {
+        Serial.printf("[%lu] [JPG] JPEG decode MCU failed at (%d, %d) with error code: %d\n", millis(), mcuX, mcuY,
+                      mcuStatus);
+      }
+      return Status::Error;
+    }
 
-    // Decode one row of MCUs
-    for (int mcuX = 0; mcuX < imageInfo.m_MCUSPerRow; mcuX++) {
-      const unsigned char mcuStatus = pjpeg_decode_mcu();
-      if (mcuStatus != 0) {
-        if (mcuStatus == PJPG_NO_MORE_BLOCKS) {
-          Serial.printf("[%lu] [JPG] Unexpected end of blocks at MCU (%d, %d)\n", millis(), mcuX, mcuY);
+    // picojpeg stores MCU data in 8x8 blocks
+    // Block layout: H2V2(16x16)=0,64,128,192 H2V1(16x8)=0,64 H1V2(8x16)=0,128
+    for (int blockY = 0; blockY < mcuPixelHeight; blockY++) {
+      for (int blockX = 0; blockX < mcuPixelWidth; blockX++) {
+        const int pixelX = mcuX * mcuPixelWidth + blockX;
+        if (pixelX >= imageInfo.m_width) continue;
+
+        // Calculate proper block offset for picojpeg buffer
+        const int blockCol = blockX / 8;
+        const int blockRow = blockY / 8;
+        const int localX = blockX % 8;
+        const int localY = blockY % 8;
+        const int blocksPerRow = mcuPixelWidth / 8;
+        const int blockIndex = blockRow * blocksPerRow + blockCol;
+        const int pixelOffset = blockIndex * 64 + localY * 8 + localX;
+
+        uint8_t gray;
+        if (imageInfo.m_comps == 1) {
+          gray = imageInfo.m_pMCUBufR[pixelOffset];
         } else {
-          Serial.printf("[%lu] [JPG] JPEG decode MCU failed at (%d, %d) with error code: %d\n", millis(), mcuX, mcuY,
-                        mcuStatus);
+          const uint8_t r = imageInfo.m_pMCUBufR[pixelOffset];
+          const uint8_t g = imageInfo.m_pMCUBufG[pixelOffset];
+          const uint8_t b = imageInfo.m_pMCUBufB[pixelOffset];
+          gray = (r * 25 + g * 50 + b * 25) / 100;
         }
-        free(mcuRowBuffer);
-        free(rowBuffer);
-        return false;
+
+        mcuRowBuffer[blockY * imageInfo.m_width + pixelX] = gray;
       }
+    }
+  }
 
-      // picojpeg stores MCU data in 8x8 blocks
-      // Block layout: H2V2(16x16)=0,64,128,192 H2V1(16x8)=0,64 H1V2(8x16)=0,128
-      for (int blockY = 0; blockY < mcuPixelHeight; blockY++) {
-        for (int blockX = 0; blockX < mcuPixelWidth; blockX++) {
-          const int pixelX = mcuX * mcuPixelWidth + blockX;
-          if (pixelX >= imageInfo.m_width) continue;
-
-          // Calculate proper block offset for picojpeg buffer
-          const int blockCol = blockX / 8;
-          const int blockRow = blockY / 8;
-          const int localX = blockX % 8;
-          const int localY = blockY % 8;
-          const int blocksPerRow = mcuPixelWidth / 8;
-          const int blockIndex = blockRow * blocksPerRow + blockCol;
-          const int pixelOffset = blockIndex * 64 + localY * 8 + localX;
-
-          uint8_t gray;
-          if (imageInfo.m_comps == 1) {
-            gray = imageInfo.m_pMCUBufR[pixelOffset];
+  // Process source rows from this MCU row
+  const int startRow = mcuY * mcuPixelHeight;
+  const int endRow = (mcuY + 1) * mcuPixelHeight;
+
+  for (int y = startRow; y < endRow && y < imageInfo.m_height; y++) {
+    const int bufferY = y - startRow;
+
+    if (!needsScaling) {
+      // No scaling - direct output (1:1 mapping)
+      memset(rowBuffer, 0, bytesPerRow);
+
+      if (USE_8BIT_OUTPUT) {
+        for (int x = 0; x < outWidth; x++) {
+          const uint8_t gray = mcuRowBuffer[bufferY * imageInfo.m_width + x];
+          rowBuffer[x] = adjustPixel(gray);
+        }
+      } else {
+        for (int x = 0; x < outWidth; x++) {
+          const uint8_t gray = mcuRowBuffer[bufferY * imageInfo.m_width + x];
+          uint8_t twoBit;
+          if (atkinsonDitherer) {
+            twoBit = atkinsonDitherer->processPixel(gray, x);
+          } else if (fsDitherer) {
+            twoBit = fsDitherer->processPixel(gray, x, fsDitherer->isReverseRow());
           } else {
-            const uint8_t r = imageInfo.m_pMCUBufR[pixelOffset];
-            const uint8_t g = imageInfo.m_pMCUBufG[pixelOffset];
-            const uint8_t b = imageInfo.m_pMCUBufB[pixelOffset];
-            gray = (r * 25 + g * 50 + b * 25) / 100;
+            twoBit = quantize(gray, x, y);
           }
-
-          mcuRowBuffer[blockY * imageInfo.m_width + pixelX] = gray;
+          const int byteIndex = (x * 2) / 8;
+          const int bitOffset = 6 - ((x * 2) % 8);
+          rowBuffer[byteIndex] |= (twoBit << bitOffset);
         }
+        if (atkinsonDitherer)
+          atkinsonDitherer->nextRow();
+        else if (fsDitherer)
+          fsDitherer->nextRow();
       }
-    }
+      bmpOut.write(rowBuffer, bytesPerRow);
+    } else {
+      // Fixed-point area averaging for exact fit scaling
+      // For each output pixel X, accumulate source pixels that map to it
+      // srcX range for outX: [outX * scaleX_fp >> 16, (outX+1) * scaleX_fp >> 16)
+      const uint8_t* srcRow = mcuRowBuffer + bufferY * imageInfo.m_width;
+
+      for (int outX = 0; outX < outWidth; outX++) {
+        // Calculate source X range for this output pixel
+        const int srcXStart = (static_cast<uint32_t>(outX) * scaleX_fp) >> 16;
+        const int srcXEnd = (static_cast<uint32_t>(outX + 1) * scaleX_fp) >> 16;
+
+        // Accumulate all source pixels in this range
+        int sum = 0;
+        int count = 0;
+        for (int srcX = srcXStart; srcX < srcXEnd && srcX < imageInfo.m_width; srcX++) {
+          sum += srcRow[srcX];
+          count++;
+        }
 
-    // Process source rows from this MCU row
-    const int startRow = mcuY * mcuPixelHeight;
-    const int endRow = (mcuY + 1) * mcuPixelHeight;
+        // Handle edge case: if no pixels in range, use nearest
+        if (count == 0 && srcXStart < imageInfo.m_width) {
+          sum = srcRow[srcXStart];
+          count = 1;
+        }
 
-    for (int y = startRow; y < endRow && y < imageInfo.m_height; y++) {
-      const int bufferY = y - startRow;
+        rowAccum[outX] += sum;
+        rowCount[outX] += count;
+      }
 
-      if (!needsScaling) {
-        // No scaling - direct output (1:1 mapping)
+      // Check if we've crossed into the next output row
+      // Current source Y in fixed point: y << 16
+      const uint32_t srcY_fp = static_cast<uint32_t>(y + 1) << 16;
+
+      // Output row when source Y crosses the boundary
+      if (srcY_fp >= nextOutY_srcStart && currentOutY < outHeight) {
         memset(rowBuffer, 0, bytesPerRow);
 
         if (USE_8BIT_OUTPUT) {
           for (int x = 0; x < outWidth; x++) {
-            const uint8_t gray = mcuRowBuffer[bufferY * imageInfo.m_width + x];
+            const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
             rowBuffer[x] = adjustPixel(gray);
           }
         } else {
           for (int x = 0; x < outWidth; x++) {
-            const uint8_t gray = mcuRowBuffer[bufferY * imageInfo.m_width + x];
+            const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
             uint8_t twoBit;
             if (atkinsonDitherer) {
               twoBit = atkinsonDitherer->processPixel(gray, x);
             } else if (fsDitherer) {
               twoBit = fsDitherer->processPixel(gray, x, fsDitherer->isReverseRow());
             } else {
-              twoBit = quantize(gray, x, y);
+              twoBit = quantize(gray, x, currentOutY);
             }
             const int byteIndex = (x * 2) / 8;
             const int bitOffset = 6 - ((x * 2) % 8);
@@ -639,100 +869,58 @@ bool JpegToBmpConverter::jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut) {
           else if (fsDitherer)
             fsDitherer->nextRow();
         }
-        bmpOut.write(rowBuffer, bytesPerRow);
-      } else {
-        // Fixed-point area averaging for exact fit scaling
-        // For each output pixel X, accumulate source pixels that map to it
-        // srcX range for outX: [outX * scaleX_fp >> 16, (outX+1) * scaleX_fp >> 16)
-        const uint8_t* srcRow = mcuRowBuffer + bufferY * imageInfo.m_width;
-
-        for (int outX = 0; outX < outWidth; outX++) {
-          // Calculate source X range for this output pixel
-          const int srcXStart = (static_cast<uint32_t>(outX) * scaleX_fp) >> 16;
-          const int srcXEnd = (static_cast<uint32_t>(outX + 1) * scaleX_fp) >> 16;
-
-          // Accumulate all source pixels in this range
-          int sum = 0;
-          int count = 0;
-          for (int srcX = srcXStart; srcX < srcXEnd && srcX < imageInfo.m_width; srcX++) {
-            sum += srcRow[srcX];
-            count++;
-          }
-
-          // Handle edge case: if no pixels in range, use nearest
-          if (count == 0 && srcXStart < imageInfo.m_width) {
-            sum = srcRow[srcXStart];
-            count = 1;
-          }
-
-          rowAccum[outX] += sum;
-          rowCount[outX] += count;
-        }
-
-        // Check if we've crossed into the next output row
-        // Current source Y in fixed point: y << 16
-        const uint32_t srcY_fp = static_cast<uint32_t>(y + 1) << 16;
-
-        // Output row when source Y crosses the boundary
-        if (srcY_fp >= nextOutY_srcStart && currentOutY < outHeight) {
-          memset(rowBuffer, 0, bytesPerRow);
-
-          if (USE_8BIT_OUTPUT) {
-            for (int x = 0; x < outWidth; x++) {
-              const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
-              rowBuffer[x] = adjustPixel(gray);
-            }
-          } else {
-            for (int x = 0; x < outWidth; x++) {
-              const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
-              uint8_t twoBit;
-              if (atkinsonDitherer) {
-                twoBit = atkinsonDitherer->processPixel(gray, x);
-              } else if (fsDitherer) {
-                twoBit = fsDitherer->processPixel(gray, x, fsDitherer->isReverseRow());
-              } else {
-                twoBit = quantize(gray, x, currentOutY);
-              }
-              const int byteIndex = (x * 2) / 8;
-              const int bitOffset = 6 - ((x * 2) % 8);
-              rowBuffer[byteIndex] |= (twoBit << bitOffset);
-            }
-            if (atkinsonDitherer)
-              atkinsonDitherer->nextRow();
-            else if (fsDitherer)
-              fsDitherer->nextRow();
-          }
 
-          bmpOut.write(rowBuffer, bytesPerRow);
-          currentOutY++;
+        bmpOut.write(rowBuffer, bytesPerRow);
+        currentOutY++;
 
-          // Reset accumulators for next output row
-          memset(rowAccum, 0, outWidth * sizeof(uint32_t));
-          memset(rowCount, 0, outWidth * sizeof(uint16_t));
+        // Reset accumulators for next output row
+        memset(rowAccum, 0, outWidth * sizeof(uint32_t));
+        memset(rowCount, 0, outWidth * sizeof(uint16_t));
 
-          // Update boundary for next output row
-          nextOutY_srcStart = static_cast<uint32_t>(currentOutY + 1) * scaleY_fp;
-        }
+        // Update boundary for next output row
+        nextOutY_srcStart = static_cast<uint32_t>(currentOutY + 1) * scaleY_fp;
       }
     }
   }
 
-  // Clean up
-  if (rowAccum) {
-    delete[] rowAccum;
+  decode->mcuY++;
+  if (decode->mcuY < imageInfo.m_MCUSPerCol) {
+    return Status::More;
   }
-  if (rowCount) {
-    delete[] rowCount;
+  Serial.printf("[%lu] [JPG] Successfully converted JPEG to BMP\n", millis());
+  return Status::Done;
+}
+
+void JpegToBmpConverter::end() {
+  if (!decode) {
+    return;
   }
-  if (atkinsonDitherer) {
-    delete atkinsonDitherer;
+
+  delete[] decode->rowAccum;
+  delete[] decode->rowCount;
+  delete decode->atkinsonDitherer;
+  delete decode->fsDitherer;
+  free(decode->mcuRowBuffer);
+  free(decode->rowBuffer);
+  delete decode;
+  decode = nullptr;
+  conversionInProgress = false;
+}
+
+bool JpegToBmpConverter::jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut) {
+  return jpegFileToBmpStream(jpegFile, bmpOut, TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT);
+}
+
+// Core function: Convert JPEG file to 2-bit BMP
+bool JpegToBmpConverter::jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut, const int targetMaxWidth,
+                                             const int targetMaxHeight) {
+  JpegToBmpConverter converter;
+  if (!converter.begin(readFile, &jpegFile, bmpOut, targetMaxWidth, targetMaxHeight)) {
+    return false;
   }
-  if (fsDitherer) {
-    delete fsDitherer;
+  auto status = Status::More;
+  while (status == Status::More) {
+    status = converter.decodeNextRow();
   }
-  free(mcuRowBuffer);
-  free(rowBuffer);
-
-  Serial.printf("[%lu] [JPG] Successfully converted JPEG to BMP\n", millis());
-  return true;
+  return status == Status::Done;
 }
@@ -1,15 +1,51 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 class FsFile;
 class Print;
 class ZipFile;
 
+// Converts a JPEG to a 2-bit BMP, scaled down (never up) to fit a target size. A conversion can be spread over several
+// calls a row of MCUs at a time, so a large image doesn't hold up a caller that has to stay responsive: begin once,
+// then call decodeNextRow until it stops returning More. picojpeg keeps its state in globals, so only one conversion
+// can be in progress at a time.
 class JpegToBmpConverter {
+ public:
+  // Supplies more JPEG bytes into buffer, returning how many were written. 0 signals the end of the input.
+  using ReadCallback = size_t (*)(void* context, uint8_t* buffer, size_t size);
+  enum class Status : uint8_t { More, Done, Error };
+
+ private:
+  struct Decode;
+  Decode* decode = nullptr;
+
   static void writeBmpHeader(Print& bmpOut, int width, int height);
   // [COMMENTED OUT] static uint8_t grayscaleTo2Bit(uint8_t grayscale, int x, int y);
   static unsigned char jpegReadCallback(unsigned char* pBuf, unsigned char buf_size,
                                         unsigned char* pBytes_actually_read, void* pCallback_data);
 
  public:
+  JpegToBmpConverter() = default;
+  ~JpegToBmpConverter() { end(); }
+  JpegToBmpConverter(const JpegToBmpConverter&) = delete;
+  JpegToBmpConverter& operator=(const JpegToBmpConverter&) = delete;
+
+  // Reads the JPEG up to its image data and writes the BMP header, false if the JPEG can't be converted. The source and
+  // bmpOut must stay valid until end.
+  bool begin(ReadCallback read, void* readContext, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  // Decodes the next row of MCUs and writes the BMP rows it completes, the BMP is whole once Done is returned
+  Status decodeNextRow();
+  // Frees what the conversion holds, whether or not it got to the end
+  void end();
+
+  // Scaled down (never up) to fit the display, for covers
   static bool jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut);
+  static bool jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  // Size of the image from its frame header, reading the JPEG only as far as that. False if there is no frame header
+  // before the image data or the JPEG is of a kind that can't be decoded (only baseline is).
+  static bool readJpegSize(ReadCallback read, void* readContext, int* width, int* height);
+  // Size a conversion scales an image of width x height to, false if it is too large to be decoded
+  static bool getOutputSize(int width, int height, int targetMaxWidth, int targetMaxHeight, int* outWidth,
+                            int* outHeight);
 };
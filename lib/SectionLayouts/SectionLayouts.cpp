@@ -0,0 +1,155 @@
+#include "SectionLayouts.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+#include <Serialization.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr uint8_t LAYOUTS_FILE_VERSION = 1;
+constexpr char layoutsFile[] = "/layouts.bin";
+constexpr size_t LAYOUT_DIR_NAME_LENGTH = 8;
+// Longest name within sections/ that is looked at, longer ones are neither layout dirs nor old section files
+constexpr size_t MAX_NAME_LENGTH = 31;
+
+bool loadLayouts(const std::string& layoutsPath, std::vector<uint32_t>& layouts) {
+  FsFile file;
+  if (!SdMan.exists(layoutsPath.c_str()) || !SdMan.openFileForRead("SCT", layoutsPath, file)) {
+    return false;
+  }
+
+  uint8_t version = 0;
+  uint8_t count = 0;
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  if (version != LAYOUTS_FILE_VERSION || count > SectionLayouts::MAX_LAYOUTS ||
+      file.size() != sizeof(uint8_t) * 2 + sizeof(uint32_t) * count) {
+    file.close();
+    return false;
+  }
+  layouts.resize(count);
+  for (auto& layout : layouts) {
+    serialization::readPod(file, layout);
+  }
+  file.close();
+  return true;
+}
+
+void saveLayouts(const std::string& layoutsPath, const std::vector<uint32_t>& layouts) {
+  FsFile file;
+  if (!SdMan.openFileForWrite("SCT", layoutsPath, file)) {
+    Serial.printf("[%lu] [SCT] Could not write layout list\n", millis());
+    return;
+  }
+
+  uint8_t buffer[sizeof(uint8_t) * 2 + sizeof(uint32_t) * SectionLayouts::MAX_LAYOUTS];
+  size_t length = 0;
+  buffer[length++] = LAYOUTS_FILE_VERSION;
+  buffer[length++] = static_cast<uint8_t>(layouts.size());
+  for (const auto layout : layouts) {
+    memcpy(buffer + length, &layout, sizeof(layout));
+    length += sizeof(layout);
+  }
+  // A short list is recovered from the layout dirs next time, nothing is lost
+  if (file.write(buffer, length) != length) {
+    Serial.printf("[%lu] [SCT] Could not write layout list\n", millis());
+  }
+  file.close();
+}
+
+bool parseLayoutDirName(const char* name, uint32_t& key) {
+  if (strlen(name) != LAYOUT_DIR_NAME_LENGTH) {
+    return false;
+  }
+  for (size_t i = 0; i < LAYOUT_DIR_NAME_LENGTH; i++) {
+    if (!isxdigit(static_cast<unsigned char>(name[i]))) {
+      return false;
+    }
+  }
+  key = static_cast<uint32_t>(strtoul(name, nullptr, 16));
+  return true;
+}
+
+// <spineIndex>.bin, written straight into sections/ before layouts were kept apart
+bool isOldSectionFile(const char* name) {
+  const char* extension = strrchr(name, '.');
+  if (!extension || extension == name || strcmp(extension, ".bin") != 0) {
+    return false;
+  }
+  for (const char* c = name; c != extension; c++) {
+    if (!isdigit(static_cast<unsigned char>(*c))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Lists the layout dirs in sections/, in no particular order, and removes old section files whose layout is unknown
+void recoverLayouts(const std::string& sectionsDir, std::vector<uint32_t>& layouts) {
+  layouts.clear();
+  auto dir = SdMan.open(sectionsDir.c_str());
+  if (!dir || !dir.isDirectory()) {
+    dir.close();
+    SdMan.mkdir(sectionsDir.c_str());
+    return;
+  }
+
+  // Old section files are gathered first so the directory isn't changed while it is being listed
+  std::vector<std::string> oldSectionFiles;
+  char name[MAX_NAME_LENGTH + 1];
+  for (auto file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    uint32_t key;
+    if (file.isDirectory() && parseLayoutDirName(name, key)) {
+      layouts.push_back(key);
+    } else if (!file.isDirectory() && isOldSectionFile(name)) {
+      oldSectionFiles.emplace_back(name);
+    }
+    file.close();
+  }
+  dir.close();
+
+  Serial.printf("[%lu] [SCT] No layout list, found %u layouts and %u old section files\n", millis(),
+                static_cast<unsigned>(layouts.size()), static_cast<unsigned>(oldSectionFiles.size()));
+  for (const auto& oldSectionFile : oldSectionFiles) {
+    SdMan.remove((sectionsDir + "/" + oldSectionFile).c_str());
+  }
+}
+}  // namespace
+
+std::string SectionLayouts::dirName(const uint32_t key) {
+  char name[LAYOUT_DIR_NAME_LENGTH + 1];
+  snprintf(name, sizeof(name), "%08x", static_cast<unsigned>(key));
+  return name;
+}
+
+void SectionLayouts::select(const std::string& sectionsDir, const uint32_t key) {
+  const auto layoutsPath = sectionsDir + layoutsFile;
+  std::vector<uint32_t> layouts;
+  if (!loadLayouts(layoutsPath, layouts)) {
+    recoverLayouts(sectionsDir, layouts);
+  } else if (!layouts.empty() && layouts.front() == key) {
+    return;
+  }
+
+  for (auto it = layouts.begin(); it != layouts.end(); ++it) {
+    if (*it == key) {
+      layouts.erase(it);
+      break;
+    }
+  }
+  layouts.insert(layouts.begin(), key);
+  while (layouts.size() > MAX_LAYOUTS) {
+    const auto evictedDir = sectionsDir + "/" + dirName(layouts.back());
+    Serial.printf("[%lu] [SCT] Evicting sections of least recently used layout %s\n", millis(), evictedDir.c_str());
+    SdMan.removeDir(evictedDir.c_str());
+    layouts.pop_back();
+  }
+
+  saveLayouts(layoutsPath, layouts);
+}
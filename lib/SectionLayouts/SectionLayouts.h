@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Keeps the section files of the few most recently used layouts of a book, each in its own sections/<layout> dir, so
+// switching back to a recent font or margin setting finds every chapter built in it still there.
+//
+// sections/layouts.bin lists the kept layouts, most recently used first. If it is lost or can't be read the list is
+// recovered from the layout dirs on the card, only section files from before layouts were kept apart are removed.
+class SectionLayouts {
+ public:
+  // Layouts whose section files are kept
+  static constexpr size_t MAX_LAYOUTS = 3;
+
+  // Name of the dir within sections/ holding the section files of a layout
+  static std::string dirName(uint32_t key);
+  // Marks the layout as the most recently used, removing the dir of the least recently used one if there are now too
+  // many
+  static void select(const std::string& sectionsDir, uint32_t key);
+};
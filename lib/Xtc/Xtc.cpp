@@ -11,6 +11,27 @@
 #include <HardwareSerial.h>
 #include <SDCardManager.h>
 
+// The header, title and page table identify an XTC file, they cover everything before the page data
+bool Xtc::identityRange(const std::string& filepath, const uint64_t fileSize, uint64_t* offset, uint64_t* length) {
+  FsFile file;
+  if (!SdMan.openFileForRead("XTC", filepath, file)) {
+    return false;
+  }
+
+  xtc::XtcHeader header;
+  const bool headerRead = file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header);
+  file.close();
+  if (!headerRead || (header.magic != xtc::XTC_MAGIC && header.magic != xtc::XTCH_MAGIC)) {
+    return false;
+  }
+
+  const uint64_t pageTableEnd =
+      header.pageTableOffset + static_cast<uint64_t>(header.pageCount) * sizeof(xtc::PageTableEntry);
+  *offset = 0;
+  *length = pageTableEnd < fileSize ? pageTableEnd : fileSize;
+  return true;
+}
+
 bool Xtc::load() {
   Serial.printf("[%lu] [XTC] Loading XTC: %s\n", millis(), filepath.c_str());
 
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <BookCacheKey.h>
+
 #include <memory>
 #include <string>
 #include <vector>
@@ -26,10 +28,12 @@ class Xtc {
   std::unique_ptr<xtc::XtcParser> parser;
   bool loaded;
 
+  static bool identityRange(const std::string& filepath, uint64_t fileSize, uint64_t* offset, uint64_t* length);
+
  public:
   explicit Xtc(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)), loaded(false) {
-    // Create cache key based on filepath (same as Epub)
-    cachePath = cacheDir + "/xtc_" + std::to_string(std::hash<std::string>{}(this->filepath));
+    // Create cache key based on the file's content (same as Epub)
+    cachePath = BookCacheKey::resolve(this->filepath, cacheDir, "xtc_", identityRange);
   }
   ~Xtc() = default;
 
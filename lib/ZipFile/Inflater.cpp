@@ -0,0 +1,722 @@
+#include "Inflater.h"
+
+#include <HardwareSerial.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr uint16_t END_OF_BLOCK = 256;
+constexpr uint16_t MAX_MATCH = 258;
+// The fast loop refills the bit buffer at most four times per iteration, each reads 4 bytes and consumes up to 3
+constexpr size_t FAST_INPUT_MARGIN = 16;
+
+constexpr uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DISTANCE_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+                                        33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+                                        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+uint16_t reverseBits(uint16_t value, const uint8_t count) {
+  value = ((value & 0xAAAA) >> 1) | ((value & 0x5555) << 1);
+  value = ((value & 0xCCCC) >> 2) | ((value & 0x3333) << 2);
+  value = ((value & 0xF0F0) >> 4) | ((value & 0x0F0F) << 4);
+  value = ((value & 0xFF00) >> 8) | ((value & 0x00FF) << 8);
+  return value >> (16 - count);
+}
+}  // namespace
+
+Inflater::Workspace* Inflater::workspace = nullptr;
+std::atomic<bool> Inflater::workspaceLent{false};
+
+Inflater::~Inflater() { end(); }
+
+bool Inflater::reserveWorkspace() {
+  if (workspaceLent.exchange(true)) {
+    return true;  // Lent out, so already reserved
+  }
+
+  if (!workspace) {
+    workspace = static_cast<Workspace*>(malloc(sizeof(Workspace)));
+    if (!workspace) {
+      Serial.printf("[%lu] [INF] Failed to allocate memory for inflate workspace\n", millis());
+    }
+  }
+  const bool reserved = workspace != nullptr;
+  workspaceLent = false;
+  return reserved;
+}
+
+void Inflater::releaseWorkspace() {
+  if (workspaceLent.exchange(true)) {
+    return;
+  }
+
+  free(workspace);
+  workspace = nullptr;
+  workspaceLent = false;
+}
+
+bool Inflater::borrowWorkspace() {
+  if (workspaceLent.exchange(true)) {
+    return false;
+  }
+
+  if (!workspace) {
+    workspace = static_cast<Workspace*>(malloc(sizeof(Workspace)));
+    if (!workspace) {
+      workspaceLent = false;
+      return false;
+    }
+  }
+  borrowedWorkspace = true;
+  return true;
+}
+
+bool Inflater::begin(const size_t inputBufferSize, const RefillCallback refill, void* refillContext) {
+  end();
+
+  if (inputBufferSize <= INPUT_BUFFER_SIZE && borrowWorkspace()) {
+    tables = &workspace->tables;
+    window = workspace->window;
+    inputBuffer = workspace->input;
+  } else {
+    tables = static_cast<Tables*>(malloc(sizeof(Tables)));
+    window = static_cast<uint8_t*>(malloc(WINDOW_SIZE));
+    inputBuffer = static_cast<uint8_t*>(malloc(inputBufferSize));
+    if (!tables || !window || !inputBuffer) {
+      Serial.printf("[%lu] [INF] Failed to allocate memory for inflater\n", millis());
+      end();
+      return false;
+    }
+  }
+  streaming = true;
+
+  this->inputBufferSize = inputBufferSize;
+  this->refill = refill;
+  this->refillContext = refillContext;
+  in = inputBuffer;
+  inEnd = inputBuffer;
+
+  output = window;
+  outputSize = WINDOW_SIZE;
+  outputMask = WINDOW_SIZE - 1;
+  reset();
+  return true;
+}
+
+bool Inflater::begin(const uint8_t* input, const size_t inputSize, uint8_t* output, const size_t outputSize) {
+  end();
+
+  if (borrowWorkspace()) {
+    tables = &workspace->tables;
+  } else {
+    tables = static_cast<Tables*>(malloc(sizeof(Tables)));
+    if (!tables) {
+      Serial.printf("[%lu] [INF] Failed to allocate memory for inflater\n", millis());
+      return false;
+    }
+  }
+
+  in = input;
+  inEnd = input + inputSize;
+
+  this->output = output;
+  this->outputSize = outputSize;
+  // Back references never wrap in a flat buffer
+  outputMask = SIZE_MAX;
+  reset();
+  return true;
+}
+
+void Inflater::end() {
+  if (borrowedWorkspace) {
+    borrowedWorkspace = false;
+    workspaceLent = false;
+  } else {
+    free(tables);
+    free(window);
+    free(inputBuffer);
+  }
+  tables = nullptr;
+  window = nullptr;
+  streaming = false;
+  inputBuffer = nullptr;
+  inputBufferSize = 0;
+  refill = nullptr;
+  refillContext = nullptr;
+  totalIn = 0;
+  output = nullptr;
+  outputSize = 0;
+}
+
+void Inflater::reset() {
+  bitBuffer = 0;
+  bitCount = 0;
+  paddingBits = 0;
+  skipBits = 0;
+  outputPos = 0;
+  readStart = 0;
+  totalOut = 0;
+  state = State::BlockHeader;
+  finalBlock = false;
+  storedRemaining = 0;
+  pendingLiteral = -1;
+  matchRemaining = 0;
+  matchDistance = 0;
+  stopAtBlockEnd = false;
+}
+
+uint8_t* Inflater::resumeAt(const uint32_t totalOut, const uint8_t bitOffset) {
+  if (!streaming) {
+    return nullptr;
+  }
+
+  reset();
+  // Mark the ring as full so the first read wraps back to its start, right behind the restored window
+  outputPos = outputSize;
+  this->totalOut = totalOut;
+  skipBits = bitOffset & 7;
+  return window;
+}
+
+uint32_t Inflater::getInputBitOffset() const {
+  return (totalIn - static_cast<uint32_t>(inEnd - in)) * 8 - bitCount;
+}
+
+bool Inflater::writeWindow(Print& out) const {
+  if (!streaming) {
+    return false;
+  }
+
+  // Everything after the write position is older than everything before it
+  const size_t pos = outputPos == outputSize ? 0 : outputPos;
+  return out.write(window + pos, WINDOW_SIZE - pos) == WINDOW_SIZE - pos && out.write(window, pos) == pos;
+}
+
+// Canonical Huffman table, codes up to FAST_BITS long resolve with a single lookup
+bool Inflater::buildTable(HuffmanTable& table, const uint8_t* lengths, const uint16_t count) {
+  uint16_t sizes[16] = {};
+  uint16_t nextCode[16] = {};
+
+  memset(table.fast, 0, sizeof(table.fast));
+  for (uint16_t i = 0; i < count; i++) {
+    sizes[lengths[i]]++;
+  }
+  sizes[0] = 0;
+
+  uint32_t code = 0;
+  uint16_t symbolIndex = 0;
+  uint8_t maxLength = 0;
+  for (uint8_t length = 1; length < 16; length++) {
+    if (sizes[length] > (1u << length)) {
+      return false;
+    }
+    nextCode[length] = code;
+    table.firstCode[length] = code;
+    table.firstSymbol[length] = symbolIndex;
+    code += sizes[length];
+    if (sizes[length] && code - 1 >= (1u << length)) {
+      return false;  // Over-subscribed
+    }
+    table.maxCode[length] = code << (16 - length);
+    code <<= 1;
+    symbolIndex += sizes[length];
+    if (sizes[length]) {
+      maxLength = length;
+    }
+  }
+  table.maxCode[16] = 0x10000;
+  // Bit patterns that no code was assigned are corrupt data. Like zlib, a table is only allowed to leave some if it
+  // is empty or holds a single code, which compressors write for a block with one distance.
+  if (code != 1u << 16 && maxLength > 1) {
+    return false;
+  }
+
+  for (uint16_t symbol = 0; symbol < count; symbol++) {
+    const uint8_t length = lengths[symbol];
+    if (!length) {
+      continue;
+    }
+
+    const uint16_t slot = nextCode[length] - table.firstCode[length] + table.firstSymbol[length];
+    table.size[slot] = length;
+    table.value[slot] = symbol;
+    if (length <= FAST_BITS) {
+      const uint16_t fastValue = (length << 9) | symbol;
+      for (uint32_t i = reverseBits(nextCode[length], length); i < (1u << FAST_BITS); i += 1u << length) {
+        table.fast[i] = fastValue;
+      }
+    }
+    nextCode[length]++;
+  }
+  return true;
+}
+
+// Caller guarantees at least 15 bits are in the buffer
+inline int Inflater::decode(const HuffmanTable& table, uint32_t& bits, uint8_t& count) {
+  const uint16_t fastValue = table.fast[bits & ((1u << FAST_BITS) - 1)];
+  if (fastValue) {
+    const uint8_t length = fastValue >> 9;
+    bits >>= length;
+    count -= length;
+    return fastValue & 0x1FF;
+  }
+
+  const uint32_t reversed = reverseBits(bits & 0xFFFF, 16);
+  uint8_t length = FAST_BITS + 1;
+  while (length < 16 && reversed >= table.maxCode[length]) {
+    length++;
+  }
+  if (length >= 16) {
+    return -1;
+  }
+
+  const uint32_t slot = (reversed >> (16 - length)) - table.firstCode[length] + table.firstSymbol[length];
+  if (slot >= MAX_SYMBOLS || table.size[slot] != length) {
+    return -1;
+  }
+  bits >>= length;
+  count -= length;
+  return table.value[slot];
+}
+
+bool Inflater::refillInput() {
+  if (!refill) {
+    return false;
+  }
+
+  const size_t read = refill(refillContext, inputBuffer, inputBufferSize);
+  if (read == 0) {
+    return false;
+  }
+  in = inputBuffer;
+  inEnd = inputBuffer + read;
+  totalIn += read;
+  return true;
+}
+
+void Inflater::fillBits() {
+  while (bitCount <= 24) {
+    if (in == inEnd && !refillInput()) {
+      // Out of input, pad with zeros so decoding can finish the final symbol
+      paddingBits += 8;
+      bitCount += 8;
+      continue;
+    }
+    bitBuffer |= static_cast<uint32_t>(*in++) << bitCount;
+    bitCount += 8;
+  }
+}
+
+uint32_t Inflater::takeBits(const uint8_t count) {
+  if (bitCount < count) {
+    fillBits();
+  }
+  const uint32_t value = bitBuffer & ((1u << count) - 1);
+  bitBuffer >>= count;
+  bitCount -= count;
+  return value;
+}
+
+int Inflater::decodeSymbol(const HuffmanTable& table) {
+  fillBits();
+  return decode(table, bitBuffer, bitCount);
+}
+
+void Inflater::loadFixedTables() {
+  uint8_t* lengths = tables->codeLengths;
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 256 - 144);
+  memset(lengths + 256, 7, 280 - 256);
+  memset(lengths + 280, 8, MAX_SYMBOLS - 280);
+  buildTable(tables->literals, lengths, MAX_SYMBOLS);
+
+  memset(lengths, 5, 32);
+  buildTable(tables->distances, lengths, 32);
+}
+
+bool Inflater::readDynamicTables() {
+  const uint16_t literalCount = takeBits(5) + 257;
+  const uint16_t distanceCount = takeBits(5) + 1;
+  const uint8_t codeLengthCount = takeBits(4) + 4;
+  if (literalCount > 286 || distanceCount > 30) {
+    return false;
+  }
+
+  uint8_t codeLengthLengths[19] = {};
+  for (uint8_t i = 0; i < codeLengthCount; i++) {
+    codeLengthLengths[CODE_LENGTH_ORDER[i]] = takeBits(3);
+  }
+  // The distance table is free until the real one is built, borrow it to decode the code lengths
+  if (!buildTable(tables->distances, codeLengthLengths, 19)) {
+    return false;
+  }
+
+  uint8_t* lengths = tables->codeLengths;
+  const uint16_t total = literalCount + distanceCount;
+  uint16_t count = 0;
+  while (count < total) {
+    const int symbol = decodeSymbol(tables->distances);
+    if (symbol < 0 || truncated()) {
+      return false;
+    }
+
+    if (symbol < 16) {
+      lengths[count++] = symbol;
+      continue;
+    }
+
+    uint8_t value = 0;
+    uint8_t repeat;
+    if (symbol == 16) {
+      if (count == 0) {
+        return false;
+      }
+      value = lengths[count - 1];
+      repeat = 3 + takeBits(2);
+    } else if (symbol == 17) {
+      repeat = 3 + takeBits(3);
+    } else {
+      repeat = 11 + takeBits(7);
+    }
+    if (count + repeat > total) {
+      return false;
+    }
+    memset(lengths + count, value, repeat);
+    count += repeat;
+  }
+
+  if (lengths[END_OF_BLOCK] == 0) {
+    return false;
+  }
+  return buildTable(tables->literals, lengths, literalCount) &&
+         buildTable(tables->distances, lengths + literalCount, distanceCount);
+}
+
+Inflater::Step Inflater::readBlockHeader() {
+  if (finalBlock) {
+    state = State::Done;
+    return Step::Continue;
+  }
+
+  finalBlock = takeBits(1);
+  switch (takeBits(2)) {
+    case 0: {
+      // Stored blocks start on a byte boundary
+      const uint8_t skip = bitCount & 7;
+      bitBuffer >>= skip;
+      bitCount -= skip;
+      const uint16_t length = takeBits(16);
+      const uint16_t lengthComplement = takeBits(16);
+      if (length != static_cast<uint16_t>(~lengthComplement)) {
+        Serial.printf("[%lu] [INF] Stored block length mismatch\n", millis());
+        return Step::Failed;
+      }
+      storedRemaining = length;
+      state = State::StoredBlock;
+      break;
+    }
+    case 1:
+      loadFixedTables();
+      state = State::HuffmanBlock;
+      break;
+    case 2:
+      if (!readDynamicTables()) {
+        Serial.printf("[%lu] [INF] Invalid dynamic Huffman tables\n", millis());
+        return Step::Failed;
+      }
+      state = State::HuffmanBlock;
+      break;
+    default:
+      Serial.printf("[%lu] [INF] Invalid block type\n", millis());
+      return Step::Failed;
+  }
+
+  if (truncated()) {
+    Serial.printf("[%lu] [INF] Unexpected end of input\n", millis());
+    return Step::Failed;
+  }
+  return Step::Continue;
+}
+
+Inflater::Step Inflater::copyStored() {
+  while (storedRemaining > 0) {
+    if (outputPos == outputSize) {
+      return Step::OutputFull;
+    }
+
+    // Whole bytes still sitting in the bit buffer come first
+    if (bitCount >= 8) {
+      if (paddingBits + 8 > bitCount) {
+        Serial.printf("[%lu] [INF] Unexpected end of input\n", millis());
+        return Step::Failed;
+      }
+      output[outputPos++] = bitBuffer & 0xFF;
+      bitBuffer >>= 8;
+      bitCount -= 8;
+      storedRemaining--;
+      continue;
+    }
+
+    if (in == inEnd && !refillInput()) {
+      Serial.printf("[%lu] [INF] Unexpected end of input\n", millis());
+      return Step::Failed;
+    }
+    size_t count = inEnd - in;
+    if (count > storedRemaining) count = storedRemaining;
+    if (count > outputSize - outputPos) count = outputSize - outputPos;
+    memcpy(output + outputPos, in, count);
+    in += count;
+    outputPos += count;
+    storedRemaining -= count;
+  }
+
+  state = State::BlockHeader;
+  return Step::Continue;
+}
+
+void Inflater::copyMatch() {
+  while (matchRemaining > 0 && outputPos < outputSize) {
+    output[outputPos] = output[(outputPos - matchDistance) & outputMask];
+    outputPos++;
+    matchRemaining--;
+  }
+}
+
+// Decodes symbols while there is enough input and output space that no bounds checks are needed per byte.
+// Works on local copies of the decoder state so they can live in registers.
+bool Inflater::decodeFast() {
+  uint32_t bits = bitBuffer;
+  uint8_t count = bitCount;
+  const uint8_t* src = in;
+  uint8_t* const out = output;
+  size_t pos = outputPos;
+  const size_t mask = outputMask;
+  const size_t history = totalOut - readStart;
+  const HuffmanTable& literals = tables->literals;
+  const HuffmanTable& distances = tables->distances;
+  bool ok = true;
+
+  // Branchless refill: load the next 4 bytes whole and only advance past the ones that fit. Bits loaded above
+  // count are the upcoming input, so loading them again later is harmless.
+  const auto refillBits = [&]() {
+    bits |= (src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(src[3]) << 24)) << count;
+    src += (31 - count) >> 3;
+    count |= 24;
+  };
+
+  // One spare byte for the second literal decoded ahead of a match
+  while (static_cast<size_t>(inEnd - src) >= FAST_INPUT_MARGIN && outputSize - pos > MAX_MATCH) {
+    refillBits();
+    int symbol = decode(literals, bits, count);
+    // Literals are the common case, take a second symbol if enough bits are left without refilling
+    if (symbol >= 0 && symbol < 256 && count >= 15) {
+      out[pos++] = symbol;
+      symbol = decode(literals, bits, count);
+    }
+    if (symbol < 256) {
+      if (symbol < 0) {
+        ok = false;
+        break;
+      }
+      out[pos++] = symbol;
+      continue;
+    }
+    if (symbol == END_OF_BLOCK) {
+      state = State::BlockHeader;
+      break;
+    }
+
+    symbol -= 257;
+    if (symbol >= 29) {
+      ok = false;
+      break;
+    }
+    uint32_t length = LENGTH_BASE[symbol];
+    uint8_t extra = LENGTH_EXTRA[symbol];
+    if (extra) {
+      if (count < extra) {
+        refillBits();
+      }
+      length += bits & ((1u << extra) - 1);
+      bits >>= extra;
+      count -= extra;
+    }
+
+    refillBits();
+    symbol = decode(distances, bits, count);
+    if (symbol < 0 || symbol >= 30) {
+      ok = false;
+      break;
+    }
+    uint32_t distance = DISTANCE_BASE[symbol];
+    extra = DISTANCE_EXTRA[symbol];
+    if (extra) {
+      if (count < extra) {
+        refillBits();
+      }
+      distance += bits & ((1u << extra) - 1);
+      bits >>= extra;
+      count -= extra;
+    }
+    if (distance > history + pos) {
+      ok = false;
+      break;
+    }
+
+    uint8_t* dst = out + pos;
+    if (distance > pos) {
+      // Source wraps around the ring
+      for (uint32_t i = 0; i < length; i++) {
+        dst[i] = out[(pos + i - distance) & mask];
+      }
+    } else if (distance == 1) {
+      memset(dst, dst[-1], length);
+    } else {
+      // Copying forward in steps no larger than the distance only ever reads bytes that are already written
+      const uint8_t* from = dst - distance;
+      uint32_t remaining = length;
+      if (distance >= 4) {
+        for (; remaining >= 4; remaining -= 4, dst += 4, from += 4) {
+          memcpy(dst, from, 4);
+        }
+      }
+      while (remaining--) {
+        *dst++ = *from++;
+      }
+    }
+    pos += length;
+  }
+
+  // Drop the bits that were loaded ahead, the slow path expects nothing above bitCount
+  bitBuffer = bits & ((1u << count) - 1);
+  bitCount = count;
+  in = src;
+  outputPos = pos;
+  return ok;
+}
+
+Inflater::Step Inflater::decodeHuffman() {
+  // Finish whatever did not fit last time
+  if (pendingLiteral >= 0) {
+    if (outputPos == outputSize) {
+      return Step::OutputFull;
+    }
+    output[outputPos++] = pendingLiteral;
+    pendingLiteral = -1;
+  }
+  if (matchRemaining > 0) {
+    copyMatch();
+    if (matchRemaining > 0) {
+      return Step::OutputFull;
+    }
+  }
+
+  while (state == State::HuffmanBlock) {
+    if (!decodeFast()) {
+      Serial.printf("[%lu] [INF] Invalid compressed data\n", millis());
+      return Step::Failed;
+    }
+    if (state != State::HuffmanBlock) {
+      break;
+    }
+
+    // Close to the end of the input buffer or of the output, decode a single symbol with all checks in place
+    int symbol = decodeSymbol(tables->literals);
+    if (symbol < 0 || truncated()) {
+      Serial.printf("[%lu] [INF] Invalid compressed data\n", millis());
+      return Step::Failed;
+    }
+    if (symbol < 256) {
+      if (outputPos == outputSize) {
+        pendingLiteral = symbol;
+        return Step::OutputFull;
+      }
+      output[outputPos++] = symbol;
+      continue;
+    }
+    if (symbol == END_OF_BLOCK) {
+      state = State::BlockHeader;
+      break;
+    }
+
+    symbol -= 257;
+    if (symbol >= 29) {
+      Serial.printf("[%lu] [INF] Invalid length symbol\n", millis());
+      return Step::Failed;
+    }
+    const uint16_t length = LENGTH_BASE[symbol] + takeBits(LENGTH_EXTRA[symbol]);
+    symbol = decodeSymbol(tables->distances);
+    if (symbol < 0 || symbol >= 30) {
+      Serial.printf("[%lu] [INF] Invalid distance symbol\n", millis());
+      return Step::Failed;
+    }
+    const uint32_t distance = DISTANCE_BASE[symbol] + takeBits(DISTANCE_EXTRA[symbol]);
+    if (truncated() || distance > totalOut + (outputPos - readStart)) {
+      Serial.printf("[%lu] [INF] Invalid distance or unexpected end of input\n", millis());
+      return Step::Failed;
+    }
+
+    matchRemaining = length;
+    matchDistance = distance;
+    copyMatch();
+    if (matchRemaining > 0) {
+      return Step::OutputFull;
+    }
+  }
+
+  return Step::Continue;
+}
+
+Inflater::Status Inflater::read(const uint8_t** data, size_t* size) {
+  *size = 0;
+  if (!tables) {
+    return Status::Error;
+  }
+
+  // Streaming output wraps back to the start of the ring once the previous span has been handed out
+  if (streaming && outputPos == outputSize) {
+    outputPos = 0;
+  }
+  readStart = outputPos;
+
+  if (skipBits) {
+    takeBits(skipBits);
+    skipBits = 0;
+  }
+
+  Step step = Step::Continue;
+  while (step == Step::Continue && state != State::Done) {
+    switch (state) {
+      case State::BlockHeader:
+        step = readBlockHeader();
+        break;
+      case State::StoredBlock:
+        step = copyStored();
+        break;
+      case State::HuffmanBlock:
+        step = decodeHuffman();
+        break;
+      default:
+        break;
+    }
+    if (stopAtBlockEnd && step == Step::Continue && state == State::BlockHeader && !finalBlock) {
+      break;
+    }
+  }
+
+  totalOut += outputPos - readStart;
+  *data = output + readStart;
+  *size = outputPos - readStart;
+
+  if (step == Step::Failed) {
+    return Status::Error;
+  }
+  return state == State::Done ? Status::Done : Status::More;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <Print.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Raw deflate (RFC 1951) decoder used in place of tinfl for zip entries.
+// Keeps a 32 bit bit buffer and decodes Huffman codes through a lookup table. A tight loop handles the common case
+// where plenty of input and output space is available, refilling the bit buffer without branches and taking two
+// literals per refill when the bits allow it.
+//
+// Streaming mode writes into a 32KB ring which doubles as the back reference window, read() hands back each newly
+// inflated span of the ring. One shot mode writes straight into a caller provided buffer sized to the whole output.
+//
+// The tables, window and input buffer come from a single shared workspace which is allocated once and lent to one
+// inflater at a time, so reading chapter after chapter doesn't churn the heap. An inflater which finds it lent out
+// allocates its own memory instead.
+//
+// A streaming inflate can be resumed between two deflate blocks given the input bit offset and the 32KB of output
+// that preceded it, which is what ZipFile's checkpoints store.
+class Inflater {
+ public:
+  enum class Status : uint8_t { More, Done, Error };
+
+  // Supplies more compressed bytes into buffer, returning how many were written. 0 signals the end of the input.
+  using RefillCallback = size_t (*)(void* context, uint8_t* buffer, size_t size);
+
+  static constexpr size_t WINDOW_SIZE = 32768;
+  // Input buffer of the shared workspace, streaming inflates asking for a larger one allocate their own memory
+  static constexpr size_t INPUT_BUFFER_SIZE = 4096;
+
+ private:
+  static constexpr uint8_t FAST_BITS = 10;
+  static constexpr uint16_t MAX_SYMBOLS = 288;
+
+  struct HuffmanTable {
+    uint16_t fast[1 << FAST_BITS];  // (code length << 9) | symbol, 0 when the code is longer than FAST_BITS
+    uint16_t firstCode[16];
+    uint16_t firstSymbol[16];
+    uint32_t maxCode[17];  // Exclusive upper bound of each code length, left aligned to 16 bits
+    uint8_t size[MAX_SYMBOLS];
+    uint16_t value[MAX_SYMBOLS];
+  };
+
+  struct Tables {
+    HuffmanTable literals;
+    HuffmanTable distances;
+    uint8_t codeLengths[MAX_SYMBOLS + 32];
+  };
+
+  struct Workspace {
+    Tables tables;
+    uint8_t window[WINDOW_SIZE];
+    uint8_t input[INPUT_BUFFER_SIZE];
+  };
+
+  enum class State : uint8_t { BlockHeader, StoredBlock, HuffmanBlock, Done };
+  enum class Step : uint8_t { Continue, OutputFull, Failed };
+
+  static Workspace* workspace;
+  static std::atomic<bool> workspaceLent;
+
+  Tables* tables = nullptr;
+  uint8_t* window = nullptr;
+  bool streaming = false;
+  bool borrowedWorkspace = false;
+
+  // Input
+  uint8_t* inputBuffer = nullptr;
+  size_t inputBufferSize = 0;
+  RefillCallback refill = nullptr;
+  void* refillContext = nullptr;
+  uint32_t totalIn = 0;
+  const uint8_t* in = nullptr;
+  const uint8_t* inEnd = nullptr;
+  uint32_t bitBuffer = 0;
+  uint8_t bitCount = 0;
+  // Zero bits appended once the input ran dry, consuming any of them means the stream was truncated
+  uint16_t paddingBits = 0;
+  // Bits to drop from the first input byte when resuming at a checkpoint
+  uint8_t skipBits = 0;
+
+  // Output
+  uint8_t* output = nullptr;
+  size_t outputSize = 0;
+  size_t outputMask = 0;
+  size_t outputPos = 0;
+  size_t readStart = 0;
+  uint32_t totalOut = 0;
+
+  State state = State::BlockHeader;
+  bool finalBlock = false;
+  uint32_t storedRemaining = 0;
+  int16_t pendingLiteral = -1;
+  uint16_t matchRemaining = 0;
+  uint16_t matchDistance = 0;
+  bool stopAtBlockEnd = false;
+
+  static bool buildTable(HuffmanTable& table, const uint8_t* lengths, uint16_t count);
+  static int decode(const HuffmanTable& table, uint32_t& bits, uint8_t& count);
+  bool refillInput();
+  void fillBits();
+  bool truncated() const { return paddingBits > bitCount; }
+  uint32_t takeBits(uint8_t count);
+  int decodeSymbol(const HuffmanTable& table);
+  Step readBlockHeader();
+  bool readDynamicTables();
+  void loadFixedTables();
+  Step copyStored();
+  void copyMatch();
+  bool decodeFast();
+  Step decodeHuffman();
+  bool borrowWorkspace();
+  void reset();
+
+ public:
+  Inflater() = default;
+  ~Inflater();
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  // Allocates the shared workspace ahead of the first inflate, while the heap is still in one piece
+  static bool reserveWorkspace();
+  // Gives the shared workspace back to the heap, unless it is lent out. The next inflate allocates it again.
+  static void releaseWorkspace();
+
+  // Streaming mode, compressed bytes are pulled through refill into an input buffer of inputBufferSize as needed
+  bool begin(size_t inputBufferSize, RefillCallback refill, void* refillContext);
+  // One shot mode, the entire compressed stream is in input and the entire result fits in output
+  bool begin(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize);
+  void end();
+
+  // Inflates until the output ring wraps (or the output buffer fills) or the stream ends.
+  // data and size describe the bytes produced by this call, they stay valid until the next call.
+  Status read(const uint8_t** data, size_t* size);
+  uint32_t getTotalOut() const { return totalOut; }
+
+  // Makes read() also return as soon as a block ends, so the caller can take a checkpoint
+  void setStopAtBlockEnd(const bool stop) { stopAtBlockEnd = stop; }
+  // True between two blocks of a stream that has more blocks to come, the only place a checkpoint can be taken
+  bool atBlockBoundary() const {
+    return state == State::BlockHeader && !finalBlock && streaming && paddingBits == 0;
+  }
+  // Position of the next unread bit, counted from the first byte supplied through refill
+  uint32_t getInputBitOffset() const;
+  // Writes the last WINDOW_SIZE bytes of output, oldest first
+  bool writeWindow(Print& out) const;
+  // Streaming mode only, continues a stream at a checkpoint. Refill must supply input starting at the byte holding
+  // the checkpoint's bit offset, bitOffset is the position within that byte. The caller fills the returned window
+  // with the WINDOW_SIZE bytes of output that preceded the checkpoint, oldest first.
+  uint8_t* resumeAt(uint32_t totalOut, uint8_t bitOffset);
+};
@@ -2,96 +2,307 @@
 
 #include <HardwareSerial.h>
 #include <SDCardManager.h>
+#include <Serialization.h>
 #include <miniz.h>
 
-bool inflateOneShot(const uint8_t* inputBuf, const size_t deflatedSize, uint8_t* outputBuf, const size_t inflatedSize) {
-  // Setup inflator
-  const auto inflator = static_cast<tinfl_decompressor*>(malloc(sizeof(tinfl_decompressor)));
-  if (!inflator) {
-    Serial.printf("[%lu] [ZIP] Failed to allocate memory for inflator\n", millis());
+#include <algorithm>
+#include <cstring>
+
+#include "Inflater.h"
+
+namespace {
+constexpr uint8_t ZIP_INDEX_VERSION = 2;
+constexpr uint8_t MIN_FANOUT_BITS = 4;
+constexpr uint8_t MAX_FANOUT_BITS = 12;
+constexpr uint32_t INDEX_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint32_t) +
+                                       sizeof(uint32_t) + sizeof(uint8_t);
+constexpr uint32_t CENTRAL_DIR_SIGNATURE = 0x02014b50;
+constexpr size_t CENTRAL_DIR_HEADER_SIZE = 46;
+constexpr uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE = 0x07064b50;
+constexpr size_t ZIP64_EOCD_LOCATOR_SIZE = 20;
+constexpr uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+constexpr size_t ZIP64_EOCD_SIZE = 56;
+constexpr uint16_t ZIP64_EXTRA_FIELD_ID = 0x0001;
+// Header value meaning the real one is in the ZIP64 extra field
+constexpr uint32_t ZIP64_FIELD_OVERFLOW = 0xFFFFFFFF;
+// Entries with sizes past 32 bits are given this method so reads of them fail as unsupported
+constexpr uint16_t UNSUPPORTED_METHOD = 0xFFFF;
+constexpr uint8_t CHECKPOINT_VERSION = 2;
+// Smaller entries inflate from the start quickly enough that checkpoints aren't worth the space
+constexpr uint32_t CHECKPOINT_MIN_ENTRY_SIZE = 1024 * 1024;
+constexpr uint32_t CHECKPOINT_SPACING = 256 * 1024;
+constexpr uint32_t CHECKPOINT_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint32_t) * 3;
+constexpr uint32_t CHECKPOINT_RECORD_SIZE = sizeof(uint32_t) * 2 + Inflater::WINDOW_SIZE;
+
+uint16_t readLE16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+
+uint32_t readLE32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t readLE64(const uint8_t* p) { return readLE32(p) | (static_cast<uint64_t>(readLE32(p + 4)) << 32); }
+
+// Walks the extra fields of a central directory entry and fills in every value left at ZIP64_FIELD_OVERFLOW in the
+// header from the ZIP64 extra field. Leaves the file positioned after the extra fields.
+bool readZip64ExtraField(FsFile& file, uint16_t extraLength, uint64_t* uncompressedSize, uint64_t* compressedSize,
+                         uint64_t* localHeaderOffset) {
+  bool found = false;
+  while (extraLength >= 4) {
+    uint8_t fieldHeader[4];
+    if (file.read(fieldHeader, sizeof(fieldHeader)) != static_cast<int>(sizeof(fieldHeader))) {
+      return false;
+    }
+    extraLength -= sizeof(fieldHeader);
+    const uint16_t fieldId = readLE16(fieldHeader);
+    const uint16_t fieldSize = readLE16(fieldHeader + 2);
+    if (fieldSize > extraLength) {
+      return false;
+    }
+    extraLength -= fieldSize;
+
+    if (fieldId != ZIP64_EXTRA_FIELD_ID || found) {
+      if (!file.seekCur(fieldSize)) {
+        return false;
+      }
+      continue;
+    }
+
+    // Only the values which overflowed in the header are present, always in this order
+    uint8_t field[24];
+    const uint16_t fieldRead = fieldSize < sizeof(field) ? fieldSize : sizeof(field);
+    if (file.read(field, fieldRead) != static_cast<int>(fieldRead) || !file.seekCur(fieldSize - fieldRead)) {
+      return false;
+    }
+    uint16_t pos = 0;
+    for (uint64_t* value : {uncompressedSize, compressedSize, localHeaderOffset}) {
+      if (*value != ZIP64_FIELD_OVERFLOW) {
+        continue;
+      }
+      if (pos + sizeof(uint64_t) > fieldRead) {
+        return false;
+      }
+      *value = readLE64(field + pos);
+      pos += sizeof(uint64_t);
+    }
+    found = true;
+  }
+
+  return found && file.seekCur(extraLength);
+}
+
+// FNV-1a, only used to spread entry names across the index
+uint32_t hashName(const char* name, const size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Pulls the compressed bytes of the current entry from the zip for the inflater
+struct EntryInput {
+  FsFile* file;
+  size_t remaining;
+};
+
+size_t readEntryInput(void* context, uint8_t* buffer, const size_t size) {
+  const auto input = static_cast<EntryInput*>(context);
+  const size_t toRead = input->remaining < size ? input->remaining : size;
+  if (toRead == 0) {
+    return 0;
+  }
+
+  const int read = input->file->read(buffer, toRead);
+  if (read <= 0) {
+    return 0;
+  }
+  input->remaining -= read;
+  return read;
+}
+
+void readCheckpoint(FsFile& checkpointFile, const uint32_t index, uint32_t* outputOffset, uint32_t* inputBitOffset) {
+  checkpointFile.seek(CHECKPOINT_HEADER_SIZE + CHECKPOINT_RECORD_SIZE * index);
+  serialization::readPod(checkpointFile, *outputOffset);
+  serialization::readPod(checkpointFile, *inputBitOffset);
+}
+
+// Restores the inflater at the last checkpoint at or before offset, inputStart is the byte to resume reading from
+bool resumeFromCheckpoint(FsFile& checkpointFile, const uint32_t checkpointCount, const size_t offset,
+                          Inflater& inflater, uint32_t* inputStart) {
+  uint32_t outputOffset;
+  uint32_t inputBitOffset;
+
+  // Checkpoints are stored in output order, find the first one past offset
+  uint32_t lo = 0;
+  uint32_t hi = checkpointCount;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    readCheckpoint(checkpointFile, mid, &outputOffset, &inputBitOffset);
+    if (outputOffset <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
     return false;
   }
-  memset(inflator, 0, sizeof(tinfl_decompressor));
-  tinfl_init(inflator);
 
-  size_t inBytes = deflatedSize;
-  size_t outBytes = inflatedSize;
-  const tinfl_status status = tinfl_decompress(inflator, inputBuf, &inBytes, nullptr, outputBuf, &outBytes,
-                                               TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
-  free(inflator);
+  readCheckpoint(checkpointFile, lo - 1, &outputOffset, &inputBitOffset);
+  uint8_t* window = inflater.resumeAt(outputOffset, inputBitOffset & 7);
+  if (!window) {
+    return false;
+  }
+  if (checkpointFile.read(window, Inflater::WINDOW_SIZE) != static_cast<int>(Inflater::WINDOW_SIZE)) {
+    Serial.printf("[%lu] [ZIP] Failed to read checkpoint window\n", millis());
+    // Resuming at zero output is the same as starting the stream over
+    inflater.resumeAt(0, 0);
+    return false;
+  }
 
-  if (status != TINFL_STATUS_DONE) {
-    Serial.printf("[%lu] [ZIP] tinfl_decompress() failed with status %d\n", millis(), status);
+  *inputStart = inputBitOffset >> 3;
+  return true;
+}
+
+// Appends a checkpoint, the count in the header is only bumped once the whole record is written
+bool writeCheckpoint(FsFile& checkpointFile, const uint32_t checkpointCount, const Inflater& inflater,
+                     const uint32_t inputBitOffset) {
+  checkpointFile.seek(CHECKPOINT_HEADER_SIZE + CHECKPOINT_RECORD_SIZE * checkpointCount);
+  serialization::writePod(checkpointFile, inflater.getTotalOut());
+  serialization::writePod(checkpointFile, inputBitOffset);
+  if (!inflater.writeWindow(checkpointFile)) {
     return false;
   }
 
+  checkpointFile.seek(CHECKPOINT_HEADER_SIZE - sizeof(uint32_t));
+  serialization::writePod(checkpointFile, checkpointCount + 1);
   return true;
 }
+}  // namespace
 
-bool ZipFile::loadAllFileStatSlims() {
-  const bool wasOpen = isOpen();
-  if (!wasOpen && !open()) {
+bool inflateOneShot(const uint8_t* inputBuf, const size_t deflatedSize, uint8_t* outputBuf, const size_t inflatedSize) {
+  Inflater inflater;
+  if (!inflater.begin(inputBuf, deflatedSize, outputBuf, inflatedSize)) {
     return false;
   }
 
-  if (!loadZipDetails()) {
-    if (!wasOpen) {
-      close();
-    }
+  const uint8_t* data;
+  size_t size;
+  const auto status = inflater.read(&data, &size);
+  if (status != Inflater::Status::Done || size != inflatedSize) {
+    Serial.printf("[%lu] [ZIP] Inflate failed with status %d\n", millis(), static_cast<int>(status));
     return false;
   }
 
-  file.seek(zipDetails.centralDirOffset);
+  return true;
+}
 
-  uint32_t sig;
-  char itemName[256];
-  fileStatSlimCache.clear();
-  fileStatSlimCache.reserve(zipDetails.totalEntries);
-
-  while (file.available()) {
-    file.read(&sig, 4);
-    if (sig != 0x02014b50) break;  // End of list
-
-    FileStatSlim fileStat = {};
-
-    file.seekCur(6);
-    file.read(&fileStat.method, 2);
-    file.seekCur(8);
-    file.read(&fileStat.compressedSize, 4);
-    file.read(&fileStat.uncompressedSize, 4);
-    uint16_t nameLen, m, k;
-    file.read(&nameLen, 2);
-    file.read(&m, 2);
-    file.read(&k, 2);
-    file.seekCur(8);
-    file.read(&fileStat.localHeaderOffset, 4);
-    file.read(itemName, nameLen);
-    itemName[nameLen] = '\0';
-
-    fileStatSlimCache.emplace(itemName, fileStat);
+ZipFile::CentralDirStatus ZipFile::readCentralDirEntry(FileStatSlim* fileStat, char* nameBuffer,
+                                                       const size_t nameBufferSize, uint16_t* nameLength) {
+  // The central directory is always followed by an EOCD record, which can be shorter than an entry header. Running
+  // out of file before a signature or partway through an entry means the directory was cut short.
+  uint8_t header[CENTRAL_DIR_HEADER_SIZE];
+  const int headerRead = file.read(header, CENTRAL_DIR_HEADER_SIZE);
+  if (headerRead >= 4 && readLE32(header) != CENTRAL_DIR_SIGNATURE) {
+    return CentralDirStatus::End;
+  }
+  if (headerRead != static_cast<int>(CENTRAL_DIR_HEADER_SIZE)) {
+    Serial.printf("[%lu] [ZIP] Central directory ends early\n", millis());
+    return CentralDirStatus::Failed;
+  }
 
+  uint64_t compressedSize = readLE32(header + 20);
+  uint64_t uncompressedSize = readLE32(header + 24);
+  uint64_t localHeaderOffset = readLE32(header + 42);
+  const uint16_t nameLen = readLE16(header + 28);
+  const uint16_t extraLen = readLE16(header + 30);
+  const uint16_t commentLen = readLE16(header + 32);
+  fileStat->method = readLE16(header + 10);
+  fileStat->compressedSize = compressedSize;
+  fileStat->uncompressedSize = uncompressedSize;
+  fileStat->localHeaderOffset = localHeaderOffset;
+  *nameLength = nameLen;
+
+  // Names which don't fit in the buffer are skipped over rather than truncated, callers check nameLength
+  if (nameLen >= nameBufferSize) {
+    nameBuffer[0] = '\0';
+    return file.seekCur(nameLen + extraLen + commentLen) ? CentralDirStatus::Read : CentralDirStatus::Failed;
+  }
+
+  if (file.read(nameBuffer, nameLen) != nameLen) {
+    Serial.printf("[%lu] [ZIP] Central directory ends early\n", millis());
+    return CentralDirStatus::Failed;
+  }
+  nameBuffer[nameLen] = '\0';
+
+  if (compressedSize != ZIP64_FIELD_OVERFLOW && uncompressedSize != ZIP64_FIELD_OVERFLOW &&
+      localHeaderOffset != ZIP64_FIELD_OVERFLOW) {
     // Skip the rest of this entry (extra field + comment)
-    file.seekCur(m + k);
+    return file.seekCur(extraLen + commentLen) ? CentralDirStatus::Read : CentralDirStatus::Failed;
   }
 
-  if (!wasOpen) {
-    close();
+  if (!readZip64ExtraField(file, extraLen, &uncompressedSize, &compressedSize, &localHeaderOffset)) {
+    Serial.printf("[%lu] [ZIP] Missing or invalid ZIP64 extra field for %s\n", millis(), nameBuffer);
+    return CentralDirStatus::Failed;
   }
-  return true;
+  fileStat->localHeaderOffset = localHeaderOffset;
+  if (compressedSize > UINT32_MAX || uncompressedSize > UINT32_MAX) {
+    Serial.printf("[%lu] [ZIP] Entry %s is too large to read\n", millis(), nameBuffer);
+    fileStat->method = UNSUPPORTED_METHOD;
+  } else {
+    fileStat->compressedSize = compressedSize;
+    fileStat->uncompressedSize = uncompressedSize;
+  }
+
+  return file.seekCur(commentLen) ? CentralDirStatus::Read : CentralDirStatus::Failed;
 }
 
-bool ZipFile::loadFileStatSlim(const char* filename, FileStatSlim* fileStat) {
-  if (!fileStatSlimCache.empty()) {
-    const auto it = fileStatSlimCache.find(filename);
-    if (it != fileStatSlimCache.end()) {
-      *fileStat = it->second;
-      return true;
-    }
+bool ZipFile::nameMatchesAt(const uint64_t centralDirEntryOffset, const char* filename, const size_t filenameLength) {
+  char itemName[256];
+  if (filenameLength >= sizeof(itemName)) {
     return false;
   }
 
+  file.seek(centralDirEntryOffset + CENTRAL_DIR_HEADER_SIZE);
+  if (file.read(itemName, filenameLength) != static_cast<int>(filenameLength)) {
+    return false;
+  }
+  return memcmp(itemName, filename, filenameLength) == 0;
+}
+
+const ZipFile::ResolvedEntry* ZipFile::findResolvedEntry(const char* filename) const {
+  for (const auto& entry : resolvedEntries) {
+    if (!entry.name.empty() && entry.name == filename) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void ZipFile::rememberResolvedEntry(const char* filename, const FileStatSlim& fileStat) {
+  auto& entry = resolvedEntries[nextResolvedEntry];
+  entry.name = filename;
+  entry.fileStat = fileStat;
+  entry.dataOffset = -1;
+  nextResolvedEntry = (nextResolvedEntry + 1) % RESOLVED_ENTRY_COUNT;
+}
+
+void ZipFile::clearResolvedEntries() {
+  for (auto& entry : resolvedEntries) {
+    entry.name.clear();
+  }
+  nextResolvedEntry = 0;
+}
+
+bool ZipFile::loadFileStatSlim(const char* filename, FileStatSlim* fileStat) {
   const bool wasOpen = isOpen();
-  if (!wasOpen && !open()) {
+  if (wasOpen) {
+    if (const auto entry = findResolvedEntry(filename)) {
+      *fileStat = entry->fileStat;
+      return true;
+    }
+  } else if (!open()) {
     return false;
   }
 
@@ -102,46 +313,296 @@ bool ZipFile::loadFileStatSlim(const char* filename, FileStatSlim* fileStat) {
     return false;
   }
 
+  // Prefer the index, only fall back to walking the central directory if it can't be used
+  const bool found = openIndex() ? lookupFileStatSlim(filename, fileStat) : scanFileStatSlim(filename, fileStat);
+
+  if (!wasOpen) {
+    close();
+  } else if (found) {
+    rememberResolvedEntry(filename, *fileStat);
+  }
+  return found;
+}
+
+bool ZipFile::scanFileStatSlim(const char* filename, FileStatSlim* fileStat) {
   file.seek(zipDetails.centralDirOffset);
 
-  uint32_t sig;
   char itemName[256];
-  bool found = false;
+  uint16_t nameLength;
+  CentralDirStatus status;
+  while ((status = readCentralDirEntry(fileStat, itemName, sizeof(itemName), &nameLength)) ==
+         CentralDirStatus::Read) {
+    if (nameLength < sizeof(itemName) && strcmp(itemName, filename) == 0) {
+      return true;
+    }
+  }
+
+  if (status == CentralDirStatus::Failed) {
+    Serial.printf("[%lu] [ZIP] Central directory is damaged, %s may be past the damaged entry\n", millis(), filename);
+  }
+  return false;
+}
+
+bool ZipFile::lookupFileStatSlim(const char* filename, FileStatSlim* fileStat) {
+  const size_t filenameLength = strlen(filename);
+  const uint32_t hash = hashName(filename, filenameLength);
+  const uint32_t bucket = hash >> (32 - indexFanoutBits);
+
+  // Fanout holds the cumulative number of entries up to and including each bucket
+  uint32_t bucketStart = 0;
+  uint32_t bucketEnd = 0;
+  if (bucket == 0) {
+    indexFile.seek(INDEX_HEADER_SIZE);
+  } else {
+    indexFile.seek(INDEX_HEADER_SIZE + sizeof(uint32_t) * (bucket - 1));
+    serialization::readPod(indexFile, bucketStart);
+  }
+  serialization::readPod(indexFile, bucketEnd);
+  if (bucketEnd > indexEntryCount || bucketStart > bucketEnd) {
+    Serial.printf("[%lu] [ZIP] Corrupt index fanout, falling back to central directory scan\n", millis());
+    return scanFileStatSlim(filename, fileStat);
+  }
+
+  // Binary search for the first entry with a matching hash
+  IndexEntry entry = {};
+  uint32_t lo = bucketStart;
+  uint32_t hi = bucketEnd;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    indexFile.seek(indexEntriesOffset + sizeof(IndexEntry) * mid);
+    serialization::readPod(indexFile, entry);
+    if (entry.nameHash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
 
-  while (file.available()) {
-    file.read(&sig, 4);
-    if (sig != 0x02014b50) break;  // End of list
-
-    file.seekCur(6);
-    file.read(&fileStat->method, 2);
-    file.seekCur(8);
-    file.read(&fileStat->compressedSize, 4);
-    file.read(&fileStat->uncompressedSize, 4);
-    uint16_t nameLen, m, k;
-    file.read(&nameLen, 2);
-    file.read(&m, 2);
-    file.read(&k, 2);
-    file.seekCur(8);
-    file.read(&fileStat->localHeaderOffset, 4);
-    file.read(itemName, nameLen);
-    itemName[nameLen] = '\0';
-
-    if (strcmp(itemName, filename) == 0) {
-      found = true;
+  // Entries with the same hash are adjacent, check each name against the central directory
+  for (uint32_t i = lo; i < bucketEnd; i++) {
+    indexFile.seek(indexEntriesOffset + sizeof(IndexEntry) * i);
+    serialization::readPod(indexFile, entry);
+    if (entry.nameHash != hash) {
       break;
     }
 
-    // Skip the rest of this entry (extra field + comment)
-    file.seekCur(m + k);
+    if (entry.nameLength == filenameLength &&
+        nameMatchesAt(entry.centralDirEntryOffset, filename, filenameLength)) {
+      fileStat->method = entry.method;
+      fileStat->compressedSize = entry.compressedSize;
+      fileStat->uncompressedSize = entry.uncompressedSize;
+      fileStat->localHeaderOffset = entry.localHeaderOffset;
+      return true;
+    }
   }
 
-  if (!wasOpen) {
-    close();
+  return false;
+}
+
+bool ZipFile::readIndexHeader() {
+  if (!SdMan.exists(indexPath.c_str()) || !SdMan.openFileForRead("ZIP", indexPath, indexFile)) {
+    return false;
   }
-  return found;
+
+  uint8_t version;
+  uint64_t zipFileSize;
+  uint64_t centralDirOffset;
+  uint32_t totalEntries;
+  serialization::readPod(indexFile, version);
+  serialization::readPod(indexFile, zipFileSize);
+  serialization::readPod(indexFile, centralDirOffset);
+  serialization::readPod(indexFile, totalEntries);
+  serialization::readPod(indexFile, indexEntryCount);
+  serialization::readPod(indexFile, indexFanoutBits);
+
+  if (version != ZIP_INDEX_VERSION || zipFileSize != file.size() || centralDirOffset != zipDetails.centralDirOffset ||
+      totalEntries != zipDetails.totalEntries || indexFanoutBits < MIN_FANOUT_BITS ||
+      indexFanoutBits > MAX_FANOUT_BITS) {
+    Serial.printf("[%lu] [ZIP] Index is stale or invalid\n", millis());
+    indexFile.close();
+    return false;
+  }
+
+  indexEntriesOffset = INDEX_HEADER_SIZE + sizeof(uint32_t) * (1u << indexFanoutBits);
+  return true;
 }
 
-long ZipFile::getDataOffset(const FileStatSlim& fileStat) {
+bool ZipFile::openIndex() {
+  if (indexFile) {
+    return true;
+  }
+
+  if (indexPath.empty()) {
+    return false;
+  }
+
+  if (readIndexHeader()) {
+    return true;
+  }
+
+  return buildIndex() && readIndexHeader();
+}
+
+bool ZipFile::buildIndex() {
+  const auto start = millis();
+
+  // Opened read/write as each bucket is read back for sorting once it has been filled
+  FsFile indexOut = SdMan.open(indexPath.c_str(), O_RDWR | O_CREAT | O_TRUNC);
+  if (!indexOut) {
+    Serial.printf("[%lu] [ZIP] Could not open index for writing: %s\n", millis(), indexPath.c_str());
+    return false;
+  }
+
+  // Aim for a few dozen entries per bucket so sorting a bucket only needs a small buffer
+  uint8_t fanoutBits = MIN_FANOUT_BITS;
+  while (fanoutBits < MAX_FANOUT_BITS && (zipDetails.totalEntries >> fanoutBits) > 32) {
+    fanoutBits++;
+  }
+  const uint32_t bucketCount = 1u << fanoutBits;
+  const uint8_t bucketShift = 32 - fanoutBits;
+
+  const auto fanout = static_cast<uint32_t*>(calloc(bucketCount, sizeof(uint32_t)));
+  if (!fanout) {
+    Serial.printf("[%lu] [ZIP] Failed to allocate memory for index fanout\n", millis());
+    indexOut.close();
+    SdMan.remove(indexPath.c_str());
+    return false;
+  }
+
+  // Pass 1: count the entries falling in each bucket
+  FileStatSlim fileStat = {};
+  char itemName[256];
+  uint16_t nameLength;
+  uint32_t entryCount = 0;
+  CentralDirStatus status;
+  file.seek(zipDetails.centralDirOffset);
+  while ((status = readCentralDirEntry(&fileStat, itemName, sizeof(itemName), &nameLength)) ==
+         CentralDirStatus::Read) {
+    if (nameLength >= sizeof(itemName)) {
+      Serial.printf("[%lu] [ZIP] Skipping entry with %u byte name in index\n", millis(), nameLength);
+      continue;
+    }
+    fanout[hashName(itemName, nameLength) >> bucketShift]++;
+    entryCount++;
+  }
+  // An index of the entries before a damaged one would have every later entry look missing
+  if (status == CentralDirStatus::Failed) {
+    Serial.printf("[%lu] [ZIP] Central directory is damaged after %u entries, not building an index\n", millis(),
+                  entryCount);
+    free(fanout);
+    indexOut.close();
+    SdMan.remove(indexPath.c_str());
+    return false;
+  }
+
+  uint32_t cumulative = 0;
+  uint32_t maxBucketSize = 0;
+  for (uint32_t b = 0; b < bucketCount; b++) {
+    if (fanout[b] > maxBucketSize) {
+      maxBucketSize = fanout[b];
+    }
+    cumulative += fanout[b];
+    fanout[b] = cumulative;
+  }
+
+  // Header is written with a zero version and only stamped once the index is complete
+  serialization::writePod(indexOut, static_cast<uint8_t>(0));
+  serialization::writePod(indexOut, static_cast<uint64_t>(file.size()));
+  serialization::writePod(indexOut, zipDetails.centralDirOffset);
+  serialization::writePod(indexOut, zipDetails.totalEntries);
+  serialization::writePod(indexOut, entryCount);
+  serialization::writePod(indexOut, fanoutBits);
+  indexOut.write(reinterpret_cast<const uint8_t*>(fanout), sizeof(uint32_t) * bucketCount);
+
+  // Reserve space for all entries so they can be written straight into their bucket
+  const uint32_t entriesOffset = indexOut.position();
+  {
+    uint8_t zeroes[256] = {};
+    uint32_t remaining = entryCount * sizeof(IndexEntry);
+    while (remaining > 0) {
+      const uint32_t toWrite = remaining < sizeof(zeroes) ? remaining : sizeof(zeroes);
+      indexOut.write(zeroes, toWrite);
+      remaining -= toWrite;
+    }
+  }
+
+  // Turn the fanout into a write cursor for each bucket, once filled each cursor is back at the end of its bucket
+  for (uint32_t b = bucketCount - 1; b > 0; b--) {
+    fanout[b] = fanout[b - 1];
+  }
+  fanout[0] = 0;
+
+  // Pass 2: scatter entries into their buckets
+  uint64_t entryOffset = zipDetails.centralDirOffset;
+  file.seek(entryOffset);
+  while (readCentralDirEntry(&fileStat, itemName, sizeof(itemName), &nameLength) == CentralDirStatus::Read) {
+    const uint64_t thisEntryOffset = entryOffset;
+    entryOffset = file.position();
+    if (nameLength >= sizeof(itemName)) {
+      continue;
+    }
+
+    const IndexEntry entry = {hashName(itemName, nameLength),
+                              fileStat.compressedSize,
+                              fileStat.uncompressedSize,
+                              fileStat.method,
+                              nameLength,
+                              thisEntryOffset,
+                              fileStat.localHeaderOffset};
+    const uint32_t slot = fanout[entry.nameHash >> bucketShift]++;
+    indexOut.seek(entriesOffset + sizeof(IndexEntry) * slot);
+    serialization::writePod(indexOut, entry);
+  }
+
+  // Pass 3: sort each bucket by hash, ties keep central directory order so the first duplicate name wins
+  const auto bucketEntries = static_cast<IndexEntry*>(malloc(sizeof(IndexEntry) * (maxBucketSize ? maxBucketSize : 1)));
+  if (!bucketEntries) {
+    Serial.printf("[%lu] [ZIP] Failed to allocate memory for index bucket\n", millis());
+    free(fanout);
+    indexOut.close();
+    SdMan.remove(indexPath.c_str());
+    return false;
+  }
+
+  uint32_t bucketStart = 0;
+  for (uint32_t b = 0; b < bucketCount; b++) {
+    const uint32_t bucketSize = fanout[b] - bucketStart;
+    if (bucketSize > 1) {
+      const uint32_t bucketOffset = entriesOffset + sizeof(IndexEntry) * bucketStart;
+      indexOut.seek(bucketOffset);
+      indexOut.read(bucketEntries, sizeof(IndexEntry) * bucketSize);
+      std::sort(bucketEntries, bucketEntries + bucketSize, [](const IndexEntry& a, const IndexEntry& b) {
+        return a.nameHash != b.nameHash ? a.nameHash < b.nameHash : a.centralDirEntryOffset < b.centralDirEntryOffset;
+      });
+      indexOut.seek(bucketOffset);
+      indexOut.write(reinterpret_cast<const uint8_t*>(bucketEntries), sizeof(IndexEntry) * bucketSize);
+    }
+    bucketStart = fanout[b];
+  }
+
+  free(bucketEntries);
+  free(fanout);
+
+  indexOut.seek(0);
+  serialization::writePod(indexOut, ZIP_INDEX_VERSION);
+  indexOut.close();
+
+  Serial.printf("[%lu] [ZIP] Built index of %u entries in %lums\n", millis(), entryCount, millis() - start);
+  return true;
+}
+
+int64_t ZipFile::getDataOffset(const FileStatSlim& fileStat) {
+  ResolvedEntry* resolvedEntry = nullptr;
+  for (auto& entry : resolvedEntries) {
+    if (!entry.name.empty() && entry.fileStat.localHeaderOffset == fileStat.localHeaderOffset) {
+      if (entry.dataOffset >= 0) {
+        return entry.dataOffset;
+      }
+      resolvedEntry = &entry;
+      break;
+    }
+  }
+
   const bool wasOpen = isOpen();
   if (!wasOpen && !open()) {
     return -1;
@@ -152,8 +613,8 @@ long ZipFile::getDataOffset(const FileStatSlim& fileStat) {
   uint8_t pLocalHeader[localHeaderSize];
   const uint64_t fileOffset = fileStat.localHeaderOffset;
 
-  file.seek(fileOffset);
-  const size_t read = file.read(pLocalHeader, localHeaderSize);
+  // A header offset past the end of the file fails the seek, reading on from wherever the file was left would not
+  const size_t read = file.seek(fileOffset) ? file.read(pLocalHeader, localHeaderSize) : 0;
   if (!wasOpen) {
     close();
   }
@@ -171,7 +632,52 @@ long ZipFile::getDataOffset(const FileStatSlim& fileStat) {
 
   const uint16_t filenameLength = pLocalHeader[26] + (pLocalHeader[27] << 8);
   const uint16_t extraOffset = pLocalHeader[28] + (pLocalHeader[29] << 8);
-  return fileOffset + localHeaderSize + filenameLength + extraOffset;
+  const int64_t dataOffset = fileOffset + localHeaderSize + filenameLength + extraOffset;
+  if (resolvedEntry) {
+    resolvedEntry->dataOffset = dataOffset;
+  }
+  return dataOffset;
+}
+
+bool ZipFile::readZip64EndOfCentralDir(const uint64_t endOfCentralDirOffset) {
+  // The locator sits right before the classic EOCD record and points at the ZIP64 one
+  if (endOfCentralDirOffset < ZIP64_EOCD_LOCATOR_SIZE) {
+    return false;
+  }
+  uint8_t locator[ZIP64_EOCD_LOCATOR_SIZE];
+  file.seek(endOfCentralDirOffset - ZIP64_EOCD_LOCATOR_SIZE);
+  if (file.read(locator, ZIP64_EOCD_LOCATOR_SIZE) != static_cast<int>(ZIP64_EOCD_LOCATOR_SIZE) ||
+      readLE32(locator) != ZIP64_EOCD_LOCATOR_SIGNATURE) {
+    return false;
+  }
+
+  // Relative positions within the ZIP64 EOCD:
+  // Offset 32: Total number of entries (8 bytes)
+  // Offset 48: Offset of start of central directory (8 bytes)
+  uint8_t record[ZIP64_EOCD_SIZE];
+  file.seek(readLE64(locator + 8));
+  if (file.read(record, ZIP64_EOCD_SIZE) != static_cast<int>(ZIP64_EOCD_SIZE) ||
+      readLE32(record) != ZIP64_EOCD_SIGNATURE) {
+    Serial.printf("[%lu] [ZIP] ZIP64 EOCD locator does not point at a ZIP64 EOCD record\n", millis());
+    return false;
+  }
+
+  const uint64_t totalEntries = readLE64(record + 32);
+  if (totalEntries > UINT32_MAX) {
+    Serial.printf("[%lu] [ZIP] Too many entries in ZIP64 archive\n", millis());
+    return false;
+  }
+  zipDetails.totalEntries = totalEntries;
+  zipDetails.centralDirOffset = readLE64(record + 48);
+  return true;
+}
+
+bool ZipFile::getCentralDirOffset(uint64_t* offset) {
+  if (!loadZipDetails()) {
+    return false;
+  }
+  *offset = zipDetails.centralDirOffset;
+  return true;
 }
 
 bool ZipFile::loadZipDetails() {
@@ -184,7 +690,7 @@ bool ZipFile::loadZipDetails() {
     return false;
   }
 
-  const size_t fileSize = file.size();
+  const uint64_t fileSize = file.size();
   if (fileSize < 22) {
     Serial.printf("[%lu] [ZIP] File too small to be a valid zip\n", millis());
     if (!wasOpen) {
@@ -212,7 +718,7 @@ bool ZipFile::loadZipDetails() {
   int foundOffset = -1;
   for (int i = scanRange - 22; i >= 0; i--) {
     constexpr uint32_t signature = 0x06054b50;
-    if (*reinterpret_cast<uint32_t*>(&buffer[i]) == signature) {
+    if (readLE32(&buffer[i]) == signature) {
       foundOffset = i;
       break;
     }
@@ -231,11 +737,14 @@ bool ZipFile::loadZipDetails() {
   // Relative positions within EOCD:
   // Offset 10: Total number of entries (2 bytes)
   // Offset 16: Offset of start of central directory with respect to the starting disk number (4 bytes)
-  zipDetails.totalEntries = *reinterpret_cast<uint16_t*>(&buffer[foundOffset + 10]);
-  zipDetails.centralDirOffset = *reinterpret_cast<uint32_t*>(&buffer[foundOffset + 16]);
+  zipDetails.totalEntries = readLE16(&buffer[foundOffset + 10]);
+  zipDetails.centralDirOffset = readLE32(&buffer[foundOffset + 16]);
+  free(buffer);
+
+  // Archives past 65535 entries or 4GB carry the real values in a ZIP64 record, the classic one is used otherwise
+  readZip64EndOfCentralDir(fileSize - scanRange + foundOffset);
   zipDetails.isSet = true;
 
-  free(buffer);
   if (!wasOpen) {
     close();
   }
@@ -243,6 +752,9 @@ bool ZipFile::loadZipDetails() {
 }
 
 bool ZipFile::open() {
+  if (isOpen()) {
+    return true;
+  }
   if (!SdMan.openFileForRead("ZIP", filePath, file)) {
     return false;
   }
@@ -250,6 +762,10 @@ bool ZipFile::open() {
 }
 
 bool ZipFile::close() {
+  clearResolvedEntries();
+  if (indexFile) {
+    indexFile.close();
+  }
   if (file) {
     file.close();
   }
@@ -280,7 +796,7 @@ uint8_t* ZipFile::readFileToMemory(const char* filename, size_t* size, const boo
     return nullptr;
   }
 
-  const long fileOffset = getDataOffset(fileStat);
+  const int64_t fileOffset = getDataOffset(fileStat);
   if (fileOffset < 0) {
     if (!wasOpen) {
       close();
@@ -362,189 +878,393 @@ uint8_t* ZipFile::readFileToMemory(const char* filename, size_t* size, const boo
   return data;
 }
 
-bool ZipFile::readFileToStream(const char* filename, Print& out, const size_t chunkSize) {
-  const bool wasOpen = isOpen();
-  if (!wasOpen && !open()) {
+bool ZipFile::openCheckpoints(const FileStatSlim& fileStat, FsFile& checkpointFile, uint32_t* checkpointCount) {
+  // Bit offsets are stored in 32 bits
+  if (checkpointDir.empty() || fileStat.uncompressedSize < CHECKPOINT_MIN_ENTRY_SIZE ||
+      fileStat.compressedSize > UINT32_MAX / 8) {
     return false;
   }
 
-  FileStatSlim fileStat = {};
-  if (!loadFileStatSlim(filename, &fileStat)) {
+  if (!SdMan.exists(checkpointDir.c_str())) {
+    SdMan.mkdir(checkpointDir.c_str());
+  }
+
+  // The local header offset is unique within the zip, so it names the entry's checkpoint file
+  const std::string path = checkpointDir + "/" + std::to_string(fileStat.localHeaderOffset) + ".ckp";
+  checkpointFile = SdMan.open(path.c_str(), O_RDWR | O_CREAT);
+  if (!checkpointFile) {
+    Serial.printf("[%lu] [ZIP] Could not open checkpoints: %s\n", millis(), path.c_str());
     return false;
   }
 
-  const long fileOffset = getDataOffset(fileStat);
-  if (fileOffset < 0) {
+  const uint64_t zipFileSize = file.size();
+  if (checkpointFile.size() >= CHECKPOINT_HEADER_SIZE) {
+    uint8_t version;
+    uint64_t storedZipFileSize;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint32_t count;
+    serialization::readPod(checkpointFile, version);
+    serialization::readPod(checkpointFile, storedZipFileSize);
+    serialization::readPod(checkpointFile, compressedSize);
+    serialization::readPod(checkpointFile, uncompressedSize);
+    serialization::readPod(checkpointFile, count);
+
+    if (version == CHECKPOINT_VERSION && storedZipFileSize == zipFileSize &&
+        compressedSize == fileStat.compressedSize && uncompressedSize == fileStat.uncompressedSize &&
+        checkpointFile.size() >= CHECKPOINT_HEADER_SIZE + static_cast<uint64_t>(CHECKPOINT_RECORD_SIZE) * count) {
+      *checkpointCount = count;
+      return true;
+    }
+    Serial.printf("[%lu] [ZIP] Checkpoints are stale or invalid, starting over\n", millis());
+  }
+
+  checkpointFile.close();
+  checkpointFile = SdMan.open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC);
+  if (!checkpointFile) {
+    Serial.printf("[%lu] [ZIP] Could not open checkpoints for writing: %s\n", millis(), path.c_str());
     return false;
   }
+  serialization::writePod(checkpointFile, CHECKPOINT_VERSION);
+  serialization::writePod(checkpointFile, zipFileSize);
+  serialization::writePod(checkpointFile, fileStat.compressedSize);
+  serialization::writePod(checkpointFile, fileStat.uncompressedSize);
+  serialization::writePod(checkpointFile, static_cast<uint32_t>(0));
+  *checkpointCount = 0;
+  return true;
+}
 
-  file.seek(fileOffset);
+bool ZipFile::copyToStream(const uint64_t dataOffset, Print& out, const size_t length, const size_t chunkSize) {
+  const auto buffer = static_cast<uint8_t*>(malloc(chunkSize));
+  if (!buffer) {
+    Serial.printf("[%lu] [ZIP] Failed to allocate memory for buffer\n", millis());
+    return false;
+  }
+
+  file.seek(dataOffset);
+  size_t remaining = length;
+  while (remaining > 0) {
+    const size_t dataRead = file.read(buffer, remaining < chunkSize ? remaining : chunkSize);
+    if (dataRead == 0) {
+      Serial.printf("[%lu] [ZIP] Could not read more bytes\n", millis());
+      free(buffer);
+      return false;
+    }
+
+    if (out.write(buffer, dataRead) != dataRead) {
+      Serial.printf("[%lu] [ZIP] Failed to write all output bytes to stream\n", millis());
+      free(buffer);
+      return false;
+    }
+    remaining -= dataRead;
+  }
+
+  free(buffer);
+  return true;
+}
+
+bool ZipFile::inflateToStream(const FileStatSlim& fileStat, const uint64_t dataOffset, Print& out, const size_t offset,
+                              const size_t length, const size_t chunkSize) {
   const auto deflatedDataSize = fileStat.compressedSize;
   const auto inflatedDataSize = fileStat.uncompressedSize;
 
-  if (fileStat.method == MZ_NO_COMPRESSION) {
-    // no deflation, just read content
-    const auto buffer = static_cast<uint8_t*>(malloc(chunkSize));
-    if (!buffer) {
-      Serial.printf("[%lu] [ZIP] Failed to allocate memory for buffer\n", millis());
-      if (!wasOpen) {
-        close();
+  // Setup inflator, it pulls compressed bytes chunkSize at a time and inflates into its 32KB window
+  EntryInput input = {&file, 0};
+  Inflater inflater;
+  if (!inflater.begin(chunkSize, readEntryInput, &input)) {
+    return false;
+  }
+
+  // New checkpoints are only appended past the last recorded one, whichever checkpoint this read starts from
+  FsFile checkpointFile;
+  uint32_t checkpointCount = 0;
+  bool recordCheckpoints = openCheckpoints(fileStat, checkpointFile, &checkpointCount);
+  uint32_t nextCheckpoint = CHECKPOINT_SPACING;
+  uint32_t inputStart = 0;
+  if (recordCheckpoints && checkpointCount > 0) {
+    uint32_t lastOutputOffset;
+    uint32_t lastInputBitOffset;
+    readCheckpoint(checkpointFile, checkpointCount - 1, &lastOutputOffset, &lastInputBitOffset);
+    nextCheckpoint = lastOutputOffset + CHECKPOINT_SPACING;
+
+    if (offset > 0 && resumeFromCheckpoint(checkpointFile, checkpointCount, offset, inflater, &inputStart)) {
+      Serial.printf("[%lu] [ZIP] Resuming inflate at %u for offset %u\n", millis(), inflater.getTotalOut(), offset);
+    }
+  }
+  inflater.setStopAtBlockEnd(recordCheckpoints);
+
+  file.seek(dataOffset + inputStart);
+  input.remaining = deflatedDataSize - inputStart;
+
+  const size_t end = offset + length;
+  bool success = false;
+  while (true) {
+    const uint8_t* data;
+    size_t size;
+    const auto status = inflater.read(&data, &size);
+
+    // Only the part of the span that falls within the requested range is written
+    const size_t spanEnd = inflater.getTotalOut();
+    const size_t spanStart = spanEnd - size;
+    const size_t from = spanStart > offset ? spanStart : offset;
+    const size_t to = spanEnd < end ? spanEnd : end;
+    if (from < to && out.write(data + (from - spanStart), to - from) != to - from) {
+      Serial.printf("[%lu] [ZIP] Failed to write all output bytes to stream\n", millis());
+      break;
+    }
+
+    if (status == Inflater::Status::Error) {
+      Serial.printf("[%lu] [ZIP] Inflate failed\n", millis());
+      break;
+    }
+
+    if (status == Inflater::Status::Done) {
+      success = spanEnd == inflatedDataSize;
+      if (success) {
+        Serial.printf("[%lu] [ZIP] Decompressed %d bytes into %d bytes\n", millis(), deflatedDataSize,
+                      inflatedDataSize);
+      } else {
+        Serial.printf("[%lu] [ZIP] Inflated size mismatch, expected %d got %d\n", millis(), inflatedDataSize,
+                      spanEnd);
       }
-      return false;
+      break;
     }
 
-    size_t remaining = inflatedDataSize;
-    while (remaining > 0) {
-      const size_t dataRead = file.read(buffer, remaining < chunkSize ? remaining : chunkSize);
-      if (dataRead == 0) {
-        Serial.printf("[%lu] [ZIP] Could not read more bytes\n", millis());
-        free(buffer);
-        if (!wasOpen) {
-          close();
-        }
-        return false;
+    if (recordCheckpoints && spanEnd >= nextCheckpoint && inflater.atBlockBoundary()) {
+      if (writeCheckpoint(checkpointFile, checkpointCount, inflater, inputStart * 8 + inflater.getInputBitOffset())) {
+        checkpointCount++;
+        nextCheckpoint = spanEnd + CHECKPOINT_SPACING;
+      } else {
+        Serial.printf("[%lu] [ZIP] Failed to write checkpoint, no longer recording\n", millis());
+        recordCheckpoints = false;
+        inflater.setStopAtBlockEnd(false);
       }
+    }
 
-      out.write(buffer, dataRead);
-      remaining -= dataRead;
+    // A range ending before the end of the entry is done as soon as it has been written
+    if (end < inflatedDataSize && spanEnd >= end) {
+      success = true;
+      break;
     }
+  }
+
+  if (checkpointFile) {
+    checkpointFile.close();
+  }
+  inflater.end();
+  return success;
+}
+
+bool ZipFile::readFileToStream(const char* filename, Print& out, const size_t chunkSize) {
+  return readFileRangeToStream(filename, out, 0, SIZE_MAX, chunkSize);
+}
 
+bool ZipFile::readFileRangeToStream(const char* filename, Print& out, const size_t offset, size_t length,
+                                    const size_t chunkSize) {
+  const bool wasOpen = isOpen();
+  if (!wasOpen && !open()) {
+    return false;
+  }
+
+  FileStatSlim fileStat = {};
+  if (!loadFileStatSlim(filename, &fileStat)) {
     if (!wasOpen) {
       close();
     }
-    free(buffer);
-    return true;
+    return false;
+  }
+
+  if (offset > fileStat.uncompressedSize) {
+    Serial.printf("[%lu] [ZIP] Range starts past the end of %s\n", millis(), filename);
+    if (!wasOpen) {
+      close();
+    }
+    return false;
+  }
+  if (length > fileStat.uncompressedSize - offset) {
+    length = fileStat.uncompressedSize - offset;
+  }
+
+  const int64_t fileOffset = getDataOffset(fileStat);
+  if (fileOffset < 0) {
+    if (!wasOpen) {
+      close();
+    }
+    return false;
   }
 
+  bool success = false;
+  if (fileStat.method == MZ_NO_COMPRESSION) {
+    // no deflation, just read content
+    success = copyToStream(fileOffset + offset, out, length, chunkSize);
+  } else if (fileStat.method == MZ_DEFLATED) {
+    success = inflateToStream(fileStat, fileOffset, out, offset, length, chunkSize);
+  } else {
+    Serial.printf("[%lu] [ZIP] Unsupported compression method\n", millis());
+  }
+
+  if (!wasOpen) {
+    close();
+  }
+  return success;
+}
+
+bool ZipFile::openEntry(const char* filename, EntryReader& reader, const size_t chunkSize) {
+  reader.close();
+  if (!isOpen() && !open()) {
+    return false;
+  }
+
+  FileStatSlim fileStat = {};
+  if (!loadFileStatSlim(filename, &fileStat)) {
+    return false;
+  }
+
+  const int64_t dataOffset = getDataOffset(fileStat);
+  if (dataOffset < 0) {
+    return false;
+  }
+
+  if (fileStat.method != MZ_NO_COMPRESSION && fileStat.method != MZ_DEFLATED) {
+    Serial.printf("[%lu] [ZIP] Unsupported compression method\n", millis());
+    return false;
+  }
+
+  reader.fileStat = fileStat;
+  reader.dataOffset = dataOffset;
+  reader.inputOffset = 0;
+  reader.position = 0;
+  reader.failed = false;
+  reader.span = nullptr;
+  reader.spanSize = 0;
+  reader.inflateDone = false;
+  reader.recordCheckpoints = false;
+
   if (fileStat.method == MZ_DEFLATED) {
-    // Setup inflator
-    const auto inflator = static_cast<tinfl_decompressor*>(malloc(sizeof(tinfl_decompressor)));
-    if (!inflator) {
-      Serial.printf("[%lu] [ZIP] Failed to allocate memory for inflator\n", millis());
-      if (!wasOpen) {
-        close();
-      }
+    if (!reader.inflater.begin(chunkSize, EntryReader::refill, &reader)) {
       return false;
     }
-    memset(inflator, 0, sizeof(tinfl_decompressor));
-    tinfl_init(inflator);
 
-    // Setup file read buffer
-    const auto fileReadBuffer = static_cast<uint8_t*>(malloc(chunkSize));
-    if (!fileReadBuffer) {
-      Serial.printf("[%lu] [ZIP] Failed to allocate memory for zip file read buffer\n", millis());
-      free(inflator);
-      if (!wasOpen) {
-        close();
-      }
-      return false;
+    // Only appends past the last recorded checkpoint, like a read from the start of the entry in inflateToStream
+    reader.checkpointCount = 0;
+    reader.nextCheckpoint = CHECKPOINT_SPACING;
+    reader.recordCheckpoints = openCheckpoints(fileStat, reader.checkpointFile, &reader.checkpointCount);
+    if (reader.recordCheckpoints && reader.checkpointCount > 0) {
+      uint32_t lastOutputOffset;
+      uint32_t lastInputBitOffset;
+      readCheckpoint(reader.checkpointFile, reader.checkpointCount - 1, &lastOutputOffset, &lastInputBitOffset);
+      reader.nextCheckpoint = lastOutputOffset + CHECKPOINT_SPACING;
     }
+    reader.inflater.setStopAtBlockEnd(reader.recordCheckpoints);
+  }
 
-    const auto outputBuffer = static_cast<uint8_t*>(malloc(TINFL_LZ_DICT_SIZE));
-    if (!outputBuffer) {
-      Serial.printf("[%lu] [ZIP] Failed to allocate memory for dictionary\n", millis());
-      free(inflator);
-      free(fileReadBuffer);
-      if (!wasOpen) {
-        close();
-      }
+  reader.zip = this;
+  return true;
+}
+
+size_t ZipFile::EntryReader::refill(void* context, uint8_t* buffer, const size_t size) {
+  const auto reader = static_cast<EntryReader*>(context);
+  const uint32_t remaining = reader->fileStat.compressedSize - reader->inputOffset;
+  const size_t toRead = remaining < size ? remaining : size;
+  if (toRead == 0 || !reader->zip->file.seek(reader->dataOffset + reader->inputOffset)) {
+    return 0;
+  }
+
+  const int read = reader->zip->file.read(buffer, toRead);
+  if (read <= 0) {
+    return 0;
+  }
+  reader->inputOffset += read;
+  return read;
+}
+
+bool ZipFile::EntryReader::inflateNextSpan() {
+  const auto status = inflater.read(&span, &spanSize);
+
+  if (status == Inflater::Status::Error) {
+    Serial.printf("[%lu] [ZIP] Inflate failed\n", millis());
+    failed = true;
+    return false;
+  }
+
+  if (status == Inflater::Status::Done) {
+    inflateDone = true;
+    if (inflater.getTotalOut() != fileStat.uncompressedSize) {
+      Serial.printf("[%lu] [ZIP] Inflated size mismatch, expected %d got %d\n", millis(), fileStat.uncompressedSize,
+                    inflater.getTotalOut());
+      failed = true;
       return false;
     }
-    memset(outputBuffer, 0, TINFL_LZ_DICT_SIZE);
-
-    size_t fileRemainingBytes = deflatedDataSize;
-    size_t processedOutputBytes = 0;
-    size_t fileReadBufferFilledBytes = 0;
-    size_t fileReadBufferCursor = 0;
-    size_t outputCursor = 0;  // Current offset in the circular dictionary
-
-    while (true) {
-      // Load more compressed bytes when needed
-      if (fileReadBufferCursor >= fileReadBufferFilledBytes) {
-        if (fileRemainingBytes == 0) {
-          // Should not be hit, but a safe protection
-          break;  // EOF
-        }
-
-        fileReadBufferFilledBytes =
-            file.read(fileReadBuffer, fileRemainingBytes < chunkSize ? fileRemainingBytes : chunkSize);
-        fileRemainingBytes -= fileReadBufferFilledBytes;
-        fileReadBufferCursor = 0;
-
-        if (fileReadBufferFilledBytes == 0) {
-          // Bad read
-          break;  // EOF
-        }
-      }
+    return true;
+  }
 
-      // Available bytes in fileReadBuffer to process
-      size_t inBytes = fileReadBufferFilledBytes - fileReadBufferCursor;
-      // Space remaining in outputBuffer
-      size_t outBytes = TINFL_LZ_DICT_SIZE - outputCursor;
-
-      const tinfl_status status = tinfl_decompress(inflator, fileReadBuffer + fileReadBufferCursor, &inBytes,
-                                                   outputBuffer, outputBuffer + outputCursor, &outBytes,
-                                                   fileRemainingBytes > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
-
-      // Update input position
-      fileReadBufferCursor += inBytes;
-
-      // Write output chunk
-      if (outBytes > 0) {
-        processedOutputBytes += outBytes;
-        if (out.write(outputBuffer + outputCursor, outBytes) != outBytes) {
-          Serial.printf("[%lu] [ZIP] Failed to write all output bytes to stream\n", millis());
-          if (!wasOpen) {
-            close();
-          }
-          free(outputBuffer);
-          free(fileReadBuffer);
-          free(inflator);
-          return false;
-        }
-        // Update output position in buffer (with wraparound)
-        outputCursor = (outputCursor + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
-      }
+  if (recordCheckpoints && inflater.getTotalOut() >= nextCheckpoint && inflater.atBlockBoundary()) {
+    if (writeCheckpoint(checkpointFile, checkpointCount, inflater, inflater.getInputBitOffset())) {
+      checkpointCount++;
+      nextCheckpoint = inflater.getTotalOut() + CHECKPOINT_SPACING;
+    } else {
+      Serial.printf("[%lu] [ZIP] Failed to write checkpoint, no longer recording\n", millis());
+      recordCheckpoints = false;
+      inflater.setStopAtBlockEnd(false);
+    }
+  }
+  return true;
+}
 
-      if (status < 0) {
-        Serial.printf("[%lu] [ZIP] tinfl_decompress() failed with status %d\n", millis(), status);
-        if (!wasOpen) {
-          close();
-        }
-        free(outputBuffer);
-        free(fileReadBuffer);
-        free(inflator);
-        return false;
-      }
+size_t ZipFile::EntryReader::read(void* buffer, const size_t size) {
+  if (!zip || failed) {
+    return 0;
+  }
 
-      if (status == TINFL_STATUS_DONE) {
-        Serial.printf("[%lu] [ZIP] Decompressed %d bytes into %d bytes\n", millis(), deflatedDataSize,
-                      inflatedDataSize);
-        if (!wasOpen) {
-          close();
-        }
-        free(inflator);
-        free(fileReadBuffer);
-        free(outputBuffer);
-        return true;
-      }
+  const size_t remaining = fileStat.uncompressedSize - position;
+  const size_t toRead = remaining < size ? remaining : size;
+  if (toRead == 0) {
+    return 0;
+  }
+
+  if (fileStat.method == MZ_NO_COMPRESSION) {
+    if (!zip->file.seek(dataOffset + position) || zip->file.read(buffer, toRead) != static_cast<int>(toRead)) {
+      Serial.printf("[%lu] [ZIP] Could not read more bytes\n", millis());
+      failed = true;
+      return 0;
     }
+    position += toRead;
+    return toRead;
+  }
 
-    // If we get here, EOF reached without TINFL_STATUS_DONE
-    Serial.printf("[%lu] [ZIP] Unexpected EOF\n", millis());
-    if (!wasOpen) {
-      close();
+  auto out = static_cast<uint8_t*>(buffer);
+  size_t copied = 0;
+  while (copied < toRead) {
+    if (spanSize == 0) {
+      if (inflateDone || !inflateNextSpan()) {
+        break;
+      }
+      continue;
     }
-    free(outputBuffer);
-    free(fileReadBuffer);
-    free(inflator);
-    return false;
+
+    const size_t length = spanSize < toRead - copied ? spanSize : toRead - copied;
+    memcpy(out + copied, span, length);
+    span += length;
+    spanSize -= length;
+    copied += length;
   }
 
-  if (!wasOpen) {
-    close();
+  position += copied;
+  if (!failed && copied < toRead) {
+    Serial.printf("[%lu] [ZIP] Entry ended after %d of %d bytes\n", millis(), position, fileStat.uncompressedSize);
+    failed = true;
   }
+  return copied;
+}
 
-  Serial.printf("[%lu] [ZIP] Unsupported compression method\n", millis());
-  return false;
+void ZipFile::EntryReader::close() {
+  if (!zip) {
+    return;
+  }
+
+  if (checkpointFile) {
+    checkpointFile.close();
+  }
+  inflater.end();
+  zip = nullptr;
 }
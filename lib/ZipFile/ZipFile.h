@@ -2,7 +2,8 @@
 #include <SdFat.h>
 
 #include <string>
-#include <unordered_map>
+
+#include "Inflater.h"
 
 class ZipFile {
  public:
@@ -10,37 +11,136 @@ class ZipFile {
     uint16_t method;             // Compression method
     uint32_t compressedSize;     // Compressed size
     uint32_t uncompressedSize;   // Uncompressed size
-    uint32_t localHeaderOffset;  // Offset of local file header
+    uint64_t localHeaderOffset;  // Offset of local file header
   };
 
   struct ZipDetails {
-    uint32_t centralDirOffset;
-    uint16_t totalEntries;
+    uint64_t centralDirOffset;
+    uint32_t totalEntries;
     bool isSet;
   };
 
+  // Pull style access to the inflated contents of one entry, for consumers that drive the reads themselves instead
+  // of being written to. Reads go through the zip's open session, which must stay open for the life of the reader.
+  // Each refill seeks to where the entry left off, so the zip can still be used for other entries in between.
+  class EntryReader {
+   public:
+    EntryReader() = default;
+    ~EntryReader() { close(); }
+    EntryReader(const EntryReader&) = delete;
+    EntryReader& operator=(const EntryReader&) = delete;
+
+    bool isOpen() const { return zip != nullptr; }
+    size_t getSize() const { return fileStat.uncompressedSize; }
+    size_t getPosition() const { return position; }
+    // Copies up to size bytes into buffer, returns how many. 0 once the entry has been read in full or on failure.
+    size_t read(void* buffer, size_t size);
+    // True if reading stopped short because the entry couldn't be read or inflated
+    bool hasFailed() const { return failed; }
+    void close();
+
+   private:
+    friend class ZipFile;
+
+    ZipFile* zip = nullptr;
+    FileStatSlim fileStat = {};
+    uint64_t dataOffset = 0;
+    // Bytes of entry data consumed from the zip so far
+    uint32_t inputOffset = 0;
+    size_t position = 0;
+    bool failed = false;
+    Inflater inflater;
+    // Inflated bytes not yet handed out, they live in the inflater's window until its next read
+    const uint8_t* span = nullptr;
+    size_t spanSize = 0;
+    bool inflateDone = false;
+    FsFile checkpointFile;
+    uint32_t checkpointCount = 0;
+    uint32_t nextCheckpoint = 0;
+    bool recordCheckpoints = false;
+
+    static size_t refill(void* context, uint8_t* buffer, size_t size);
+    bool inflateNextSpan();
+  };
+
  private:
+  // A single record in the on-disk central directory index, records are sorted by nameHash
+  struct IndexEntry {
+    uint32_t nameHash;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint16_t method;
+    uint16_t nameLength;
+    uint64_t centralDirEntryOffset;  // Used to verify the name on hash match
+    uint64_t localHeaderOffset;
+  };
+  static_assert(sizeof(IndexEntry) == 32, "Index entries are written to disk as-is");
+
+  // Recently resolved entry, remembered while the zip is open so repeated reads of the same item skip the lookup
+  struct ResolvedEntry {
+    std::string name;
+    FileStatSlim fileStat;
+    int64_t dataOffset;  // -1 until the local header has been read
+  };
+  static constexpr size_t RESOLVED_ENTRY_COUNT = 8;
+
+  // Result of reading the next central directory entry. Failed means the directory is damaged or cut short, which
+  // is kept apart from End so it isn't mistaken for the last entry.
+  enum class CentralDirStatus : uint8_t { Read, End, Failed };
+
   const std::string& filePath;
+  // Optional path of the central directory index, no index is used if empty
+  std::string indexPath;
+  // Optional directory for inflate checkpoints of large entries, none are kept if empty
+  std::string checkpointDir;
   FsFile file;
+  FsFile indexFile;
   ZipDetails zipDetails = {0, 0, false};
-  std::unordered_map<std::string, FileStatSlim> fileStatSlimCache;
+  uint32_t indexEntriesOffset = 0;
+  uint32_t indexEntryCount = 0;
+  uint8_t indexFanoutBits = 0;
+  ResolvedEntry resolvedEntries[RESOLVED_ENTRY_COUNT];
+  size_t nextResolvedEntry = 0;
 
+  CentralDirStatus readCentralDirEntry(FileStatSlim* fileStat, char* nameBuffer, size_t nameBufferSize,
+                                       uint16_t* nameLength);
+  bool nameMatchesAt(uint64_t centralDirEntryOffset, const char* filename, size_t filenameLength);
+  const ResolvedEntry* findResolvedEntry(const char* filename) const;
+  void rememberResolvedEntry(const char* filename, const FileStatSlim& fileStat);
+  void clearResolvedEntries();
   bool loadFileStatSlim(const char* filename, FileStatSlim* fileStat);
-  long getDataOffset(const FileStatSlim& fileStat);
+  bool scanFileStatSlim(const char* filename, FileStatSlim* fileStat);
+  bool lookupFileStatSlim(const char* filename, FileStatSlim* fileStat);
+  bool readIndexHeader();
+  bool openIndex();
+  bool buildIndex();
+  int64_t getDataOffset(const FileStatSlim& fileStat);
+  bool readZip64EndOfCentralDir(uint64_t endOfCentralDirOffset);
   bool loadZipDetails();
+  bool openCheckpoints(const FileStatSlim& fileStat, FsFile& checkpointFile, uint32_t* checkpointCount);
+  bool copyToStream(uint64_t dataOffset, Print& out, size_t length, size_t chunkSize);
+  bool inflateToStream(const FileStatSlim& fileStat, uint64_t dataOffset, Print& out, size_t offset, size_t length,
+                       size_t chunkSize);
 
  public:
-  explicit ZipFile(const std::string& filePath) : filePath(filePath) {}
-  ~ZipFile() = default;
-  // Zip file can be opened and closed by hand in order to allow for quick calculation of inflated file size
-  // It is NOT recommended to pre-open it for any kind of inflation due to memory constraints
+  explicit ZipFile(const std::string& filePath, std::string indexPath = "", std::string checkpointDir = "")
+      : filePath(filePath), indexPath(std::move(indexPath)), checkpointDir(std::move(checkpointDir)) {}
+  ~ZipFile() { close(); }
+  // Zip file can be opened and closed by hand, keeping it open turns it into a session: the EOCD, index handle and
+  // recently resolved entries are reused across calls instead of being reloaded each time
   bool isOpen() const { return !!file; }
   bool open();
   bool close();
-  bool loadAllFileStatSlims();
   bool getInflatedFileSize(const char* filename, size_t* size);
-  // Due to the memory required to run each of these, it is recommended to not preopen the zip file for multiple
-  // These functions will open and close the zip as needed
+  bool getCentralDirOffset(uint64_t* offset);
+  // Inflation buffers are only held for the duration of each call, so these are safe to use on an open session
+  // These functions will open and close the zip as needed if it is not already open
   uint8_t* readFileToMemory(const char* filename, size_t* size = nullptr, bool trailingNullByte = false);
   bool readFileToStream(const char* filename, Print& out, size_t chunkSize);
+  // Streams length bytes of the inflated entry starting at offset. With a checkpoint directory set, inflating large
+  // entries records checkpoints along the way and later reads start from the nearest one instead of the beginning.
+  bool readFileRangeToStream(const char* filename, Print& out, size_t offset, size_t length, size_t chunkSize);
+  // Opens the zip if needed and leaves it open, compressed data is pulled chunkSize bytes at a time. Large entries
+  // record inflate checkpoints as they are read, the same as readFileToStream.
+  bool openEntry(const char* filename, EntryReader& reader, size_t chunkSize);
 };
@@ -1,5 +1,6 @@
 #include "CrossPointSettings.h"
 
+#include <BookCacheManager.h>
 #include <HardwareSerial.h>
 #include <SDCardManager.h>
 #include <Serialization.h>
@@ -12,7 +13,7 @@ CrossPointSettings CrossPointSettings::instance;
 namespace {
 constexpr uint8_t SETTINGS_FILE_VERSION = 1;
 // Increment this when adding new persisted settings fields
-constexpr uint8_t SETTINGS_COUNT = 11;
+constexpr uint8_t SETTINGS_COUNT = 12;
 constexpr char SETTINGS_FILE[] = "/.crosspoint/settings.bin";
 }  // namespace
 
@@ -38,6 +39,7 @@ bool CrossPointSettings::saveToFile() const {
   serialization::writePod(outputFile, fontSize);
   serialization::writePod(outputFile, lineSpacing);
   serialization::writePod(outputFile, sleepTimeout);
+  serialization::writePod(outputFile, cacheSizeLimit);
   outputFile.close();
 
   Serial.printf("[%lu] [CPS] Settings saved to file\n", millis());
@@ -86,6 +88,8 @@ bool CrossPointSettings::loadFromFile() {
     if (++settingsRead >= fileSettingsCount) break;
     serialization::readPod(inputFile, sleepTimeout);
     if (++settingsRead >= fileSettingsCount) break;
+    serialization::readPod(inputFile, cacheSizeLimit);
+    if (++settingsRead >= fileSettingsCount) break;
   } while (false);
 
   inputFile.close();
@@ -111,6 +115,20 @@ unsigned long CrossPointSettings::getSleepTimeoutMs() const {
   }
 }
 
+uint64_t CrossPointSettings::getCacheBudgetBytes() const {
+  switch (cacheSizeLimit) {
+    case MB_64:
+      return 64ull * 1024 * 1024;
+    case MB_256:
+    default:
+      return 256ull * 1024 * 1024;
+    case GB_1:
+      return 1024ull * 1024 * 1024;
+    case UNLIMITED:
+      return BookCacheManager::UNLIMITED;
+  }
+}
+
 float CrossPointSettings::getReaderLineCompression() const {
   switch (fontFamily) {
     case BOOKERLY:
@@ -67,6 +67,9 @@ class CrossPointSettings {
   uint8_t fontFamily = BOOKERLY;
   uint8_t fontSize = MEDIUM;
   uint8_t lineSpacing = NORMAL;
+  // Space book caches may take up on the SD card before the least recently read books are evicted
+  enum CACHE_SIZE_LIMIT { MB_64 = 0, MB_256 = 1, GB_1 = 2, UNLIMITED = 3 };
+  uint8_t cacheSizeLimit = MB_256;
 
   ~CrossPointSettings() = default;
 
@@ -76,6 +79,7 @@ class CrossPointSettings {
   uint16_t getPowerButtonDuration() const { return shortPwrBtn ? 10 : 400; }
   unsigned long getSleepTimeoutMs() const;
   int getReaderFontId() const;
+  uint64_t getCacheBudgetBytes() const;
 
   bool saveToFile() const;
   bool loadFromFile();
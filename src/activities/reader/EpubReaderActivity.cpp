@@ -1,13 +1,18 @@
 #include "EpubReaderActivity.h"
 
+#include <BookCacheManager.h>
 #include <Epub/Page.h>
 #include <FsHelpers.h>
 #include <GfxRenderer.h>
+#include <Inflater.h>
 #include <SDCardManager.h>
 
+#include <cstdlib>
+
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "EpubReaderChapterSelectionActivity.h"
+#include "EpubReaderGoToPageActivity.h"
 #include "MappedInputManager.h"
 #include "ScreenComponents.h"
 #include "fontIds.h"
@@ -16,9 +21,14 @@ namespace {
 constexpr int pagesPerRefresh = 15;
 constexpr unsigned long skipChapterMs = 700;
 constexpr unsigned long goHomeMs = 1000;
+constexpr unsigned long goToPageMs = 700;
 constexpr int topPadding = 5;
 constexpr int horizontalPadding = 5;
 constexpr int statusBarMargin = 19;
+// Longest the display task holds the rendering mutex for background pagination before checking in again
+constexpr unsigned long buildSliceMs = 50;
+// Chapter bytes parsed between checks for a pending redraw
+constexpr size_t buildStepBytes = 1024;
 }  // namespace
 
 void EpubReaderActivity::taskTrampoline(void* param) {
@@ -55,6 +65,17 @@ void EpubReaderActivity::onEnter() {
 
   epub->setupCacheDir();
 
+  // Book-wide page numbers, if the book has been indexed in this layout
+  {
+    int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
+    getReaderMargins(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom, &orientedMarginLeft);
+    const uint16_t viewportWidth = renderer.getScreenWidth() - orientedMarginLeft - orientedMarginRight;
+    const uint16_t viewportHeight = renderer.getScreenHeight() - orientedMarginTop - orientedMarginBottom;
+    pageIndex.reset(new BookPageIndex(epub));
+    pageIndex->load(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(), SETTINGS.extraParagraphSpacing,
+                    viewportWidth, viewportHeight);
+  }
+
   FsFile f;
   if (SdMan.openFileForRead("ERS", epub->getCachePath() + "/progress.bin", f)) {
     uint8_t data[4];
@@ -106,7 +127,16 @@ void EpubReaderActivity::onExit() {
   vSemaphoreDelete(renderingMutex);
   renderingMutex = nullptr;
   section.reset();
+  // Removes the partial file of an unfinished background build
+  prefetchSection.reset();
+  pageIndex.reset();
+  // Sections built while reading count towards the cache budget
+  if (epub) {
+    BookCacheManager::onBookClosed(epub->getCachePath(), SETTINGS.getCacheBudgetBytes());
+  }
   epub.reset();
+  // Nothing else inflates, hand the workspace back to the heap for the rest of the UI
+  Inflater::releaseWorkspace();
 }
 
 void EpubReaderActivity::loop() {
@@ -116,26 +146,42 @@ void EpubReaderActivity::loop() {
     return;
   }
 
+  // Long press CONFIRM picks a page of the book to go to
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm) && mappedInput.getHeldTime() >= goToPageMs) {
+    openGoToPage();
+    return;
+  }
+
   // Enter chapter selection activity
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
     // Don't start activity transition while rendering
     xSemaphoreTake(renderingMutex, portMAX_DELAY);
-    exitActivity();
-    enterNewActivity(new EpubReaderChapterSelectionActivity(
-        this->renderer, this->mappedInput, epub, currentSpineIndex,
-        [this] {
-          exitActivity();
-          updateRequired = true;
-        },
-        [this](const int newSpineIndex) {
-          if (currentSpineIndex != newSpineIndex) {
-            currentSpineIndex = newSpineIndex;
-            nextPageNumber = 0;
-            section.reset();
-          }
-          exitActivity();
-          updateRequired = true;
-        }));
+    // Normally already built after the first page, this only blocks if the menu is opened straight away
+    if (!epub->isTocLoaded()) {
+      finishSectionBuilds();
+    }
+    if (epub->loadToc() && epub->getTocItemsCount() > 0) {
+      exitActivity();
+      enterNewActivity(new EpubReaderChapterSelectionActivity(
+          this->renderer, this->mappedInput, epub, currentSpineIndex,
+          [this] {
+            exitActivity();
+            updateRequired = true;
+          },
+          [this](const int newSpineIndex, const std::string& anchor) {
+            // An anchor in the current chapter reopens it, which finds its section built
+            if (currentSpineIndex != newSpineIndex || !anchor.empty()) {
+              currentSpineIndex = newSpineIndex;
+              nextPageNumber = 0;
+              nextPageAnchor = anchor;
+              leaveSection();
+            }
+            exitActivity();
+            updateRequired = true;
+          }));
+    } else {
+      Serial.printf("[%lu] [ERS] Book has no TOC entries, not opening chapter selection\n", millis());
+    }
     xSemaphoreGive(renderingMutex);
   }
 
@@ -175,14 +221,19 @@ void EpubReaderActivity::loop() {
     xSemaphoreTake(renderingMutex, portMAX_DELAY);
     nextPageNumber = 0;
     currentSpineIndex = nextReleased ? currentSpineIndex + 1 : currentSpineIndex - 1;
-    section.reset();
+    leaveSection();
     xSemaphoreGive(renderingMutex);
     updateRequired = true;
     return;
   }
 
+  // The display task drops the section if building the rest of it fails, so it is only looked at with the semaphore
+  // held. This waits out at most one background build slice.
+  xSemaphoreTake(renderingMutex, portMAX_DELAY);
+
   // No current section, attempt to rerender the book
   if (!section) {
+    xSemaphoreGive(renderingMutex);
     updateRequired = true;
     return;
   }
@@ -191,27 +242,22 @@ void EpubReaderActivity::loop() {
     if (section->currentPage > 0) {
       section->currentPage--;
     } else {
-      // We don't want to delete the section mid-render, so grab the semaphore
-      xSemaphoreTake(renderingMutex, portMAX_DELAY);
       nextPageNumber = UINT16_MAX;
       currentSpineIndex--;
-      section.reset();
-      xSemaphoreGive(renderingMutex);
+      leaveSection();
     }
-    updateRequired = true;
   } else {
-    if (section->currentPage < section->pageCount - 1) {
+    // A chapter still being built may have more pages than written so far, rendering waits for the next one
+    if (section->currentPage < section->pageCount - 1 || section->isPaginating()) {
       section->currentPage++;
     } else {
-      // We don't want to delete the section mid-render, so grab the semaphore
-      xSemaphoreTake(renderingMutex, portMAX_DELAY);
       nextPageNumber = 0;
       currentSpineIndex++;
-      section.reset();
-      xSemaphoreGive(renderingMutex);
+      leaveSection();
     }
-    updateRequired = true;
   }
+  xSemaphoreGive(renderingMutex);
+  updateRequired = true;
 }
 
 void EpubReaderActivity::displayTaskLoop() {
@@ -221,11 +267,241 @@ void EpubReaderActivity::displayTaskLoop() {
       xSemaphoreTake(renderingMutex, portMAX_DELAY);
       renderScreen();
       xSemaphoreGive(renderingMutex);
+    } else {
+      xSemaphoreTake(renderingMutex, portMAX_DELAY);
+      if (!tocBuildAttempted && !(section && section->isBuilding()) && !prefetchSection) {
+        // Build the TOC once the first page is on screen and no chapter is being paginated, then redraw so the status
+        // bar can show the chapter title
+        tocBuildAttempted = true;
+        if (!epub->isTocLoaded() && epub->loadToc() && !subActivity &&
+            (SETTINGS.statusBar == CrossPointSettings::STATUS_BAR_MODE::NO_PROGRESS ||
+             SETTINGS.statusBar == CrossPointSettings::STATUS_BAR_MODE::FULL)) {
+          updateRequired = true;
+        }
+      } else {
+        buildSectionsInBackground();
+      }
+      xSemaphoreGive(renderingMutex);
     }
     vTaskDelay(10 / portTICK_PERIOD_MS);
   }
 }
 
+// Runs a slice of background pagination while the reader is idle: first the rest of the chapter being read, whose
+// first pages were shown as soon as they were ready, then its neighbours. Must be called with the rendering mutex held.
+void EpubReaderActivity::buildSectionsInBackground() {
+  // Sub activities render on their own task and also use the SD card
+  if (subActivity || !section) {
+    return;
+  }
+
+  if (!section->isBuilding()) {
+    prefetchNeighbouringSections();
+    return;
+  }
+
+  const auto status = continueBuildSlice(*section);
+  if (status == Section::BuildStatus::Done) {
+    Serial.printf("[%lu] [ERS] Finished building section %d, %d pages\n", millis(), currentSpineIndex,
+                  section->pageCount);
+    checkPageIndex();
+    // The status bar can show the page count now, and the page on screen the images decoded after it was drawn
+    const int firstImagePage = section->getFirstImagePage();
+    if (SETTINGS.statusBar == CrossPointSettings::STATUS_BAR_MODE::FULL ||
+        (firstImagePage >= 0 && section->currentPage >= firstImagePage)) {
+      updateRequired = true;
+    }
+  } else if (status == Section::BuildStatus::Failed) {
+    Serial.printf("[%lu] [ERS] Failed to build the rest of section %d\n", millis(), currentSpineIndex);
+    // The next page turn starts over, from the page on screen
+    nextPageNumber = section->currentPage;
+    section.reset();
+  }
+}
+
+// Parses the section a step at a time until it is done, a redraw is wanted or the slice is used up
+Section::BuildStatus EpubReaderActivity::continueBuildSlice(Section& buildingSection) const {
+  const unsigned long start = millis();
+  auto status = Section::BuildStatus::InProgress;
+  while (status == Section::BuildStatus::InProgress && !updateRequired && millis() - start < buildSliceMs) {
+    status = buildingSection.continueSectionFile(buildStepBytes);
+  }
+  return status;
+}
+
+// Paginates the chapters after and before the current one, so turning into them finds their section file ready. A
+// build that is no longer next to the current chapter is dropped.
+void EpubReaderActivity::prefetchNeighbouringSections() {
+  if (prefetchSpineIndex != currentSpineIndex) {
+    prefetchSpineIndex = currentSpineIndex;
+    prefetchCandidate = 0;
+    if (prefetchSection && std::abs(prefetchSection->getSpineIndex() - currentSpineIndex) != 1) {
+      Serial.printf("[%lu] [ERS] Dropping background build of %d\n", millis(), prefetchSection->getSpineIndex());
+      prefetchSection.reset();
+    }
+  }
+
+  int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
+  getReaderMargins(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom, &orientedMarginLeft);
+  const uint16_t viewportWidth = renderer.getScreenWidth() - orientedMarginLeft - orientedMarginRight;
+  const uint16_t viewportHeight = renderer.getScreenHeight() - orientedMarginTop - orientedMarginBottom;
+
+  // Next chapter first, then the previous one
+  while (!prefetchSection && prefetchCandidate < 2) {
+    const int spineIndex = currentSpineIndex + (prefetchCandidate++ == 0 ? 1 : -1);
+    if (spineIndex < 0 || spineIndex >= epub->getSpineItemsCount()) {
+      continue;
+    }
+
+    auto candidate = std::unique_ptr<Section>(new Section(epub, spineIndex, renderer));
+    if (candidate->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                   SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight)) {
+      continue;
+    }
+    if (candidate->beginSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                    SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight)) {
+      Serial.printf("[%lu] [ERS] Building section %d in the background\n", millis(), spineIndex);
+      prefetchSection = std::move(candidate);
+    }
+  }
+
+  if (!prefetchSection) {
+    return;
+  }
+
+  const auto status = continueBuildSlice(*prefetchSection);
+  if (status != Section::BuildStatus::InProgress) {
+    Serial.printf("[%lu] [ERS] Background build of section %d %s\n", millis(), prefetchSection->getSpineIndex(),
+                  status == Section::BuildStatus::Done ? "finished" : "failed");
+    prefetchSection.reset();
+  }
+}
+
+void EpubReaderActivity::leaveSection() {
+  // Pagination carries on in the background, it is dropped later if the chapter isn't next to the new one
+  if (section && section->isBuilding() && !prefetchSection) {
+    prefetchSection = std::move(section);
+  }
+  section.reset();
+}
+
+// Finishes building the chapter being read and drops the background build, so no section file is half written and
+// no chapter reader holds the book's inflate workspace. Must be called with the rendering mutex held.
+void EpubReaderActivity::finishSectionBuilds() {
+  prefetchSection.reset();
+  if (section && section->isBuilding() && section->continueSectionFile(SIZE_MAX) != Section::BuildStatus::Done) {
+    Serial.printf("[%lu] [ERS] Failed to build the rest of section %d\n", millis(), currentSpineIndex);
+    nextPageNumber = section->currentPage;
+    section.reset();
+  }
+}
+
+// Paginates every chapter of the book in the current layout to number pages across the whole book, blocking with a
+// progress bar until done. Must be called with the rendering mutex held.
+bool EpubReaderActivity::indexBook() {
+  // The index builds or loads every section file
+  finishSectionBuilds();
+
+  int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
+  getReaderMargins(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom, &orientedMarginLeft);
+  const uint16_t viewportWidth = renderer.getScreenWidth() - orientedMarginLeft - orientedMarginRight;
+  const uint16_t viewportHeight = renderer.getScreenHeight() - orientedMarginTop - orientedMarginBottom;
+
+  constexpr int barWidth = 200;
+  constexpr int barHeight = 10;
+  constexpr int boxMargin = 20;
+  constexpr int boxY = 50;
+  const int textWidth = renderer.getTextWidth(UI_12_FONT_ID, "Indexing book...");
+  const int boxWidth = (barWidth > textWidth ? barWidth : textWidth) + boxMargin * 2;
+  const int boxHeight = renderer.getLineHeight(UI_12_FONT_ID) + barHeight + boxMargin * 3;
+  const int boxX = (renderer.getScreenWidth() - boxWidth) / 2;
+  const int barX = boxX + (boxWidth - barWidth) / 2;
+  const int barY = boxY + renderer.getLineHeight(UI_12_FONT_ID) + boxMargin * 2;
+
+  renderer.fillRect(boxX, boxY, boxWidth, boxHeight, false);
+  renderer.drawText(UI_12_FONT_ID, boxX + boxMargin, boxY + boxMargin, "Indexing book...");
+  renderer.drawRect(boxX + 5, boxY + 5, boxWidth - 10, boxHeight - 10);
+  renderer.drawRect(barX, barY, barWidth, barHeight);
+  renderer.displayBuffer();
+  pagesUntilFullRefresh = 0;
+
+  // Refreshing the display takes a while, the bar only moves in steps of 5%
+  int shownProgress = 0;
+  const bool indexed = pageIndex->build(
+      renderer, SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(), SETTINGS.extraParagraphSpacing,
+      viewportWidth, viewportHeight, [this, barX, barY, &shownProgress](const int progress) {
+        if (progress - shownProgress < 5) {
+          return;
+        }
+        shownProgress = progress;
+        const int fillWidth = (barWidth - 2) * progress / 100;
+        renderer.fillRect(barX + 1, barY + 1, fillWidth, barHeight - 2, true);
+        renderer.displayBuffer(EInkDisplay::FAST_REFRESH);
+      });
+  if (!indexed) {
+    Serial.printf("[%lu] [ERS] Failed to index book\n", millis());
+  }
+  return indexed;
+}
+
+void EpubReaderActivity::openGoToPage() {
+  // Don't start activity transition while rendering
+  xSemaphoreTake(renderingMutex, portMAX_DELAY);
+  if (!pageIndex->isLoaded() && !indexBook()) {
+    xSemaphoreGive(renderingMutex);
+    updateRequired = true;
+    return;
+  }
+
+  const uint32_t currentBookPage =
+      currentSpineIndex >= epub->getSpineItemsCount()
+          ? pageIndex->getPageCount()
+          : pageIndex->getBookPage(currentSpineIndex, section ? section->currentPage : 0);
+  exitActivity();
+  enterNewActivity(new EpubReaderGoToPageActivity(
+      this->renderer, this->mappedInput, currentBookPage, pageIndex->getPageCount(),
+      [this] {
+        exitActivity();
+        updateRequired = true;
+      },
+      [this](const uint32_t bookPage) {
+        int spineIndex;
+        int page;
+        if (pageIndex->findPage(bookPage, &spineIndex, &page)) {
+          if (section && spineIndex == currentSpineIndex) {
+            section->currentPage = page;
+          } else {
+            currentSpineIndex = spineIndex;
+            nextPageNumber = page;
+            leaveSection();
+          }
+        }
+        exitActivity();
+        updateRequired = true;
+      }));
+  xSemaphoreGive(renderingMutex);
+}
+
+// The index is only right while every chapter keeps the page count it was indexed with, one laid out again with another
+// (e.g. after its section file was lost to a firmware with a different layout) makes it stale
+void EpubReaderActivity::checkPageIndex() {
+  if (pageIndex->isLoaded() && section && !section->isBuilding() &&
+      pageIndex->getChapterPageCount(currentSpineIndex) != section->pageCount) {
+    Serial.printf("[%lu] [ERS] Section %d no longer matches the page index, dropping it\n", millis(),
+                  currentSpineIndex);
+    pageIndex->clear();
+  }
+}
+
+void EpubReaderActivity::getReaderMargins(int* top, int* right, int* bottom, int* left) const {
+  // Apply screen viewable areas and additional padding
+  renderer.getOrientedViewableTRBL(top, right, bottom, left);
+  *top += topPadding;
+  *left += horizontalPadding;
+  *right += horizontalPadding;
+  *bottom += statusBarMargin;
+}
+
 // TODO: Failure handling
 void EpubReaderActivity::renderScreen() {
   if (!epub) {
@@ -249,14 +525,8 @@ void EpubReaderActivity::renderScreen() {
     return;
   }
 
-  // Apply screen viewable areas and additional padding
   int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
-  renderer.getOrientedViewableTRBL(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom,
-                                   &orientedMarginLeft);
-  orientedMarginTop += topPadding;
-  orientedMarginLeft += horizontalPadding;
-  orientedMarginRight += horizontalPadding;
-  orientedMarginBottom += statusBarMargin;
+  getReaderMargins(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom, &orientedMarginLeft);
 
   if (!section) {
     const auto filepath = epub->getSpineItem(currentSpineIndex).href;
@@ -266,59 +536,82 @@ void EpubReaderActivity::renderScreen() {
     const uint16_t viewportWidth = renderer.getScreenWidth() - orientedMarginLeft - orientedMarginRight;
     const uint16_t viewportHeight = renderer.getScreenHeight() - orientedMarginTop - orientedMarginBottom;
 
-    if (!section->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
-                                  SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight)) {
-      Serial.printf("[%lu] [ERS] Cache not found, building...\n", millis());
-
-      // Progress bar dimensions
-      constexpr int barWidth = 200;
-      constexpr int barHeight = 10;
-      constexpr int boxMargin = 20;
-      const int textWidth = renderer.getTextWidth(UI_12_FONT_ID, "Indexing...");
-      const int boxWidthWithBar = (barWidth > textWidth ? barWidth : textWidth) + boxMargin * 2;
-      const int boxWidthNoBar = textWidth + boxMargin * 2;
-      const int boxHeightWithBar = renderer.getLineHeight(UI_12_FONT_ID) + barHeight + boxMargin * 3;
-      const int boxHeightNoBar = renderer.getLineHeight(UI_12_FONT_ID) + boxMargin * 2;
-      const int boxXWithBar = (renderer.getScreenWidth() - boxWidthWithBar) / 2;
-      const int boxXNoBar = (renderer.getScreenWidth() - boxWidthNoBar) / 2;
-      constexpr int boxY = 50;
-      const int barX = boxXWithBar + (boxWidthWithBar - barWidth) / 2;
-      const int barY = boxY + renderer.getLineHeight(UI_12_FONT_ID) + boxMargin * 2;
-
-      // Always show "Indexing..." text first
-      {
-        renderer.fillRect(boxXNoBar, boxY, boxWidthNoBar, boxHeightNoBar, false);
-        renderer.drawText(UI_12_FONT_ID, boxXNoBar + boxMargin, boxY + boxMargin, "Indexing...");
-        renderer.drawRect(boxXNoBar + 5, boxY + 5, boxWidthNoBar - 10, boxHeightNoBar - 10);
-        renderer.displayBuffer();
-        pagesUntilFullRefresh = 0;
-      }
+    // A background build of this chapter carries on as the section being read. It has to be taken before looking
+    // for the cache, the partial file it is writing doesn't load and would be cleared.
+    if (prefetchSection && prefetchSection->getSpineIndex() == currentSpineIndex) {
+      Serial.printf("[%lu] [ERS] Taking over background build\n", millis());
+      section = std::move(prefetchSection);
 
-      // Setup callback - only called for chapters >= 50KB, redraws with progress bar
-      auto progressSetup = [this, boxXWithBar, boxWidthWithBar, boxHeightWithBar, barX, barY] {
-        renderer.fillRect(boxXWithBar, boxY, boxWidthWithBar, boxHeightWithBar, false);
-        renderer.drawText(UI_12_FONT_ID, boxXWithBar + boxMargin, boxY + boxMargin, "Indexing...");
-        renderer.drawRect(boxXWithBar + 5, boxY + 5, boxWidthWithBar - 10, boxHeightWithBar - 10);
-        renderer.drawRect(barX, barY, barWidth, barHeight);
-        renderer.displayBuffer();
-      };
-
-      // Progress callback to update progress bar
-      auto progressCallback = [this, barX, barY, barWidth, barHeight](int progress) {
-        const int fillWidth = (barWidth - 2) * progress / 100;
-        renderer.fillRect(barX + 1, barY + 1, fillWidth, barHeight - 2, true);
-        renderer.displayBuffer(EInkDisplay::FAST_REFRESH);
-      };
-
-      if (!section->createSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
-                                      SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight, progressSetup,
-                                      progressCallback)) {
+      // Opening at the end of the chapter needs all of it
+      if (nextPageNumber == UINT16_MAX && section->continueSectionFile(SIZE_MAX) != Section::BuildStatus::Done) {
         Serial.printf("[%lu] [ERS] Failed to persist page data to SD\n", millis());
         section.reset();
         return;
       }
-    } else {
+    } else if (section->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                        SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight)) {
       Serial.printf("[%lu] [ERS] Cache found, skipping build...\n", millis());
+    } else {
+      // Frees the parser and inflater of any other background build for this one
+      prefetchSection.reset();
+
+      // Pages are shown as soon as they are written and the rest of the chapter is built while the reader is idle,
+      // only opening at the end of the chapter needs all of it up front
+      if (nextPageNumber != UINT16_MAX &&
+          section->beginSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                    SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight)) {
+        Serial.printf("[%lu] [ERS] Cache not found, building from the first page...\n", millis());
+      } else {
+        Serial.printf("[%lu] [ERS] Cache not found, building...\n", millis());
+
+        // Progress bar dimensions
+        constexpr int barWidth = 200;
+        constexpr int barHeight = 10;
+        constexpr int boxMargin = 20;
+        const int textWidth = renderer.getTextWidth(UI_12_FONT_ID, "Indexing...");
+        const int boxWidthWithBar = (barWidth > textWidth ? barWidth : textWidth) + boxMargin * 2;
+        const int boxWidthNoBar = textWidth + boxMargin * 2;
+        const int boxHeightWithBar = renderer.getLineHeight(UI_12_FONT_ID) + barHeight + boxMargin * 3;
+        const int boxHeightNoBar = renderer.getLineHeight(UI_12_FONT_ID) + boxMargin * 2;
+        const int boxXWithBar = (renderer.getScreenWidth() - boxWidthWithBar) / 2;
+        const int boxXNoBar = (renderer.getScreenWidth() - boxWidthNoBar) / 2;
+        constexpr int boxY = 50;
+        const int barX = boxXWithBar + (boxWidthWithBar - barWidth) / 2;
+        const int barY = boxY + renderer.getLineHeight(UI_12_FONT_ID) + boxMargin * 2;
+
+        // Always show "Indexing..." text first
+        {
+          renderer.fillRect(boxXNoBar, boxY, boxWidthNoBar, boxHeightNoBar, false);
+          renderer.drawText(UI_12_FONT_ID, boxXNoBar + boxMargin, boxY + boxMargin, "Indexing...");
+          renderer.drawRect(boxXNoBar + 5, boxY + 5, boxWidthNoBar - 10, boxHeightNoBar - 10);
+          renderer.displayBuffer();
+          pagesUntilFullRefresh = 0;
+        }
+
+        // Setup callback - only called for chapters >= 50KB, redraws with progress bar
+        auto progressSetup = [this, boxXWithBar, boxWidthWithBar, boxHeightWithBar, barX, barY] {
+          renderer.fillRect(boxXWithBar, boxY, boxWidthWithBar, boxHeightWithBar, false);
+          renderer.drawText(UI_12_FONT_ID, boxXWithBar + boxMargin, boxY + boxMargin, "Indexing...");
+          renderer.drawRect(boxXWithBar + 5, boxY + 5, boxWidthWithBar - 10, boxHeightWithBar - 10);
+          renderer.drawRect(barX, barY, barWidth, barHeight);
+          renderer.displayBuffer();
+        };
+
+        // Progress callback to update progress bar
+        auto progressCallback = [this, barX, barY, barWidth, barHeight](int progress) {
+          const int fillWidth = (barWidth - 2) * progress / 100;
+          renderer.fillRect(barX + 1, barY + 1, fillWidth, barHeight - 2, true);
+          renderer.displayBuffer(EInkDisplay::FAST_REFRESH);
+        };
+
+        if (!section->createSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                        SETTINGS.extraParagraphSpacing, viewportWidth, viewportHeight, progressSetup,
+                                        progressCallback)) {
+          Serial.printf("[%lu] [ERS] Failed to persist page data to SD\n", millis());
+          section.reset();
+          return;
+        }
+      }
     }
 
     if (nextPageNumber == UINT16_MAX) {
@@ -326,8 +619,46 @@ void EpubReaderActivity::renderScreen() {
     } else {
       section->currentPage = nextPageNumber;
     }
+
+    if (!nextPageAnchor.empty()) {
+      // A chapter still being built only knows the anchors up to where it has got to
+      int anchorPage = section->getPageForAnchor(nextPageAnchor);
+      while (anchorPage < 0 && section->isPaginating()) {
+        if (section->continueSectionFile(buildStepBytes) == Section::BuildStatus::Failed) {
+          Serial.printf("[%lu] [ERS] Failed to persist page data to SD\n", millis());
+          nextPageAnchor.clear();
+          section.reset();
+          return;
+        }
+        anchorPage = section->getPageForAnchor(nextPageAnchor);
+      }
+      if (anchorPage >= 0) {
+        section->currentPage = anchorPage;
+      } else {
+        Serial.printf("[%lu] [ERS] Anchor %s not found, opening chapter start\n", millis(), nextPageAnchor.c_str());
+      }
+      nextPageAnchor.clear();
+    }
+  }
+
+  // The chapter may not have been built up to this page yet
+  while (section->isPaginating() && section->currentPage >= section->pageCount) {
+    if (section->continueSectionFile(buildStepBytes) == Section::BuildStatus::Failed) {
+      Serial.printf("[%lu] [ERS] Failed to persist page data to SD\n", millis());
+      section.reset();
+      return;
+    }
   }
 
+  // Turned past the last page of a chapter that was still being built
+  if (section->pageCount > 0 && section->currentPage == section->pageCount) {
+    nextPageNumber = 0;
+    currentSpineIndex++;
+    section.reset();
+    return renderScreen();
+  }
+
+  checkPageIndex();
   renderer.clearScreen();
 
   if (section->pageCount == 0) {
@@ -425,13 +756,24 @@ void EpubReaderActivity::renderStatusBar(const int orientedMarginRight, const in
   int progressTextWidth = 0;
 
   if (showProgress) {
-    // Calculate progress in book
-    const float sectionChapterProg = static_cast<float>(section->currentPage) / section->pageCount;
-    const uint8_t bookProgress = epub->calculateProgress(currentSpineIndex, sectionChapterProg);
+    // Calculate progress in book, the page count of a chapter isn't known until it has been built
+    const bool paginated = !section->isPaginating();
+    std::string progress;
+    if (paginated && pageIndex->getPageCount() > 0) {
+      // Pages are numbered across the whole book once it has been indexed
+      const uint32_t bookPage = pageIndex->getBookPage(currentSpineIndex, section->currentPage) + 1;
+      const uint32_t bookPages = pageIndex->getPageCount();
+      progress = std::to_string(bookPage) + "/" + std::to_string(bookPages) + "  " +
+                 std::to_string(static_cast<uint64_t>(bookPage) * 100 / bookPages) + "%";
+    } else {
+      const float sectionChapterProg = paginated ? static_cast<float>(section->currentPage) / section->pageCount : 0;
+      const uint8_t bookProgress = epub->calculateProgress(currentSpineIndex, sectionChapterProg);
+      progress = std::to_string(section->currentPage + 1) +
+                 (paginated ? "/" + std::to_string(section->pageCount) : "") + "  " + std::to_string(bookProgress) +
+                 "%";
+    }
 
     // Right aligned text for progress counter
-    const std::string progress = std::to_string(section->currentPage + 1) + "/" + std::to_string(section->pageCount) +
-                                 "  " + std::to_string(bookProgress) + "%";
     progressTextWidth = renderer.getTextWidth(SMALL_FONT_ID, progress.c_str());
     renderer.drawText(SMALL_FONT_ID, renderer.getScreenWidth() - orientedMarginRight - progressTextWidth, textY,
                       progress.c_str());
@@ -441,7 +783,8 @@ void EpubReaderActivity::renderStatusBar(const int orientedMarginRight, const in
     ScreenComponents::drawBattery(renderer, orientedMarginLeft, textY);
   }
 
-  if (showChapterTitle) {
+  // Title is left out until the TOC has been built
+  if (showChapterTitle && epub->isTocLoaded()) {
     // Centered chatper title text
     // Page width minus existing content with 30px padding on each side
     const int titleMarginLeft = 50 + 30 + orientedMarginLeft;  // 50px for battery
@@ -455,8 +798,11 @@ void EpubReaderActivity::renderStatusBar(const int orientedMarginRight, const in
       title = "Unnamed";
       titleWidth = renderer.getTextWidth(SMALL_FONT_ID, "Unnamed");
     } else {
-      const auto tocItem = epub->getTocItem(tocIndex);
-      title = tocItem.title;
+      if (tocIndex != statusBarTocIndex) {
+        statusBarTitle = epub->getTocItem(tocIndex).title;
+        statusBarTocIndex = tocIndex;
+      }
+      title = statusBarTitle;
       titleWidth = renderer.getTextWidth(SMALL_FONT_ID, title.c_str());
       while (titleWidth > availableTextWidth && title.length() > 11) {
         title.replace(title.length() - 8, 8, "...");
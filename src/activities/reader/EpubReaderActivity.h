@@ -1,5 +1,6 @@
 #pragma once
 #include <Epub.h>
+#include <Epub/BookPageIndex.h>
 #include <Epub/Section.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
@@ -10,17 +11,39 @@
 class EpubReaderActivity final : public ActivityWithSubactivity {
   std::shared_ptr<Epub> epub;
   std::unique_ptr<Section> section = nullptr;
+  // A chapter next to the current one, paginated a slice at a time while the reader is idle
+  std::unique_ptr<Section> prefetchSection = nullptr;
+  // Spine index the neighbouring chapters were picked for, and how many of them have been looked at since
+  int prefetchSpineIndex = -1;
+  int prefetchCandidate = 0;
+  // Book-wide page numbers for the current layout, once the book has been indexed
+  std::unique_ptr<BookPageIndex> pageIndex = nullptr;
   TaskHandle_t displayTaskHandle = nullptr;
   SemaphoreHandle_t renderingMutex = nullptr;
   int currentSpineIndex = 0;
   int nextPageNumber = 0;
+  // Element id to open the chapter at instead of nextPageNumber, looked up once its section is loaded
+  std::string nextPageAnchor;
   int pagesUntilFullRefresh = 0;
   bool updateRequired = false;
+  bool tocBuildAttempted = false;
+  // Chapter title shown in the status bar, only re-read from the book cache when the TOC index changes
+  mutable int statusBarTocIndex = -1;
+  mutable std::string statusBarTitle;
   const std::function<void()> onGoBack;
   const std::function<void()> onGoHome;
 
   static void taskTrampoline(void* param);
   [[noreturn]] void displayTaskLoop();
+  void buildSectionsInBackground();
+  Section::BuildStatus continueBuildSlice(Section& buildingSection) const;
+  void prefetchNeighbouringSections();
+  void leaveSection();
+  void finishSectionBuilds();
+  bool indexBook();
+  void openGoToPage();
+  void checkPageIndex();
+  void getReaderMargins(int* top, int* right, int* bottom, int* left) const;
   void renderScreen();
   void renderContents(std::unique_ptr<Page> page, int orientedMarginTop, int orientedMarginRight,
                       int orientedMarginBottom, int orientedMarginLeft);
@@ -16,7 +16,8 @@ class EpubReaderChapterSelectionActivity final : public Activity {
   int selectorIndex = 0;
   bool updateRequired = false;
   const std::function<void()> onGoBack;
-  const std::function<void(int newSpineIndex)> onSelectSpineIndex;
+  // The anchor is the part of the TOC entry's href after '#', empty if it points at the start of the chapter
+  const std::function<void(int newSpineIndex, const std::string& anchor)> onSelectSpineIndex;
 
   // Number of items that fit on a page, derived from logical screen height.
   // This adapts automatically when switching between portrait and landscape.
@@ -30,7 +31,8 @@ class EpubReaderChapterSelectionActivity final : public Activity {
   explicit EpubReaderChapterSelectionActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
                                               const std::shared_ptr<Epub>& epub, const int currentSpineIndex,
                                               const std::function<void()>& onGoBack,
-                                              const std::function<void(int newSpineIndex)>& onSelectSpineIndex)
+                                              const std::function<void(int newSpineIndex, const std::string& anchor)>&
+                                                  onSelectSpineIndex)
       : Activity("EpubReaderChapterSelection", renderer, mappedInput),
         epub(epub),
         currentSpineIndex(currentSpineIndex),
@@ -0,0 +1,118 @@
+#include "EpubReaderGoToPageActivity.h"
+
+#include <GfxRenderer.h>
+
+#include <string>
+
+#include "MappedInputManager.h"
+#include "fontIds.h"
+
+namespace {
+// Time threshold for treating a long press as a bigger step
+constexpr int SKIP_PAGES_MS = 700;
+}  // namespace
+
+void EpubReaderGoToPageActivity::taskTrampoline(void* param) {
+  auto* self = static_cast<EpubReaderGoToPageActivity*>(param);
+  self->displayTaskLoop();
+}
+
+void EpubReaderGoToPageActivity::onEnter() {
+  Activity::onEnter();
+
+  renderingMutex = xSemaphoreCreateMutex();
+  if (selectedPage >= pageCount) {
+    selectedPage = pageCount > 0 ? pageCount - 1 : 0;
+  }
+
+  // Trigger first update
+  updateRequired = true;
+  xTaskCreate(&EpubReaderGoToPageActivity::taskTrampoline, "EpubReaderGoToPageActivityTask",
+              4096,               // Stack size
+              this,               // Parameters
+              1,                  // Priority
+              &displayTaskHandle  // Task handle
+  );
+}
+
+void EpubReaderGoToPageActivity::onExit() {
+  Activity::onExit();
+
+  // Wait until not rendering to delete task to avoid killing mid-instruction to EPD
+  xSemaphoreTake(renderingMutex, portMAX_DELAY);
+  if (displayTaskHandle) {
+    vTaskDelete(displayTaskHandle);
+    displayTaskHandle = nullptr;
+  }
+  vSemaphoreDelete(renderingMutex);
+  renderingMutex = nullptr;
+}
+
+// Stops at the first and last page rather than wrapping around
+void EpubReaderGoToPageActivity::moveSelection(const int pages) {
+  if (pageCount == 0) {
+    return;
+  }
+  const int64_t page = static_cast<int64_t>(selectedPage) + pages;
+  selectedPage = page < 0 ? 0 : page >= pageCount ? pageCount - 1 : static_cast<uint32_t>(page);
+  updateRequired = true;
+}
+
+void EpubReaderGoToPageActivity::loop() {
+  const bool prevReleased = mappedInput.wasReleased(MappedInputManager::Button::Left) ||
+                            mappedInput.wasReleased(MappedInputManager::Button::PageBack);
+  const bool nextReleased = mappedInput.wasReleased(MappedInputManager::Button::Right) ||
+                            mappedInput.wasReleased(MappedInputManager::Button::PageForward);
+
+  // Left and right step a page, up and down ten. Holding steps ten times as far.
+  const int multiplier = mappedInput.getHeldTime() > SKIP_PAGES_MS ? 10 : 1;
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    if (pageCount == 0) {
+      onGoBack();
+    } else {
+      onSelectPage(selectedPage);
+    }
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
+    onGoBack();
+  } else if (prevReleased) {
+    moveSelection(-multiplier);
+  } else if (nextReleased) {
+    moveSelection(multiplier);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Up)) {
+    moveSelection(10 * multiplier);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Down)) {
+    moveSelection(-10 * multiplier);
+  }
+}
+
+void EpubReaderGoToPageActivity::displayTaskLoop() {
+  while (true) {
+    if (updateRequired) {
+      updateRequired = false;
+      xSemaphoreTake(renderingMutex, portMAX_DELAY);
+      renderScreen();
+      xSemaphoreGive(renderingMutex);
+    }
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+}
+
+void EpubReaderGoToPageActivity::renderScreen() {
+  renderer.clearScreen();
+  renderer.drawCenteredText(UI_12_FONT_ID, 15, "Go to page", true, EpdFontFamily::BOLD);
+
+  const int centerY = renderer.getScreenHeight() / 2;
+  const std::string page = std::to_string(selectedPage + 1) + " / " + std::to_string(pageCount);
+  renderer.drawCenteredText(UI_12_FONT_ID, centerY - renderer.getLineHeight(UI_12_FONT_ID), page.c_str(), true,
+                            EpdFontFamily::BOLD);
+  const std::string percent =
+      std::to_string(pageCount > 0 ? static_cast<uint64_t>(selectedPage + 1) * 100 / pageCount : 0) + "%";
+  renderer.drawCenteredText(UI_10_FONT_ID, centerY + 10, percent.c_str());
+  renderer.drawCenteredText(SMALL_FONT_ID, centerY + 50, "Up/down: 10 pages, hold to move further");
+
+  const auto labels = mappedInput.mapLabels("« Back", "Go", "-1", "+1");
+  renderer.drawButtonHints(UI_10_FONT_ID, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+
+  renderer.displayBuffer();
+}
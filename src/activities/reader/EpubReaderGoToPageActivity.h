@@ -0,0 +1,39 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <functional>
+
+#include "../Activity.h"
+
+// Picks a page of an indexed book to open, numbered across the whole book
+class EpubReaderGoToPageActivity final : public Activity {
+  TaskHandle_t displayTaskHandle = nullptr;
+  SemaphoreHandle_t renderingMutex = nullptr;
+  // Counting from 0, shown counting from 1
+  uint32_t selectedPage = 0;
+  const uint32_t pageCount;
+  bool updateRequired = false;
+  const std::function<void()> onGoBack;
+  const std::function<void(uint32_t bookPage)> onSelectPage;
+
+  void moveSelection(int pages);
+  static void taskTrampoline(void* param);
+  [[noreturn]] void displayTaskLoop();
+  void renderScreen();
+
+ public:
+  explicit EpubReaderGoToPageActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
+                                      const uint32_t currentPage, const uint32_t pageCount,
+                                      const std::function<void()>& onGoBack,
+                                      const std::function<void(uint32_t bookPage)>& onSelectPage)
+      : Activity("EpubReaderGoToPage", renderer, mappedInput),
+        selectedPage(currentPage),
+        pageCount(pageCount),
+        onGoBack(onGoBack),
+        onSelectPage(onSelectPage) {}
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+};
@@ -1,5 +1,9 @@
 #include "ReaderActivity.h"
 
+#include <BookCacheManager.h>
+#include <Inflater.h>
+
+#include "CrossPointSettings.h"
 #include "Epub.h"
 #include "EpubReaderActivity.h"
 #include "FileSelectionActivity.h"
@@ -32,6 +36,8 @@ std::unique_ptr<Epub> ReaderActivity::loadEpub(const std::string& path) {
     return nullptr;
   }
 
+  // Take the inflate workspace before loading the book scatters allocations across the heap
+  Inflater::reserveWorkspace();
   auto epub = std::unique_ptr<Epub>(new Epub(path, "/.crosspoint"));
   if (epub->load()) {
     return epub;
@@ -99,6 +105,7 @@ void ReaderActivity::onGoToFileSelection(const std::string& fromBookPath) {
 void ReaderActivity::onGoToEpubReader(std::unique_ptr<Epub> epub) {
   const auto epubPath = epub->getPath();
   currentBookPath = epubPath;
+  BookCacheManager::onBookOpened(epub->getCachePath(), SETTINGS.getCacheBudgetBytes());
   exitActivity();
   enterNewActivity(new EpubReaderActivity(
       renderer, mappedInput, std::move(epub), [this, epubPath] { onGoToFileSelection(epubPath); },
@@ -108,6 +115,7 @@ void ReaderActivity::onGoToEpubReader(std::unique_ptr<Epub> epub) {
 void ReaderActivity::onGoToXtcReader(std::unique_ptr<Xtc> xtc) {
   const auto xtcPath = xtc->getPath();
   currentBookPath = xtcPath;
+  BookCacheManager::onBookOpened(xtc->getCachePath(), SETTINGS.getCacheBudgetBytes());
   exitActivity();
   enterNewActivity(new XtcReaderActivity(
       renderer, mappedInput, std::move(xtc), [this, xtcPath] { onGoToFileSelection(xtcPath); },
@@ -7,10 +7,12 @@
 
 #include "XtcReaderActivity.h"
 
+#include <BookCacheManager.h>
 #include <FsHelpers.h>
 #include <GfxRenderer.h>
 #include <SDCardManager.h>
 
+#include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "MappedInputManager.h"
 #include "XtcReaderChapterSelectionActivity.h"
@@ -67,6 +69,9 @@ void XtcReaderActivity::onExit() {
   }
   vSemaphoreDelete(renderingMutex);
   renderingMutex = nullptr;
+  if (xtc) {
+    BookCacheManager::onBookClosed(xtc->getCachePath(), SETTINGS.getCacheBudgetBytes());
+  }
   xtc.reset();
 }
 
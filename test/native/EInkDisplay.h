@@ -0,0 +1,29 @@
+#pragma once
+// Framebuffer-only stand-in for the e-ink panel driver, for the native test env. Nothing reaches a panel, refreshes are
+// only counted.
+#include <HardwareSerial.h>
+
+#include <cstdint>
+#include <cstring>
+
+class EInkDisplay {
+ public:
+  static constexpr int DISPLAY_WIDTH = 800;
+  static constexpr int DISPLAY_HEIGHT = 480;
+  static constexpr int DISPLAY_WIDTH_BYTES = DISPLAY_WIDTH / 8;
+  static constexpr int BUFFER_SIZE = DISPLAY_WIDTH_BYTES * DISPLAY_HEIGHT;
+  enum RefreshMode { FULL_REFRESH, HALF_REFRESH, FAST_REFRESH };
+
+  uint8_t frameBuffer[BUFFER_SIZE] = {};
+  int refreshCount = 0;
+
+  uint8_t* getFrameBuffer() { return frameBuffer; }
+  void clearScreen(const uint8_t color) { memset(frameBuffer, color, BUFFER_SIZE); }
+  void displayBuffer(RefreshMode) { refreshCount++; }
+  void drawImage(const uint8_t*, int, int, int, int) {}
+  void copyGrayscaleLsbBuffers(const uint8_t*) {}
+  void copyGrayscaleMsbBuffers(const uint8_t*) {}
+  void displayGrayBuffer(bool = false) {}
+  void cleanupGrayscaleBuffers(const uint8_t*) {}
+  void grayscaleRevert() {}
+};
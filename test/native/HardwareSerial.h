@@ -0,0 +1,27 @@
+#pragma once
+// Host stand-in for the Arduino core pieces the cache code uses, for the native test env
+#include <cstdarg>
+#include <cstdio>
+
+// The clock only moves when a test moves it, so code that works in time slices runs the same however fast the host is
+inline unsigned long& fakeMillis() {
+  static unsigned long now = 0;
+  return now;
+}
+
+inline unsigned long millis() { return fakeMillis(); }
+
+inline void delay(const unsigned long ms) { fakeMillis() += ms; }
+
+class HardwareSerial {
+ public:
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    const int written = vprintf(format, args);
+    va_end(args);
+    return written;
+  }
+};
+
+inline HardwareSerial Serial;
@@ -0,0 +1,12 @@
+#pragma once
+// The real Print.h brings in WString.h, which code using it relies on for the C string functions
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+// SD card manager over the in-memory FakeFs, for the native test env
+#include <SdFat.h>
+
+class SDCardManager {
+ public:
+  bool begin() { return true; }
+  bool exists(const char* path) const { return FakeFs::instance().isDir(path) || FakeFs::instance().isFile(path); }
+  bool mkdir(const char* path) {
+    auto& fs = FakeFs::instance();
+    if (fs.isFile(path) || !fs.isDir(FakeFs::parentOf(path))) return false;
+    fs.dirs.insert(path);
+    return true;
+  }
+  bool remove(const char* path) { return FakeFs::instance().files.erase(path) > 0; }
+  bool rmdir(const char* path) {
+    auto& fs = FakeFs::instance();
+    return fs.children(path).empty() && fs.dirs.erase(path) > 0;
+  }
+  bool removeDir(const char* path) { return FakeFs::instance().removeTree(path); }
+  FsFile open(const char* path, const int flags = O_RDONLY) { return FsFile::openPath(path, flags); }
+  bool openFileForRead(const char*, const std::string& path, FsFile& file) {
+    file = FsFile::openPath(path, O_RDONLY);
+    return file && !file.isDirectory();
+  }
+  bool openFileForWrite(const char*, const std::string& path, FsFile& file) {
+    file = FsFile::openPath(path, O_RDWR | O_CREAT | O_TRUNC);
+    if (file) FakeFs::instance().filesWritten++;
+    return file && !file.isDirectory();
+  }
+};
+
+inline SDCardManager SdMan;
@@ -0,0 +1,230 @@
+#pragma once
+// In-memory stand-in for SdFat, for the native test env. Files and directories live in FakeFs::instance(), keyed by
+// their absolute path, and every open handle shares its file's bytes so writes are seen by other handles at once.
+// The real SdFat brings in Arduino.h, which code using it relies on for Serial, millis and the C library.
+#include <HardwareSerial.h>
+#include <Print.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#define O_RDONLY 0x00
+#define O_WRONLY 0x01
+#define O_RDWR 0x02
+#define O_CREAT 0x40
+#define O_TRUNC 0x200
+
+class FakeFs {
+ public:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  std::set<std::string> dirs{"/"};
+  // Counters tests use to see how much work a call did
+  uint64_t bytesRead = 0;
+  uint64_t filesWritten = 0;
+  std::vector<std::string> listedDirs;
+
+  static FakeFs& instance() {
+    static FakeFs fs;
+    return fs;
+  }
+
+  void reset() { *this = FakeFs(); }
+
+  static std::string parentOf(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    return slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+  }
+
+  bool isDir(const std::string& path) const { return dirs.count(path) > 0; }
+  bool isFile(const std::string& path) const { return files.count(path) > 0; }
+
+  // Children of a directory, directories first, each group in name order
+  std::vector<std::string> children(const std::string& dir) const {
+    const std::string prefix = dir == "/" ? "/" : dir + "/";
+    std::vector<std::string> out;
+    const auto isChild = [&](const std::string& path) {
+      return path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0 &&
+             path.find('/', prefix.size()) == std::string::npos;
+    };
+    for (const auto& path : dirs) {
+      if (isChild(path)) out.push_back(path);
+    }
+    for (const auto& entry : files) {
+      if (isChild(entry.first)) out.push_back(entry.first);
+    }
+    return out;
+  }
+
+  // Moves a file or a directory with everything below it
+  bool rename(const std::string& from, const std::string& to) {
+    if (!isDir(parentOf(to)) || isDir(to) || isFile(to)) {
+      return false;
+    }
+    if (isFile(from)) {
+      files[to] = files[from];
+      files.erase(from);
+      return true;
+    }
+    if (!isDir(from)) {
+      return false;
+    }
+    const std::string prefix = from + "/";
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> movedFiles;
+    for (auto it = files.begin(); it != files.end();) {
+      if (it->first.compare(0, prefix.size(), prefix) == 0) {
+        movedFiles[to + it->first.substr(from.size())] = it->second;
+        it = files.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    std::set<std::string> movedDirs{to};
+    for (auto it = dirs.begin(); it != dirs.end();) {
+      if (*it == from || it->compare(0, prefix.size(), prefix) == 0) {
+        if (*it != from) movedDirs.insert(to + it->substr(from.size()));
+        it = dirs.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    files.insert(movedFiles.begin(), movedFiles.end());
+    dirs.insert(movedDirs.begin(), movedDirs.end());
+    return true;
+  }
+
+  bool removeTree(const std::string& dir) {
+    if (!isDir(dir)) {
+      return false;
+    }
+    const std::string prefix = dir + "/";
+    for (auto it = files.begin(); it != files.end();) {
+      it = it->first.compare(0, prefix.size(), prefix) == 0 ? files.erase(it) : std::next(it);
+    }
+    for (auto it = dirs.begin(); it != dirs.end();) {
+      it = *it == dir || it->compare(0, prefix.size(), prefix) == 0 ? dirs.erase(it) : std::next(it);
+    }
+    return true;
+  }
+
+  // Total size of the files below a directory
+  uint64_t treeSize(const std::string& dir) const {
+    const std::string prefix = dir + "/";
+    uint64_t total = 0;
+    for (const auto& entry : files) {
+      if (entry.first.compare(0, prefix.size(), prefix) == 0) total += entry.second->size();
+    }
+    return total;
+  }
+};
+
+class FsFile : public Print {
+  std::string path;
+  std::shared_ptr<std::vector<uint8_t>> data;
+  size_t pos = 0;
+  bool directory = false;
+  bool isOpen = false;
+  bool writable = false;
+  std::vector<std::string> listing;
+  size_t nextChild = 0;
+
+ public:
+  static FsFile openPath(const std::string& path, const int flags) {
+    auto& fs = FakeFs::instance();
+    FsFile file;
+    file.path = path;
+    if (fs.isDir(path)) {
+      file.directory = true;
+      file.isOpen = true;
+      return file;
+    }
+    if (!fs.isFile(path)) {
+      if (!(flags & O_CREAT) || !fs.isDir(FakeFs::parentOf(path))) {
+        return file;
+      }
+      fs.files[path] = std::make_shared<std::vector<uint8_t>>();
+    }
+    file.data = fs.files[path];
+    if (flags & O_TRUNC) {
+      file.data->clear();
+    }
+    file.writable = (flags & (O_WRONLY | O_RDWR)) != 0;
+    file.isOpen = true;
+    return file;
+  }
+
+  explicit operator bool() const { return isOpen; }
+  bool isDirectory() const { return isOpen && directory; }
+
+  int read(void* buffer, const size_t size) {
+    if (!isOpen || directory) return -1;
+    const size_t available = pos < data->size() ? data->size() - pos : 0;
+    const size_t count = std::min(size, available);
+    memcpy(buffer, data->data() + pos, count);
+    pos += count;
+    FakeFs::instance().bytesRead += count;
+    return static_cast<int>(count);
+  }
+
+  int read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+  }
+
+  size_t write(const uint8_t* buffer, const size_t size) override {
+    if (!isOpen || directory || !writable) return 0;
+    if (data->size() < pos + size) data->resize(pos + size);
+    memcpy(data->data() + pos, buffer, size);
+    pos += size;
+    return size;
+  }
+  using Print::write;
+
+  bool seek(const uint64_t position) {
+    if (!isOpen || directory || position > data->size()) return false;
+    pos = position;
+    return true;
+  }
+  bool seekCur(const int64_t offset) { return seek(pos + offset); }
+  uint64_t position() const { return pos; }
+  uint64_t size() const { return isOpen && !directory ? data->size() : 0; }
+  int available() const { return isOpen && !directory ? static_cast<int>(data->size() - pos) : 0; }
+  void flush() {}
+
+  size_t getName(char* name, const size_t size) const {
+    const std::string base = path.substr(path.find_last_of('/') + 1);
+    if (size == 0) return 0;
+    const size_t length = std::min(base.size(), size - 1);
+    memcpy(name, base.data(), length);
+    name[length] = '\0';
+    return length;
+  }
+
+  FsFile openNextFile() {
+    if (!isOpen || !directory) return FsFile();
+    if (nextChild == 0 && listing.empty()) {
+      listing = FakeFs::instance().children(path);
+      FakeFs::instance().listedDirs.push_back(path);
+    }
+    if (nextChild >= listing.size()) return FsFile();
+    return openPath(listing[nextChild++], O_RDONLY);
+  }
+
+  bool rename(const char* newPath) {
+    if (!isOpen || !FakeFs::instance().rename(path, newPath)) return false;
+    path = newPath;
+    return true;
+  }
+
+  bool close() {
+    isOpen = false;
+    data.reset();
+    return true;
+  }
+};
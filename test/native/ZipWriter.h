@@ -0,0 +1,138 @@
+#pragma once
+// Builds zips in memory for the native tests, to be written to the in-memory SD card
+#include <miniz.h>
+#include <unity.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline void put16(std::vector<uint8_t>& bytes, const uint16_t value) {
+  bytes.push_back(value & 0xFF);
+  bytes.push_back(value >> 8);
+}
+
+inline void put32(std::vector<uint8_t>& bytes, const uint32_t value) {
+  put16(bytes, value & 0xFFFF);
+  put16(bytes, value >> 16);
+}
+
+inline void put64(std::vector<uint8_t>& bytes, const uint64_t value) {
+  put32(bytes, value & 0xFFFFFFFF);
+  put32(bytes, value >> 32);
+}
+
+// Writes a zip the way EPUB tools do, entries are stored or deflated by miniz
+class ZipWriter {
+  std::vector<uint8_t> centralDir;
+  uint32_t entryCount = 0;
+
+ public:
+  std::vector<uint8_t> bytes;
+  // Position of each central directory entry in bytes, once finished
+  std::vector<size_t> centralDirEntries;
+  // Puts local header offsets in a ZIP64 extra field even when they fit in the header, as some writers do
+  bool zip64Offsets = false;
+
+  uint64_t add(const std::string& name, const std::string& text, const bool deflated) {
+    return add(name, std::vector<uint8_t>(text.begin(), text.end()), deflated);
+  }
+
+  uint64_t add(const std::string& name, const std::vector<uint8_t>& data, const bool deflated) {
+    std::vector<uint8_t> stored = data;
+    if (deflated) {
+      size_t size = 0;
+      void* compressed = tdefl_compress_mem_to_heap(data.data(), data.size(), &size, 128);
+      TEST_ASSERT_NOT_NULL(compressed);
+      stored.assign(static_cast<const uint8_t*>(compressed), static_cast<const uint8_t*>(compressed) + size);
+      mz_free(compressed);
+    }
+    const uint16_t method = deflated ? MZ_DEFLATED : MZ_NO_COMPRESSION;
+    const uint32_t crc = mz_crc32(MZ_CRC32_INIT, data.data(), data.size());
+
+    const uint64_t localHeaderOffset = bytes.size();
+    put32(bytes, 0x04034b50);
+    put16(bytes, 20);
+    put16(bytes, 0);
+    put16(bytes, method);
+    put32(bytes, 0);
+    put32(bytes, crc);
+    put32(bytes, stored.size());
+    put32(bytes, data.size());
+    put16(bytes, name.size());
+    put16(bytes, 0);
+    bytes.insert(bytes.end(), name.begin(), name.end());
+    bytes.insert(bytes.end(), stored.begin(), stored.end());
+
+    addCentralDirEntry(name, method, crc, stored.size(), data.size(), localHeaderOffset);
+    return localHeaderOffset;
+  }
+
+  void addCentralDirEntry(const std::string& name, const uint16_t method, const uint32_t crc,
+                          const uint32_t compressedSize, const uint32_t uncompressedSize,
+                          const uint64_t localHeaderOffset) {
+    const bool zip64Offset = zip64Offsets || localHeaderOffset > UINT32_MAX;
+    centralDirEntries.push_back(centralDir.size());
+    put32(centralDir, 0x02014b50);
+    put16(centralDir, 20);
+    put16(centralDir, 20);
+    put16(centralDir, 0);
+    put16(centralDir, method);
+    put32(centralDir, 0);
+    put32(centralDir, crc);
+    put32(centralDir, compressedSize);
+    put32(centralDir, uncompressedSize);
+    put16(centralDir, name.size());
+    put16(centralDir, zip64Offset ? 12 : 0);
+    put16(centralDir, 0);
+    put16(centralDir, 0);
+    put16(centralDir, 0);
+    put32(centralDir, 0);
+    put32(centralDir, zip64Offset ? 0xFFFFFFFF : localHeaderOffset);
+    centralDir.insert(centralDir.end(), name.begin(), name.end());
+    if (zip64Offset) {
+      put16(centralDir, 0x0001);
+      put16(centralDir, 8);
+      put64(centralDir, localHeaderOffset);
+    }
+    entryCount++;
+  }
+
+  // Past 65535 entries the counts only fit in a ZIP64 end of central directory record
+  void finish() {
+    const uint64_t centralDirOffset = bytes.size();
+    bytes.insert(bytes.end(), centralDir.begin(), centralDir.end());
+    for (auto& entry : centralDirEntries) {
+      entry += centralDirOffset;
+    }
+
+    const bool zip64 = entryCount > 0xFFFF;
+    if (zip64) {
+      const uint64_t zip64EndOffset = bytes.size();
+      put32(bytes, 0x06064b50);
+      put64(bytes, 44);
+      put16(bytes, 45);
+      put16(bytes, 45);
+      put32(bytes, 0);
+      put32(bytes, 0);
+      put64(bytes, entryCount);
+      put64(bytes, entryCount);
+      put64(bytes, centralDir.size());
+      put64(bytes, centralDirOffset);
+
+      put32(bytes, 0x07064b50);
+      put32(bytes, 0);
+      put64(bytes, zip64EndOffset);
+      put32(bytes, 1);
+    }
+
+    put32(bytes, 0x06054b50);
+    put16(bytes, 0);
+    put16(bytes, 0);
+    put16(bytes, zip64 ? 0xFFFF : entryCount);
+    put16(bytes, zip64 ? 0xFFFF : entryCount);
+    put32(bytes, zip64 ? 0xFFFFFFFF : centralDir.size());
+    put32(bytes, zip64 ? 0xFFFFFFFF : centralDirOffset);
+    put16(bytes, 0);
+  }
+};
@@ -0,0 +1,176 @@
+#include <BookCacheKey.h>
+#include <SDCardManager.h>
+#include <unity.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+const std::string CACHE_DIR = "/.crosspoint";
+// Books in these tests end in a directory of this many bytes, like a zip's central directory
+constexpr size_t DIRECTORY_SIZE = 1024;
+int legacyChecks = 0;
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", path, file));
+  file.write(bytes.data(), bytes.size());
+  file.close();
+}
+
+std::vector<uint8_t> makeBook(const uint8_t seed, const size_t size = 8 * 1024) {
+  std::vector<uint8_t> bytes(size);
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = static_cast<uint8_t>(seed * 31 + i * 7 + (i >> 8));
+  }
+  return bytes;
+}
+
+bool directoryRange(const std::string&, const uint64_t fileSize, uint64_t* offset, uint64_t* length) {
+  if (fileSize < DIRECTORY_SIZE) {
+    return false;
+  }
+  *offset = fileSize - DIRECTORY_SIZE;
+  *length = DIRECTORY_SIZE;
+  return true;
+}
+
+// Legacy caches of these tests record the size of the book they were built from
+bool legacySizeMatches(const std::string& filepath, const std::string& legacyCachePath) {
+  legacyChecks++;
+  FsFile book;
+  FsFile recorded;
+  if (!SdMan.openFileForRead("TST", filepath, book) ||
+      !SdMan.openFileForRead("TST", legacyCachePath + "/size.bin", recorded)) {
+    return false;
+  }
+  uint64_t size = 0;
+  recorded.read(&size, sizeof(size));
+  return size == book.size();
+}
+
+std::string resolve(const std::string& path) {
+  return BookCacheKey::resolve(path, CACHE_DIR, "book_", directoryRange, legacySizeMatches);
+}
+
+std::string legacyPathOf(const std::string& path) {
+  return CACHE_DIR + "/book_" + std::to_string(std::hash<std::string>{}(path));
+}
+
+void makeCache(const std::string& cachePath) {
+  TEST_ASSERT_TRUE(SdMan.mkdir(cachePath.c_str()));
+  writeFile(cachePath + "/progress.bin", {1, 2, 3, 4});
+}
+
+void recordSize(const std::string& cachePath, const uint64_t size) {
+  const auto bytes = reinterpret_cast<const uint8_t*>(&size);
+  writeFile(cachePath + "/size.bin", std::vector<uint8_t>(bytes, bytes + sizeof(size)));
+}
+}  // namespace
+
+void setUp() {
+  FakeFs::instance().reset();
+  SdMan.mkdir(CACHE_DIR.c_str());
+  SdMan.mkdir("/books");
+  SdMan.mkdir("/books/sub");
+  legacyChecks = 0;
+}
+
+void tearDown() {}
+
+void test_reopen_and_rename_keep_the_key() {
+  writeFile("/books/a.bin", makeBook(1));
+  const std::string key = resolve("/books/a.bin");
+  TEST_ASSERT_EQUAL_STRING(key.c_str(), resolve("/books/a.bin").c_str());
+
+  TEST_ASSERT_TRUE(FakeFs::instance().rename("/books/a.bin", "/books/renamed.bin"));
+  TEST_ASSERT_EQUAL_STRING(key.c_str(), resolve("/books/renamed.bin").c_str());
+
+  TEST_ASSERT_TRUE(FakeFs::instance().rename("/books/renamed.bin", "/books/sub/moved.bin"));
+  TEST_ASSERT_EQUAL_STRING(key.c_str(), resolve("/books/sub/moved.bin").c_str());
+}
+
+void test_known_path_only_reads_the_fingerprint() {
+  writeFile("/books/a.bin", makeBook(1));
+  resolve("/books/a.bin");
+  FakeFs::instance().bytesRead = 0;
+  resolve("/books/a.bin");
+  // The alias map plus the directory, never the whole book
+  TEST_ASSERT_LESS_THAN(DIRECTORY_SIZE * 2, FakeFs::instance().bytesRead);
+}
+
+void test_replacing_the_book_changes_the_key() {
+  writeFile("/books/a.bin", makeBook(1));
+  const std::string key = resolve("/books/a.bin");
+
+  writeFile("/books/a.bin", makeBook(2, 9 * 1024));
+  const std::string otherKey = resolve("/books/a.bin");
+  TEST_ASSERT_NOT_EQUAL(0, key.compare(otherKey));
+
+  // Putting the original back finds its cache again
+  writeFile("/books/a.bin", makeBook(1));
+  TEST_ASSERT_EQUAL_STRING(key.c_str(), resolve("/books/a.bin").c_str());
+}
+
+void test_same_size_replacement_changing_only_the_directory_changes_the_key() {
+  // Same size, same first and last bytes, one byte different in the middle of the directory
+  auto book = makeBook(1);
+  writeFile("/books/a.bin", book);
+  const std::string key = resolve("/books/a.bin");
+
+  book[book.size() - DIRECTORY_SIZE / 2] ^= 0xFF;
+  writeFile("/books/a.bin", book);
+  TEST_ASSERT_NOT_EQUAL(0, key.compare(resolve("/books/a.bin")));
+}
+
+void test_legacy_cache_of_the_same_book_is_carried_over() {
+  writeFile("/books/a.bin", makeBook(1));
+  const std::string legacyPath = legacyPathOf("/books/a.bin");
+  makeCache(legacyPath);
+  recordSize(legacyPath, 8 * 1024);
+
+  const std::string cachePath = resolve("/books/a.bin");
+  TEST_ASSERT_EQUAL(1, legacyChecks);
+  TEST_ASSERT_FALSE(SdMan.exists(legacyPath.c_str()));
+  TEST_ASSERT_TRUE(SdMan.exists((cachePath + "/progress.bin").c_str()));
+}
+
+void test_legacy_cache_of_a_replaced_book_is_dropped() {
+  // The cache was built from a book that has since been replaced by another one under the same name
+  writeFile("/books/a.bin", makeBook(2, 9 * 1024));
+  const std::string legacyPath = legacyPathOf("/books/a.bin");
+  makeCache(legacyPath);
+  recordSize(legacyPath, 8 * 1024);
+
+  const std::string cachePath = resolve("/books/a.bin");
+  TEST_ASSERT_FALSE(SdMan.exists(legacyPath.c_str()));
+  TEST_ASSERT_FALSE(SdMan.exists((cachePath + "/progress.bin").c_str()));
+}
+
+void test_legacy_cache_without_a_check_is_dropped() {
+  writeFile("/books/a.bin", makeBook(1));
+  const std::string legacyPath = legacyPathOf("/books/a.bin");
+  makeCache(legacyPath);
+
+  const std::string cachePath = BookCacheKey::resolve("/books/a.bin", CACHE_DIR, "book_", directoryRange);
+  TEST_ASSERT_FALSE(SdMan.exists(legacyPath.c_str()));
+  TEST_ASSERT_FALSE(SdMan.exists((cachePath + "/progress.bin").c_str()));
+}
+
+void test_unreadable_book_falls_back_to_the_path() {
+  TEST_ASSERT_EQUAL_STRING(legacyPathOf("/books/missing.bin").c_str(), resolve("/books/missing.bin").c_str());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reopen_and_rename_keep_the_key);
+  RUN_TEST(test_known_path_only_reads_the_fingerprint);
+  RUN_TEST(test_replacing_the_book_changes_the_key);
+  RUN_TEST(test_same_size_replacement_changing_only_the_directory_changes_the_key);
+  RUN_TEST(test_legacy_cache_of_the_same_book_is_carried_over);
+  RUN_TEST(test_legacy_cache_of_a_replaced_book_is_dropped);
+  RUN_TEST(test_legacy_cache_without_a_check_is_dropped);
+  RUN_TEST(test_unreadable_book_falls_back_to_the_path);
+  return UNITY_END();
+}
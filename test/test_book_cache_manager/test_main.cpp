@@ -0,0 +1,182 @@
+#include <BookCacheManager.h>
+#include <SDCardManager.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+const std::string CACHE_DIR = "/.crosspoint";
+constexpr uint64_t KB = 1024;
+constexpr uint64_t MB = 1024 * KB;
+constexpr uint64_t BUDGET = 10 * MB;
+
+void writeFile(const std::string& path, const size_t size) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", path, file));
+  const std::vector<uint8_t> bytes(size, 0xAB);
+  file.write(bytes.data(), bytes.size());
+  file.close();
+}
+
+std::string bookPath(const int book) { return CACHE_DIR + "/epub_" + std::to_string(book); }
+
+bool hasCache(const int book) { return SdMan.exists((bookPath(book) + "/book.bin").c_str()); }
+
+bool hasProgress(const int book) { return SdMan.exists((bookPath(book) + "/progress.bin").c_str()); }
+
+// A book cache as the reader leaves it: metadata, progress, an index and sectionCount 100KB chapters
+void makeBook(const int book, const int sectionCount) {
+  const std::string path = bookPath(book);
+  if (!SdMan.exists(path.c_str())) {
+    SdMan.mkdir(path.c_str());
+  }
+  SdMan.mkdir((path + "/sections").c_str());
+  SdMan.mkdir((path + "/sections/3fa2c1d0").c_str());
+  writeFile(path + "/book.bin", 200 * KB);
+  writeFile(path + "/zip.idx", 8 * KB);
+  writeFile(path + "/progress.bin", 4);
+  for (int i = 0; i < sectionCount; i++) {
+    writeFile(path + "/sections/3fa2c1d0/" + std::to_string(i) + ".bin", 100 * KB);
+  }
+}
+
+uint64_t cacheSize() { return FakeFs::instance().treeSize(CACHE_DIR); }
+
+// Opens a book, reads sectionCount chapters of it and closes it again
+void readBook(const int book, const int sectionCount, const uint64_t budget = BUDGET) {
+  if (!hasCache(book)) {
+    makeBook(book, 0);
+  }
+  BookCacheManager::onBookOpened(bookPath(book), budget);
+  makeBook(book, sectionCount);
+  BookCacheManager::onBookClosed(bookPath(book), budget);
+}
+
+// Directories listed by the last call that are outside the given book, anything there is a scan of the cache tree
+bool onlyListed(const int book) {
+  for (const auto& dir : FakeFs::instance().listedDirs) {
+    if (dir.compare(0, bookPath(book).size(), bookPath(book)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+void setUp() {
+  FakeFs::instance().reset();
+  SdMan.mkdir(CACHE_DIR.c_str());
+  writeFile(CACHE_DIR + "/settings.bin", 30);
+}
+
+void tearDown() {}
+
+void test_first_open_seeds_the_manifest_and_fits_the_budget() {
+  for (int book = 0; book < 8; book++) {
+    makeBook(book, 20);
+  }
+  BookCacheManager::onBookOpened(bookPath(0), BUDGET);
+  TEST_ASSERT_TRUE(SdMan.exists((CACHE_DIR + "/cache_manifest.bin").c_str()));
+  TEST_ASSERT_LESS_OR_EQUAL(BUDGET, cacheSize());
+  TEST_ASSERT_TRUE(hasCache(0));
+}
+
+void test_later_calls_only_walk_the_book_being_read() {
+  readBook(1, 5);
+  FakeFs::instance().listedDirs.clear();
+  readBook(2, 5);
+  TEST_ASSERT_TRUE(onlyListed(2));
+}
+
+void test_least_recently_read_books_are_evicted_first() {
+  for (int book = 10; book < 14; book++) {
+    readBook(book, 20);
+  }
+  // Book 10 is read again, so 11 is now the least recently read
+  readBook(10, 20);
+  readBook(14, 20);
+  TEST_ASSERT_TRUE(hasCache(10));
+  TEST_ASSERT_FALSE(hasCache(11));
+  TEST_ASSERT_TRUE(hasCache(14));
+
+  readBook(15, 20);
+  TEST_ASSERT_FALSE(hasCache(12));
+  TEST_ASSERT_TRUE(hasCache(10));
+}
+
+void test_cache_stays_within_budget_while_reading() {
+  for (int book = 0; book < 30; book++) {
+    readBook(book, 15);
+    TEST_ASSERT_LESS_OR_EQUAL(BUDGET, cacheSize());
+    TEST_ASSERT_TRUE(hasCache(book));
+  }
+}
+
+void test_eviction_keeps_reading_progress() {
+  readBook(1, 40);
+  readBook(2, 40);
+  readBook(3, 40);
+  TEST_ASSERT_FALSE(hasCache(1));
+  TEST_ASSERT_TRUE(hasProgress(1));
+  TEST_ASSERT_FALSE(SdMan.exists((bookPath(1) + "/sections").c_str()));
+  TEST_ASSERT_FALSE(SdMan.exists((bookPath(1) + "/zip.idx").c_str()));
+
+  // Reopening it rebuilds the cache around the progress that was kept
+  readBook(1, 5);
+  TEST_ASSERT_TRUE(hasCache(1));
+  TEST_ASSERT_TRUE(hasProgress(1));
+}
+
+void test_book_over_budget_on_its_own_is_kept() {
+  readBook(1, 10);
+  readBook(2, 10);
+  readBook(3, 150);
+  TEST_ASSERT_TRUE(hasCache(3));
+  TEST_ASSERT_FALSE(hasCache(1));
+  TEST_ASSERT_FALSE(hasCache(2));
+  TEST_ASSERT_TRUE(SdMan.exists((CACHE_DIR + "/settings.bin").c_str()));
+}
+
+void test_unlimited_budget_never_evicts() {
+  for (int book = 0; book < 20; book++) {
+    readBook(book, 20, BookCacheManager::UNLIMITED);
+  }
+  for (int book = 0; book < 20; book++) {
+    TEST_ASSERT_TRUE(hasCache(book));
+  }
+}
+
+void test_manifest_with_a_damaged_count_is_rebuilt() {
+  readBook(1, 5);
+  readBook(2, 5);
+
+  // Version, read counter, then a count far past what the file holds
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", CACHE_DIR + "/cache_manifest.bin", file));
+  const uint8_t manifest[] = {1, 9, 0, 0, 0, 0xFF, 0xFF};
+  file.write(manifest, sizeof(manifest));
+  file.close();
+
+  FakeFs::instance().listedDirs.clear();
+  readBook(3, 5);
+  // The damaged manifest was dropped and seeded again from the cache dir
+  TEST_ASSERT_FALSE(onlyListed(3));
+  TEST_ASSERT_GREATER_THAN(sizeof(manifest), FakeFs::instance().files[CACHE_DIR + "/cache_manifest.bin"]->size());
+  TEST_ASSERT_TRUE(hasCache(1));
+  TEST_ASSERT_TRUE(hasCache(2));
+  TEST_ASSERT_TRUE(hasCache(3));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_open_seeds_the_manifest_and_fits_the_budget);
+  RUN_TEST(test_later_calls_only_walk_the_book_being_read);
+  RUN_TEST(test_least_recently_read_books_are_evicted_first);
+  RUN_TEST(test_cache_stays_within_budget_while_reading);
+  RUN_TEST(test_eviction_keeps_reading_progress);
+  RUN_TEST(test_book_over_budget_on_its_own_is_kept);
+  RUN_TEST(test_unlimited_budget_never_evicts);
+  RUN_TEST(test_manifest_with_a_damaged_count_is_rebuilt);
+  return UNITY_END();
+}
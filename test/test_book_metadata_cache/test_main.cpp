@@ -0,0 +1,355 @@
+#include <Epub.h>
+#include <SDCardManager.h>
+#include <ZipWriter.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+const std::string BOOK_PATH = "/book.epub";
+const std::string CACHE_DIR = "/.crosspoint";
+
+const char CONTAINER_XML[] = R"(<?xml version="1.0"?>
+<container version="1.0" xmlns="urn:oasis:names:tc:opendocument:xmlns:container">
+  <rootfiles>
+    <rootfile full-path="OEBPS/content.opf" media-type="application/oebps-package+xml"/>
+  </rootfiles>
+</container>
+)";
+
+// Spine: an idref missing from the manifest is dropped, an item missing from the zip is kept with no size
+const char CONTENT_OPF[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="2.0" unique-identifier="book-id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:title>A Synthetic Book</dc:title>
+    <dc:creator>Test Author</dc:creator>
+    <meta name="cover" content="cover-image"/>
+  </metadata>
+  <manifest>
+    <item id="ncx" href="toc.ncx" media-type="application/x-dtbncx+xml"/>
+    <item id="cover-image" href="images/cover.jpg" media-type="image/jpeg"/>
+    <item id="css" href="style.css" media-type="text/css"/>
+    <item id="intro" href="text/intro.xhtml" media-type="application/xhtml+xml"/>
+    <item id="ch1" href="text/ch1.xhtml" media-type="application/xhtml+xml"/>
+    <item id="ch2" href="text/ch2.xhtml" media-type="application/xhtml+xml"/>
+    <item id="lost" href="text/lost.xhtml" media-type="application/xhtml+xml"/>
+    <item id="ch3" href="text/ch3.xhtml" media-type="application/xhtml+xml"/>
+  </manifest>
+  <spine toc="ncx">
+    <itemref idref="intro"/>
+    <itemref idref="ch1"/>
+    <itemref idref="ch2"/>
+    <itemref idref="lost"/>
+    <itemref idref="unknown"/>
+    <itemref idref="ch3"/>
+  </spine>
+  <guide>
+    <reference type="text" title="Start" href="text/ch1.xhtml"/>
+  </guide>
+</package>
+)";
+
+// TOC: a nested entry with an anchor, a chapter without an entry of its own and an entry outside the spine
+const char TOC_NCX[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<ncx xmlns="http://www.daisy.org/z3986/2005/ncx/" version="2005-1">
+  <navMap>
+    <navPoint id="n1" playOrder="1">
+      <navLabel><text>Introduction</text></navLabel>
+      <content src="text/intro.xhtml"/>
+    </navPoint>
+    <navPoint id="n2" playOrder="2">
+      <navLabel><text>Chapter 1</text></navLabel>
+      <content src="text/ch1.xhtml"/>
+      <navPoint id="n3" playOrder="3">
+        <navLabel><text>Part &amp; Parcel</text></navLabel>
+        <content src="text/ch1.xhtml#part"/>
+      </navPoint>
+    </navPoint>
+    <navPoint id="n4" playOrder="4">
+      <navLabel><text>Chapter 3</text></navLabel>
+      <content src="text/ch3.xhtml#top"/>
+    </navPoint>
+    <navPoint id="n5" playOrder="5">
+      <navLabel><text>Elsewhere</text></navLabel>
+      <content src="text/nowhere.xhtml"/>
+    </navPoint>
+  </navMap>
+</ncx>
+)";
+
+std::string chapter(const size_t size) {
+  std::string text = "<html><body><p>";
+  while (text.size() < size - 18) {
+    text += "word ";
+  }
+  text.resize(size - 18);
+  return text + "</p></body></html>";
+}
+
+void writeBook(const std::string& tocNcx = TOC_NCX, const bool deflateTocNcx = true) {
+  ZipWriter writer;
+  writer.add("mimetype", std::string("application/epub+zip"), false);
+  writer.add("META-INF/container.xml", std::string(CONTAINER_XML), true);
+  writer.add("OEBPS/content.opf", std::string(CONTENT_OPF), true);
+  writer.add("OEBPS/toc.ncx", tocNcx, deflateTocNcx);
+  writer.add("OEBPS/style.css", std::string("p { text-indent: 1em; }"), false);
+  writer.add("OEBPS/text/intro.xhtml", chapter(1000), false);
+  writer.add("OEBPS/text/ch1.xhtml", chapter(2500), true);
+  writer.add("OEBPS/text/ch2.xhtml", chapter(40000), true);
+  writer.add("OEBPS/text/ch3.xhtml", chapter(123), true);
+  writer.finish();
+
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", BOOK_PATH, file));
+  file.write(writer.bytes.data(), writer.bytes.size());
+  file.close();
+}
+
+Bytes readFile(const std::string& path) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForRead("TST", path, file));
+  Bytes bytes(file.size());
+  file.read(bytes.data(), bytes.size());
+  file.close();
+  return bytes;
+}
+
+void putString(Bytes& bytes, const std::string& s) {
+  put32(bytes, s.size());
+  bytes.insert(bytes.end(), s.begin(), s.end());
+}
+
+// book.bin as documented in docs/file-formats.md, written out field by field
+Bytes expectedBookBin() {
+  const std::vector<std::pair<std::string, uint32_t>> spine = {{"OEBPS/text/intro.xhtml", 1000},
+                                                               {"OEBPS/text/ch1.xhtml", 3500},
+                                                               {"OEBPS/text/ch2.xhtml", 43500},
+                                                               {"OEBPS/text/lost.xhtml", 43500},
+                                                               {"OEBPS/text/ch3.xhtml", 43623}};
+  Bytes metadata;
+  putString(metadata, "A Synthetic Book");
+  putString(metadata, "Test Author");
+  putString(metadata, "OEBPS/images/cover.jpg");
+  putString(metadata, "OEBPS/text/ch1.xhtml");
+  putString(metadata, "OEBPS/");
+  putString(metadata, "OEBPS/toc.ncx");
+
+  Bytes bytes;
+  const uint32_t lutOffset = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t) + metadata.size();
+  bytes.push_back(4);
+  put32(bytes, lutOffset);
+  put16(bytes, spine.size());
+  bytes.insert(bytes.end(), metadata.begin(), metadata.end());
+
+  uint32_t entryOffset = lutOffset + sizeof(uint32_t) * spine.size();
+  for (const auto& entry : spine) {
+    put32(bytes, entryOffset);
+    entryOffset += sizeof(uint32_t) + entry.first.size() + sizeof(uint32_t);
+  }
+  for (const auto& entry : spine) {
+    putString(bytes, entry.first);
+    put32(bytes, entry.second);
+  }
+  return bytes;
+}
+
+struct ExpectedTocEntry {
+  std::string title;
+  std::string href;
+  std::string anchor;
+  uint8_t level;
+  int16_t spineIndex;
+};
+
+const std::vector<ExpectedTocEntry> TOC = {{"Introduction", "OEBPS/text/intro.xhtml", "", 1, 0},
+                                           {"Chapter 1", "OEBPS/text/ch1.xhtml", "", 1, 1},
+                                           {"Part & Parcel", "OEBPS/text/ch1.xhtml", "part", 2, 1},
+                                           {"Chapter 3", "OEBPS/text/ch3.xhtml", "top", 1, 4},
+                                           {"Elsewhere", "OEBPS/text/nowhere.xhtml", "", 1, -1}};
+// Spine items without a TOC entry of their own take the one before them
+const std::vector<int16_t> SPINE_TOC_INDEXES = {0, 1, 1, 1, 3};
+
+// toc.bin as documented in docs/file-formats.md, written out field by field
+Bytes expectedTocBin(const std::vector<ExpectedTocEntry>& toc, const std::vector<int16_t>& spineTocIndexes) {
+  Bytes bytes;
+  bytes.push_back(1);
+  put16(bytes, spineTocIndexes.size());
+  put16(bytes, toc.size());
+
+  uint32_t entryOffset = bytes.size() + sizeof(uint32_t) * toc.size() + sizeof(int16_t) * spineTocIndexes.size();
+  for (const auto& entry : toc) {
+    put32(bytes, entryOffset);
+    entryOffset += sizeof(uint32_t) * 3 + entry.title.size() + entry.href.size() + entry.anchor.size() +
+                   sizeof(uint8_t) + sizeof(int16_t);
+  }
+  for (const auto tocIndex : spineTocIndexes) {
+    put16(bytes, tocIndex);
+  }
+  for (const auto& entry : toc) {
+    putString(bytes, entry.title);
+    putString(bytes, entry.href);
+    putString(bytes, entry.anchor);
+    bytes.push_back(entry.level);
+    put16(bytes, entry.spineIndex);
+  }
+  return bytes;
+}
+
+// A TOC far bigger than one 1024 byte read, nested 12 deep, with entities and UTF-8 in its labels so some of them are
+// split across reads. Entries are spread evenly over the five spine items and every other one has an anchor.
+constexpr int LARGE_TOC_SIZE = 600;
+constexpr int LARGE_TOC_DEPTH = 12;
+const char* const SPINE_HREFS[] = {"text/intro.xhtml", "text/ch1.xhtml", "text/ch2.xhtml", "text/lost.xhtml",
+                                   "text/ch3.xhtml"};
+
+uint8_t largeTocLevel(const int index) {
+  // Walks down to the deepest level and back up one step at a time
+  const int step = index % (2 * (LARGE_TOC_DEPTH - 1));
+  return 1 + (step < LARGE_TOC_DEPTH ? step : 2 * (LARGE_TOC_DEPTH - 1) - step);
+}
+
+std::string largeTocNcx() {
+  std::string ncx = R"(<?xml version="1.0" encoding="UTF-8"?>
+<ncx xmlns="http://www.daisy.org/z3986/2005/ncx/" version="2005-1">
+  <navMap>
+)";
+  int open = 0;
+  for (int i = 0; i < LARGE_TOC_SIZE; i++) {
+    const int level = largeTocLevel(i);
+    for (; open >= level; open--) {
+      ncx += std::string(2 * open, ' ') + "</navPoint>\n";
+    }
+    const std::string indent(2 * level, ' ');
+    std::string src = SPINE_HREFS[i * 5 / LARGE_TOC_SIZE];
+    if (i % 2 == 1) {
+      src += "#a" + std::to_string(i);
+    }
+    ncx += indent + "<navPoint id=\"n" + std::to_string(i) + "\" playOrder=\"" + std::to_string(i + 1) + "\">\n";
+    ncx += indent + "  <navLabel><text>Entry " + std::to_string(i) + " &lt;&amp;&gt; \u00e9t\u00e9</text></navLabel>\n";
+    ncx += indent + "  <content src=\"" + src + "\"/>\n";
+    open++;
+  }
+  for (; open > 0; open--) {
+    ncx += std::string(2 * open, ' ') + "</navPoint>\n";
+  }
+  return ncx + "  </navMap>\n</ncx>\n";
+}
+
+std::vector<ExpectedTocEntry> largeToc() {
+  std::vector<ExpectedTocEntry> toc;
+  for (int i = 0; i < LARGE_TOC_SIZE; i++) {
+    const int16_t spineIndex = i * 5 / LARGE_TOC_SIZE;
+    toc.push_back({"Entry " + std::to_string(i) + " <&> \u00e9t\u00e9", std::string("OEBPS/") + SPINE_HREFS[spineIndex],
+                   i % 2 == 1 ? "a" + std::to_string(i) : "", largeTocLevel(i), spineIndex});
+  }
+  return toc;
+}
+// The first entry of each spine item
+const std::vector<int16_t> LARGE_SPINE_TOC_INDEXES = {0, 120, 240, 360, 480};
+
+void checkLargeToc(const bool deflated) {
+  const auto ncx = largeTocNcx();
+  TEST_ASSERT_GREATER_THAN(50 * 1024, ncx.size());
+  writeBook(ncx, deflated);
+
+  Epub epub(BOOK_PATH, CACHE_DIR);
+  TEST_ASSERT_TRUE(epub.load());
+  TEST_ASSERT_TRUE(epub.loadToc());
+
+  const auto tocBin = readFile(epub.getCachePath() + "/toc.bin");
+  const auto expectedToc = expectedTocBin(largeToc(), LARGE_SPINE_TOC_INDEXES);
+  TEST_ASSERT_EQUAL(expectedToc.size(), tocBin.size());
+  TEST_ASSERT_EQUAL_MEMORY(expectedToc.data(), tocBin.data(), expectedToc.size());
+}
+
+void checkLookups(const Epub& epub) {
+  TEST_ASSERT_EQUAL_STRING("A Synthetic Book", epub.getTitle().c_str());
+  TEST_ASSERT_EQUAL_STRING("Test Author", epub.getAuthor().c_str());
+  TEST_ASSERT_EQUAL(5, epub.getSpineItemsCount());
+  TEST_ASSERT_EQUAL(43623, epub.getBookSize());
+  TEST_ASSERT_EQUAL(1, epub.getSpineIndexForTextReference());
+  TEST_ASSERT_EQUAL_STRING("OEBPS/text/ch3.xhtml", epub.getSpineItem(4).href.c_str());
+
+  TEST_ASSERT_EQUAL(TOC.size(), epub.getTocItemsCount());
+  for (size_t i = 0; i < TOC.size(); i++) {
+    const auto entry = epub.getTocItem(i);
+    TEST_ASSERT_EQUAL_STRING(TOC[i].title.c_str(), entry.title.c_str());
+    TEST_ASSERT_EQUAL_STRING(TOC[i].anchor.c_str(), entry.anchor.c_str());
+    TEST_ASSERT_EQUAL(TOC[i].spineIndex, entry.spineIndex);
+    // Entries outside the spine go to the first chapter
+    TEST_ASSERT_EQUAL(TOC[i].spineIndex < 0 ? 0 : TOC[i].spineIndex, epub.getSpineIndexForTocIndex(i));
+  }
+  for (size_t i = 0; i < SPINE_TOC_INDEXES.size(); i++) {
+    TEST_ASSERT_EQUAL(SPINE_TOC_INDEXES[i], epub.getTocIndexForSpineIndex(i));
+  }
+}
+}  // namespace
+
+void setUp() {
+  FakeFs::instance().reset();
+  SdMan.mkdir(CACHE_DIR.c_str());
+  writeBook();
+}
+
+void tearDown() {}
+
+void test_book_bin_and_toc_bin_bytes() {
+  Epub epub(BOOK_PATH, CACHE_DIR);
+  TEST_ASSERT_TRUE(epub.load());
+  // The TOC is only built when first needed
+  TEST_ASSERT_FALSE(SdMan.exists((epub.getCachePath() + "/toc.bin").c_str()));
+  TEST_ASSERT_TRUE(epub.loadToc());
+
+  const auto bookBin = readFile(epub.getCachePath() + "/book.bin");
+  const auto tocBin = readFile(epub.getCachePath() + "/toc.bin");
+  const auto expectedBook = expectedBookBin();
+  const auto expectedToc = expectedTocBin(TOC, SPINE_TOC_INDEXES);
+  TEST_ASSERT_EQUAL(expectedBook.size(), bookBin.size());
+  TEST_ASSERT_EQUAL_MEMORY(expectedBook.data(), bookBin.data(), expectedBook.size());
+  TEST_ASSERT_EQUAL(expectedToc.size(), tocBin.size());
+  TEST_ASSERT_EQUAL_MEMORY(expectedToc.data(), tocBin.data(), expectedToc.size());
+
+  // No temp files are left behind in the cache
+  for (const auto& path : FakeFs::instance().children(epub.getCachePath())) {
+    TEST_ASSERT_TRUE_MESSAGE(path.find(".tmp") == std::string::npos, path.c_str());
+  }
+}
+
+void test_lookups_after_building() {
+  Epub epub(BOOK_PATH, CACHE_DIR);
+  TEST_ASSERT_TRUE(epub.load());
+  TEST_ASSERT_TRUE(epub.loadToc());
+  checkLookups(epub);
+}
+
+void test_lookups_from_the_cache() {
+  {
+    Epub epub(BOOK_PATH, CACHE_DIR);
+    TEST_ASSERT_TRUE(epub.load());
+    TEST_ASSERT_TRUE(epub.loadToc());
+  }
+
+  // Opened again, everything comes from book.bin and toc.bin without building
+  Epub epub(BOOK_PATH, CACHE_DIR);
+  TEST_ASSERT_TRUE(epub.load(false));
+  TEST_ASSERT_TRUE(epub.isTocLoaded());
+  checkLookups(epub);
+}
+
+// toc.ncx is inflated straight into the parser, a large one gives the same toc.bin whether it's stored or deflated
+void test_large_stored_toc_ncx() { checkLargeToc(false); }
+
+void test_large_deflated_toc_ncx() { checkLargeToc(true); }
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_book_bin_and_toc_bin_bytes);
+  RUN_TEST(test_lookups_after_building);
+  RUN_TEST(test_lookups_from_the_cache);
+  RUN_TEST(test_large_stored_toc_ncx);
+  RUN_TEST(test_large_deflated_toc_ncx);
+  return UNITY_END();
+}
@@ -0,0 +1,217 @@
+#include <Epub/htmlEntities.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+// Decoded in a buffer of exactly the text's size, so writing past its end is caught by the sanitizers
+std::string decode(const std::string& text) {
+  std::unique_ptr<char[]> buffer(new char[text.size()]);
+  std::copy(text.begin(), text.end(), buffer.get());
+  const size_t length = decodeHtmlEntities(buffer.get(), text.size());
+  TEST_ASSERT_LESS_OR_EQUAL(text.size(), length);
+  return std::string(buffer.get(), length);
+}
+
+void checkDecodes(const std::string& text, const std::string& expected) {
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.c_str(), decode(text).c_str(), text.c_str());
+}
+
+void checkUnchanged(const std::string& text) { checkDecodes(text, text); }
+
+std::string reference(const std::string& digits) {
+  char out[4];
+  const size_t length = decodeCharacterReference(digits.data(), digits.size(), out);
+  TEST_ASSERT_LESS_OR_EQUAL(4, length);
+  return std::string(out, length);
+}
+
+// Fragments and what they decode to. Each either ends with a ';' or is text without an '&', and a fragment that
+// doesn't decode is followed by a space, so they decode the same on their own as next to each other.
+const std::vector<std::pair<std::string, std::string>> FRAGMENTS = {
+    {"&amp;", "&"},
+    {"&lt;", "<"},
+    {"&gt;", ">"},
+    {"&quot;", "\""},
+    {"&eacute;", "\xC3\xA9"},
+    {"&Eacute;", "\xC3\x89"},
+    {"&hellip;", "\xE2\x80\xA6"},
+    {"&thetasym;", "\xCF\x91"},
+    {"&emsp;", ""},
+    {"&nbsp;", " "},
+    {"&#160;", " "},
+    {"&#65;", "A"},
+    {"&#x42;", "B"},
+    {"&#X43;", "C"},
+    {"&#233;", "\xC3\xA9"},
+    {"&#x20AC;", "\xE2\x82\xAC"},
+    {"&#x1F600;", "\xF0\x9F\x98\x80"},
+    {"&#65536;", "\xF0\x90\x80\x80"},
+    {"&#x10FFFF;", "\xF4\x8F\xBF\xBF"},
+    {"&#xD800; ", "&#xD800; "},
+    {"&#57343; ", "&#57343; "},
+    {"&#x110000; ", "&#x110000; "},
+    {"&#0; ", "&#0; "},
+    {"&#160lt; ", "&#160lt; "},
+    {"&bogus; ", "&bogus; "},
+    {"&AMP; ", "&AMP; "},
+    {"&; ", "&; "},
+    {"&#; ", "&#; "},
+    {"&#x; ", "&#x; "},
+    {"&amp ", "&amp "},
+    {"&#233 ", "&#233 "},
+    {"& ", "& "},
+    {"plain text ", "plain text "},
+    {"\xC3\xA9t\xC3\xA9", "\xC3\xA9t\xC3\xA9"},
+    {"a;b", "a;b"},
+};
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_named_entities() {
+  checkDecodes("&amp;&lt;&gt;&quot;", "&<>\"");
+  checkDecodes("caf&eacute; &AElig;sop &Omega;&omega;", "caf\xC3\xA9 \xC3\x86sop \xCE\xA9\xCF\x89");
+  checkDecodes("a&mdash;b&ndash;c&hellip;", "a\xE2\x80\x94" "b\xE2\x80\x93" "c\xE2\x80\xA6");
+  checkDecodes("&ldquo;quoted&rdquo; &lsquo;single&rsquo;",
+               "\xE2\x80\x9Cquoted\xE2\x80\x9D \xE2\x80\x98single\xE2\x80\x99");
+  // First and last in the table, and the longest name
+  checkDecodes("&AElig;&zwnj;&thetasym;", "\xC3\x86\xE2\x80\x8C\xCF\x91");
+  // Names are case sensitive
+  checkDecodes("&Eacute;&eacute;", "\xC3\x89\xC3\xA9");
+  checkUnchanged("&EACUTE;");
+  checkUnchanged("&Amp;");
+  // A non-breaking space is laid out as a space, soft hyphens and zero width joiners are kept
+  checkDecodes("a&nbsp;b", "a b");
+  checkDecodes("&shy;&zwj;", "\xC2\xAD\xE2\x80\x8D");
+  checkDecodes("a&emsp;b&thinsp;c", "abc");
+}
+
+void test_numeric_references() {
+  checkDecodes("&#65;&#97;&#48;", "Aa0");
+  checkDecodes("&#233;&#8212;&#128512;", "\xC3\xA9\xE2\x80\x94\xF0\x9F\x98\x80");
+  checkDecodes("&#0000065;", "A");
+  checkDecodes("&#160;", " ");
+  checkDecodes("&#9;&#10;", "\t\n");
+}
+
+void test_hex_references() {
+  checkDecodes("&#x41;&#X42;&#xe9;&#xE9;", "AB\xC3\xA9\xC3\xA9");
+  checkDecodes("&#x2014;&#x1f600;&#x1F600;", "\xE2\x80\x94\xF0\x9F\x98\x80\xF0\x9F\x98\x80");
+  checkDecodes("&#xA0;", " ");
+  checkDecodes("&#x0000041;", "A");
+}
+
+void test_utf8_length_boundaries() {
+  TEST_ASSERT_EQUAL_STRING("\x7F", reference("127").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xC2\x80", reference("x80").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xDF\xBF", reference("x7FF").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xE0\xA0\x80", reference("x800").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xED\x9F\xBF", reference("xD7FF").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xEE\x80\x80", reference("xE000").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xEF\xBF\xBF", reference("xFFFF").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xF0\x90\x80\x80", reference("x10000").c_str());
+  TEST_ASSERT_EQUAL_STRING("\xF4\x8F\xBF\xBF", reference("1114111").c_str());
+}
+
+void test_invalid_references_are_rejected() {
+  // Surrogates, past U+10FFFF, zero, and digits that overflow 32 bits
+  for (const char* digits : {"xD800", "xDBFF", "xDC00", "xDFFF", "55296", "57343", "x110000", "1114112", "xFFFFFFFF",
+                             "99999999999999999999", "x100000000000041", "0", "x0", "00"}) {
+    TEST_ASSERT_EQUAL_MESSAGE(0, reference(digits).size(), digits);
+    checkUnchanged("&#" + std::string(digits) + ";");
+  }
+  // Not digits, or digits followed by something else
+  for (const char* digits : {"", "x", "X", "-1", "+1", " 65", "65 ", "6 5", "1e3", "65.0", "x41g", "xg41", "160lt",
+                             "12a", "a12", "xx41", "#65"}) {
+    TEST_ASSERT_EQUAL_MESSAGE(0, reference(digits).size(), digits);
+    checkUnchanged("&#" + std::string(digits) + ";");
+  }
+}
+
+void test_malformed_entities_are_left_as_written() {
+  checkUnchanged("&");
+  checkUnchanged("&;");
+  checkUnchanged("&a;");
+  checkUnchanged("&bogus;");
+  checkUnchanged("fish & chips; AT&T");
+  checkUnchanged("&&&;;;");
+  checkUnchanged("& amp;");
+  checkUnchanged("&am p;");
+  checkUnchanged("&amp ;");
+  // Longer than any name in the table, the ';' is too far off to be looked for
+  checkUnchanged("&thetasymX;");
+  checkUnchanged("&#x00000041;");
+  checkUnchanged("&abcdefghijklmnopqrstuvwxyz;");
+  // A malformed entity leaves the ones after it alone
+  checkDecodes("&bogus&amp;", "&bogus&");
+  checkDecodes("&#xZZ;&#65;", "&#xZZ;A");
+}
+
+void test_truncated_entities() {
+  checkUnchanged("&amp");
+  checkUnchanged("&#233");
+  checkUnchanged("&#x");
+  checkUnchanged("&#");
+  checkUnchanged("text&");
+  checkUnchanged("text&l");
+  checkDecodes("&lt;&gt", "<&gt");
+  checkDecodes("&amp &lt;", "&amp <");
+  checkDecodes("&#233 &#233;", "&#233 \xC3\xA9");
+}
+
+void test_adjacent_entities() {
+  checkDecodes("&lt;&gt;&amp;&#65;&#x42;&eacute;", "<>&AB\xC3\xA9");
+  checkDecodes("a&amp;b&amp;c", "a&b&c");
+  checkDecodes("&#x1F600;&#x1F600;&#x1F600;", "\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80");
+  // Each entity is decoded once, what it decodes to isn't looked at again
+  checkDecodes("&amp;lt;", "&lt;");
+  checkDecodes("&amp;amp;amp;", "&amp;amp;");
+  checkDecodes("&amp;#65;", "&#65;");
+  checkDecodes("&&amp;;", "&&;");
+}
+
+// Decoded text is never longer than the text it came from, so decoding in place never writes ahead of what is still to
+// be read, whatever entities come next to each other
+void test_in_place_decoding_only_shrinks() {
+  std::mt19937 random(23);
+  for (int run = 0; run < 20000; run++) {
+    std::string text;
+    std::string expected;
+    const int count = 1 + random() % 40;
+    for (int i = 0; i < count; i++) {
+      const auto& fragment = FRAGMENTS[random() % FRAGMENTS.size()];
+      text += fragment.first;
+      expected += fragment.second;
+    }
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.c_str(), decode(text).c_str(), text.c_str());
+  }
+
+  // The longest UTF-8 from the shortest reference that gives it
+  checkDecodes("&#65536;", "\xF0\x90\x80\x80");
+  checkDecodes("&or;&ne;", "\xE2\x88\xA8\xE2\x89\xA0");
+  // Nothing to decode, nothing moves
+  checkUnchanged("");
+  checkUnchanged("no entities at all");
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_named_entities);
+  RUN_TEST(test_numeric_references);
+  RUN_TEST(test_hex_references);
+  RUN_TEST(test_utf8_length_boundaries);
+  RUN_TEST(test_invalid_references_are_rejected);
+  RUN_TEST(test_malformed_entities_are_left_as_written);
+  RUN_TEST(test_truncated_entities);
+  RUN_TEST(test_adjacent_entities);
+  RUN_TEST(test_in_place_decoding_only_shrinks);
+  return UNITY_END();
+}
@@ -0,0 +1,435 @@
+#include <Inflater.h>
+#include <miniz.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Differential tests of the inflater against miniz's tinfl, which it replaced: every stream must inflate to the same
+// bytes through both, and a stream tinfl rejects must be rejected too.
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+// Deflated by miniz, raw deflate as in a zip entry
+Bytes deflate(const Bytes& data, const int flags) {
+  size_t size = 0;
+  void* compressed = tdefl_compress_mem_to_heap(data.data(), data.size(), &size, flags);
+  TEST_ASSERT_NOT_NULL(compressed);
+  const auto bytes = static_cast<const uint8_t*>(compressed);
+  Bytes out(bytes, bytes + size);
+  mz_free(compressed);
+  return out;
+}
+
+// Output room for streams whose inflated size isn't known, e.g. corrupted ones
+constexpr size_t OUTPUT_SLACK = 65536;
+
+bool tinflate(const Bytes& input, const size_t outputSize, Bytes* output) {
+  output->assign(outputSize, 0);
+  const size_t size = tinfl_decompress_mem_to_mem(output->data(), output->size(), input.data(), input.size(), 0);
+  if (size == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED) {
+    output->clear();
+    return false;
+  }
+  output->resize(size);
+  return true;
+}
+
+// One shot mode, the way readFileToMemory inflates
+bool inflateOneShot(const Bytes& input, const size_t outputSize, Bytes* output) {
+  output->assign(outputSize, 0);
+  Inflater inflater;
+  TEST_ASSERT_TRUE(inflater.begin(input.data(), input.size(), output->data(), output->size()));
+  const uint8_t* data;
+  size_t size;
+  const auto status = inflater.read(&data, &size);
+  inflater.end();
+  output->resize(size);
+  return status == Inflater::Status::Done;
+}
+
+struct ChunkedInput {
+  const Bytes& bytes;
+  size_t position;
+  size_t chunkSize;
+};
+
+size_t refillChunk(void* context, uint8_t* buffer, const size_t size) {
+  auto* input = static_cast<ChunkedInput*>(context);
+  size_t count = input->bytes.size() - input->position;
+  count = count < size ? count : size;
+  count = count < input->chunkSize ? count : input->chunkSize;
+  if (count > 0) {
+    memcpy(buffer, input->bytes.data() + input->position, count);
+  }
+  input->position += count;
+  return count;
+}
+
+// Streaming mode, the way entries are read, with the compressed bytes handed over chunkSize at a time
+bool inflateStreamed(const Bytes& input, const size_t chunkSize, Bytes* output) {
+  output->clear();
+  ChunkedInput chunked{input, 0, chunkSize};
+  Inflater inflater;
+  TEST_ASSERT_TRUE(inflater.begin(Inflater::INPUT_BUFFER_SIZE, refillChunk, &chunked));
+  auto status = Inflater::Status::More;
+  // A stream that never ends can't produce more than the window per read without consuming input
+  for (size_t reads = 0; status == Inflater::Status::More && reads < 1 << 20; reads++) {
+    const uint8_t* data;
+    size_t size;
+    status = inflater.read(&data, &size);
+    output->insert(output->end(), data, data + size);
+  }
+  inflater.end();
+  return status == Inflater::Status::Done;
+}
+
+// Inflates through tinfl and both inflater modes and checks they agree with each other and with the original
+void checkStream(const Bytes& original, const Bytes& compressed, const size_t chunkSize) {
+  Bytes expected, oneShot, streamed;
+  TEST_ASSERT_TRUE(tinflate(compressed, original.size(), &expected));
+  TEST_ASSERT_TRUE(expected == original);
+  TEST_ASSERT_TRUE(inflateOneShot(compressed, original.size(), &oneShot));
+  TEST_ASSERT_TRUE(oneShot == expected);
+  TEST_ASSERT_TRUE(inflateStreamed(compressed, chunkSize, &streamed));
+  TEST_ASSERT_TRUE(streamed == expected);
+}
+
+Bytes randomBytes(std::mt19937& random, const size_t size) {
+  Bytes bytes(size);
+  for (auto& byte : bytes) {
+    byte = static_cast<uint8_t>(random());
+  }
+  return bytes;
+}
+
+// Words from a small vocabulary, compresses like chapter text
+Bytes text(std::mt19937& random, const size_t size) {
+  static const char* const words[] = {"the ", "reader ", "<p>", "</p>\n", "page ", "chapter ", "and ", "of ",
+                                      "a ",   "light ",  "ink ", "e ",    "paper ", "turned ", "quietly ", "."};
+  Bytes bytes;
+  while (bytes.size() < size) {
+    const char* word = words[random() % (sizeof(words) / sizeof(words[0]))];
+    bytes.insert(bytes.end(), word, word + strlen(word));
+  }
+  bytes.resize(size);
+  return bytes;
+}
+
+// Long runs of a few byte values, lots of overlapping matches
+Bytes runs(std::mt19937& random, const size_t size) {
+  Bytes bytes;
+  while (bytes.size() < size) {
+    bytes.insert(bytes.end(), 1 + random() % 600, static_cast<uint8_t>(random() % 4));
+  }
+  bytes.resize(size);
+  return bytes;
+}
+
+// Writes a deflate stream by hand, for streams a compressor won't produce
+class BitWriter {
+  uint32_t bitBuffer = 0;
+  int bitCount = 0;
+
+ public:
+  Bytes bytes;
+
+  void bits(const uint32_t value, const int count) {
+    for (int i = 0; i < count; i++) {
+      bitBuffer |= ((value >> i) & 1) << bitCount;
+      if (++bitCount == 8) {
+        bytes.push_back(static_cast<uint8_t>(bitBuffer));
+        bitBuffer = 0;
+        bitCount = 0;
+      }
+    }
+  }
+
+  // Huffman codes are packed starting with their most significant bit
+  void code(const uint32_t value, const int length) {
+    for (int i = length - 1; i >= 0; i--) {
+      bits((value >> i) & 1, 1);
+    }
+  }
+
+  void alignToByte() {
+    if (bitCount > 0) {
+      bits(0, 8 - bitCount);
+    }
+  }
+
+  void storedBlock(const Bytes& data, const bool final) {
+    bits(final ? 1 : 0, 1);
+    bits(0, 2);
+    alignToByte();
+    bits(data.size(), 16);
+    bits(~data.size() & 0xFFFF, 16);
+    bytes.insert(bytes.end(), data.begin(), data.end());
+  }
+
+  void fixedBlockHeader(const bool final) {
+    bits(final ? 1 : 0, 1);
+    bits(1, 2);
+  }
+
+  void fixedSymbol(const int symbol) {
+    if (symbol < 144) {
+      code(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      code(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      code(symbol - 256, 7);
+    } else {
+      code(0xC0 + symbol - 280, 8);
+    }
+  }
+
+  void fixedMatch(const int length, const int distance) {
+    static const uint16_t lengthBase[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                          31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                          2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t distanceBase[] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                            33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                            1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int lengthCode = 28;
+    while (lengthBase[lengthCode] > length) {
+      lengthCode--;
+    }
+    fixedSymbol(257 + lengthCode);
+    bits(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+    int distanceCode = 29;
+    while (distanceBase[distanceCode] > distance) {
+      distanceCode--;
+    }
+    code(distanceCode, 5);
+    bits(distance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+  }
+};
+
+void appendMatch(Bytes& bytes, const int length, const int distance) {
+  for (int i = 0; i < length; i++) {
+    bytes.push_back(bytes[bytes.size() - distance]);
+  }
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_stored_blocks() {
+  std::mt19937 random(3);
+  for (const size_t size : {0, 1, 65535, 65536, 200000}) {
+    const auto data = randomBytes(random, size);
+    checkStream(data, deflate(data, 128 | TDEFL_FORCE_ALL_RAW_BLOCKS), 4096);
+    checkStream(data, deflate(data, 128 | TDEFL_FORCE_ALL_RAW_BLOCKS), 1);
+  }
+}
+
+void test_fixed_blocks() {
+  std::mt19937 random(5);
+  for (const size_t size : {1, 100, 40000, 300000}) {
+    const auto data = text(random, size);
+    checkStream(data, deflate(data, 128 | TDEFL_FORCE_ALL_STATIC_BLOCKS), 4096);
+    checkStream(data, deflate(data, 128 | TDEFL_FORCE_ALL_STATIC_BLOCKS), 7);
+  }
+}
+
+void test_dynamic_blocks() {
+  std::mt19937 random(7);
+  for (const int probes : {1, 16, 128, 4095}) {
+    const auto data = text(random, 500000);
+    checkStream(data, deflate(data, probes), 4096);
+    checkStream(data, deflate(data, probes | TDEFL_GREEDY_PARSING_FLAG), 333);
+    const auto repeated = runs(random, 300000);
+    checkStream(repeated, deflate(repeated, probes), 4096);
+  }
+}
+
+void test_random_generated_streams() {
+  std::mt19937 random(11);
+  for (int i = 0; i < 200; i++) {
+    const size_t size = random() % 3 == 0 ? random() % 64 : random() % 150000;
+    Bytes data;
+    switch (random() % 4) {
+      case 0:
+        data = randomBytes(random, size);
+        break;
+      case 1:
+        data = text(random, size);
+        break;
+      case 2:
+        data = runs(random, size);
+        break;
+      default:
+        // Text with random bytes mixed in, so blocks switch between kinds
+        data = text(random, size);
+        for (size_t j = 0; j < data.size(); j += 1 + random() % 5000) {
+          const auto noise = randomBytes(random, random() % 3000);
+          std::copy(noise.begin(), noise.begin() + std::min(noise.size(), data.size() - j), data.begin() + j);
+        }
+    }
+    static const int flags[] = {1, 6, 32, 128, 4095, 128 | TDEFL_FORCE_ALL_STATIC_BLOCKS,
+                                128 | TDEFL_FORCE_ALL_RAW_BLOCKS, 128 | TDEFL_GREEDY_PARSING_FLAG,
+                                128 | TDEFL_RLE_MATCHES, 128 | TDEFL_FILTER_MATCHES};
+    const auto compressed = deflate(data, flags[random() % (sizeof(flags) / sizeof(flags[0]))]);
+    checkStream(data, compressed, 1 + random() % 4096);
+  }
+}
+
+void test_back_references_at_the_window_boundary() {
+  std::mt19937 random(13);
+  BitWriter writer;
+  // 40000 literal bytes, more than the window
+  Bytes expected = randomBytes(random, 40000);
+  writer.storedBlock(expected, false);
+
+  writer.fixedBlockHeader(true);
+  // Farthest reach back, at the shortest and longest lengths
+  for (const int length : {3, 258, 100, 4, 258}) {
+    writer.fixedMatch(length, 32768);
+    appendMatch(expected, length, 32768);
+  }
+  // Matches longer than their distance repeat the bytes just written
+  for (const int distance : {1, 2, 3, 7}) {
+    writer.fixedMatch(258, distance);
+    appendMatch(expected, 258, distance);
+  }
+  // Enough far matches for the streaming ring to wrap partway through some of them
+  for (int i = 0; i < 400; i++) {
+    const int length = 3 + random() % 256;
+    const int distance = 32768 - random() % 300;
+    writer.fixedMatch(length, distance);
+    appendMatch(expected, length, distance);
+    writer.fixedSymbol(expected.back() ^ 0x5A);
+    expected.push_back(expected.back() ^ 0x5A);
+  }
+  writer.fixedSymbol(256);
+  writer.alignToByte();
+
+  for (const size_t chunkSize : {1, 5, 4096}) {
+    checkStream(expected, writer.bytes, chunkSize);
+  }
+}
+
+void test_distance_past_the_start_is_rejected() {
+  BitWriter writer;
+  writer.fixedBlockHeader(true);
+  for (const char c : std::string("abc")) {
+    writer.fixedSymbol(c);
+  }
+  writer.fixedMatch(10, 4);
+  writer.fixedSymbol(256);
+  writer.alignToByte();
+
+  Bytes output;
+  TEST_ASSERT_FALSE(tinflate(writer.bytes, OUTPUT_SLACK, &output));
+  TEST_ASSERT_FALSE(inflateOneShot(writer.bytes, OUTPUT_SLACK, &output));
+  TEST_ASSERT_FALSE(inflateStreamed(writer.bytes, 4096, &output));
+}
+
+void test_truncated_streams_are_rejected() {
+  std::mt19937 random(17);
+  const auto data = text(random, 20000);
+  for (const int flags : {128, 128 | TDEFL_FORCE_ALL_STATIC_BLOCKS, 128 | TDEFL_FORCE_ALL_RAW_BLOCKS}) {
+    const auto compressed = deflate(data, flags);
+    for (size_t cut = 0; cut < compressed.size(); cut += 1 + cut / 64) {
+      const Bytes truncated(compressed.begin(), compressed.begin() + cut);
+      Bytes expected, oneShot, streamed;
+      TEST_ASSERT_FALSE(tinflate(truncated, data.size(), &expected));
+      TEST_ASSERT_FALSE(inflateOneShot(truncated, data.size(), &oneShot));
+      TEST_ASSERT_FALSE(inflateStreamed(truncated, 1 + cut % 700, &streamed));
+      // Whatever came out before the stream ran dry is still the start of the entry
+      TEST_ASSERT_TRUE(oneShot.size() <= data.size() && std::equal(oneShot.begin(), oneShot.end(), data.begin()));
+      TEST_ASSERT_TRUE(streamed.size() <= data.size() && std::equal(streamed.begin(), streamed.end(), data.begin()));
+    }
+  }
+}
+
+void test_corrupted_streams_match_tinfl() {
+  std::mt19937 random(19);
+  int rejected = 0;
+  int unassignedCodes = 0;
+  for (int i = 0; i < 1500; i++) {
+    const auto data = random() % 2 ? text(random, random() % 30000) : runs(random, random() % 30000);
+    auto compressed = deflate(data, i % 3 == 0 ? 128 | TDEFL_FORCE_ALL_STATIC_BLOCKS : 128);
+    if (compressed.empty()) {
+      continue;
+    }
+    // Damage in the block header and code length tables is the most interesting, so the start is hit most often
+    const size_t header = std::min<size_t>(compressed.size(), 64);
+    const size_t damaged = random() % 2 ? random() % header : random() % compressed.size();
+    compressed[damaged] ^= static_cast<uint8_t>(1 + random() % 255);
+
+    Bytes expected, oneShot, streamed;
+    const bool accepted = tinflate(compressed, data.size() + OUTPUT_SLACK, &expected);
+    const bool oneShotAccepted = inflateOneShot(compressed, data.size() + OUTPUT_SLACK, &oneShot);
+    const bool streamedAccepted = inflateStreamed(compressed, 1 + random() % 4096, &streamed);
+    TEST_ASSERT_EQUAL(oneShotAccepted, streamedAccepted);
+    if (!accepted) {
+      TEST_ASSERT_FALSE(oneShotAccepted);
+      rejected++;
+    } else if (oneShotAccepted) {
+      TEST_ASSERT_TRUE(oneShot == expected);
+      TEST_ASSERT_TRUE(streamed == expected);
+    } else {
+      // tinfl decodes a bit pattern that no code of an incomplete Huffman table was assigned as symbol 0, where the
+      // inflater (like zlib) rejects it. Up to there both produce the same bytes.
+      TEST_ASSERT_TRUE(oneShot.size() <= expected.size() &&
+                       std::equal(oneShot.begin(), oneShot.end(), expected.begin()));
+      TEST_ASSERT_TRUE(streamed.size() <= expected.size() &&
+                       std::equal(streamed.begin(), streamed.end(), expected.begin()));
+      unassignedCodes++;
+    }
+  }
+  // Most damage is caught, make sure the comparison isn't only ever of two successes
+  TEST_ASSERT_GREATER_THAN(100, rejected);
+  TEST_ASSERT_LESS_THAN(rejected / 10, unassignedCodes);
+}
+
+void test_throughput() {
+  std::mt19937 random(23);
+  const auto data = text(random, 8 * 1024 * 1024);
+  const auto compressed = deflate(data, 128);
+
+  const auto megabytesPerSecond = [&](const std::function<bool(Bytes*)>& inflate) {
+    Bytes output;
+    const auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(inflate(&output));
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_TRUE(output == data);
+    return data.size() / seconds / (1024 * 1024);
+  };
+  const double tinfl = megabytesPerSecond([&](Bytes* output) { return tinflate(compressed, data.size(), output); });
+  const double oneShot =
+      megabytesPerSecond([&](Bytes* output) { return inflateOneShot(compressed, data.size(), output); });
+  const double streamed = megabytesPerSecond([&](Bytes* output) { return inflateStreamed(compressed, 4096, output); });
+
+  char message[160];
+  snprintf(message, sizeof(message), "Inflated MB/s: tinfl %.1f, inflater one shot %.1f, streamed %.1f", tinfl,
+           oneShot, streamed);
+  TEST_MESSAGE(message);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stored_blocks);
+  RUN_TEST(test_fixed_blocks);
+  RUN_TEST(test_dynamic_blocks);
+  RUN_TEST(test_random_generated_streams);
+  RUN_TEST(test_back_references_at_the_window_boundary);
+  RUN_TEST(test_distance_past_the_start_is_rejected);
+  RUN_TEST(test_truncated_streams_are_rejected);
+  RUN_TEST(test_corrupted_streams_match_tinfl);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,513 @@
+#include <Epub.h>
+#include <Epub/Page.h>
+#include <Epub/Section.h>
+#include <GfxRenderer.h>
+#include <SDCardManager.h>
+#include <ZipWriter.h>
+#include <builtinFonts/bookerly_12_bold.h>
+#include <builtinFonts/bookerly_12_bolditalic.h>
+#include <builtinFonts/bookerly_12_italic.h>
+#include <builtinFonts/bookerly_12_regular.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+const std::string BOOK_PATH = "/book.epub";
+const std::string CACHE_DIR = "/.crosspoint";
+
+constexpr int FONT_ID = 1;
+constexpr float LINE_COMPRESSION = 1.0f;
+constexpr bool EXTRA_PARAGRAPH_SPACING = true;
+constexpr uint16_t VIEWPORT_WIDTH = 464;
+constexpr uint16_t VIEWPORT_HEIGHT = 760;
+// The reader's background build: 1KB steps in 50ms slices. A step is about 8ms of parsing and layout on the device.
+constexpr size_t STEP_BYTES = 1024;
+constexpr unsigned long SLICE_MS = 50;
+constexpr unsigned long STEP_MS = 8;
+
+const char CONTAINER_XML[] = R"(<?xml version="1.0"?>
+<container version="1.0" xmlns="urn:oasis:names:tc:opendocument:xmlns:container">
+  <rootfiles>
+    <rootfile full-path="OEBPS/content.opf" media-type="application/oebps-package+xml"/>
+  </rootfiles>
+</container>
+)";
+
+const char CONTENT_OPF[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="2.0" unique-identifier="book-id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:title>Sections</dc:title>
+  </metadata>
+  <manifest>
+    <item id="ch0" href="ch0.xhtml" media-type="application/xhtml+xml"/>
+    <item id="ch1" href="ch1.xhtml" media-type="application/xhtml+xml"/>
+  </manifest>
+  <spine>
+    <itemref idref="ch0"/>
+    <itemref idref="ch1"/>
+  </spine>
+</package>
+)";
+
+constexpr int PARAGRAPHS = 150;
+
+// Paragraphs whose start also has an id used twice in the chapter
+constexpr int TWICE_FIRST = 10;
+constexpr int TWICE_SECOND = PARAGRAPHS - 10;
+
+// Every paragraph has an id, so most pages have several of them
+std::string chapter(const int number) {
+  std::string html = "<html><body><h1 id=\"top\">Chapter " + std::to_string(number) + "</h1>";
+  for (int i = 0; i < PARAGRAPHS; i++) {
+    html += "<p id=\"p" + std::to_string(i) + "\">";
+    if (i == TWICE_FIRST || i == TWICE_SECOND) {
+      html += "<a id=\"twice\"></a>";
+    }
+    html += "Paragraph " + std::to_string(i) + " of chapter " + std::to_string(number) + ".";
+    for (int word = 0; word < 20 + i % 30; word++) {
+      html += " word" + std::to_string((i * 31 + word) % 97);
+    }
+    html += "</p>";
+  }
+  return html + "</body></html>";
+}
+
+void writeBook() {
+  ZipWriter writer;
+  writer.add("mimetype", std::string("application/epub+zip"), false);
+  writer.add("META-INF/container.xml", std::string(CONTAINER_XML), true);
+  writer.add("OEBPS/content.opf", std::string(CONTENT_OPF), true);
+  writer.add("OEBPS/ch0.xhtml", chapter(0), true);
+  writer.add("OEBPS/ch1.xhtml", chapter(1), true);
+  writer.finish();
+
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", BOOK_PATH, file));
+  file.write(writer.bytes.data(), writer.bytes.size());
+  file.close();
+}
+
+Bytes readFile(const std::string& path) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForRead("TST", path, file));
+  Bytes bytes(file.size());
+  file.read(bytes.data(), bytes.size());
+  file.close();
+  return bytes;
+}
+
+EpdFont regularFont(&bookerly_12_regular);
+EpdFont boldFont(&bookerly_12_bold);
+EpdFont italicFont(&bookerly_12_italic);
+EpdFont boldItalicFont(&bookerly_12_bolditalic);
+
+EInkDisplay display;
+GfxRenderer renderer(display);
+std::shared_ptr<Epub> epub;
+
+std::unique_ptr<Section> makeSection(const int spineIndex) {
+  return std::unique_ptr<Section>(new Section(epub, spineIndex, renderer));
+}
+
+bool begin(Section& section) {
+  return section.beginSectionFile(FONT_ID, LINE_COMPRESSION, EXTRA_PARAGRAPH_SPACING, VIEWPORT_WIDTH,
+                                  VIEWPORT_HEIGHT);
+}
+
+bool load(Section& section) {
+  return section.loadSectionFile(FONT_ID, LINE_COMPRESSION, EXTRA_PARAGRAPH_SPACING, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+}
+
+std::string sectionPath(const int spineIndex) {
+  return Section::getLayoutDir(*epub, FONT_ID, LINE_COMPRESSION, EXTRA_PARAGRAPH_SPACING, VIEWPORT_WIDTH,
+                               VIEWPORT_HEIGHT) +
+         "/" + std::to_string(spineIndex) + ".bin";
+}
+
+std::string tokensPath(const int spineIndex) {
+  return epub->getCachePath() + "/tokens/" + std::to_string(spineIndex) + ".bin";
+}
+
+// Steps a build to its end, returns how many steps it took
+int finish(Section& section) {
+  int steps = 1;
+  auto status = section.continueSectionFile(STEP_BYTES);
+  for (; status == Section::BuildStatus::InProgress; steps++) {
+    status = section.continueSectionFile(STEP_BYTES);
+  }
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Done), static_cast<int>(status));
+  return steps;
+}
+
+Bytes serialize(const Page& page) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", "/page.bin", file));
+  TEST_ASSERT_TRUE(page.serialize(file));
+  file.close();
+  return readFile("/page.bin");
+}
+
+// Whether a page has the first words of a paragraph, an anchor lands on the page of the word that follows it
+bool startsParagraph(const Page& page, const int paragraph) {
+  const auto bytes = serialize(page);
+  // Words are stored one after the other, each with its length before it
+  Bytes words;
+  for (const std::string& word : {std::string("Paragraph"), std::to_string(paragraph)}) {
+    put32(words, word.size());
+    words.insert(words.end(), word.begin(), word.end());
+  }
+  return std::search(bytes.begin(), bytes.end(), words.begin(), words.end()) != bytes.end();
+}
+
+std::unique_ptr<Page> loadPage(Section& section, const int page) {
+  section.currentPage = page;
+  auto loaded = section.loadPageFromSectionFile();
+  TEST_ASSERT_NOT_NULL(loaded.get());
+  return loaded;
+}
+
+// One idle slice of the reader, as EpubReaderActivity::continueBuildSlice does it
+Section::BuildStatus runSlice(Section& section) {
+  const unsigned long start = millis();
+  auto status = Section::BuildStatus::InProgress;
+  while (status == Section::BuildStatus::InProgress && millis() - start < SLICE_MS) {
+    status = section.continueSectionFile(STEP_BYTES);
+    fakeMillis() += STEP_MS;
+  }
+  return status;
+}
+}  // namespace
+
+void setUp() {
+  FakeFs::instance().reset();
+  fakeMillis() = 0;
+  SdMan.mkdir(CACHE_DIR.c_str());
+  writeBook();
+  renderer.insertFont(FONT_ID, EpdFontFamily(&regularFont, &boldFont, &italicFont, &boldItalicFont));
+  epub = std::make_shared<Epub>(BOOK_PATH, CACHE_DIR);
+  TEST_ASSERT_TRUE(epub->load());
+}
+
+void tearDown() { epub.reset(); }
+
+void test_continue_without_begin_fails() {
+  auto section = makeSection(0);
+  TEST_ASSERT_FALSE(section->isBuilding());
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Failed),
+                    static_cast<int>(section->continueSectionFile(STEP_BYTES)));
+}
+
+void test_built_in_steps_matches_built_at_once() {
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*section));
+  TEST_ASSERT_TRUE(section->isBuilding());
+  TEST_ASSERT_TRUE(section->isPaginating());
+  TEST_ASSERT_GREATER_THAN(10, finish(*section));
+  TEST_ASSERT_FALSE(section->isBuilding());
+  const auto stepped = readFile(sectionPath(0));
+  const auto pageCount = section->pageCount;
+  TEST_ASSERT_GREATER_THAN(5, pageCount);
+
+  // Parsed again rather than replayed from the tokens the first build recorded
+  SdMan.remove(tokensPath(0).c_str());
+  auto again = makeSection(0);
+  TEST_ASSERT_TRUE(again->createSectionFile(FONT_ID, LINE_COMPRESSION, EXTRA_PARAGRAPH_SPACING, VIEWPORT_WIDTH,
+                                            VIEWPORT_HEIGHT));
+  const auto atOnce = readFile(sectionPath(0));
+  TEST_ASSERT_EQUAL(stepped.size(), atOnce.size());
+  TEST_ASSERT_EQUAL_MEMORY(stepped.data(), atOnce.data(), stepped.size());
+
+  auto loaded = makeSection(0);
+  TEST_ASSERT_TRUE(load(*loaded));
+  TEST_ASSERT_EQUAL(pageCount, loaded->pageCount);
+  TEST_ASSERT_FALSE(loaded->isBuilding());
+}
+
+void test_abort_removes_the_partial_build() {
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*section));
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::InProgress),
+                      static_cast<int>(section->continueSectionFile(STEP_BYTES)));
+  }
+  TEST_ASSERT_TRUE(SdMan.exists(sectionPath(0).c_str()));
+  TEST_ASSERT_TRUE(SdMan.exists(tokensPath(0).c_str()));
+
+  section->abortSectionFile();
+  TEST_ASSERT_FALSE(section->isBuilding());
+  TEST_ASSERT_FALSE(SdMan.exists(sectionPath(0).c_str()));
+  // Tokens are only kept for a chapter that was read to the end
+  TEST_ASSERT_FALSE(SdMan.exists(tokensPath(0).c_str()));
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Failed),
+                    static_cast<int>(section->continueSectionFile(STEP_BYTES)));
+  TEST_ASSERT_FALSE(load(*section));
+
+  // Aborting twice does nothing, and the section can be built again
+  section->abortSectionFile();
+  TEST_ASSERT_TRUE(begin(*section));
+  finish(*section);
+  TEST_ASSERT_TRUE(load(*makeSection(0)));
+}
+
+void test_destroying_a_building_section_aborts() {
+  {
+    auto section = makeSection(1);
+    TEST_ASSERT_TRUE(begin(*section));
+    section->continueSectionFile(STEP_BYTES);
+  }
+  TEST_ASSERT_FALSE(SdMan.exists(sectionPath(1).c_str()));
+  TEST_ASSERT_FALSE(SdMan.exists(tokensPath(1).c_str()));
+  TEST_ASSERT_FALSE(load(*makeSection(1)));
+}
+
+void test_beginning_again_restarts_the_build() {
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*section));
+  section->continueSectionFile(STEP_BYTES);
+  section->continueSectionFile(STEP_BYTES);
+  TEST_ASSERT_TRUE(begin(*section));
+  TEST_ASSERT_EQUAL(0, section->pageCount);
+  finish(*section);
+  const auto restarted = readFile(sectionPath(0));
+
+  SdMan.remove(tokensPath(0).c_str());
+  auto fresh = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*fresh));
+  finish(*fresh);
+  const auto expected = readFile(sectionPath(0));
+  TEST_ASSERT_EQUAL(expected.size(), restarted.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected.data(), restarted.data(), expected.size());
+}
+
+// The reader sits on the last pages of a chapter for a few seconds each. The next chapter is built in the idle slices
+// in between, so turning into it finds its section file ready and nothing is parsed.
+void test_next_chapter_is_ready_at_the_chapter_boundary() {
+  auto current = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*current));
+  finish(*current);
+
+  constexpr unsigned long PAGE_READ_MS = 5000;
+  constexpr unsigned long IDLE_LOOP_MS = 100;
+  auto next = makeSection(1);
+  TEST_ASSERT_TRUE(begin(*next));
+  auto status = Section::BuildStatus::InProgress;
+  int slices = 0;
+  for (int page = 0; page < 3; page++) {
+    const unsigned long pageStart = millis();
+    while (millis() - pageStart < PAGE_READ_MS) {
+      if (status == Section::BuildStatus::InProgress) {
+        const unsigned long sliceStart = millis();
+        status = runSlice(*next);
+        slices++;
+        // A slice gives input back within a step of its budget
+        TEST_ASSERT_LESS_OR_EQUAL(SLICE_MS + STEP_MS, millis() - sliceStart);
+      }
+      fakeMillis() += IDLE_LOOP_MS;
+    }
+  }
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Done), static_cast<int>(status));
+  TEST_ASSERT_GREATER_THAN(1, slices);
+  next.reset();
+
+  // Turning the page loads the finished section file, only its header is read
+  const auto bytesRead = FakeFs::instance().bytesRead;
+  auto turnedInto = makeSection(1);
+  TEST_ASSERT_TRUE(load(*turnedInto));
+  TEST_ASSERT_FALSE(turnedInto->isBuilding());
+  TEST_ASSERT_LESS_THAN(64, FakeFs::instance().bytesRead - bytesRead);
+  TEST_ASSERT_NOT_NULL(turnedInto->loadPageFromSectionFile().get());
+}
+
+// Opening a chapter shows its first page once that page is laid out, long before the rest of the chapter is built
+void test_first_page_is_ready_early() {
+  auto section = makeSection(0);
+  const unsigned long start = millis();
+  TEST_ASSERT_TRUE(begin(*section));
+  while (section->pageCount == 0) {
+    TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::InProgress),
+                      static_cast<int>(section->continueSectionFile(STEP_BYTES)));
+    fakeMillis() += STEP_MS;
+  }
+  const unsigned long firstPageMs = millis() - start;
+  section->currentPage = 0;
+  const auto firstPage = section->loadPageFromSectionFile();
+  TEST_ASSERT_NOT_NULL(firstPage.get());
+  TEST_ASSERT_TRUE(section->isBuilding());
+  const auto shownDuringBuild = serialize(*firstPage);
+
+  while (section->continueSectionFile(STEP_BYTES) == Section::BuildStatus::InProgress) {
+    fakeMillis() += STEP_MS;
+  }
+  const unsigned long chapterMs = millis() - start;
+  TEST_ASSERT_GREATER_THAN(5, section->pageCount);
+  TEST_ASSERT_LESS_THAN(chapterMs / 4, firstPageMs);
+
+  // The page shown early is the one the finished file has
+  auto loaded = makeSection(0);
+  TEST_ASSERT_TRUE(load(*loaded));
+  const auto finishedFirstPage = loaded->loadPageFromSectionFile();
+  TEST_ASSERT_NOT_NULL(finishedFirstPage.get());
+  const auto shownAfterBuild = serialize(*finishedFirstPage);
+  TEST_ASSERT_EQUAL(shownAfterBuild.size(), shownDuringBuild.size());
+  TEST_ASSERT_EQUAL_MEMORY(shownAfterBuild.data(), shownDuringBuild.data(), shownAfterBuild.size());
+}
+
+// Pages already written can be loaded at any point of the build, the ones after them can't yet
+void test_pages_load_while_building() {
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*section));
+  auto status = Section::BuildStatus::InProgress;
+  while (status == Section::BuildStatus::InProgress) {
+    section->currentPage = section->pageCount - 1;
+    if (section->pageCount > 0) {
+      TEST_ASSERT_NOT_NULL(section->loadPageFromSectionFile().get());
+    }
+    section->currentPage = section->pageCount;
+    TEST_ASSERT_NULL(section->loadPageFromSectionFile().get());
+    status = section->continueSectionFile(STEP_BYTES);
+  }
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Done), static_cast<int>(status));
+
+  // Loading pages in between didn't change what was written
+  const auto interleaved = readFile(sectionPath(0));
+  SdMan.remove(tokensPath(0).c_str());
+  TEST_ASSERT_TRUE(begin(*section));
+  finish(*section);
+  const auto expected = readFile(sectionPath(0));
+  TEST_ASSERT_EQUAL(expected.size(), interleaved.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected.data(), interleaved.data(), expected.size());
+}
+
+// Anchors are known as soon as their page is written, and the table written after the LUT gives the same pages
+void test_anchor_table_round_trip() {
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*section));
+  std::vector<int> duringBuild(PARAGRAPHS, -1);
+  auto status = Section::BuildStatus::InProgress;
+  while (status == Section::BuildStatus::InProgress) {
+    for (int i = 0; i < PARAGRAPHS; i++) {
+      const int page = section->getPageForAnchor("p" + std::to_string(i));
+      if (duringBuild[i] == -1) {
+        duringBuild[i] = page;
+      } else {
+        TEST_ASSERT_EQUAL(duringBuild[i], page);
+      }
+      // At most the page still being filled
+      TEST_ASSERT_LESS_OR_EQUAL(static_cast<int>(section->pageCount), page);
+    }
+    status = section->continueSectionFile(STEP_BYTES);
+  }
+  TEST_ASSERT_EQUAL(static_cast<int>(Section::BuildStatus::Done), static_cast<int>(status));
+  const uint16_t pageCount = section->pageCount;
+
+  auto loaded = makeSection(0);
+  TEST_ASSERT_TRUE(load(*loaded));
+  std::vector<uint16_t> pages;
+  TEST_ASSERT_EQUAL(0, loaded->getPageForAnchor("top"));
+  pages.push_back(0);
+  for (int i = 0; i < PARAGRAPHS; i++) {
+    const int page = loaded->getPageForAnchor("p" + std::to_string(i));
+    // The ones on the last page are only known once the build has finished
+    if (duringBuild[i] != -1) {
+      TEST_ASSERT_EQUAL(duringBuild[i], page);
+    } else {
+      TEST_ASSERT_EQUAL(pageCount - 1, page);
+    }
+    TEST_ASSERT_TRUE(page >= 0 && page < pageCount);
+    if (i > 0) {
+      TEST_ASSERT_GREATER_OR_EQUAL(pages.back(), page);
+    }
+    TEST_ASSERT_TRUE(startsParagraph(*loadPage(*loaded, page), i));
+    pages.push_back(page);
+  }
+  // An id used twice lands on its first use
+  const int twicePage = loaded->getPageForAnchor("twice");
+  TEST_ASSERT_EQUAL(loaded->getPageForAnchor("p" + std::to_string(TWICE_FIRST)), twicePage);
+  pages.push_back(twicePage);
+  TEST_ASSERT_EQUAL(-1, loaded->getPageForAnchor("missing"));
+  TEST_ASSERT_EQUAL(-1, loaded->getPageForAnchor(""));
+
+  // After the LUT: a count, then hash and page records in hash order, one per id, and nothing after them
+  const auto bytes = readFile(sectionPath(0));
+  const auto read16 = [&](const size_t at) { return static_cast<uint16_t>(bytes[at] | bytes[at + 1] << 8); };
+  const auto read32 = [&](const size_t at) { return static_cast<uint32_t>(read16(at) | read16(at + 2) << 16); };
+  const uint32_t lutOffset = read32(16);
+  const size_t anchorsOffset = lutOffset + sizeof(uint32_t) * pageCount;
+  const uint16_t anchorCount = read16(anchorsOffset);
+  TEST_ASSERT_EQUAL(pages.size(), anchorCount);
+  TEST_ASSERT_EQUAL(anchorsOffset + sizeof(uint16_t) + 6 * anchorCount, bytes.size());
+  std::vector<uint16_t> tablePages;
+  for (uint16_t i = 0; i < anchorCount; i++) {
+    const size_t record = anchorsOffset + sizeof(uint16_t) + 6 * i;
+    if (i > 0) {
+      TEST_ASSERT_TRUE(read32(record - 6) < read32(record));
+    }
+    tablePages.push_back(read16(record + 4));
+  }
+  std::sort(pages.begin(), pages.end());
+  std::sort(tablePages.begin(), tablePages.end());
+  TEST_ASSERT_EQUAL(pages.size(), tablePages.size());
+  TEST_ASSERT_EQUAL_MEMORY(pages.data(), tablePages.data(), sizeof(uint16_t) * pages.size());
+}
+
+// A TOC entry whose anchor is on a page with several others opens at that page from the section file alone, the
+// chapter isn't read or parsed again
+void test_landing_page_with_several_anchors_needs_no_reparse() {
+  auto built = makeSection(0);
+  TEST_ASSERT_TRUE(begin(*built));
+  finish(*built);
+  built.reset();
+
+  auto section = makeSection(0);
+  TEST_ASSERT_TRUE(load(*section));
+  int crowdedPage = -1;
+  std::vector<int> crowdedParagraphs;
+  for (int i = 0; i < PARAGRAPHS && crowdedParagraphs.size() < 3; i++) {
+    const int page = section->getPageForAnchor("p" + std::to_string(i));
+    if (page != crowdedPage) {
+      crowdedPage = page;
+      crowdedParagraphs.clear();
+    }
+    crowdedParagraphs.push_back(i);
+  }
+  TEST_ASSERT_EQUAL(3, crowdedParagraphs.size());
+
+  const auto tokens = readFile(tokensPath(0));
+  const auto bytesRead = FakeFs::instance().bytesRead;
+  const auto filesWritten = FakeFs::instance().filesWritten;
+  for (const int paragraph : crowdedParagraphs) {
+    TEST_ASSERT_EQUAL(crowdedPage, section->getPageForAnchor("p" + std::to_string(paragraph)));
+  }
+  // Each lookup is a binary search of the anchor table, a few records read from the section file
+  TEST_ASSERT_LESS_THAN(crowdedParagraphs.size() * 128, FakeFs::instance().bytesRead - bytesRead);
+  TEST_ASSERT_EQUAL(filesWritten, FakeFs::instance().filesWritten);
+  TEST_ASSERT_FALSE(section->isBuilding());
+  const auto tokensAfter = readFile(tokensPath(0));
+  TEST_ASSERT_EQUAL_MEMORY(tokens.data(), tokensAfter.data(), tokens.size());
+
+  const auto landing = loadPage(*section, crowdedPage);
+  for (const int paragraph : crowdedParagraphs) {
+    TEST_ASSERT_TRUE(startsParagraph(*landing, paragraph));
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_continue_without_begin_fails);
+  RUN_TEST(test_built_in_steps_matches_built_at_once);
+  RUN_TEST(test_abort_removes_the_partial_build);
+  RUN_TEST(test_destroying_a_building_section_aborts);
+  RUN_TEST(test_beginning_again_restarts_the_build);
+  RUN_TEST(test_next_chapter_is_ready_at_the_chapter_boundary);
+  RUN_TEST(test_first_page_is_ready_early);
+  RUN_TEST(test_pages_load_while_building);
+  RUN_TEST(test_anchor_table_round_trip);
+  RUN_TEST(test_landing_page_with_several_anchors_needs_no_reparse);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#include <SDCardManager.h>
+#include <SectionLayouts.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+const std::string SECTIONS_DIR = "/.crosspoint/epub_1/sections";
+constexpr uint32_t LAYOUT_A = 0x3fa2c1d0;
+constexpr uint32_t LAYOUT_B = 0x0000beef;
+constexpr uint32_t LAYOUT_C = 0x9e3779b9;
+constexpr uint32_t LAYOUT_D = 0x12345678;
+constexpr int CHAPTERS = 5;
+
+void writeFile(const std::string& path, const size_t size) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", path, file));
+  const std::vector<uint8_t> bytes(size, 0xAB);
+  file.write(bytes.data(), bytes.size());
+  file.close();
+}
+
+std::string layoutDir(const uint32_t layout) { return SECTIONS_DIR + "/" + SectionLayouts::dirName(layout); }
+
+std::string sectionPath(const uint32_t layout, const int chapter) {
+  return layoutDir(layout) + "/" + std::to_string(chapter) + ".bin";
+}
+
+// Opens every chapter in a layout the way the reader does, returns how many of them had to be built
+int readBook(const uint32_t layout) {
+  SectionLayouts::select(SECTIONS_DIR, layout);
+  int built = 0;
+  for (int chapter = 0; chapter < CHAPTERS; chapter++) {
+    if (SdMan.exists(sectionPath(layout, chapter).c_str())) {
+      continue;
+    }
+    if (!SdMan.exists(layoutDir(layout).c_str())) {
+      SdMan.mkdir(layoutDir(layout).c_str());
+    }
+    writeFile(sectionPath(layout, chapter), 4096);
+    built++;
+  }
+  return built;
+}
+}  // namespace
+
+void setUp() {
+  FakeFs::instance().reset();
+  SdMan.mkdir("/.crosspoint");
+  SdMan.mkdir("/.crosspoint/epub_1");
+}
+
+void tearDown() {}
+
+void test_toggling_between_layouts_builds_each_once() {
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_B));
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+    TEST_ASSERT_EQUAL(0, readBook(LAYOUT_B));
+  }
+}
+
+void test_least_recently_used_layout_is_evicted() {
+  readBook(LAYOUT_A);
+  readBook(LAYOUT_B);
+  readBook(LAYOUT_C);
+  // A is used again, B becomes the least recently used
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_D));
+  TEST_ASSERT_FALSE(SdMan.exists(layoutDir(LAYOUT_B).c_str()));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_C));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_D));
+}
+
+void test_reselecting_the_current_layout_writes_nothing() {
+  readBook(LAYOUT_A);
+  const auto filesWritten = FakeFs::instance().filesWritten;
+  SectionLayouts::select(SECTIONS_DIR, LAYOUT_A);
+  TEST_ASSERT_EQUAL(filesWritten, FakeFs::instance().filesWritten);
+}
+
+void test_missing_layout_list_keeps_layout_dirs() {
+  readBook(LAYOUT_A);
+  readBook(LAYOUT_B);
+  SdMan.remove((SECTIONS_DIR + "/layouts.bin").c_str());
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_B));
+  TEST_ASSERT_TRUE(SdMan.exists((SECTIONS_DIR + "/layouts.bin").c_str()));
+}
+
+void test_short_layout_list_keeps_layout_dirs() {
+  readBook(LAYOUT_A);
+  readBook(LAYOUT_B);
+  // Version and a count of 2, cut off in the first layout
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", SECTIONS_DIR + "/layouts.bin", file));
+  const uint8_t bytes[] = {1, 2, 0xd0, 0xc1};
+  file.write(bytes, sizeof(bytes));
+  file.close();
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_B));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_C));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_B));
+}
+
+void test_recovered_layouts_are_still_bounded() {
+  readBook(LAYOUT_A);
+  readBook(LAYOUT_B);
+  readBook(LAYOUT_C);
+  SdMan.remove((SECTIONS_DIR + "/layouts.bin").c_str());
+  readBook(LAYOUT_D);
+  int kept = 0;
+  for (const auto layout : {LAYOUT_A, LAYOUT_B, LAYOUT_C, LAYOUT_D}) {
+    kept += SdMan.exists(layoutDir(layout).c_str()) ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL(SectionLayouts::MAX_LAYOUTS, kept);
+  TEST_ASSERT_TRUE(SdMan.exists(layoutDir(LAYOUT_D).c_str()));
+}
+
+void test_old_flat_section_files_are_removed() {
+  SdMan.mkdir(SECTIONS_DIR.c_str());
+  for (int chapter = 0; chapter < CHAPTERS; chapter++) {
+    writeFile(SECTIONS_DIR + "/" + std::to_string(chapter) + ".bin", 4096);
+  }
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_A));
+  for (int chapter = 0; chapter < CHAPTERS; chapter++) {
+    TEST_ASSERT_FALSE(SdMan.exists((SECTIONS_DIR + "/" + std::to_string(chapter) + ".bin").c_str()));
+  }
+  TEST_ASSERT_TRUE(SdMan.exists(layoutDir(LAYOUT_A).c_str()));
+}
+
+void test_first_layout_of_a_new_book() {
+  TEST_ASSERT_EQUAL(CHAPTERS, readBook(LAYOUT_A));
+  TEST_ASSERT_TRUE(SdMan.exists((SECTIONS_DIR + "/layouts.bin").c_str()));
+  TEST_ASSERT_EQUAL(0, readBook(LAYOUT_A));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_toggling_between_layouts_builds_each_once);
+  RUN_TEST(test_least_recently_used_layout_is_evicted);
+  RUN_TEST(test_reselecting_the_current_layout_writes_nothing);
+  RUN_TEST(test_missing_layout_list_keeps_layout_dirs);
+  RUN_TEST(test_short_layout_list_keeps_layout_dirs);
+  RUN_TEST(test_recovered_layouts_are_still_bounded);
+  RUN_TEST(test_old_flat_section_files_are_removed);
+  RUN_TEST(test_first_layout_of_a_new_book);
+  return UNITY_END();
+}
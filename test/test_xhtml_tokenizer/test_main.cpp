@@ -0,0 +1,285 @@
+#include <Epub/parsers/XhtmlTokenizer.h>
+#include <expat.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Differential tests of XhtmlTokenizer against expat, which it replaced for chapters. The chapter parser sees nothing
+// but the start, end and text events, so the same events make the same pages: every well-formed document must give
+// exactly expat's events however it is split up, and a sloppy one the events expat gives for its repaired version.
+namespace {
+// Events one per line, text merged until the next tag since both split it wherever their buffers end
+class Recorder {
+  std::string text;
+
+  void flushText() {
+    if (!text.empty()) {
+      events += "\"" + text + "\"\n";
+      text.clear();
+    }
+  }
+
+ public:
+  std::string events;
+
+  static void startElement(void* userData, const char* name, const char** atts) {
+    auto* self = static_cast<Recorder*>(userData);
+    self->flushText();
+    self->events += "<" + std::string(name);
+    for (int i = 0; atts[i]; i += 2) {
+      self->events += " " + std::string(atts[i]) + "=\"" + atts[i + 1] + "\"";
+    }
+    self->events += ">\n";
+  }
+
+  static void endElement(void* userData, const char* name) {
+    auto* self = static_cast<Recorder*>(userData);
+    self->flushText();
+    self->events += "</" + std::string(name) + ">\n";
+  }
+
+  static void characterData(void* userData, const char* s, const int len) {
+    static_cast<Recorder*>(userData)->text.append(s, len);
+  }
+
+  std::string finish() {
+    flushText();
+    return events;
+  }
+};
+
+std::string expatEvents(const std::string& document) {
+  Recorder recorder;
+  const XML_Parser parser = XML_ParserCreate(nullptr);
+  XML_SetUserData(parser, &recorder);
+  XML_SetElementHandler(parser, Recorder::startElement, Recorder::endElement);
+  XML_SetCharacterDataHandler(parser, Recorder::characterData);
+  const auto status = XML_Parse(parser, document.data(), static_cast<int>(document.size()), XML_TRUE);
+  TEST_ASSERT_EQUAL_MESSAGE(XML_STATUS_OK, status, XML_ErrorString(XML_GetErrorCode(parser)));
+  XML_ParserFree(parser);
+  return recorder.finish();
+}
+
+// Fed in chunks of this size, the last one on its own with isFinal set, as the chapter parser does with its reads
+std::string tokenizerEvents(const std::string& document, const size_t chunkSize) {
+  Recorder recorder;
+  std::unique_ptr<XhtmlTokenizer> tokenizer(
+      new XhtmlTokenizer(&recorder, Recorder::startElement, Recorder::endElement, Recorder::characterData));
+  for (size_t offset = 0; offset < document.size(); offset += chunkSize) {
+    const size_t length = std::min(chunkSize, document.size() - offset);
+    TEST_ASSERT_TRUE(tokenizer->parse(document.data() + offset, length, false));
+  }
+  TEST_ASSERT_TRUE(tokenizer->parse(nullptr, 0, true));
+  return recorder.finish();
+}
+
+void checkEveryChunkSize(const std::string& document, const std::string& expected) {
+  for (size_t chunkSize = 1; chunkSize <= 4096; chunkSize++) {
+    const auto events = tokenizerEvents(document, chunkSize);
+    if (events != expected) {
+      char message[64];
+      snprintf(message, sizeof(message), "Chunks of %zu bytes", chunkSize);
+      TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.c_str(), events.c_str(), message);
+    }
+  }
+}
+
+void checkSameAsExpat(const std::string& document) { checkEveryChunkSize(document, expatEvents(document)); }
+
+// A sloppy chapter gives the events of the well-formed one it stands for
+void checkRepairedAs(const std::string& sloppy, const std::string& repaired) {
+  const std::string head = "<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>";
+  const std::string tail = "</body></html>";
+  checkEveryChunkSize(head + sloppy, expatEvents(head + repaired + tail));
+}
+
+const char XHTML_HEAD[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE html PUBLIC "-//W3C//DTD XHTML 1.1//EN" "http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd">
+<html xmlns="http://www.w3.org/1999/xhtml" xml:lang="en">
+<head>
+  <title>Chapter One</title>
+  <link rel="stylesheet" type="text/css" href="../styles/book.css"/>
+</head>
+)";
+
+// A chapter of the usual kind, long enough for text and tags to be split at many places
+std::string chapter(const int paragraphs) {
+  std::string html = XHTML_HEAD;
+  html += "<body class='chapter'>\n<h1 id=\"ch1\" class=\"title\">One &amp; Only</h1>\n";
+  for (int i = 0; i < paragraphs; i++) {
+    html += "<p id=\"p" + std::to_string(i) + "\" class=\"" + (i % 3 == 0 ? "first" : "body") + "\">";
+    html += "It was <i>the</i> best of times, it was the <b>worst</b> of times &#8212; ";
+    html += "the age of <span class=\"sc\">wisdom</span>, &lt;foolishness&gt; &#x2019;and&#x2019; &quot;belief&quot;";
+    if (i % 5 == 0) {
+      html += "<br/><a href=\"notes.xhtml#n" + std::to_string(i) + "\">" + std::to_string(i) + "</a>";
+    }
+    if (i % 7 == 0) {
+      html += "<img src=\"../images/fig" + std::to_string(i) + ".jpg\" alt=\"Figure &apos;" + std::to_string(i) +
+              "&apos;\"/>";
+    }
+    html += "</p>\n";
+  }
+  return html + "</body>\n</html>\n";
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_chapter() { checkSameAsExpat(chapter(30)); }
+
+void test_character_references() {
+  checkSameAsExpat(std::string(XHTML_HEAD) +
+                   "<body><p title=\"&#65;&#x42;&#x1F600;\">&#65;&#x42; &#233;&#xE9; &#x2014;&#8364; &#x1F600;"
+                   "&#128512; &#x10FFFF; &amp;&lt;&gt;&quot;&apos; a&amp;b&#59;c</p></body></html>");
+}
+
+void test_comments_and_processing_instructions() {
+  checkSameAsExpat(std::string(XHTML_HEAD) +
+                   "<!-- before the body -->\n<body><!----><p>one<!-- a - b -> c < d & e -->two</p>\n"
+                   "<?page-break here?><p>three<?pi <b>not a tag</b>?>four</p><!--\nmany\nlines\n--></body>"
+                   "<!-- after the end -->\n</html>\n<!-- trailing -->");
+}
+
+void test_cdata_sections() {
+  checkSameAsExpat(std::string(XHTML_HEAD) +
+                   "<body><p>a<![CDATA[<b>not a tag</b> & no &amp; reference]]>b</p><p><![CDATA[]]></p>"
+                   "<p><![CDATA[ ]] ]> ]]] ]]>]</p><pre><![CDATA[\nline one\n  line two\n]]></pre></body></html>");
+}
+
+void test_byte_order_mark() {
+  checkSameAsExpat("\xEF\xBB\xBF" + std::string(XHTML_HEAD) +
+                   "<body><p>na\xC3\xAFve \xE2\x80\x94 \xE6\x97\xA5\xE6\x9C\xAC \xF0\x9F\x98\x80</p></body></html>");
+  checkSameAsExpat("\xEF\xBB\xBF<html><body><p>no declaration</p></body></html>");
+}
+
+void test_iso_8859_1() {
+  const std::string body =
+      "<body><p title=\"caf\xE9\">\xC0 la carte, na\xEFve, \xFC\xDF\xA0\xFF\xA9 &#233;</p></body></html>";
+  checkSameAsExpat("<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n<html>" + body);
+  checkSameAsExpat("<?xml version='1.0' encoding='iso-8859-1' standalone='yes'?>\n<html>" + body);
+  // Converted to UTF-8 as expat does
+  const auto events = tokenizerEvents("<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><p>\xE9</p>", 4096);
+  TEST_ASSERT_EQUAL_STRING("<p>\n\"\xC3\xA9\"\n</p>\n", events.c_str());
+}
+
+void test_line_ends_and_whitespace() {
+  checkSameAsExpat("<?xml version=\"1.0\"?>\r\n<html>\r\n<body>\r\n<p class=\"a\tb\r\nc\nd\">one\r\ntwo\rthree\n\r</p>"
+                   "\r\n<p\r\n  id = 'x'\t>\t tabs \t</p  >\r\n<pre><![CDATA[one\r\ntwo\rthree]]>\r\r\n</pre>"
+                   "</body>\r\n</html>\r\n");
+}
+
+void test_long_text_and_attributes() {
+  const std::string word(600, 'w');
+  const std::string value(1500, 'v');
+  checkSameAsExpat("<html><body><p title=\"" + value + "\">" + word + " " + word + "</p><p>" + std::string(5000, 'x') +
+                   "</p></body></html>");
+}
+
+void test_deep_nesting() {
+  std::string open;
+  std::string close;
+  for (int i = 0; i < 200; i++) {
+    const std::string name = i % 2 == 0 ? "div" : "span";
+    open += "<" + name + " class=\"d" + std::to_string(i) + "\">" + std::to_string(i);
+    close = "</" + name + ">" + close;
+  }
+  checkSameAsExpat("<html><body>" + open + close + "</body></html>");
+}
+
+void test_sloppy_html() {
+  // Void elements don't need closing, attribute values don't need quotes
+  checkRepairedAs("<p>one<br>two<img src=a.jpg alt=x>three<hr></p>",
+                  "<p>one<br/>two<img src=\"a.jpg\" alt=\"x\"/>three<hr/></p>");
+  // A stray '&' or '<' is text, an unknown entity is passed on for the chapter parser to decode
+  checkRepairedAs("<p>fish & chips, 1 < 2, AT&T, &nbsp;&hellip;</p>",
+                  "<p>fish &amp; chips, 1 &lt; 2, AT&amp;T, &amp;nbsp;&amp;hellip;</p>");
+  // An unclosed <p> or <li> is closed by the next one
+  checkRepairedAs("<p>one<p>two<ul><li>a<li>b</ul>", "<p>one</p><p>two<ul><li>a</li><li>b</li></ul></p>");
+  // A close tag closes what was left open inside its element, one that matches nothing is ignored
+  checkRepairedAs("<div><b>bold<i>both</div>after</span>", "<div><b>bold<i>both</i></b></div>after");
+  // Everything still open at the end is closed
+  checkRepairedAs("<div><p>unfinished", "<div><p>unfinished</p></div>");
+  // Upper case names are kept as written
+  checkRepairedAs("<P CLASS=x>text</P>", "<P CLASS=\"x\">text</P>");
+}
+
+// Events are the same for every split of the sloppy chapter too, not only for one that happens to work
+void test_sloppy_chapter_in_every_chunk_size() {
+  std::string html = "<html><body>";
+  for (int i = 0; i < 20; i++) {
+    html += "<p class=c" + std::to_string(i) + ">Fish & chips &amp; peas<br>AT&T &nbsp; 1 < 2<li>item";
+  }
+  checkEveryChunkSize(html, tokenizerEvents(html, html.size()));
+}
+
+void test_throughput() {
+  const auto document = chapter(20000);
+
+  class Counter {
+   public:
+    size_t events = 0;
+    static void startElement(void* userData, const char*, const char**) { static_cast<Counter*>(userData)->events++; }
+    static void endElement(void* userData, const char*) { static_cast<Counter*>(userData)->events++; }
+    static void characterData(void* userData, const char*, int) { static_cast<Counter*>(userData)->events++; }
+  };
+
+  // Fed 1024 bytes at a time as the chapter parser does, the handlers only count
+  const auto megabytesPerSecond = [&](const bool expat) {
+    Counter counter;
+    const auto start = std::chrono::steady_clock::now();
+    if (expat) {
+      const XML_Parser parser = XML_ParserCreate(nullptr);
+      XML_SetUserData(parser, &counter);
+      XML_SetElementHandler(parser, Counter::startElement, Counter::endElement);
+      XML_SetCharacterDataHandler(parser, Counter::characterData);
+      for (size_t offset = 0; offset < document.size(); offset += 1024) {
+        const int length = static_cast<int>(std::min<size_t>(1024, document.size() - offset));
+        TEST_ASSERT_EQUAL(XML_STATUS_OK, XML_Parse(parser, document.data() + offset, length, XML_FALSE));
+      }
+      TEST_ASSERT_EQUAL(XML_STATUS_OK, XML_Parse(parser, nullptr, 0, XML_TRUE));
+      XML_ParserFree(parser);
+    } else {
+      std::unique_ptr<XhtmlTokenizer> tokenizer(
+          new XhtmlTokenizer(&counter, Counter::startElement, Counter::endElement, Counter::characterData));
+      for (size_t offset = 0; offset < document.size(); offset += 1024) {
+        TEST_ASSERT_TRUE(tokenizer->parse(document.data() + offset, std::min<size_t>(1024, document.size() - offset),
+                                          false));
+      }
+      TEST_ASSERT_TRUE(tokenizer->parse(nullptr, 0, true));
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_GREATER_THAN(0, counter.events);
+    return document.size() / seconds / (1024 * 1024);
+  };
+  const double expat = megabytesPerSecond(true);
+  const double tokenizer = megabytesPerSecond(false);
+
+  char message[128];
+  snprintf(message, sizeof(message), "Tokenized MB/s over %zu KB: expat %.1f, XhtmlTokenizer %.1f",
+           document.size() / 1024, expat, tokenizer);
+  TEST_MESSAGE(message);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_chapter);
+  RUN_TEST(test_character_references);
+  RUN_TEST(test_comments_and_processing_instructions);
+  RUN_TEST(test_cdata_sections);
+  RUN_TEST(test_byte_order_mark);
+  RUN_TEST(test_iso_8859_1);
+  RUN_TEST(test_line_ends_and_whitespace);
+  RUN_TEST(test_long_text_and_attributes);
+  RUN_TEST(test_deep_nesting);
+  RUN_TEST(test_sloppy_html);
+  RUN_TEST(test_sloppy_chapter_in_every_chunk_size);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,324 @@
+#include <SDCardManager.h>
+#include <ZipFile.h>
+#include <ZipWriter.h>
+#include <miniz.h>
+#include <unity.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+const std::string ZIP_PATH = "/book.epub";
+const std::string INDEX_PATH = "/book.idx";
+const std::string CHECKPOINT_DIR = "/checkpoints";
+constexpr size_t CHUNK_SIZE = 4096;
+// Matches ZipFile.cpp, entries this large record checkpoints every CHECKPOINT_SPACING inflated bytes
+constexpr size_t CHECKPOINT_MIN_ENTRY_SIZE = 1024 * 1024;
+constexpr size_t CHECKPOINT_SPACING = 256 * 1024;
+// Count of recorded checkpoints, the last field of the checkpoint file header
+constexpr size_t CHECKPOINT_COUNT_OFFSET = sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint32_t) * 2;
+
+class ByteSink : public Print {
+ public:
+  Bytes bytes;
+
+  size_t write(const uint8_t* buffer, const size_t size) override {
+    bytes.insert(bytes.end(), buffer, buffer + size);
+    return size;
+  }
+  using Print::write;
+};
+
+void writeFile(const std::string& path, const Bytes& bytes) {
+  FsFile file;
+  TEST_ASSERT_TRUE(SdMan.openFileForWrite("TST", path, file));
+  TEST_ASSERT_EQUAL(bytes.size(), file.write(bytes.data(), bytes.size()));
+  file.close();
+}
+
+// Chapter-like text with stretches of noise, several MB deflate into many blocks
+Bytes chapterText(const size_t size, const uint32_t seed) {
+  static const char* const words[] = {"the ", "reader ", "<p>", "</p>\n", "page ", "chapter ", "and ", "of ",
+                                      "a ",   "light ",  "ink ", "e ",    "paper ", "turned ", "quietly ", "."};
+  std::mt19937 random(seed);
+  Bytes bytes;
+  while (bytes.size() < size) {
+    if (random() % 64 == 0) {
+      for (int i = 0; i < 200; i++) {
+        bytes.push_back(static_cast<uint8_t>(random()));
+      }
+    }
+    const char* word = words[random() % (sizeof(words) / sizeof(words[0]))];
+    bytes.insert(bytes.end(), word, word + strlen(word));
+  }
+  bytes.resize(size);
+  return bytes;
+}
+
+void writeBook(const Bytes& chapter) {
+  ZipWriter writer;
+  writer.add("mimetype", Bytes{'a', 'p', 'p'}, false);
+  writer.add("OEBPS/chapter.xhtml", chapter, true);
+  writer.add("OEBPS/small.xhtml", Bytes(CHECKPOINT_MIN_ENTRY_SIZE - 1, 'x'), true);
+  writer.finish();
+  writeFile(ZIP_PATH, writer.bytes);
+}
+
+std::string entryName(const uint32_t i) { return "OEBPS/" + std::to_string(i) + ".xhtml"; }
+
+Bytes entryContents(const uint32_t i) {
+  const std::string text = "<p>" + std::to_string(i) + "</p>";
+  return Bytes(text.begin(), text.end());
+}
+
+// A small book with numbered entries, each holding its own number
+ZipWriter numberedEntries(const uint32_t count) {
+  ZipWriter writer;
+  for (uint32_t i = 0; i < count; i++) {
+    writer.add(entryName(i), entryContents(i), i % 2 == 1);
+  }
+  return writer;
+}
+
+bool readsBack(ZipFile& zip, const uint32_t i) {
+  size_t size = 0;
+  uint8_t* data = zip.readFileToMemory(entryName(i).c_str(), &size);
+  if (!data) {
+    return false;
+  }
+  const bool matches = Bytes(data, data + size) == entryContents(i);
+  free(data);
+  return matches;
+}
+
+Bytes readRange(ZipFile& zip, const char* filename, const size_t offset, const size_t length) {
+  ByteSink sink;
+  TEST_ASSERT_TRUE(zip.readFileRangeToStream(filename, sink, offset, length, CHUNK_SIZE));
+  return sink.bytes;
+}
+
+Bytes slice(const Bytes& bytes, const size_t offset, const size_t length) {
+  return Bytes(bytes.begin() + offset, bytes.begin() + offset + std::min(length, bytes.size() - offset));
+}
+
+uint32_t checkpointCount() {
+  uint32_t count = 0;
+  const auto dir = FakeFs::instance().children(CHECKPOINT_DIR);
+  for (const auto& path : dir) {
+    FsFile file;
+    TEST_ASSERT_TRUE(SdMan.openFileForRead("TST", path, file));
+    uint32_t fileCount = 0;
+    file.seek(CHECKPOINT_COUNT_OFFSET);
+    file.read(&fileCount, sizeof(fileCount));
+    file.close();
+    count += fileCount;
+  }
+  return count;
+}
+}  // namespace
+
+void setUp() { FakeFs::instance().reset(); }
+
+void tearDown() {}
+
+void test_range_read_from_checkpoint_matches_cold_inflate() {
+  const auto chapter = chapterText(3 * 1024 * 1024 + 12345, 1);
+  writeBook(chapter);
+
+  // Reading the whole entry once records checkpoints along the way
+  {
+    ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+    ByteSink sink;
+    TEST_ASSERT_TRUE(zip.readFileToStream("OEBPS/chapter.xhtml", sink, CHUNK_SIZE));
+    TEST_ASSERT_TRUE(sink.bytes == chapter);
+  }
+  // Checkpoints can only be taken between deflate blocks, which miniz ends every few hundred KB of this text
+  TEST_ASSERT_GREATER_OR_EQUAL(chapter.size() / CHECKPOINT_MIN_ENTRY_SIZE, checkpointCount());
+
+  const size_t offsets[] = {0,
+                            1,
+                            CHECKPOINT_SPACING - 1,
+                            CHECKPOINT_SPACING,
+                            CHECKPOINT_SPACING + 1,
+                            1000003,
+                            2 * 1024 * 1024 + 77,
+                            chapter.size() - 40000,
+                            chapter.size() - 1};
+  for (const size_t offset : offsets) {
+    for (const size_t length : {size_t{1}, size_t{5000}, size_t{70000}, SIZE_MAX}) {
+      ZipFile cold(ZIP_PATH);
+      const auto coldBytesRead = FakeFs::instance().bytesRead;
+      const auto expected = readRange(cold, "OEBPS/chapter.xhtml", offset, length);
+      const auto coldCost = FakeFs::instance().bytesRead - coldBytesRead;
+      TEST_ASSERT_TRUE(expected == slice(chapter, offset, length));
+
+      ZipFile resumed(ZIP_PATH, "", CHECKPOINT_DIR);
+      const auto resumedBytesRead = FakeFs::instance().bytesRead;
+      const auto bytes = readRange(resumed, "OEBPS/chapter.xhtml", offset, length);
+      const auto resumedCost = FakeFs::instance().bytesRead - resumedBytesRead;
+      TEST_ASSERT_TRUE(bytes == expected);
+      // Past the second checkpoint, skipping the compressed bytes before it outweighs reading its window
+      if (offset >= 2 * CHECKPOINT_SPACING + 1) {
+        TEST_ASSERT_LESS_THAN(coldCost, resumedCost);
+      }
+    }
+  }
+}
+
+void test_entry_reader_records_checkpoints_for_range_reads() {
+  const auto chapter = chapterText(2 * 1024 * 1024, 2);
+  writeBook(chapter);
+
+  {
+    ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+    ZipFile::EntryReader reader;
+    TEST_ASSERT_TRUE(zip.openEntry("OEBPS/chapter.xhtml", reader, CHUNK_SIZE));
+    Bytes bytes;
+    uint8_t buffer[1000];
+    size_t read;
+    while ((read = reader.read(buffer, sizeof(buffer))) > 0) {
+      bytes.insert(bytes.end(), buffer, buffer + read);
+    }
+    TEST_ASSERT_FALSE(reader.hasFailed());
+    TEST_ASSERT_TRUE(bytes == chapter);
+  }
+  TEST_ASSERT_GREATER_THAN(0, checkpointCount());
+
+  ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+  for (const size_t offset : {size_t{300000}, size_t{1500000}, chapter.size() - 10}) {
+    TEST_ASSERT_TRUE(readRange(zip, "OEBPS/chapter.xhtml", offset, 20000) == slice(chapter, offset, 20000));
+  }
+}
+
+void test_checkpoints_of_a_replaced_zip_are_not_used() {
+  writeBook(chapterText(2 * 1024 * 1024, 3));
+  {
+    ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+    ByteSink sink;
+    TEST_ASSERT_TRUE(zip.readFileToStream("OEBPS/chapter.xhtml", sink, CHUNK_SIZE));
+  }
+  TEST_ASSERT_GREATER_THAN(0, checkpointCount());
+
+  // Same entry name and local header offset, different contents
+  const auto replaced = chapterText(2 * 1024 * 1024 + 100, 4);
+  writeBook(replaced);
+  ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+  TEST_ASSERT_TRUE(readRange(zip, "OEBPS/chapter.xhtml", 1500000, 50000) == slice(replaced, 1500000, 50000));
+}
+
+void test_small_entries_record_no_checkpoints() {
+  writeBook(chapterText(2 * 1024 * 1024, 5));
+  ZipFile zip(ZIP_PATH, "", CHECKPOINT_DIR);
+  ByteSink sink;
+  TEST_ASSERT_TRUE(zip.readFileToStream("OEBPS/small.xhtml", sink, CHUNK_SIZE));
+  TEST_ASSERT_EQUAL(CHECKPOINT_MIN_ENTRY_SIZE - 1, sink.bytes.size());
+  TEST_ASSERT_EQUAL(0, checkpointCount());
+}
+
+void test_zip64_archive_with_more_than_65535_entries() {
+  constexpr uint32_t ENTRIES = 70000;
+  auto writer = numberedEntries(ENTRIES);
+  writer.finish();
+  writeFile(ZIP_PATH, writer.bytes);
+
+  const uint32_t checked[] = {0, 1, 65534, 65535, 65536, 65537, ENTRIES - 1};
+  // Without an index every lookup walks the central directory
+  {
+    ZipFile zip(ZIP_PATH);
+    TEST_ASSERT_TRUE(zip.open());
+    for (const auto i : checked) {
+      TEST_ASSERT_TRUE(readsBack(zip, i));
+    }
+  }
+
+  ZipFile zip(ZIP_PATH, INDEX_PATH);
+  TEST_ASSERT_TRUE(zip.open());
+  for (uint32_t i = 0; i < ENTRIES; i += 997) {
+    TEST_ASSERT_TRUE(readsBack(zip, i));
+  }
+  for (const auto i : checked) {
+    TEST_ASSERT_TRUE(readsBack(zip, i));
+  }
+  TEST_ASSERT_TRUE(SdMan.exists(INDEX_PATH.c_str()));
+  TEST_ASSERT_FALSE(zip.readFileToMemory(entryName(ENTRIES).c_str()));
+}
+
+void test_zip64_local_header_offsets() {
+  auto writer = numberedEntries(70000);
+  writer.zip64Offsets = true;
+  const uint64_t offset = writer.add("OEBPS/zip64.xhtml", Bytes{'z', 'i', 'p'}, false);
+  // Points 4GB past the zip64 entry, reading it has to fail rather than wrap around to the entry
+  writer.addCentralDirEntry("OEBPS/far.xhtml", MZ_NO_COMPRESSION, 0, 3, 3, (1ull << 32) + offset);
+  writer.finish();
+  writeFile(ZIP_PATH, writer.bytes);
+
+  for (const auto& indexPath : {std::string(), INDEX_PATH}) {
+    ZipFile zip(ZIP_PATH, indexPath);
+    TEST_ASSERT_TRUE(zip.open());
+    size_t size = 0;
+    uint8_t* data = zip.readFileToMemory("OEBPS/zip64.xhtml", &size);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_TRUE((Bytes(data, data + size) == Bytes{'z', 'i', 'p'}));
+    free(data);
+
+    TEST_ASSERT_TRUE(zip.getInflatedFileSize("OEBPS/far.xhtml", &size));
+    TEST_ASSERT_EQUAL(3, size);
+    TEST_ASSERT_FALSE(zip.readFileToMemory("OEBPS/far.xhtml"));
+    ByteSink sink;
+    TEST_ASSERT_FALSE(zip.readFileToStream("OEBPS/far.xhtml", sink, CHUNK_SIZE));
+    TEST_ASSERT_EQUAL(0, sink.bytes.size());
+  }
+}
+
+// A damaged entry in the middle of the central directory must not look like its end, which would make every later
+// entry look missing from the book for good once an index of the earlier ones was written
+void test_damaged_central_dir_entry_fails_instead_of_ending() {
+  constexpr uint32_t ENTRIES = 100;
+  constexpr uint32_t DAMAGED = 50;
+  // Relative positions within a central directory entry
+  constexpr size_t NAME_LENGTH = 28;
+  constexpr size_t EXTRA_LENGTH = 30;
+  constexpr size_t LOCAL_HEADER_OFFSET = 42;
+  const std::pair<size_t, uint32_t> damages[] = {
+      {NAME_LENGTH, 0xFFFF},              // Name runs past the end of the file
+      {EXTRA_LENGTH, 0xFFFF},             // Extra field runs past the end of the file
+      {LOCAL_HEADER_OFFSET, 0xFFFFFFFF},  // Offset is in a ZIP64 extra field that isn't there
+  };
+
+  for (const auto& damage : damages) {
+    FakeFs::instance().reset();
+    auto writer = numberedEntries(ENTRIES);
+    writer.finish();
+    const size_t field = writer.centralDirEntries[DAMAGED] + damage.first;
+    writer.bytes[field] = damage.second & 0xFF;
+    writer.bytes[field + 1] = (damage.second >> 8) & 0xFF;
+    if (damage.first == LOCAL_HEADER_OFFSET) {
+      writer.bytes[field + 2] = damage.second >> 16;
+      writer.bytes[field + 3] = damage.second >> 24;
+    }
+    writeFile(ZIP_PATH, writer.bytes);
+
+    ZipFile zip(ZIP_PATH, INDEX_PATH);
+    TEST_ASSERT_TRUE(zip.open());
+    // Entries before the damage are still found by walking the directory
+    TEST_ASSERT_TRUE(readsBack(zip, 0));
+    TEST_ASSERT_TRUE(readsBack(zip, DAMAGED - 1));
+    TEST_ASSERT_FALSE(readsBack(zip, DAMAGED + 1));
+    TEST_ASSERT_FALSE(SdMan.exists(INDEX_PATH.c_str()));
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_range_read_from_checkpoint_matches_cold_inflate);
+  RUN_TEST(test_entry_reader_records_checkpoints_for_range_reads);
+  RUN_TEST(test_checkpoints_of_a_replaced_zip_are_not_used);
+  RUN_TEST(test_small_entries_record_no_checkpoints);
+  RUN_TEST(test_zip64_archive_with_more_than_65535_entries);
+  RUN_TEST(test_zip64_local_header_offsets);
+  RUN_TEST(test_damaged_central_dir_entry_fails_instead_of_ending);
+  return UNITY_END();
+}